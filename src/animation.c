@@ -1,4 +1,24 @@
 #include "animation.h"
+#include "pool.h"
+
+/* The time animations are being shown at */
+static Uint32 now = 0;
+
+/* Animations' images being loaded in the background */
+typedef struct gfx_job_struct
+{
+  AnimData **anims;
+  int n;
+  ImageBatch *batch;
+} GfxJob;
+
+/* Private function prototypes */
+static double clockPlayed(AnimClock *clock);
+static int queueGfx(AnimData *anim);
+static void addAtlas(AnimPages *pages, Atlas *atlas);
+static void dropAtlas(AnimPages *pages, Atlas *atlas);
+static void decodeGfx(void *thing);
+static void finishGfx(void *thing);
 
 /* anim_freeAnim
    Frees animation data.
@@ -7,67 +27,298 @@ void
 anim_freeAnim(AnimData *anim)
 {
   int i;
-  /* Free the frames */
-  for (i = 0; i < anim->n_frames; i++)
-    {
-      gfx_freeImage(anim->frames[i].image);
-    }
 
+  /* Free the frames.  Their images are on atlas pages, which are freed
+     with the tileset or sprite set the animation is in. */
   dyn_1dArrayFree(anim->frames);
+  for (i = 0; i < anim->n_frames; i++) free(anim->files[i]);
+  free(anim->files);
 
   /* Free the name */
   free(anim->name);
+  free(anim->dir);
 }
 
-/* anim_animate
-   Advances an animation's current frame, given pointers to the animation
-   and its animation data.
+/* anim_setTime
+   Sets the time which animations are shown at, once a cycle, so that
+   everything shows the frame it had at the same moment.
 */
 void
-anim_animate(Animation *anim, AnimData *data)
+anim_setTime(Uint32 ticks)
 {
+  extern Uint32 now;
+  now = ticks;
+}
 
-  /* Only do any of this if it's really an animation and not just 1 frame: */
-  /* Only animate if the timer's max_elapsed is not 0 */
-  /* Only animate if the time passed exceeds the specified delay */
-  if (data->n_frames > 1 && time_getMax(&anim->timer) > 0 && time_expired(&anim->timer))
+/* anim_initClock
+   Starts a clock at the first frame, playing at an animation's default
+   speed.
+*/
+void
+anim_initClock(AnimClock *clock, AnimData *data)
+{
+  extern Uint32 now;
+
+  clock->start = now;
+  clock->played = 0;
+  clock->delay = data->def_delay;
+}
+
+/* anim_init
+   Starts an animation playing in step with everything else that's playing
+   it.
+*/
+void
+anim_init(Animation *anim, int anim_id, AnimData *data)
+{
+  anim->anim_id = anim_id;
+  anim->shared = 1;
+  anim->offset.x = 0;
+  anim->offset.y = 0;
+  anim_initClock(&anim->clock, data);
+}
+
+/* anim_setDelay
+   Sets the delay between an animation's frames.  It gets its own clock,
+   starting from wherever the shared one is, so that it can play at its
+   own speed without the frame jumping.
+*/
+void
+anim_setDelay(Animation *anim, AnimData *data, Time delay)
+{
+  extern Uint32 now;
+
+  if (anim->shared)
     {
-      
-      /* If the animation is playing forwards: */
-      if (anim->play_dir == FORWARD)
-	{
+      anim->clock = data->clock;
+      anim->shared = 0;
+    }
+
+  if (anim->clock.delay != delay)
+    {
+      anim->clock.played = clockPlayed(&anim->clock);
+      anim->clock.start = now;
+      anim->clock.delay = delay;
+    }
+}
+
+/* clockPlayed
+   Returns how many frames a clock has played, counting the one it's
+   partway through.
+*/
+double
+clockPlayed(AnimClock *clock)
+{
+  extern Uint32 now;
+
+  if (clock->delay <= 0) return clock->played;
+  return clock->played + (Uint32) (now - clock->start) / UNIT_TIME / clock->delay;
+}
+
+/* anim_frameAfter
+   Returns the frame an animation is on after it has played a number of
+   frames from the start.
+   REPEAT goes 0, 1, .. n-1, 0, 1, ..
+   SINE goes 0, 1, .. n-1, n-2, .. 1, 0, 1, ..
+*/
+int
+anim_frameAfter(AnimData *data, long played)
+{
+  int n = data->n_frames;
+
+  if (n <= 1) return 0;
+  if (data->play_mode == REPEAT) return played % n;
+
+  played %= 2 * n - 2;
+  return (played < n) ? played : 2 * n - 2 - played;
+}
+
+/* anim_getFrame
+   Returns the number of the frame an animation is showing.
+*/
+int
+anim_getFrame(Animation *anim, AnimData *data)
+{
+  return anim_frameAfter(data, (long) clockPlayed(anim->shared ? &data->clock : &anim->clock));
+}
+
+/* queueGfx
+   Queues an animation's images to be loaded, if they aren't loaded or
+   being loaded.  Returns true if they were queued.
+*/
+int
+queueGfx(AnimData *anim)
+{
+  int i;
+
+  if (anim->gfx != GFX_OUT) return 0;
+  for (i = 0; i < anim->n_frames; i++)
+    gfx_queueImage(anim->files[i], &anim->frames[i].page, &anim->frames[i].src);
+  anim->gfx = GFX_LOADING;
+  return 1;
+}
+
+/* addAtlas
+   Adds an atlas to the ones a set of animations' images are on.
+*/
+void
+addAtlas(AnimPages *pages, Atlas *atlas)
+{
+  if ((pages->atlases = realloc(pages->atlases, (pages->n_atlases + 1) * sizeof(Atlas *))) == NULL)
+    {
+      fprintf(stderr, "Unable to allocate memory.\n");
+      exit(0);
+    }
+  pages->atlases[pages->n_atlases++] = atlas;
+}
+
+/* anim_loadGfx
+   Loads the images of a list of animations that aren't loaded, all
+   together onto one atlas.  If wait is true it waits for them, and if
+   not they're loaded in the background, and drawn as placeholders until
+   they're in.  The animations must all put their images in the same
+   place.
+*/
+void
+anim_loadGfx(AnimData **anims, int n, int wait)
+{
+  AnimData **queued;
+  GfxJob *job;
+  int i, n_queued = 0;
+
+  MALLOC(queued, (n + 1) * sizeof(AnimData *));
+  for (i = 0; i < n; i++)
+    if (queueGfx(anims[i])) queued[n_queued++] = anims[i];
+
+  if (n_queued == 0)
+    free(queued);
+  else if (wait)
+    {
+      addAtlas(queued[0]->pages, gfx_loadQueued());
+      for (i = 0; i < n_queued; i++) queued[i]->gfx = GFX_IN;
+      free(queued);
+    }
+  else
+    {
+      MALLOC(job, sizeof(GfxJob));
+      job->anims = queued;
+      job->n = n_queued;
+      job->batch = gfx_takeQueued();
+      pool_post(decodeGfx, finishGfx, job);
+    }
+}
+
+/* anim_requestGfx
+   Starts loading an animation's images in the background.  Until they're
+   in, it's drawn as placeholders.
+*/
+void
+anim_requestGfx(AnimData *anim)
+{
+  anim_loadGfx(&anim, 1, 0);
+}
+
+/* decodeGfx
+   Decodes animations' images, in the background.
+*/
+void
+decodeGfx(void *thing)
+{
+  gfx_decodeBatch(((GfxJob *) thing)->batch);
+}
+
+/* finishGfx
+   Puts animations' decoded images on a page, once they're decoded.
+*/
+void
+finishGfx(void *thing)
+{
+  GfxJob *job = (GfxJob *) thing;
+  int i;
+
+  addAtlas(job->anims[0]->pages, gfx_packBatch(job->batch));
+  for (i = 0; i < job->n; i++) job->anims[i]->gfx = GFX_IN;
+  free(job->anims);
+  free(job);
+}
 
-	  if (++(anim->curr_frame) >= data->n_frames)
-	    {
-	      if (data->play_mode == SINE)
-		{
-		  anim->play_dir = BACK;
-		  anim->curr_frame -= 2;
-		}
-	      else
-		{
-		  anim->curr_frame = 0;
-		}
-	    }
+/* anim_replace
+   Puts an animation that's been read again in place of the old one, so
+   everything showing it by id shows the new one, and returns true.  If the
+   old one's images were loaded, the new ones are loaded now, onto an atlas
+   of the animation's own.  An atlas it had of its own from being replaced
+   before is freed; the first time, its old images stay on the set's
+   shared atlas until the set is freed.  If the new images can't all be
+   loaded, the new animation is freed, the old one is kept, and false is
+   returned.
+*/
+int
+anim_replace(AnimData *anim, AnimData *fresh)
+{
+  /* Nothing can still be loading into the old frames */
+  if (anim->gfx == GFX_LOADING) pool_finish(1);
+
+  fresh->pages = anim->pages;
+  if (anim->gfx == GFX_IN && queueGfx(fresh))
+    {
+      if ((fresh->own = gfx_tryLoadQueued()) == NULL)
+	{
+	  anim_freeAnim(fresh);
+	  return 0;
 	}
-      // If the animation is playing backwards:
-      else
+      addAtlas(fresh->pages, fresh->own);
+      fresh->gfx = GFX_IN;
+    }
+
+  if (anim->own != NULL) dropAtlas(anim->pages, anim->own);
+  anim_freeAnim(anim);
+  *anim = *fresh;
+  return 1;
+}
+
+/* dropAtlas
+   Takes an atlas out of a set's atlases and frees it.
+*/
+void
+dropAtlas(AnimPages *pages, Atlas *atlas)
+{
+  int i;
+
+  for (i = 0; i < pages->n_atlases; i++)
+    {
+      if (pages->atlases[i] == atlas)
 	{
-	  if (--(anim->curr_frame) < 0)	  
-	    {
-	      if (data->play_mode == SINE)
-		{
-		  anim->play_dir = FORWARD;
-		  anim->curr_frame += 2;
-		}
-	      else
-		{
-		  anim->curr_frame = data->n_frames - 1;
-		}
-	    }
+	  pages->atlases[i] = pages->atlases[--pages->n_atlases];
+	  break;
 	}
-      /* Update the timer: */
-      time_update(&anim->timer);
     }
+  gfx_freeAtlas(atlas);
+}
+
+/* anim_freePages
+   Frees all of the atlases a set of animations' images were loaded onto.
+   Nothing can be loading onto them.
+*/
+void
+anim_freePages(AnimPages *pages)
+{
+  int i;
+
+  for (i = 0; i < pages->n_atlases; i++) gfx_freeAtlas(pages->atlases[i]);
+  free(pages->atlases);
+  pages->atlases = NULL;
+  pages->n_atlases = 0;
+}
+
+/* anim_pagesBytes
+   Returns how much memory a set of animations' atlases take up.
+*/
+long
+anim_pagesBytes(AnimPages *pages)
+{
+  long bytes = 0;
+  int i;
+
+  for (i = 0; i < pages->n_atlases; i++) bytes += gfx_atlasBytes(pages->atlases[i]);
+  return bytes;
 }
-      
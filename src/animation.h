@@ -17,15 +17,35 @@
 */
 enum play_modes {SINE, REPEAT};
 
-/* An animation can either be playing forward or back */
-enum play_dirs {FORWARD, BACK};
+/* An animation's images are either not loaded, being loaded in the
+   background, or loaded */
+enum gfx_states {GFX_OUT, GFX_LOADING, GFX_IN};
+
+/* The atlases a tileset's or sprite set's animations' images have been
+   loaded onto, one more each time some of them are loaded */
+typedef struct anim_pages_struct
+{
+  int n_atlases;
+  Atlas **atlases;
+} AnimPages;
 
 typedef struct frame_struct
 {
-  SDL_Surface *image;    /* A pointer to the frame's image */
+  SDL_Surface *page;     /* The atlas page the frame's image is on */
+  SDL_Rect src;          /* Where on the page it is */
   Point offset;          /* x,y offset of the image */
 } Frame;
 
+/* Where an animation is in its playback.  Nothing ever has to run a
+   clock: the frame it's showing is worked out from the time whenever
+   somebody wants to know. */
+typedef struct anim_clock_struct
+{
+  Uint32 start;     /* The ticks when the clock was last set */
+  double played;    /* How many frames it had played by then */
+  Time delay;       /* The delay between frames, or 0 if it's stopped */
+} AnimClock;
+
 typedef struct animdata_struct
 {
   char *name;       /* The name of the animation */
@@ -33,20 +53,46 @@ typedef struct animdata_struct
   int play_mode;    /* Playback mode */
   Time def_delay;   /* The default delay between frames */
   Frame *frames;    /* A dynamic array containing the frames */
+  AnimClock clock;  /* Everything playing the animation at its default
+		       speed plays in step with this one clock */
+  char **files;     /* Each frame's image file */
+  int gfx;          /* Whether the frames' images are loaded, see
+		       gfx_states.  Until they are, the frames' pages are
+		       NULL, and they're drawn as placeholders. */
+  AnimPages *pages; /* Where its images go when they're loaded */
+  char *dir;        /* The directory it was read from, without the data
+		       prefix, so it can be read again */
+  Atlas *own;       /* The atlas its images were loaded onto on their own
+		       when it was read again, or NULL if they're on one
+		       shared with the rest of its set */
 } AnimData;
 
 typedef struct animation_struct
 {
   int anim_id;      /* The id corresponds to the location of
 		       AnimData in an array */
-  int curr_frame;   /* The number of the current frame. */
-  int play_dir;     /* Is it playing forwards or backwards? */
+  int shared;       /* If this is true, the animation follows its
+		       AnimData's clock, and its own is ignored */
+  AnimClock clock;  /* Its own clock, for playing out of step */
   Point offset;     /* x,y offset of the animation */
-  Timer timer;      /* A timer for animation speed. */
 
 } Animation;
 
 extern void anim_freeAnim(AnimData *anim);
-extern void anim_animate(Animation *anim, AnimData *data);
+extern void anim_setTime(Uint32 ticks);
+extern void anim_initClock(AnimClock *clock, AnimData *data);
+extern void anim_init(Animation *anim, int anim_id, AnimData *data);
+extern void anim_setDelay(Animation *anim, AnimData *data, Time delay);
+extern int anim_frameAfter(AnimData *data, long played);
+extern int anim_getFrame(Animation *anim, AnimData *data);
+extern void anim_loadGfx(AnimData **anims, int n, int wait);
+extern void anim_requestGfx(AnimData *anim);
+extern int anim_replace(AnimData *anim, AnimData *fresh);
+extern void anim_freePages(AnimPages *pages);
+extern long anim_pagesBytes(AnimPages *pages);
+
+/* Asks for an animation's images to be loaded in the background if they
+   aren't, for something about to draw it */
+#define anim_needGfx(a) do { if ((a)->gfx == GFX_OUT) anim_requestGfx(a); } while (0)
 
 #endif /* __DEFINED_ANIMATION_H */
@@ -0,0 +1,125 @@
+#include "atlas.h"
+#include "dynarray.h"
+#include <string.h>
+
+/* Private function prototypes */
+static int fitAt(Skyline *s, int i, int w, int h);
+
+/* atl_init
+   Starts an empty page of the given size, with its skyline flat along the
+   top.
+*/
+void
+atl_init(Skyline *s, int w, int h)
+{
+  s->w = w;
+  s->h = h;
+  s->used_w = s->used_h = 0;
+  s->segs = (SkylineSeg *) dyn_1dArrayAlloc(w + 1, sizeof(SkylineSeg));
+  s->n_segs = 1;
+  s->segs[0].x = 0;
+  s->segs[0].y = 0;
+  s->segs[0].w = w;
+}
+
+/* atl_free
+   Frees a skyline.
+*/
+void
+atl_free(Skyline *s)
+{
+  dyn_1dArrayFree(s->segs);
+  s->segs = NULL;
+}
+
+/* fitAt
+   Works out how far down a rectangle has to go to sit on the skyline with
+   its left edge at the start of segment i.  Returns that y, or -1 if it
+   goes off the page there.
+*/
+int
+fitAt(Skyline *s, int i, int w, int h)
+{
+  int x = s->segs[i].x, y = 0, left = w;
+
+  if (x + w > s->w) return -1;
+  for (; left > 0; i++)
+    {
+      if (s->segs[i].y > y) y = s->segs[i].y;
+      left -= s->segs[i].w;
+    }
+  return (y + h > s->h) ? -1 : y;
+}
+
+/* atl_place
+   Finds room for a w by h rectangle on the page, as low as it can go, and
+   marks it as used.  Returns true and sets its top left, or returns false
+   if there isn't room.
+*/
+int
+atl_place(Skyline *s, int w, int h, int *x, int *y)
+{
+  int i, best = -1, best_y = 0, best_w = 0;
+  SkylineSeg seg;
+
+  if (w <= 0 || h <= 0) return 0;
+
+  /* Find where the rectangle sits highest, and the narrowest segment
+     for that, to leave the fewest gaps */
+  for (i = 0; i < s->n_segs; i++)
+    {
+      int fit = fitAt(s, i, w, h);
+      if (fit < 0) continue;
+      if (best < 0 || fit < best_y ||
+	  (fit == best_y && s->segs[i].w < best_w))
+	{
+	  best = i;
+	  best_y = fit;
+	  best_w = s->segs[i].w;
+	}
+    }
+  if (best < 0) return 0;
+
+  *x = s->segs[best].x;
+  *y = best_y;
+
+  /* The rectangle's top is a new segment, which covers up whatever it
+     was put on */
+  seg.x = *x;
+  seg.y = best_y + h;
+  seg.w = w;
+  memmove(&s->segs[best + 1], &s->segs[best], (s->n_segs - best) * sizeof(SkylineSeg));
+  s->segs[best] = seg;
+  s->n_segs++;
+
+  for (i = best + 1; i < s->n_segs; i++)
+    {
+      int cut = seg.x + seg.w - s->segs[i].x;
+      if (cut <= 0) break;
+      if (cut < s->segs[i].w)
+	{
+	  s->segs[i].x += cut;
+	  s->segs[i].w -= cut;
+	  break;
+	}
+      memmove(&s->segs[i], &s->segs[i + 1], (s->n_segs - i - 1) * sizeof(SkylineSeg));
+      s->n_segs--;
+      i--;
+    }
+
+  /* Join up segments next to each other at the same height */
+  for (i = 0; i + 1 < s->n_segs; i++)
+    {
+      if (s->segs[i].y == s->segs[i + 1].y)
+	{
+	  s->segs[i].w += s->segs[i + 1].w;
+	  memmove(&s->segs[i + 1], &s->segs[i + 2], (s->n_segs - i - 2) * sizeof(SkylineSeg));
+	  s->n_segs--;
+	  i--;
+	}
+    }
+
+  if (*x + w > s->used_w) s->used_w = *x + w;
+  if (*y + h > s->used_h) s->used_h = *y + h;
+  return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef __DEFINED_ATLAS_H
+#define __DEFINED_ATLAS_H
+
+#include "SDL.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/* A skyline packer, for putting lots of little images on a few big atlas
+   pages.  It keeps the outline of the tops of what's been placed so far,
+   as a row of flat segments from left to right, and puts each new
+   rectangle wherever its top would end up lowest.  It works best if the
+   rectangles are placed tallest first. */
+
+/* How big an atlas page is.  An image bigger than this gets a page of
+   its own. */
+#define ATLAS_SIZE 1024
+
+/* A flat piece of the skyline, starting at x and w wide, with its top at
+   y */
+typedef struct skyline_seg_struct
+{
+  int x, y, w;
+} SkylineSeg;
+
+typedef struct skyline_struct
+{
+  int w, h;            /* The size of the page */
+  int used_w, used_h;  /* How much of it has been used */
+  int n_segs;
+  SkylineSeg *segs;    /* There can't be more segments than w */
+} Skyline;
+
+extern void atl_init(Skyline *s, int w, int h);
+extern void atl_free(Skyline *s);
+extern int atl_place(Skyline *s, int w, int h, int *x, int *y);
+
+#endif // __DEFINED_ATLAS_H
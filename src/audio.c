@@ -1,90 +1,160 @@
 #include "audio.h"
+#include "pack.h"
+#include "pool.h"
 
-/* There is only one music file at a time, so we keep it here: */
-static Mix_Music *music = NULL;
+/* There is only one music file playing at a time, out of the cache: */
+static Music *music = NULL;
+static ResHandle music_res = RES_NONE;
 
-/* Sounds are stored in a binary tree */
-static SoundTree sounds = NULL;
+/* And one set of sounds, found by name through its map */
+static SoundSet *sound_set = NULL;
+static ResHandle sound_res = RES_NONE;
 
-/* Private function prototypes */
-SoundTree loadSound(SoundNode *node, char *name, char *filename);
-void freeSound(SoundNode *node);
-Mix_Chunk *findSound(SoundNode *node, char *name);
+/* A sound being loaded in the background */
+typedef struct sound_job_struct
+{
+  Sound *sound;
+  void *data;            /* A copy of it out of the pack, if it's in there */
+  int size;
+  Mix_Chunk *chunk;
+  char error[256];       /* Why it couldn't be loaded, if it couldn't */
+} SoundJob;
 
-/* findSound
-   Finds a sound in a tree.
+/* Private function prototypes */
+static void addSound(SoundSet *set, char *name, char *filename);
+static void loadSound(Sound *s);
+static void requestSound(Sound *s);
+static void decodeSound(void *thing);
+static void finishSound(void *thing);
+
+/* addSound
+   Adds a sound to a set, and names it, without loading it yet.
 */
-Mix_Chunk *findSound(SoundNode *node, char *name)
+void
+addSound(SoundSet *set, char *name, char *filename)
 {
-  int cond;
+  Sound *s = &set->sounds[set->n_sounds];
 
-  if (node == NULL)
-    return NULL;
-  else if ((cond = strcmp(name, node->name)) == 0)
+  if (!nam_set(&set->names, nam_intern(name), set->n_sounds))
     {
-      /* Found it */
-      return node->sound;
+      /* For some reason a sound of this name has already been loaded.
+	 Don't load it again.  Free the sound name string. */
+      fprintf(stderr, "Warning: Attempt to load sound file %s with name %s, but a sound file with the same name has already been loaded. Not loading this sound.\n", filename, name);
+      free(name);
+      free(filename);
+      return;
     }
-  else if (cond < 0)
-    return findSound(node->left, name);
-  else
-    return findSound(node->right, name);
+
+  s->name = name;
+  s->file = filename;
+  s->sound = NULL;
+  s->state = SOUND_OUT;
+  set->n_sounds++;
 }
 
-/* freeSound
-   Frees a tree of sounds recursively.
+/* loadSound
+   Loads a sound now, if it isn't loaded.  If it can't be, it's left out,
+   and is silent.
 */
-void freeSound(SoundNode *node)
+void
+loadSound(Sound *s)
 {
-  if (node != NULL)
+  SDL_RWops *rw;
+
+  if (s->state != SOUND_OUT) return;
+
+  /* Load it straight out of the pack if it's in there */
+  if ((rw = pak_openRW(s->file)) != NULL) s->sound = Mix_LoadWAV_RW(rw, 1);
+  else s->sound = Mix_LoadWAV(s->file);
+  if (!s->sound)
     {
-      freeSound(node->left);
-      freeSound(node->right);
-
-      /* Free the name */
-      free(node->name);
-      /* Free the sound */
-      Mix_FreeChunk(node->sound);
-      free(node);
-      node = NULL;
+      fprintf(stderr, "Error: Could not load soundfile %s: %s\n", s->file, Mix_GetError());
+      s->state = SOUND_MISSING;
+      return;
     }
+  s->state = SOUND_IN;
 }
 
-/* loadSound
-   Add a node in the tree of sounds at or below the given node.
+/* requestSound
+   Starts loading a sound in the background.  It's silent until it's in.
+*/
+void
+requestSound(Sound *s)
+{
+  SoundJob *job;
+
+  if (s->state != SOUND_OUT) return;
 
-   Using recursive code from The C Programming Language.
+  MALLOC(job, sizeof(SoundJob));
+  job->sound = s;
+  job->data = pak_copy(s->file, &job->size);
+  job->chunk = NULL;
+  job->error[0] = '\0';
+  s->state = SOUND_LOADING;
+  pool_post(decodeSound, finishSound, job);
+}
+
+/* decodeSound
+   Loads a sound, in the background.  The error is kept in the job if it
+   can't be, as it's only good on the thread that got it.
 */
-SoundTree loadSound(SoundNode *node, char *name, char *filename)
+void
+decodeSound(void *thing)
 {
+  SoundJob *job = (SoundJob *) thing;
 
-  int cond;
+  if (job->data != NULL)
+    job->chunk = Mix_LoadWAV_RW(SDL_RWFromConstMem(job->data, job->size), 1);
+  else
+    job->chunk = Mix_LoadWAV(job->sound->file);
 
-  if (node == NULL)
+  if (!job->chunk)
     {
-      MALLOC(node, sizeof(SoundNode));
-      node->name = name;
-      node->sound = Mix_LoadWAV(filename);
-      if (!node->sound)
-	{
-	  fprintf(stderr, "Error: Could not load soundfile %s: %s\n", filename, Mix_GetError());
-	  exit(0);
-	}
-      node->left = node->right = NULL;
+      strncpy(job->error, Mix_GetError(), sizeof(job->error) - 1);
+      job->error[sizeof(job->error) - 1] = '\0';
     }
-  else if ((cond = strcmp(name, node->name)) == 0)
+}
+
+/* finishSound
+   Puts a sound that's been loaded in the background in its set, or leaves
+   it out if it couldn't be loaded.
+*/
+void
+finishSound(void *thing)
+{
+  SoundJob *job = (SoundJob *) thing;
+
+  if (!job->chunk)
     {
-      /* For some reason a sound of this name has already been loaded.
-	 Don't a sound here.  Free the sound name string. */
-      fprintf(stderr, "Warning: Attempt to load sound file %s with name %s, but a sound file with the same name has already been loaded. Not loading this sound.\n", filename, name);
-      free(name);
+      fprintf(stderr, "Error: Could not load soundfile %s: %s\n", job->sound->file, job->error);
+      job->sound->state = SOUND_MISSING;
     }
-  else if (cond < 0)
-    node->left = loadSound(node->left, name, filename);
   else
-    node->right = loadSound(node->right, name, filename);
+    {
+      job->sound->sound = job->chunk;
+      job->sound->state = SOUND_IN;
+    }
+  free(job->data);
+  free(job);
+}
 
-  return node;
+/* aud_getSoundHandle
+   Finds a sound by name, for something that plays it a lot to keep.  It
+   doesn't have to be loaded yet.  Returns SOUND_NONE if there's no sound
+   of that name.
+*/
+SoundHandle
+aud_getSoundHandle(char *name)
+{
+  extern SoundSet *sound_set;
+  int i = (sound_set == NULL) ? -1 : nam_lookup(&sound_set->names, name);
+
+  if (i < 0)
+    {
+      fprintf(stderr, "Error: Sound \"%s\" is not loaded\n", name);
+      return SOUND_NONE;
+    }
+  return i;
 }
 
 /* aud_playSound
@@ -95,77 +165,188 @@ SoundTree loadSound(SoundNode *node, char *name, char *filename)
 */
 int aud_playSound(char *name, int pan, int vol, int loops)
 {
-  extern SoundTree sounds;
-  Mix_Chunk *chunk;
+  extern SoundSet *sound_set;
+  int i = (sound_set == NULL) ? -1 : nam_lookup(&sound_set->names, name);
+
+  if (i < 0)
+    {
+      fprintf(stderr, "Error: Could not play unloaded sound \"%s\"\n", name);
+      return -1;
+    }
+  return aud_playSoundByHandle(i, pan, vol, loops);
+}
+
+/* aud_playSoundByHandle
+   The same as aud_playSound(), for a sound that's already been looked up.
+*/
+int
+aud_playSoundByHandle(SoundHandle sound, int pan, int vol, int loops)
+{
+  extern SoundSet *sound_set;
   int channel;
 
+  if (sound == SOUND_NONE || sound_set == NULL) return -1;
 
-  /* Find the chunk in the tree */
-  if ((chunk = findSound(sounds, name)) == NULL)
+  /* A sound nobody said they'd make is loaded now, and is silent until
+     it's in */
+  if (sound_set->sounds[sound].state != SOUND_IN)
     {
-      fprintf(stderr, "Error: Could not play unloaded sound \"%s\"\n", name);
+      requestSound(&sound_set->sounds[sound]);
       return -1;
     }
+
+  /* Play the sound */
+  channel = Mix_PlayChannel(-1, sound_set->sounds[sound].sound, loops);
+  if (channel == -1)
+    {
+      fprintf(stderr, "Mix_PlayChannel: %s\n", Mix_GetError());
+    }
   else
     {
-      /* Play the sound */
-      channel = Mix_PlayChannel(-1, chunk, loops);
-      if (channel == -1)
-	{
-	  fprintf(stderr, "Mix_PlayChannel: %s\n", Mix_GetError());
-	}
-      else
-	{
-	  /* Set the volume */
-	  Mix_Volume(channel, vol);
-	  /* Set the panning */
-	  if (!Mix_SetPanning(channel, 254 - pan, pan))
-	    fprintf(stderr, "Mix_SetPanning: %s\n", Mix_GetError());
-	}
+      /* Set the volume */
+      Mix_Volume(channel, vol);
+      /* Set the panning */
+      if (!Mix_SetPanning(channel, 254 - pan, pan))
+	fprintf(stderr, "Mix_SetPanning: %s\n", Mix_GetError());
     }
   return channel;
 }
 
 /* aud_loadSounds
-   Load all sounds into memory.
+   Gets a set of sounds out of the cache, which reads what they are the
+   first time.  Only one set is used at a time, and the sounds in it are
+   loaded by aud_loadNeeded().
 */
 void
 aud_loadSounds(char *datfile)
 {
-  extern SoundTree sounds;
+  extern SoundSet *sound_set;
+  extern ResHandle sound_res;
+
+  aud_freeSounds();
+  sound_res = res_acquire(RES_SOUNDS, datfile);
+  sound_set = (SoundSet *) res_get(sound_res);
+}
+
+/* aud_loadNeeded
+   Loads the sounds of a list of names, if they aren't loaded.  If wait is
+   false they're loaded in the background, and are silent until they're
+   in.
+*/
+void
+aud_loadNeeded(char **names, int n, int wait)
+{
+  extern SoundSet *sound_set;
+  SoundHandle *handles;
+  char **files;
+  int i, j, n_files = 0;
+
+  if (sound_set == NULL) return;
+
+  /* Look them up once, and unpack them all together first */
+  MALLOC(handles, (n + 1) * sizeof(SoundHandle));
+  MALLOC(files, (n + 1) * sizeof(char *));
+  for (i = 0; i < n; i++)
+    if ((j = handles[i] = aud_getSoundHandle(names[i])) != SOUND_NONE &&
+	sound_set->sounds[j].state == SOUND_OUT)
+      files[n_files++] = sound_set->sounds[j].file;
+  pak_prefetch(files, n_files);
+  free(files);
+
+  for (i = 0; i < n; i++)
+    if ((j = handles[i]) != SOUND_NONE)
+      {
+	if (wait) loadSound(&sound_set->sounds[j]);
+	else requestSound(&sound_set->sounds[j]);
+      }
+  free(handles);
+}
+
+/* aud_freeSounds
+   Stops the sounds, and gives them back to the cache.
+*/
+void
+aud_freeSounds(void)
+{
+  extern SoundSet *sound_set;
+  extern ResHandle sound_res;
+
+  /* Stop all playback */
+  Mix_HaltChannel(-1);
+
+  res_release(sound_res);
+  sound_res = RES_NONE;
+  sound_set = NULL;
+}
+
+/* aud_makeSounds
+   Reads the names and files of the sounds in a .dat file, for the cache.
+   None of them are loaded yet.
+*/
+void *
+aud_makeSounds(char *datfile)
+{
+  SoundSet *set;
   char *sound_name, *sound_file;
+  DatFile *dat;
+  int i;
 
-  /* Open the datfile */
-  file_openFile(datfile, 'r');
+  MALLOC(set, sizeof(SoundSet));
 
-  while (file_getNextSound(datfile, &sound_name, &sound_file))
-    {
-      /* Load the sound */
-      sounds = loadSound(sounds, sound_name, sound_file); 
+  /* Read the datfile in */
+  dat = file_openDat(datfile);
 
-      /* Free the string of the filename */
-      free(sound_file);
+  /* Make room for all of them */
+  MALLOC(set->sounds, (dat->n_pairs + 1) * sizeof(Sound));
+  set->n_sounds = 0;
+  nam_initMap(&set->names);
 
+  for (i = 0; i < dat->n_pairs; i++)
+    {
+      file_getSound(dat, i, &sound_name, &sound_file);
+      addSound(set, sound_name, sound_file);
     }
 
-  /* Close the datfile */
-  file_closeFile(datfile);
+  return set;
 }
 
-/* aud_freeSounds
-   Free sounds from memory.
+/* aud_destroySounds
+   Frees a set of sounds the cache is done with.
 */
 void
-aud_freeSounds(void)
+aud_destroySounds(void *data)
 {
-  extern SoundTree sounds;
+  SoundSet *set = (SoundSet *) data;
+  int i;
 
-  /* Stop all playback */
+  /* None of them can be playing or loading */
   Mix_HaltChannel(-1);
+  pool_finish(1);
 
-  /* Recursively free the tree of sounds */
-  freeSound(sounds);
+  for (i = 0; i < set->n_sounds; i++)
+    {
+      free(set->sounds[i].name);
+      free(set->sounds[i].file);
+      if (set->sounds[i].sound != NULL) Mix_FreeChunk(set->sounds[i].sound);
+    }
+  free(set->sounds);
+  nam_freeMap(&set->names);
+  free(set);
+}
+
+/* aud_soundsBytes
+   Returns about how much memory a set of sounds takes up, for the cache.
+*/
+long
+aud_soundsBytes(void *data)
+{
+  SoundSet *set = (SoundSet *) data;
+  long bytes = sizeof(SoundSet) + set->n_sounds * sizeof(Sound);
+  int i;
 
+  for (i = 0; i < set->n_sounds; i++)
+    if (set->sounds[i].sound != NULL) bytes += set->sounds[i].sound->alen;
+  return bytes;
 }
 
 /* aud_setMusicVol
@@ -184,8 +365,8 @@ aud_setMusicVol(int volume)
 void
 aud_playMusic(int loops)
 {
-  extern Mix_Music *music;
-  if(Mix_PlayMusic(music, loops)==-1)
+  extern Music *music;
+  if(Mix_PlayMusic(music->music, loops)==-1)
     {
       fprintf(stderr, "Mix_PlayMusic: %s\n", Mix_GetError());
     }
@@ -201,36 +382,96 @@ aud_haltMusic(void)
 }
 
 /* aud_loadMusic
-   Load the music indicated in a given .area file.
+   Gets the music indicated in a given .area file out of the cache, which
+   loads it if it isn't there.
 */
 void
 aud_loadMusic(char *areafile)
 {
-  extern Mix_Music *music;
+  extern Music *music;
+  extern ResHandle music_res;
   char *musicfile;
 
   /* Get the filename */
   musicfile = file_getAreaMusicFile(areafile);
 
-  music = Mix_LoadMUS(musicfile);
+  aud_freeMusic();
+  music_res = res_acquire(RES_MUSIC, musicfile);
+  music = (Music *) res_get(music_res);
   free(musicfile);
+}
+
+/* aud_freeMusic
+   Stops the music, and gives it back to the cache.
+*/
+void
+aud_freeMusic(void)
+{
+  extern Music *music;
+  extern ResHandle music_res;
 
-  if (!music)
+  if (music != NULL) Mix_HaltMusic();
+  res_release(music_res);
+  music_res = RES_NONE;
+  music = NULL;
+}
+
+/* aud_makeMusic
+   Loads a music file, for the cache.
+*/
+void *
+aud_makeMusic(char *musicfile)
+{
+  Music *m;
+
+  MALLOC(m, sizeof(Music));
+  m->rw = NULL;
+
+  /* Music is played as it's read, so if it's in the pack, it's read from
+     a copy that's kept until it's freed, since the pack is flushed once
+     the area's loaded */
+  if ((m->data = pak_copy(musicfile, &m->size)) != NULL)
     {
-      fprintf(stderr, "Mix_LoadMUS(\"%s\"): %s\n", Mix_GetError());
+      m->rw = SDL_RWFromConstMem(m->data, m->size);
+      m->music = Mix_LoadMUS_RW(m->rw);
+    }
+  else
+    {
+      /* Read from its file as it plays */
+      m->size = 0;
+      m->music = Mix_LoadMUS(musicfile);
+    }
+
+  if (!m->music)
+    {
+      fprintf(stderr, "Mix_LoadMUS(\"%s\"): %s\n", musicfile, Mix_GetError());
       exit(0);
     }
+
+  return m;
 }
 
-/* aud_freeMusic
-   Frees the music.
+/* aud_destroyMusic
+   Frees music the cache is done with.
 */
 void
-aud_freeMusic(void)
+aud_destroyMusic(void *data)
 {
-  extern Mix_Music *music;
-  Mix_FreeMusic(music);
-  music = NULL;
+  Music *m = (Music *) data;
+
+  Mix_FreeMusic(m->music);
+  if (m->rw != NULL) SDL_FreeRW(m->rw);
+  free(m->data);
+  free(m);
+}
+
+/* aud_musicBytes
+   Returns about how much memory music takes up, for the cache.
+*/
+long
+aud_musicBytes(void *data)
+{
+  return sizeof(Music) + ((Music *) data)->size;
 }
 
 /* aud_init
@@ -5,6 +5,8 @@
 #include "SDL.h"
 #include "SDL_mixer.h"
 #include "file.h"
+#include "names.h"
+#include "res.h"
 
 /* The sound playing is pretty simple.  The audio module just plays a sound
    and forgets about it, and relies on the module calling it to stop the sound
@@ -20,27 +22,64 @@
 #define SOUND_DEFAULT_VOL (MIX_MAX_VOLUME * .8)
 #define PANNING_MAX 254
 
-/* Sounds are stored in a binary tree */
-typedef struct sound_node
+/* Sounds are stored in an array, and found by name through a map */
+typedef struct sound_struct
 {
   char *name;                 /* The name of the sound */
-  Mix_Chunk *sound;           /* The sound */
-  struct sound_node *left;
-  struct sound_node *right;
-} SoundNode;
+  char *file;                 /* The file it's loaded from */
+  Mix_Chunk *sound;           /* The sound, or NULL if it isn't loaded */
+  int state;                  /* Whether it's loaded, see sound_states */
+} Sound;
 
-typedef SoundNode *SoundTree;
+/* A sound is either not loaded, being loaded in the background, loaded,
+   or left out because it couldn't be loaded.  Only the ones an area's
+   objects make are loaded with it. */
+enum sound_states {SOUND_OUT, SOUND_LOADING, SOUND_IN, SOUND_MISSING};
+
+/* A set of sounds loaded from a .dat file */
+typedef struct sound_set_struct
+{
+  int n_sounds;
+  Sound *sounds;              /* A 1d array of the sounds */
+  NameMap names;              /* Where each sound is, by name */
+} SoundSet;
+
+/* A music file, and where it's being read from if it's in the pack */
+typedef struct music_struct
+{
+  Mix_Music *music;
+  SDL_RWops *rw;
+  void *data;
+  int size;                   /* How big data is */
+} Music;
+
+/* Where a sound is in the array, for things that play it a lot to look
+   up once */
+typedef int SoundHandle;
+
+/* The handle of a sound that isn't loaded, which plays nothing */
+#define SOUND_NONE (-1)
 
 
 extern void aud_playMusic(int loops);
 extern void aud_haltMusic(void);
 extern void aud_loadMusic(char *areafile);
 extern void aud_freeMusic(void);
+extern void *aud_makeMusic(char *musicfile);
+extern void aud_destroyMusic(void *data);
+extern long aud_musicBytes(void *data);
 extern void aud_init(void);
 extern void aud_close(void);
 extern void aud_setMusicVol(int volume);
 extern void aud_loadSounds(char *datfile);
+extern void aud_freeSounds(void);
+extern void aud_loadNeeded(char **names, int n, int wait);
+extern void *aud_makeSounds(char *datfile);
+extern void aud_destroySounds(void *data);
+extern long aud_soundsBytes(void *data);
 extern int aud_playSound(char *name, int pan, int vol, int loops);
+extern SoundHandle aud_getSoundHandle(char *name);
+extern int aud_playSoundByHandle(SoundHandle sound, int pan, int vol, int loops);
 #define aud_haltSound(x) Mix_HaltChannel(x)
 
 #endif /* __DEFINED_AUDIO_H */
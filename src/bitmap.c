@@ -0,0 +1,91 @@
+#include "bitmap.h"
+#include "dynarray.h"
+
+/* Private function prototypes */
+static int lowestBit(Uint32 word);
+
+/* lowestBit
+   Returns the position of the lowest bit set in a word which isn't 0.
+*/
+int
+lowestBit(Uint32 word)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(word);
+#else
+  int i = 0;
+  while (!(word & 1))
+    {
+      word >>= 1;
+      i++;
+    }
+  return i;
+#endif
+}
+
+/* bit_alloc
+   Allocates a bitmap of the given dimensions with all of its bits off.
+*/
+void
+bit_alloc(Bitmap *bm, int w, int h)
+{
+  bm->w = w;
+  bm->h = h;
+  bm->words = (w + 31) / 32;
+  bm->bits = (Uint32 *) dyn_1dArrayAlloc((bm->words * h > 0) ? bm->words * h : 1, sizeof(Uint32));
+}
+
+/* bit_free
+   Frees a bitmap.
+*/
+void
+bit_free(Bitmap *bm)
+{
+  dyn_1dArrayFree(bm->bits);
+  bm->bits = NULL;
+}
+
+/* bit_set
+   Turns the bit at a position on or off.
+*/
+void
+bit_set(Bitmap *bm, int x, int y, int on)
+{
+  if (on)
+    BIT_WORD(bm, x, y) |= (Uint32) 1 << (x & 31);
+  else
+    BIT_WORD(bm, x, y) &= ~((Uint32) 1 << (x & 31));
+}
+
+/* bit_next
+   Returns the first x from x to x_end in row y whose bit is on, or x_end + 1
+   if there isn't one.  Empty stretches of the row are skipped 32 at a time.
+   Positions off either side of the bitmap count as off, so
+
+   for (x = bit_next(bm, y, x1, x2); x <= x2; x = bit_next(bm, y, x + 1, x2))
+
+   visits every position in a range that is on.
+*/
+int
+bit_next(Bitmap *bm, int y, int x, int x_end)
+{
+  Uint32 *row;
+  int last = (x_end < bm->w) ? x_end : bm->w - 1;
+
+  if (y < 0 || y >= bm->h) return x_end + 1;
+  if (x < 0) x = 0;
+
+  row = &bm->bits[y * bm->words];
+  while (x <= last)
+    {
+      Uint32 word = row[x >> 5] >> (x & 31);
+      if (word != 0)
+	{
+	  x += lowestBit(word);
+	  return (x <= last) ? x : x_end + 1;
+	}
+      /* Nothing else in this word, go to the start of the next one */
+      x = (x | 31) + 1;
+    }
+  return x_end + 1;
+}
@@ -0,0 +1,26 @@
+#ifndef __DEFINED_BITMAP_H
+#define __DEFINED_BITMAP_H
+
+#include "SDL.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/* A packed 2d array of bits, 1 bit per position.  Each row (y) is a run of
+   32-bit words, so a whole row can be searched a word at a time. */
+typedef struct bitmap_struct
+{
+  int w, h;
+  int words;      /* Words in each row */
+  Uint32 *bits;
+} Bitmap;
+
+/* The word a position's bit is in, and the bit itself: */
+#define BIT_WORD(bm, x, y) ((bm)->bits[(y) * (bm)->words + ((x) >> 5)])
+#define bit_test(bm, x, y) ((BIT_WORD(bm, x, y) >> ((x) & 31)) & 1)
+
+extern void bit_alloc(Bitmap *bm, int w, int h);
+extern void bit_free(Bitmap *bm);
+extern void bit_set(Bitmap *bm, int x, int y, int on);
+extern int bit_next(Bitmap *bm, int y, int x, int x_end);
+
+#endif // __DEFINED_BITMAP_H
@@ -4,6 +4,8 @@
 #include "graphics.h"
 #include "object.h"
 #include "collision.h"
+#include "projectile.h"
+#include "particle.h"
 
 /* The camera's position refers to a coordinate on this layer */
 static int focus_layer;
@@ -14,6 +16,15 @@ static Point position;
 // Camera dimensions
 static int width, height;
 
+/* Tiles waiting to be blitted, which are all off the same atlas page */
+static SDL_Surface *batch_page = NULL;
+static SDL_Rect batch_src[TILE_BATCH], batch_dest[TILE_BATCH];
+static int batch_n = 0;
+
+/* Private function prototypes */
+static void batchTile(Frame *f, int x, int y);
+static void flushTiles(void);
+
 /* cam_setFocusLayer
    sets the layer the camera is pointed at
 */
@@ -107,6 +118,40 @@ cam_moveCamera(int dx, int dy)
   position.y = (position.y >= map_mapToRealY(map_getLayerHeight(focus_layer))) ? (map_mapToRealY(map_getLayerHeight(focus_layer)) - 1) : position.y;
 }
 
+/* batchTile
+   Adds a tile to the batch to be blitted.  The batch is blitted first if
+   the tile's from a different page, so everything's still drawn in
+   order.
+*/
+void
+batchTile(Frame *f, int x, int y)
+{
+  extern SDL_Surface *batch_page;
+  extern SDL_Rect batch_src[], batch_dest[];
+  extern int batch_n;
+
+  if (f->page != batch_page || batch_n == TILE_BATCH) flushTiles();
+  batch_page = f->page;
+  batch_src[batch_n] = f->src;
+  batch_dest[batch_n].x = x;
+  batch_dest[batch_n].y = y;
+  batch_n++;
+}
+
+/* flushTiles
+   Blits the batch of tiles.
+*/
+void
+flushTiles(void)
+{
+  extern SDL_Surface *batch_page;
+  extern SDL_Rect batch_src[], batch_dest[];
+  extern int batch_n;
+
+  if (batch_n > 0) gfx_blitImages(batch_page, batch_src, batch_dest, batch_n);
+  batch_n = 0;
+}
+
 /* cam_render
    renders what the camera is looking at to the center of the screen
 */
@@ -162,20 +207,22 @@ cam_render(void)
 	 that the camera sees at least a
 	 part of.  Also make sure that the 
 	 coordinates are not off the map. */
-      for (map_x = (map_realToMapX(camera_top_left.x) >= 0) ? map_realToMapX(camera_top_left.x) : 0; 
-	   (map_x <= map_realToMapX(camera_top_left.x + width))
-	     && (map_x < map_getLayerWidth(l)); 
-	   map_x++)
+      for (map_y = (map_realToMapY(camera_top_left.y) >= 0) ? map_realToMapY(camera_top_left.y) : 0; 
+	   (map_y <= map_realToMapY(camera_top_left.y + height))
+	     && (map_y < map_getLayerHeight(l)); 
+	   map_y++)
 	{
-	  
-	  for (map_y = (map_realToMapY(camera_top_left.y) >= 0) ? map_realToMapY(camera_top_left.y) : 0; 
-	       (map_y <= map_realToMapY(camera_top_left.y + height))
-		 && (map_y < map_getLayerHeight(l)); 
-	       map_y++)
+	  int map_x_end = map_realToMapX(camera_top_left.x + width);
+
+	  /* Only visit the map coordinates on this row that have tiles */
+	  for (map_x = map_nextTile(l, map_y, map_realToMapX(camera_top_left.x), map_x_end);
+	       map_x <= map_x_end;
+	       map_x = map_nextTile(l, map_y, map_x + 1, map_x_end))
 	    {
 	      
 	      // If there is a tile at this map coordinate, render it:
-	      if (map_getTileGfx(l, map_x, map_y) != NULL)
+	      Frame *tile_gfx = map_getTileGfx(l, map_x, map_y);
+	      if (tile_gfx != NULL)
 		{
 
 		  /* Blit the image of the tile at 
@@ -189,15 +236,16 @@ cam_render(void)
 		  int blit_x = blit_start.x - x_offset + tile_gfx_offset.x + map_mapToRealX(map_x - map_realToMapX(camera_top_left.x));
 		  int blit_y = blit_start.y - y_offset + tile_gfx_offset.y + map_mapToRealY(map_y - map_realToMapY(camera_top_left.y));
 		  
-		  gfx_blitImage(map_getTileGfx(l, map_x, map_y), 
-				blit_x, 
-				blit_y);
+		  /* Tiles next to each other are usually off the same atlas
+		     page, so they're blitted in batches */
+		  batchTile(tile_gfx, blit_x, blit_y);
 
 		  /* Render tile boundaries for testing purposes: */
 #ifdef RENDER_TILE_BOUND
 		  {
 		    Bound *this_bound;
 		    this_bound = map_getTileBounds(l, map_x, map_y);
+		    flushTiles();
 		    
 		    while (this_bound != NULL)
 		      {
@@ -225,6 +273,7 @@ cam_render(void)
 		}  /* endif there are graphics at this tile */
 	    }
 	}  /* end x,y for loops */
+      flushTiles();
 
       /* Render objects */
 
@@ -256,14 +305,14 @@ cam_render(void)
 		  /* Get the top left point in real coordinates of the object's
 		     graphic: */
 		  gfx_pos = obj_getGfxPos(this_object);
-		  SDL_Surface *obj_gfx = obj_getObjGfx(this_object);
+		  Frame *obj_gfx = obj_getObjGfx(this_object);
 		  
 		  /* Render it if any part of the graphic is on screen: */
 		  if (
 		      !((gfx_pos.y > camera_top_left.y + height) ||
-			(gfx_pos.y + obj_gfx->h < camera_top_left.y) ||
+			(gfx_pos.y + obj_gfx->src.h < camera_top_left.y) ||
 			(gfx_pos.x > camera_top_left.x + width) ||
-			(gfx_pos.x + obj_gfx->w < camera_top_left.x))
+			(gfx_pos.x + obj_gfx->src.w < camera_top_left.x))
 		      )
 		    {
 		      
@@ -273,7 +322,7 @@ cam_render(void)
 		      blit_x = blit_start.x + gfx_pos.x - camera_top_left.x;
 		      blit_y = blit_start.y + gfx_pos.y - camera_top_left.y;
 		      
-		      gfx_blitImage(obj_gfx, blit_x, blit_y);
+		      gfx_blitImage(obj_gfx->page, &obj_gfx->src, blit_x, blit_y);
 		      
 		      /* Render the object's boundaries for testing purposes: */
 #ifdef RENDER_OBJ_BOUND
@@ -324,6 +373,66 @@ cam_render(void)
 	    }
 	} /* end sector for loops */
 
+      /* Render the projectiles in this layer, all in one go: */
+      {
+	Projectiles *projs = proj_getProjectiles();
+	int i;
+	for (i = 0; i < projs->n; i++)
+	  {
+	    Point gfx_pos;
+	    Frame *proj_gfx;
+
+	    if (projs->layer[i] != l) continue;
+
+	    gfx_pos = proj_getGfxPos(i);
+	    proj_gfx = proj_getGfx(i);
+
+	    if (
+		!((gfx_pos.y > camera_top_left.y + height) ||
+		  (gfx_pos.y + proj_gfx->src.h < camera_top_left.y) ||
+		  (gfx_pos.x > camera_top_left.x + width) ||
+		  (gfx_pos.x + proj_gfx->src.w < camera_top_left.x))
+		)
+	      gfx_blitImage(proj_gfx->page, &proj_gfx->src,
+			    blit_start.x + gfx_pos.x - camera_top_left.x,
+			    blit_start.y + gfx_pos.y - camera_top_left.y);
+	  }
+      }
+
+      /* Render the particles in this layer, filling a run of particles of
+	 the same color all at once: */
+      {
+	static SDL_Rect rects[PART_MAX];
+	Particles *parts = part_getParticles();
+	int i, n_rects = 0;
+	Uint32 color = 0;
+
+	for (i = 0; i < parts->n; i++)
+	  {
+	    int x = (int) parts->x[i] - PART_SIZE / 2;
+	    int y = (int) parts->y[i] - PART_SIZE / 2;
+
+	    if (parts->layer[i] != l ||
+		y > camera_top_left.y + height || y + PART_SIZE < camera_top_left.y ||
+		x > camera_top_left.x + width || x + PART_SIZE < camera_top_left.x)
+	      continue;
+
+	    if (n_rects > 0 && parts->color[i] != color)
+	      {
+		gfx_fillRects(rects, n_rects, color);
+		n_rects = 0;
+	      }
+	    color = parts->color[i];
+
+	    rects[n_rects].x = blit_start.x + x - camera_top_left.x;
+	    rects[n_rects].y = blit_start.y + y - camera_top_left.y;
+	    rects[n_rects].w = PART_SIZE;
+	    rects[n_rects].h = PART_SIZE;
+	    n_rects++;
+	  }
+	if (n_rects > 0) gfx_fillRects(rects, n_rects, color);
+      }
+
       /* Render sector boundaries for testing purposes: */	
 #ifdef RENDER_SECTORS
       {
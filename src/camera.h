@@ -14,6 +14,9 @@ extern void cam_render(void);
 extern void cam_moveCamera(int dx, int dy);
 extern Rect cam_getViewRange(int l);
 
+/* The most tiles blitted in one batch */
+#define TILE_BATCH 256
+
 /* If we want to render object boundaries: */
 //#define RENDER_OBJ_BOUND
 #define OBJ_BOUND_RGBA 200, 200, 255, 255
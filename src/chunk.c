@@ -0,0 +1,500 @@
+#include "chunk.h"
+#include "camera.h"
+
+/* What's known about the chunks in one layer */
+typedef struct chunk_layer_struct
+{
+  int cw, ch;         /* The layer's dimensions in chunks */
+  ChunkInfo *info;    /* A 1d array of the chunks, row by row */
+} ChunkLayer;
+
+static int n_layers;
+static ChunkLayer *layers;
+
+/* How many bytes of chunks can be loaded, and how many are */
+static int budget = CHUNK_BUDGET;
+static int loaded_bytes = 0;
+
+/* The chunks the loading thread has been asked for and hasn't handed back
+   yet */
+static int n_pending = 0;
+
+/* The queues between the game and the loading thread, and the lock and
+   conditions that guard them */
+static ChunkJob todo[CHUNK_QUEUE];
+static int todo_head = 0, todo_n = 0;
+static ChunkJob done[CHUNK_QUEUE];
+static int done_head = 0, done_n = 0;
+static SDL_mutex *lock = NULL;
+static SDL_cond *todo_cond, *done_cond;
+static SDL_Thread *loader = NULL;
+static int quitting = 0;
+
+#define INFO_AT(l, cx, cy) (&layers[(l)].info[(cy) * layers[(l)].cw + (cx)])
+
+/* Private function prototypes */
+static int loadChunks(void *data);
+static void findRange(int l, int margin, int *cx1, int *cy1, int *cx2, int *cy2);
+static int requestRange(int margin);
+static void installLoaded(void);
+static Dormant *newDormant(int l, Point pos);
+static void wakeDormant(int l, int cx, int cy);
+static void putToSleep(int l, int cx, int cy);
+static void evictChunks(void);
+
+/* chk_init
+   Gets ready to take the chunks of a map with a number of layers.
+*/
+void
+chk_init(int n)
+{
+  extern int n_layers;
+  extern ChunkLayer *layers;
+
+  n_layers = n;
+  layers = (ChunkLayer *) dyn_1dArrayAlloc(n, sizeof(ChunkLayer));
+}
+
+/* chk_initLayer
+   Sets a layer's dimensions in chunks.
+*/
+void
+chk_initLayer(int l, int cw, int ch)
+{
+  extern ChunkLayer *layers;
+
+  layers[l].cw = cw;
+  layers[l].ch = ch;
+  layers[l].info = (ChunkInfo *) dyn_1dArrayAlloc(cw * ch, sizeof(ChunkInfo));
+}
+
+/* chk_addDormant
+   Puts an object that hasn't been made yet to sleep in the chunk where it
+   is, until the chunk is loaded.
+*/
+void
+chk_addDormant(int l, Point pos, Velocity vel, int type)
+{
+  Dormant *d;
+
+  if ((d = newDormant(l, pos)) == NULL) return;
+  d->obj = NULL;
+  d->type = type;
+  d->pos = pos;
+  d->vel = vel;
+}
+
+/* newDormant
+   Makes room for one more dormant object in the chunk where a position
+   is, and returns it, or NULL if the position is off the layer.
+*/
+Dormant *
+newDormant(int l, Point pos)
+{
+  extern ChunkLayer *layers;
+  ChunkInfo *info;
+
+  if (pos.x < 0 || pos.x >= map_mapToRealX(map_getLayerWidth(l)) ||
+      pos.y < 0 || pos.y >= map_mapToRealY(map_getLayerHeight(l)))
+    return NULL;
+
+  info = INFO_AT(l, map_realToMapX(pos.x) / CHUNK_W, map_realToMapY(pos.y) / CHUNK_H);
+  if (info->n_dormant == info->max_dormant)
+    {
+      info->max_dormant = (info->max_dormant == 0) ? 4 : info->max_dormant * 2;
+      if ((info->dormant = (Dormant *) realloc(info->dormant, info->max_dormant * sizeof(Dormant))) == NULL)
+	{
+	  fprintf(stderr, "Unable to allocate memory.\n");
+	  exit(0);
+	}
+    }
+
+  return &info->dormant[info->n_dormant++];
+}
+
+/* chk_setBudget
+   Sets how many bytes of chunks can be loaded at once.  The chunks near the
+   camera are always loaded, even if they're over the budget.
+*/
+void
+chk_setBudget(int bytes)
+{
+  extern int budget;
+  budget = bytes;
+}
+
+/* chk_start
+   Starts the loading thread.  The map and objects must be loaded first.
+*/
+void
+chk_start(void)
+{
+  extern SDL_mutex *lock;
+  extern SDL_cond *todo_cond, *done_cond;
+  extern SDL_Thread *loader;
+
+  lock = SDL_CreateMutex();
+  todo_cond = SDL_CreateCond();
+  done_cond = SDL_CreateCond();
+  quitting = 0;
+
+  if ((loader = SDL_CreateThread(loadChunks, NULL)) == NULL)
+    {
+      fprintf(stderr, "Unable to start the chunk loading thread: %s\n", SDL_GetError());
+      exit(0);
+    }
+}
+
+/* loadChunks
+   The loading thread.  It waits for chunks to be asked for, has the map
+   read them, and hands them back.  It never changes the map, putting them
+   in is left for the game to do between cycles.
+*/
+int
+loadChunks(void *data)
+{
+  SDL_LockMutex(lock);
+  while (1)
+    {
+      ChunkJob job;
+
+      while (todo_n == 0 && !quitting) SDL_CondWait(todo_cond, lock);
+      if (quitting) break;
+
+      job = todo[todo_head];
+      todo_head = (todo_head + 1) % CHUNK_QUEUE;
+      todo_n--;
+      SDL_UnlockMutex(lock);
+
+      job.chunk = map_readChunk(job.l, job.cx, job.cy);
+
+      SDL_LockMutex(lock);
+      done[(done_head + done_n) % CHUNK_QUEUE] = job;
+      done_n++;
+      SDL_CondSignal(done_cond);
+    }
+  SDL_UnlockMutex(lock);
+
+  return 0;
+}
+
+/* findRange
+   Finds the range of chunks in a layer which have to be loaded for the
+   world to run around the camera, plus a margin of chunks.
+*/
+void
+findRange(int l, int margin, int *cx1, int *cy1, int *cx2, int *cy2)
+{
+  extern ChunkLayer *layers;
+  Rect view = cam_getViewRange(l);
+  int x1 = view.p1.x - CHUNK_NEED_X, y1 = view.p1.y - CHUNK_NEED_Y;
+  int x2 = view.p2.x + CHUNK_NEED_X, y2 = view.p2.y + CHUNK_NEED_Y;
+
+  *cx1 = map_realToMapX(x1 > 0 ? x1 : 0) / CHUNK_W - margin;
+  *cy1 = map_realToMapY(y1 > 0 ? y1 : 0) / CHUNK_H - margin;
+  *cx2 = map_realToMapX(x2 > 0 ? x2 : 0) / CHUNK_W + margin;
+  *cy2 = map_realToMapY(y2 > 0 ? y2 : 0) / CHUNK_H + margin;
+
+  if (*cx1 < 0) *cx1 = 0;
+  if (*cy1 < 0) *cy1 = 0;
+  if (*cx2 >= layers[l].cw) *cx2 = layers[l].cw - 1;
+  if (*cy2 >= layers[l].ch) *cy2 = layers[l].ch - 1;
+}
+
+/* requestRange
+   Asks the loading thread for the chunks around the camera, out to a
+   margin, which aren't loaded yet, as many as there's room for.  Returns
+   the number of chunks in the range which aren't loaded.
+*/
+int
+requestRange(int margin)
+{
+  extern int n_layers;
+  extern int n_pending;
+  int l, cx, cy, cx1, cy1, cx2, cy2, missing = 0, asked = 0;
+
+  SDL_LockMutex(lock);
+  for (l = 0; l < n_layers; l++)
+    {
+      findRange(l, margin, &cx1, &cy1, &cx2, &cy2);
+      for (cy = cy1; cy <= cy2; cy++)
+	{
+	  for (cx = cx1; cx <= cx2; cx++)
+	    {
+	      ChunkInfo *info = INFO_AT(l, cx, cy);
+	      ChunkJob *job;
+
+	      if (info->state == CHUNK_IN) continue;
+
+	      /* There's nothing to load in an empty chunk, only its
+		 objects to wake up */
+	      if (map_chunkTiles(l, cx, cy) == 0)
+		{
+		  info->state = CHUNK_IN;
+		  info->bytes = 0;
+		  wakeDormant(l, cx, cy);
+		  continue;
+		}
+
+	      missing++;
+	      if (info->state == CHUNK_LOADING || n_pending == CHUNK_QUEUE) continue;
+
+	      job = &todo[(todo_head + todo_n) % CHUNK_QUEUE];
+	      job->l = l;
+	      job->cx = cx;
+	      job->cy = cy;
+	      todo_n++;
+	      n_pending++;
+	      asked = 1;
+	      info->state = CHUNK_LOADING;
+	    }
+	}
+    }
+  if (asked) SDL_CondSignal(todo_cond);
+  SDL_UnlockMutex(lock);
+
+  return missing;
+}
+
+/* installLoaded
+   Puts the chunks which the loading thread is done with into the map, and
+   wakes up their objects.
+*/
+void
+installLoaded(void)
+{
+  extern int n_pending, loaded_bytes;
+  ChunkJob jobs[CHUNK_QUEUE];
+  int i, n = 0;
+
+  SDL_LockMutex(lock);
+  while (done_n > 0)
+    {
+      jobs[n++] = done[done_head];
+      done_head = (done_head + 1) % CHUNK_QUEUE;
+      done_n--;
+    }
+  SDL_UnlockMutex(lock);
+
+  for (i = 0; i < n; i++)
+    {
+      ChunkInfo *info = INFO_AT(jobs[i].l, jobs[i].cx, jobs[i].cy);
+
+      info->bytes = map_installChunk(jobs[i].l, jobs[i].cx, jobs[i].cy, jobs[i].chunk);
+      info->state = CHUNK_IN;
+      loaded_bytes += info->bytes;
+      n_pending--;
+      wakeDormant(jobs[i].l, jobs[i].cx, jobs[i].cy);
+    }
+}
+
+/* wakeDormant
+   Brings back the objects which were asleep in a chunk.
+*/
+void
+wakeDormant(int l, int cx, int cy)
+{
+  ChunkInfo *info = INFO_AT(l, cx, cy);
+  int i;
+
+  for (i = 0; i < info->n_dormant; i++)
+    {
+      if (info->dormant[i].obj != NULL)
+	obj_wakeObj(info->dormant[i].obj);
+      else
+	obj_spawnObj(l, info->dormant[i].pos, info->dormant[i].vel, info->dormant[i].type);
+    }
+  info->n_dormant = 0;
+}
+
+/* putToSleep
+   Takes the objects in a chunk that's about to be thrown out out of the
+   world, and keeps them in the chunk.  The player never goes to sleep.
+*/
+void
+putToSleep(int l, int cx, int cy)
+{
+  int x1 = map_mapToRealX(cx * CHUNK_W), y1 = map_mapToRealY(cy * CHUNK_H);
+  int x2 = x1 + map_mapToRealX(CHUNK_W) - 1, y2 = y1 + map_mapToRealY(CHUNK_H) - 1;
+  int sx, sy;
+
+  for (sy = obj_realToSectorY(y1); sy <= obj_realToSectorY(y2) && sy < obj_getLayerHeight(l); sy++)
+    {
+      for (sx = obj_realToSectorX(x1); sx <= obj_realToSectorX(x2) && sx < obj_getLayerWidth(l); sx++)
+	{
+	  Object *obj, *next;
+	  for (obj = obj_getObjList(l, sx, sy); obj != NULL; obj = next)
+	    {
+	      Point pos = obj_getObjPos(obj);
+	      Dormant *d;
+
+	      next = obj_getNextObj(obj);
+	      if (pos.x < x1 || pos.x > x2 || pos.y < y1 || pos.y > y2 ||
+		  obj->dead || obj == obj_getPlayerPtr())
+		continue;
+
+	      d = newDormant(l, pos);
+	      d->obj = obj;
+	      obj_sleepObj(obj);
+	    }
+	}
+    }
+}
+
+/* evictChunks
+   While there are more bytes of chunks loaded than the budget allows,
+   throws out the loaded chunk furthest from the camera which isn't near
+   it.
+*/
+void
+evictChunks(void)
+{
+  extern int n_layers, budget, loaded_bytes;
+
+  while (loaded_bytes > budget)
+    {
+      int l, cx, cy, best_l = -1, best_cx, best_cy;
+      long best_d = -1;
+
+      for (l = 0; l < n_layers; l++)
+	{
+	  int cx1, cy1, cx2, cy2;
+	  Rect view = cam_getViewRange(l);
+	  int mid_x = map_realToMapX((view.p1.x + view.p2.x) / 2) / CHUNK_W;
+	  int mid_y = map_realToMapY((view.p1.y + view.p2.y) / 2) / CHUNK_H;
+
+	  findRange(l, CHUNK_MARGIN, &cx1, &cy1, &cx2, &cy2);
+	  for (cy = 0; cy < layers[l].ch; cy++)
+	    {
+	      for (cx = 0; cx < layers[l].cw; cx++)
+		{
+		  long d = (long) (cx - mid_x) * (cx - mid_x) + (long) (cy - mid_y) * (cy - mid_y);
+
+		  if (INFO_AT(l, cx, cy)->state != CHUNK_IN ||
+		      (cx >= cx1 && cx <= cx2 && cy >= cy1 && cy <= cy2))
+		    continue;
+
+		  if (d > best_d)
+		    {
+		      best_d = d;
+		      best_l = l;
+		      best_cx = cx;
+		      best_cy = cy;
+		    }
+		}
+	    }
+	}
+
+      /* Everything loaded is needed */
+      if (best_l == -1) return;
+
+      putToSleep(best_l, best_cx, best_cy);
+      map_evictChunk(best_l, best_cx, best_cy);
+      INFO_AT(best_l, best_cx, best_cy)->state = CHUNK_OUT;
+      loaded_bytes -= INFO_AT(best_l, best_cx, best_cy)->bytes;
+    }
+}
+
+/* chk_update
+   Called once a cycle after the camera moves.  Puts in the chunks that have
+   been loaded, waits for any which the world can't run without, asks for
+   the ones it will need soon, and throws out the ones over the budget.
+*/
+void
+chk_update(void)
+{
+  installLoaded();
+  while (requestRange(0) > 0)
+    {
+      SDL_LockMutex(lock);
+      while (done_n == 0) SDL_CondWait(done_cond, lock);
+      SDL_UnlockMutex(lock);
+      installLoaded();
+    }
+
+  requestRange(CHUNK_MARGIN);
+  evictChunks();
+}
+
+/* chk_settle
+   Waits for the loading thread to finish the chunks it was asked for, and
+   puts them in, so it's left alone with nothing to do.  It stays that way
+   until chk_update() is called again.
+*/
+void
+chk_settle(void)
+{
+  extern int n_pending;
+
+  while (n_pending > 0)
+    {
+      SDL_LockMutex(lock);
+      while (done_n == 0) SDL_CondWait(done_cond, lock);
+      SDL_UnlockMutex(lock);
+      installLoaded();
+    }
+}
+
+/* chk_dropChunk
+   Throws a chunk out while the map is running, without putting its
+   objects to sleep, so that it's read again like any other when it's
+   needed.  For changing a map, once the loading thread has settled.
+*/
+void
+chk_dropChunk(int l, int cx, int cy)
+{
+  extern int loaded_bytes;
+  ChunkInfo *info = INFO_AT(l, cx, cy);
+
+  if (info->state != CHUNK_IN) return;
+  map_evictChunk(l, cx, cy);
+  loaded_bytes -= info->bytes;
+  info->bytes = 0;
+  info->state = CHUNK_OUT;
+}
+
+/* chk_free
+   Stops the loading thread and frees everything the chunk module has,
+   except the loaded chunks, which belong to the map.
+*/
+void
+chk_free(void)
+{
+  extern int n_layers;
+  extern ChunkLayer *layers;
+  extern SDL_Thread *loader;
+  int l, i;
+
+  if (loader != NULL)
+    {
+      SDL_LockMutex(lock);
+      quitting = 1;
+      SDL_CondSignal(todo_cond);
+      SDL_UnlockMutex(lock);
+      SDL_WaitThread(loader, NULL);
+      loader = NULL;
+
+      /* Chunks which were loaded but never put in */
+      for (; done_n > 0; done_n--, done_head = (done_head + 1) % CHUNK_QUEUE)
+	if (done[done_head].chunk != NULL) map_freeChunk(done[done_head].chunk);
+
+      SDL_DestroyCond(todo_cond);
+      SDL_DestroyCond(done_cond);
+      SDL_DestroyMutex(lock);
+    }
+
+  for (l = 0; l < n_layers; l++)
+    {
+      for (i = 0; i < layers[l].cw * layers[l].ch; i++)
+	{
+	  ChunkInfo *info = &layers[l].info[i];
+	  int j;
+
+	  for (j = 0; j < info->n_dormant; j++)
+	    if (info->dormant[j].obj != NULL) obj_freeSleepingObj(info->dormant[j].obj);
+	  free(info->dormant);
+	}
+      dyn_1dArrayFree(layers[l].info);
+    }
+  dyn_1dArrayFree(layers);
+}
@@ -0,0 +1,78 @@
+#ifndef __DEFINED_CHUNK_H
+#define __DEFINED_CHUNK_H
+
+#include "defs.h"
+#include "map.h"
+#include "object.h"
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
+/* The chunk module streams the map in and out around the camera.  A
+   background thread reads the chunks the camera is getting close to
+   straight out of the area, which keeps each chunk's tiles together, and
+   builds their static geometry.  The chunks furthest from the camera are
+   thrown out when there are more loaded than the memory budget allows.  Objects in a chunk that's thrown out go
+   dormant, and come back just as they were when it's loaded again.  The
+   objects an area starts with sleep as just their type, position and
+   velocity until their chunk is first loaded.
+
+   Active tiles aren't kept like that: their states are thrown out with
+   their chunk, and loading it again gives them new attributes from their
+   type's init_atts(). */
+
+/* How many bytes of chunks can be loaded before they start getting thrown
+   out, unless it's set otherwise */
+#define CHUNK_BUDGET (4 * 1024 * 1024)
+
+/* How far around the camera chunks have to be loaded before the world can
+   run, in real coordinates.  Objects and tiles run this far away: */
+#define CHUNK_NEED_X (SECTOR_W * (SECTOR_X_RANGE + 1))
+#define CHUNK_NEED_Y (SECTOR_H * (SECTOR_Y_RANGE + 1))
+
+/* How many chunks further than that are loaded ahead of time */
+#define CHUNK_MARGIN 1
+
+/* The most chunks which can be waiting to be loaded at once */
+#define CHUNK_QUEUE 64
+
+enum chunk_states {CHUNK_OUT, CHUNK_LOADING, CHUNK_IN};
+
+/* An object in a chunk that isn't loaded, packed away */
+typedef struct dormant_struct
+{
+  Object *obj;        /* The object itself, taken out of the world, or NULL
+			 if it hasn't been made yet */
+  int type;           /* What to make it from if it hasn't */
+  Point pos;
+  Velocity vel;
+} Dormant;
+
+/* What's known about a chunk whether it's loaded or not */
+typedef struct chunk_info_struct
+{
+  int state;
+  int bytes;          /* How much memory it takes up when it's loaded */
+  int n_dormant, max_dormant;
+  Dormant *dormant;   /* Its dormant objects */
+} ChunkInfo;
+
+/* A chunk to load or one that's been loaded, passed between the game and
+   the loading thread */
+typedef struct chunk_job_struct
+{
+  int l, cx, cy;
+  Chunk *chunk;
+} ChunkJob;
+
+extern void chk_init(int n_layers);
+extern void chk_initLayer(int l, int cw, int ch);
+extern void chk_addDormant(int l, Point pos, Velocity vel, int type);
+extern void chk_setBudget(int bytes);
+extern void chk_start(void);
+extern void chk_update(void);
+extern void chk_settle(void);
+extern void chk_dropChunk(int l, int cx, int cy);
+extern void chk_free(void);
+
+#endif /* __DEFINED_CHUNK_H */
@@ -14,6 +14,32 @@ static Point closestPointOnLine(Point p, Line l);
 static int getLineCollision(Line mov_line, Line stat_line, Velocity v, Time dt);
 static int testRectOverlap(Rect r1, Rect r2);
 static Collision *findSolidCollision(Object *obj, Collision *c);
+static Collision *newCircleCollision(Bound *a, Bound *b, Object *other_obj, Point *tile_pos, Vector n, float depth);
+static int circleLineCollision(Circle c, Line l, Velocity v, Time dt, Vector *n, float *depth);
+static int circleRectCollision(Circle c, Rect rect, Velocity v, Time dt, Vector *n, float *depth);
+static int circleCircleCollision(Circle a, Circle b, Velocity v, Time dt, Vector *n, float *depth);
+static Collision *getBoundCollision(Bound *a_b, Point a_top_left, Bound *b_b, Point b_top_left, Velocity a_v, Time dt, Object *other_obj, Point *tile_pos);
+static Collision *getSegmentCollision(Object *obj, Segment *seg, Time dt);
+static float cross(float ax, float ay, float bx, float by);
+static int castLine(Line path, Line l, float *t);
+static int castRect(Line path, Rect r, float *t);
+static int castCircle(Line path, Circle c, float *t);
+static int castBounds(Line path, Bound *b, Point top_left, float *t);
+static Contact *findContact(Object *obj, int type, Object *other_obj, Point *tile_pos);
+static void rememberContact(Object *obj, Collision *c, Vector n);
+static void freeContact(Contact *c);
+static int contactIsThere(Contact *c, Time dt);
+static void sendImpulses(Object *obj, int type, Object *other_obj, Point *tile_pos, Vector impulse_a, Vector impulse_b);
+
+/* The contacts remembered from the last frame, hashed by object */
+static Contact *contacts[CONTACT_BUCKETS];
+#define CONTACT_HASH(obj) ((((unsigned long) (obj)) >> 4) % CONTACT_BUCKETS)
+
+/* The number of the current frame, for dating contacts */
+static int contact_frame = 0;
+
+/* Stamped on segments of the static geometry once they've been tested */
+static int seg_stamp = 0;
 
 
 /* ccw
@@ -265,11 +291,26 @@ newCollision(Bound *a, Bound *b, Object *other_obj, Point *tile_pos, int point_c
     }
 
   new_collision->point_collided = point_collided;
+  new_collision->n.x = new_collision->n.y = 0;
+  new_collision->depth = 0;
   new_collision->next = NULL;
 
   return new_collision;
 }
 
+/* newCircleCollision
+   Allocates and initializes a collision involving a circle, which already
+   knows its normal and depth.
+*/
+Collision *
+newCircleCollision(Bound *a, Bound *b, Object *other_obj, Point *tile_pos, Vector n, float depth)
+{
+  Collision *new_collision = newCollision(a, b, other_obj, tile_pos, -1);
+  new_collision->n = n;
+  new_collision->depth = depth;
+  return new_collision;
+}
+
 /* closestPointOnLine
    Given a point and a line segment, find the closest point on that line
    segment.
@@ -373,6 +414,656 @@ testRectOverlap(Rect r1, Rect r2)
 
 }
 
+/* circleLineCollision
+   Given a moving circle and a stationary line, check if the circle ran into
+   the line from the side its normal points to.  Everything is compared as
+   squared distances or distances along the line's normal, so a square root is
+   only taken when the circle hits one of the line's endpoints.  If there was
+   a collision, n is set to the direction the circle has to move to get out
+   of it, and depth to how far.
+*/
+int
+circleLineCollision(Circle c, Line l, Velocity v, Time dt, Vector *n, float *depth)
+{
+
+  Vector ln = normal(l);
+  Vector p, c0;
+  float dx, dy, len2, s, s0, t;
+  float r = c.r;
+
+  /* Exit now if the circle isn't moving towards the front of the line */
+  if (dot(v, ln) >= 0) return 0;
+
+  dx = l.p2.x - l.p1.x;
+  dy = l.p2.y - l.p1.y;
+  len2 = dx * dx + dy * dy;
+  if (len2 == 0) return 0;
+
+  /* Where the center was before it moved: */
+  c0.x = c.p.x - v.x * dt;
+  c0.y = c.p.y - v.y * dt;
+
+  /* The distances of the center from the line before and after moving: */
+  s = (c.p.x - l.p1.x) * ln.x + (c.p.y - l.p1.y) * ln.y;
+  s0 = (c0.x - l.p1.x) * ln.x + (c0.y - l.p1.y) * ln.y;
+
+  /* The center has to have started in front of the line and ended up closer
+     to it than the radius: */
+  if (s0 < 0 || s >= r) return 0;
+
+  /* Find where the center was when the circle first touched the line, so
+     that fast circles don't pass through the ends of short lines: */
+  if (s0 > r)
+    {
+      float a = (s0 - r) / (s0 - s);
+      p.x = c0.x + a * (c.p.x - c0.x);
+      p.y = c0.y + a * (c.p.y - c0.y);
+    }
+  else
+    {
+      p.x = c.p.x;
+      p.y = c.p.y;
+    }
+
+  /* If that point is alongside the line, the circle hit its face: */
+  t = ((p.x - l.p1.x) * dx + (p.y - l.p1.y) * dy) / len2;
+  if (t >= 0 && t <= 1)
+    {
+      *n = ln;
+      *depth = r - s;
+      return 1;
+    }
+
+  /* Otherwise it can only have hit the nearest endpoint: */
+  {
+    Point e = (t < 0) ? l.p1 : l.p2;
+    float ex = c.p.x - e.x, ey = c.p.y - e.y;
+    float d2 = ex * ex + ey * ey;
+    float d;
+
+    if (d2 >= r * r) return 0;
+
+    d = sqrtf(d2);
+    if (d == 0)
+      {
+	*n = ln;
+	*depth = r;
+      }
+    else
+      {
+	n->x = ex / d;
+	n->y = ey / d;
+	*depth = r - d;
+      }
+    return 1;
+  }
+}
+
+/* circleRectCollision
+   Given a moving circle and a stationary rectangle, check if they
+   collided.  If they did, n and depth are set like in circleLineCollision.
+*/
+int
+circleRectCollision(Circle c, Rect rect, Velocity v, Time dt, Vector *n, float *depth)
+{
+
+  float r = c.r;
+  float qx, qy, dx, dy, d2;
+
+  /* Find the point in the rectangle closest to the circle's center: */
+  qx = (c.p.x < rect.p1.x) ? rect.p1.x : ((c.p.x > rect.p2.x) ? rect.p2.x : c.p.x);
+  qy = (c.p.y < rect.p1.y) ? rect.p1.y : ((c.p.y > rect.p2.y) ? rect.p2.y : c.p.y);
+  dx = c.p.x - qx;
+  dy = c.p.y - qy;
+  d2 = dx * dx + dy * dy;
+
+  /* The center is outside the rectangle, but the circle overlaps it: */
+  if (d2 > 0 && d2 < r * r)
+    {
+      float d = sqrtf(d2);
+      n->x = dx / d;
+      n->y = dy / d;
+      *depth = r - d;
+      return 1;
+    }
+
+  /* The center is inside the rectangle.  Push it back out of the side it
+     most likely came in through, which is the nearest side facing against
+     its velocity: */
+  if (d2 == 0)
+    {
+      float d, best = -1;
+
+      if (v.x >= 0 && ((d = c.p.x - rect.p1.x) < best || best < 0))
+	{ best = d; n->x = -1; n->y = 0; }
+      if (v.x <= 0 && ((d = rect.p2.x - c.p.x) < best || best < 0))
+	{ best = d; n->x = 1; n->y = 0; }
+      if (v.y >= 0 && ((d = c.p.y - rect.p1.y) < best || best < 0))
+	{ best = d; n->x = 0; n->y = -1; }
+      if (v.y <= 0 && ((d = rect.p2.y - c.p.y) < best || best < 0))
+	{ best = d; n->x = 0; n->y = 1; }
+
+      *depth = best + r;
+      return 1;
+    }
+
+  /* No overlap now, but a fast circle may have passed all the way through the
+     rectangle.  Check if the path of its center crossed the rectangle grown
+     by the radius: */
+  {
+    float lo[2], hi[2], from[2], dist[2];
+    float t_in = 0, t_out = 1;
+    int i, axis = -1;
+
+    lo[0] = rect.p1.x - r; hi[0] = rect.p2.x + r;
+    lo[1] = rect.p1.y - r; hi[1] = rect.p2.y + r;
+    dist[0] = v.x * dt; dist[1] = v.y * dt;
+    from[0] = c.p.x - dist[0]; from[1] = c.p.y - dist[1];
+
+    for (i = 0; i < 2; i++)
+      {
+	if (dist[i] == 0)
+	  {
+	    if (from[i] < lo[i] || from[i] > hi[i]) return 0;
+	  }
+	else
+	  {
+	    float t1 = (lo[i] - from[i]) / dist[i];
+	    float t2 = (hi[i] - from[i]) / dist[i];
+	    if (t1 > t2) { float temp = t1; t1 = t2; t2 = temp; }
+	    if (t1 > t_in) { t_in = t1; axis = i; }
+	    if (t2 < t_out) t_out = t2;
+	    if (t_in > t_out) return 0;
+	  }
+      }
+
+    /* It has to have entered the rectangle during this move: */
+    if (axis == -1) return 0;
+
+    n->x = n->y = 0;
+    if (axis == 0)
+      {
+	n->x = (dist[0] > 0) ? -1 : 1;
+	*depth = (dist[0] > 0) ? c.p.x - lo[0] : hi[0] - c.p.x;
+      }
+    else
+      {
+	n->y = (dist[1] > 0) ? -1 : 1;
+	*depth = (dist[1] > 0) ? c.p.y - lo[1] : hi[1] - c.p.y;
+      }
+    return 1;
+  }
+}
+
+/* circleCircleCollision
+   Given a moving circle a and a stationary circle b, check if they
+   collided.  If they did, n and depth are set like in circleLineCollision.
+*/
+int
+circleCircleCollision(Circle a, Circle b, Velocity v, Time dt, Vector *n, float *depth)
+{
+
+  float r = a.r + b.r;
+  float dx = a.p.x - b.p.x, dy = a.p.y - b.p.y;
+  float d2 = dx * dx + dy * dy;
+
+  /* The circles overlap: */
+  if (d2 < r * r)
+    {
+      float d = sqrtf(d2);
+      if (d == 0)
+	{
+	  /* Right on top of each other, just back a up: */
+	  if (v.x == 0 && v.y == 0)
+	    {
+	      n->x = 0;
+	      n->y = -1;
+	    }
+	  else
+	    {
+	      n->x = -v.x;
+	      n->y = -v.y;
+	      *n = normalize(*n);
+	    }
+	}
+      else
+	{
+	  n->x = dx / d;
+	  n->y = dy / d;
+	}
+      *depth = r - d;
+      return 1;
+    }
+
+  /* No overlap now, but a may have passed through b.  Find the point on the
+     path of a's center which was closest to b's center: */
+  {
+    float px, py, mx, my, m2, t;
+    float from_x = a.p.x - v.x * dt, from_y = a.p.y - v.y * dt;
+
+    mx = a.p.x - from_x;
+    my = a.p.y - from_y;
+    m2 = mx * mx + my * my;
+    if (m2 == 0) return 0;
+
+    /* a has to have started outside of b: */
+    if ((from_x - b.p.x) * (from_x - b.p.x) + (from_y - b.p.y) * (from_y - b.p.y) < r * r)
+      return 0;
+
+    t = ((b.p.x - from_x) * mx + (b.p.y - from_y) * my) / m2;
+    if (t <= 0 || t >= 1) return 0;
+
+    px = from_x + t * mx - b.p.x;
+    py = from_y + t * my - b.p.y;
+    if (px * px + py * py >= r * r) return 0;
+
+    if (px == 0 && py == 0)
+      {
+	n->x = -mx;
+	n->y = -my;
+      }
+    else
+      {
+	n->x = px;
+	n->y = py;
+      }
+    *n = normalize(*n);
+    *depth = r - (dx * n->x + dy * n->y);
+    return 1;
+  }
+}
+
+/* getBoundCollision
+   Given one boundary from each of two things, find a collision between them.
+   The boundaries are relative to the top left points given, and a_v is a's
+   velocity relative to b.
+
+   Returns NULL if no collision was found.
+*/
+Collision *
+getBoundCollision(Bound *a_b, Point a_top_left, Bound *b_b, Point b_top_left, Velocity a_v, Time dt, Object *other_obj, Point *tile_pos)
+{
+
+  int point_collided = -1;
+
+  /* Circle collisions find the normal and depth of the collision: */
+  Vector n;
+  float depth;
+
+  /* If b's boundary is a line and a is moving in a direction which
+     can collide with the line: */
+  if (b_b->type == LINE &&
+      (dot(a_v, normal(b_b->b.line)) < 0))
+    {
+
+      /* Map the line into real coordinates: */
+      Line b_line;
+      b_line.p1.x = b_b->b.line.p1.x + b_top_left.x;
+      b_line.p1.y = b_b->b.line.p1.y + b_top_left.y;
+      b_line.p2.x = b_b->b.line.p2.x + b_top_left.x;
+      b_line.p2.y = b_b->b.line.p2.y + b_top_left.y;
+      
+      /* If a's boundary is a line and this line's normal is within
+	 90 degrees of a's velocity: */
+      if (a_b->type == LINE &&
+	  (dot(a_v, normal(a_b->b.line)) > 0))
+	{
+	  
+	  /* Map the line into real coordinates: */
+	  Line a_line;
+	  a_line.p1.x = a_b->b.line.p1.x + a_top_left.x;
+	  a_line.p1.y = a_b->b.line.p1.y + a_top_left.y;
+	  a_line.p2.x = a_b->b.line.p2.x + a_top_left.x;
+	  a_line.p2.y = a_b->b.line.p2.y + a_top_left.y;
+
+	  /* See if there was a collision between the two lines,
+	     and return if there was one: */
+	  point_collided = getLineCollision(a_line, b_line, a_v, dt);
+	  if (point_collided != -1)
+	    {
+	      Bound a, b;
+	      a.type = LINE;
+	      a.b.line = a_line;
+	      b.type = LINE;
+	      b.b.line = b_line;
+	      return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
+	    }
+	}
+      /* If a's boundary is a rect: */
+      else if (a_b->type == RECT)
+	{
+	  Line a_line;
+
+	  /* Check for collisions as if the rectangle was composed
+	     of 4 lines: */
+
+	  /* Check top and bottom before sides, because I think that
+	     there will be collisions with the objects' bottoms more
+	     frequently than the sides because of gravity: */
+
+	  /* If a has vertical velocity check its top or
+	     bottom: */
+	  if (a_v.y != 0) 
+	    {
+	      /* If a is moving down, check its bottom: */
+	      if (a_v.y > 0)
+		{
+		  a_line.p1.x = a_b->b.rect.p2.x + a_top_left.x;
+		  a_line.p1.y = a_b->b.rect.p2.y + a_top_left.y;
+		  a_line.p2.x = a_b->b.rect.p1.x + a_top_left.x;
+		  a_line.p2.y = a_line.p1.y;
+		  
+		}
+	      else if (a_v.y < 0)
+		{
+		  a_line.p1.x = a_b->b.rect.p1.x + a_top_left.x;
+		  a_line.p1.y = a_b->b.rect.p1.y + a_top_left.y;
+		  a_line.p2.x = a_b->b.rect.p2.x + a_top_left.x;
+		  a_line.p2.y = a_line.p1.y;
+		}
+	      /* Check for collision: */
+	      point_collided = getLineCollision(a_line, b_line, a_v, dt);
+	      if (point_collided != -1)
+		{
+		  Bound a, b;
+		  a.type = LINE;
+		  a.b.line = a_line;
+		  b.type = LINE;
+		  b.b.line = b_line;
+		  return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
+		}
+	    }
+	  /* If a has horizontal velocity, check its sides: */
+	  if (a_v.x != 0)
+	    {
+	      /* If a is moving right, check its right side:*/
+	      if (a_v.x > 0)
+		{
+		  a_line.p1.x = a_b->b.rect.p2.x + a_top_left.x;
+		  a_line.p1.y = a_b->b.rect.p1.y + a_top_left.y;
+		  a_line.p2.x = a_line.p1.x;
+		  a_line.p2.y = a_b->b.rect.p2.y + a_top_left.y;
+		}
+	      /* If it's moving left, check its left side: */
+	      else if (a_v.x < 0)
+		{
+		  a_line.p1.x = a_b->b.rect.p1.x + a_top_left.x;
+		  a_line.p1.y = a_b->b.rect.p2.y + a_top_left.y;
+		  a_line.p2.x = a_line.p1.x;
+		  a_line.p2.y = a_b->b.rect.p1.y + a_top_left.y;
+		}
+	      /* Check for collision: */
+	      point_collided = getLineCollision(a_line, b_line, a_v, dt);
+	      if (point_collided != -1)
+		{
+		  Bound a, b;
+		  a.type = LINE;
+		  a.b.line = a_line;
+		  b.type = LINE;
+		  b.b.line = b_line;
+		  return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
+		}
+	    }
+	}
+      /* If a's boundary is a circle: */
+      else if (a_b->type == CIRCLE)
+	{
+	  Circle a_circle;
+	  a_circle.p.x = a_b->b.circle.p.x + a_top_left.x;
+	  a_circle.p.y = a_b->b.circle.p.y + a_top_left.y;
+	  a_circle.r = a_b->b.circle.r;
+
+	  if (circleLineCollision(a_circle, b_line, a_v, dt, &n, &depth))
+	    {
+	      Bound a, b;
+	      a.type = CIRCLE;
+	      a.b.circle = a_circle;
+	      b.type = LINE;
+	      b.b.line = b_line;
+	      return (newCircleCollision(&a, &b, other_obj, tile_pos, n, depth));
+	    }
+	}
+    }
+
+  /* If b's boundary is a rectangle: */
+  else if (b_b->type == RECT)
+    {
+
+      /* If a's boundary is a rectangle too: */
+      if (a_b->type == RECT)
+	{
+	  Rect a_rect, b_rect;
+
+	  /* Map the rectangles into real coordinates for comparison:
+	   */
+	  b_rect.p1.x = b_b->b.rect.p1.x + b_top_left.x;
+	  b_rect.p1.y = b_b->b.rect.p1.y + b_top_left.y;
+	  b_rect.p2.x = b_b->b.rect.p2.x + b_top_left.x;
+	  b_rect.p2.y = b_b->b.rect.p2.y + b_top_left.y;
+
+	  a_rect.p1.x = a_b->b.rect.p1.x + a_top_left.x;
+	  a_rect.p1.y = a_b->b.rect.p1.y + a_top_left.y;
+	  a_rect.p2.x = a_b->b.rect.p2.x + a_top_left.x;
+	  a_rect.p2.y = a_b->b.rect.p2.y + a_top_left.y;
+
+	  /* If the two boundaries are rectangles, return a
+	     collision if they simply overlap.  Collisions are
+	     simpler this way, but two small rectangles are likely to
+	     pass through each other at high speeds, so we just assume
+	     that the rectangles are fairly big: */
+	  if (testRectOverlap(a_rect, b_rect))
+	    {
+	      Bound a, b;
+	      a.type = RECT;
+	      a.b.rect = a_rect;
+	      b.type = RECT;
+	      b.b.rect = b_rect;
+	      return (newCollision(&a, &b, other_obj, tile_pos, 0));
+	    }
+	}
+
+      /* If a's boundary is a line and its normal is within 90 degrees
+	 of a's velocity: */
+      else if (a_b->type == LINE &&
+	       (dot(a_v, normal(a_b->b.line)) > 0))
+	{
+
+	  Line b_line;
+
+	  /* Map this object boundary into real coordinates */
+	  Line a_line;
+	  a_line.p1.x = a_b->b.line.p1.x + a_top_left.x;
+	  a_line.p1.y = a_b->b.line.p1.y + a_top_left.y;
+	  a_line.p2.x = a_b->b.line.p2.x + a_top_left.x;
+	  a_line.p2.y = a_b->b.line.p2.y + a_top_left.y;
+
+	  /* Check for collisions as if the b's rectangle is made of
+	     of 4 lines: */
+
+	  /* Check top and bottom before sides, because I think that
+	     there will be collisions with the tiles' tops more
+	     frequently than the sides because of gravity: */
+
+	  /* If a has vertical velocity, check b's top
+	     or bottom: */
+	  if (a_v.y != 0) {
+	  /* If a is moving down, check b's top: */
+	    if (a_v.y > 0)
+	      {
+		b_line.p1.x = b_b->b.rect.p1.x + b_top_left.x;
+		b_line.p1.y = b_b->b.rect.p1.y + b_top_left.y;
+		b_line.p2.x = b_b->b.rect.p2.x + b_top_left.x;
+		b_line.p2.y = b_line.p1.y;
+		
+	      }
+	    /* If a is moving up, check b's bottom: */
+	    else if (a_v.y < 0)
+	      {
+		b_line.p1.x = b_b->b.rect.p2.x + b_top_left.x;
+		b_line.p1.y = b_b->b.rect.p2.y + b_top_left.y;
+		b_line.p2.x = b_b->b.rect.p1.x + b_top_left.x;
+		b_line.p2.y = b_line.p1.y;
+	      }
+
+	    /* Check for collision: */
+	    point_collided = getLineCollision(a_line, b_line, a_v, dt);
+	    if (point_collided != -1)
+	      {
+		Bound a, b;
+		a.type = LINE;
+		a.b.line = a_line;
+		b.type = LINE;
+		b.b.line = b_line;
+		return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
+	      }
+	    
+	  }
+
+	  /* If a has horizontal velocity, check the sides: */
+	  if (a_v.x != 0) {
+	    /* If a is moving right, check b's left: */
+	    if (a_v.x > 0)
+	      {
+		b_line.p1.x = b_b->b.rect.p1.x + b_top_left.x;
+		b_line.p1.y = b_b->b.rect.p2.y + b_top_left.y;
+		b_line.p2.x = b_line.p1.x;
+		b_line.p2.y = b_b->b.rect.p1.y + b_top_left.y;
+	      }
+	    /* If a is moving left, check b's right: */
+	    else if (a_v.x < 0)
+	      {
+		b_line.p1.x = b_b->b.rect.p2.x + b_top_left.x;
+		b_line.p1.y = b_b->b.rect.p1.y + b_top_left.y;
+		b_line.p2.x = b_line.p1.x;
+		b_line.p2.y = b_b->b.rect.p2.y + b_top_left.y;
+	      }
+	    /* Check for collision: */
+	    point_collided = getLineCollision(a_line, b_line, a_v, dt);
+	    if (point_collided != -1)
+	      {
+		Bound a, b;
+		a.type = LINE;
+		a.b.line = a_line;
+		b.type = LINE;
+		b.b.line = b_line;
+		return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
+	      }
+	  }
+
+	}
+
+      /* If a's boundary is a circle: */
+      else if (a_b->type == CIRCLE)
+	{
+	  Circle a_circle;
+	  Rect b_rect;
+
+	  a_circle.p.x = a_b->b.circle.p.x + a_top_left.x;
+	  a_circle.p.y = a_b->b.circle.p.y + a_top_left.y;
+	  a_circle.r = a_b->b.circle.r;
+
+	  b_rect.p1.x = b_b->b.rect.p1.x + b_top_left.x;
+	  b_rect.p1.y = b_b->b.rect.p1.y + b_top_left.y;
+	  b_rect.p2.x = b_b->b.rect.p2.x + b_top_left.x;
+	  b_rect.p2.y = b_b->b.rect.p2.y + b_top_left.y;
+
+	  if (circleRectCollision(a_circle, b_rect, a_v, dt, &n, &depth))
+	    {
+	      Bound a, b;
+	      a.type = CIRCLE;
+	      a.b.circle = a_circle;
+	      b.type = RECT;
+	      b.b.rect = b_rect;
+	      return (newCircleCollision(&a, &b, other_obj, tile_pos, n, depth));
+	    }
+	}
+    }
+
+  /* If b's boundary is a circle: */
+  else if (b_b->type == CIRCLE)
+    {
+      Circle b_circle;
+      Velocity b_v;
+
+      b_circle.p.x = b_b->b.circle.p.x + b_top_left.x;
+      b_circle.p.y = b_b->b.circle.p.y + b_top_left.y;
+      b_circle.r = b_b->b.circle.r;
+
+      /* If a's boundary is not a circle, it's easier to pretend that b's
+	 circle is the one moving and turn the normal around afterwards: */
+      b_v.x = -a_v.x;
+      b_v.y = -a_v.y;
+
+      /* If a's boundary is a circle too: */
+      if (a_b->type == CIRCLE)
+	{
+	  Circle a_circle;
+	  a_circle.p.x = a_b->b.circle.p.x + a_top_left.x;
+	  a_circle.p.y = a_b->b.circle.p.y + a_top_left.y;
+	  a_circle.r = a_b->b.circle.r;
+
+	  if (circleCircleCollision(a_circle, b_circle, a_v, dt, &n, &depth))
+	    {
+	      Bound a, b;
+	      a.type = CIRCLE;
+	      a.b.circle = a_circle;
+	      b.type = CIRCLE;
+	      b.b.circle = b_circle;
+	      return (newCircleCollision(&a, &b, other_obj, tile_pos, n, depth));
+	    }
+	}
+
+      /* If a's boundary is a line and its normal is within 90 degrees
+	 of a's velocity: */
+      else if (a_b->type == LINE &&
+	       (dot(a_v, normal(a_b->b.line)) > 0))
+	{
+	  Line a_line;
+	  a_line.p1.x = a_b->b.line.p1.x + a_top_left.x;
+	  a_line.p1.y = a_b->b.line.p1.y + a_top_left.y;
+	  a_line.p2.x = a_b->b.line.p2.x + a_top_left.x;
+	  a_line.p2.y = a_b->b.line.p2.y + a_top_left.y;
+
+	  if (circleLineCollision(b_circle, a_line, b_v, dt, &n, &depth))
+	    {
+	      Bound a, b;
+	      a.type = LINE;
+	      a.b.line = a_line;
+	      b.type = CIRCLE;
+	      b.b.circle = b_circle;
+	      n.x = -n.x;
+	      n.y = -n.y;
+	      return (newCircleCollision(&a, &b, other_obj, tile_pos, n, depth));
+	    }
+	}
+
+      /* If a's boundary is a rectangle: */
+      else if (a_b->type == RECT)
+	{
+	  Rect a_rect;
+	  a_rect.p1.x = a_b->b.rect.p1.x + a_top_left.x;
+	  a_rect.p1.y = a_b->b.rect.p1.y + a_top_left.y;
+	  a_rect.p2.x = a_b->b.rect.p2.x + a_top_left.x;
+	  a_rect.p2.y = a_b->b.rect.p2.y + a_top_left.y;
+
+	  if (circleRectCollision(b_circle, a_rect, b_v, dt, &n, &depth))
+	    {
+	      Bound a, b;
+	      a.type = RECT;
+	      a.b.rect = a_rect;
+	      b.type = CIRCLE;
+	      b.b.circle = b_circle;
+	      n.x = -n.x;
+	      n.y = -n.y;
+	      return (newCircleCollision(&a, &b, other_obj, tile_pos, n, depth));
+	    }
+	}
+    }
+
+  /* No collision found, return NULL */
+  return NULL;
+}
+
 /* col_GetCollision
    Given an object and a tile or an object, find a collision.
 
@@ -384,7 +1075,6 @@ col_getCollision(Object *obj, Object *other_obj, Point *tile_pos, Time dt)
 
   Bound *a_b, *a_bounds, *b_bounds;
   Point a_top_left, b_top_left;
-  int point_collided = -1;
   int type;
   Velocity a_v = obj_getObjVel(obj);
 
@@ -425,264 +1115,9 @@ col_getCollision(Object *obj, Object *other_obj, Point *tile_pos, Time dt)
       Bound *b_b = b_bounds;
       while (b_b != NULL)
 	{
-	  
-	  /* If b's boundary is a line and a is moving in a direction which
-	     can collide with the line: */
-	  if (b_b->type == LINE &&
-	      (dot(a_v, normal(b_b->b.line)) < 0))
-	    {
-
-	      /* Map the line into real coordinates: */
-	      Line b_line;
-	      b_line.p1.x = b_b->b.line.p1.x + b_top_left.x;
-	      b_line.p1.y = b_b->b.line.p1.y + b_top_left.y;
-	      b_line.p2.x = b_b->b.line.p2.x + b_top_left.x;
-	      b_line.p2.y = b_b->b.line.p2.y + b_top_left.y;
-	      
-	      /* If a's boundary is a line and this line's normal is within
-		 90 degrees of a's velocity: */
-	      if (a_b->type == LINE &&
-		  (dot(a_v, normal(a_b->b.line)) > 0))
-		{
-		  
-		  /* Map the line into real coordinates: */
-		  Line a_line;
-		  a_line.p1.x = a_b->b.line.p1.x + a_top_left.x;
-		  a_line.p1.y = a_b->b.line.p1.y + a_top_left.y;
-		  a_line.p2.x = a_b->b.line.p2.x + a_top_left.x;
-		  a_line.p2.y = a_b->b.line.p2.y + a_top_left.y;
-
-		  /* See if there was a collision between the two lines,
-		     and return if there was one: */
-		  point_collided = getLineCollision(a_line, b_line, a_v, dt);
-		  if (point_collided != -1)
-		    {
-		      Bound a, b;
-		      a.type = LINE;
-		      a.b.line = a_line;
-		      b.type = LINE;
-		      b.b.line = b_line;
-		      return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
-		    }
-		}
-	      /* If a's boundary is a rect: */
-	      else if (a_b->type == RECT)
-		{
-		  Line a_line;
-
-		  /* Check for collisions as if the rectangle was composed
-		     of 4 lines: */
-
-		  /* Check top and bottom before sides, because I think that
-		     there will be collisions with the objects' bottoms more
-		     frequently than the sides because of gravity: */
-
-		  /* If a has vertical velocity check its top or
-		     bottom: */
-		  if (a_v.y != 0) 
-		    {
-		      /* If a is moving down, check its bottom: */
-		      if (a_v.y > 0)
-			{
-			  a_line.p1.x = a_b->b.rect.p2.x + a_top_left.x;
-			  a_line.p1.y = a_b->b.rect.p2.y + a_top_left.y;
-			  a_line.p2.x = a_b->b.rect.p1.x + a_top_left.x;
-			  a_line.p2.y = a_line.p1.y;
-			  
-			}
-		      else if (a_v.y < 0)
-			{
-			  a_line.p1.x = a_b->b.rect.p1.x + a_top_left.x;
-			  a_line.p1.y = a_b->b.rect.p1.y + a_top_left.y;
-			  a_line.p2.x = a_b->b.rect.p2.x + a_top_left.x;
-			  a_line.p2.y = a_line.p1.y;
-			}
-		      /* Check for collision: */
-		      point_collided = getLineCollision(a_line, b_line, a_v, dt);
-		      if (point_collided != -1)
-			{
-			  Bound a, b;
-			  a.type = LINE;
-			  a.b.line = a_line;
-			  b.type = LINE;
-			  b.b.line = b_line;
-			  return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
-			}
-		    }
-		  /* If a has horizontal velocity, check its sides: */
-		  if (a_v.x != 0)
-		    {
-		      /* If a is moving right, check its right side:*/
-		      if (a_v.x > 0)
-			{
-			  a_line.p1.x = a_b->b.rect.p2.x + a_top_left.x;
-			  a_line.p1.y = a_b->b.rect.p1.y + a_top_left.y;
-			  a_line.p2.x = a_line.p1.x;
-			  a_line.p2.y = a_b->b.rect.p2.y + a_top_left.y;
-			}
-		      /* If it's moving left, check its left side: */
-		      else if (a_v.x < 0)
-			{
-			  a_line.p1.x = a_b->b.rect.p1.x + a_top_left.x;
-			  a_line.p1.y = a_b->b.rect.p2.y + a_top_left.y;
-			  a_line.p2.x = a_line.p1.x;
-			  a_line.p2.y = a_b->b.rect.p1.y + a_top_left.y;
-			}
-		      /* Check for collision: */
-		      point_collided = getLineCollision(a_line, b_line, a_v, dt);
-		      if (point_collided != -1)
-			{
-			  Bound a, b;
-			  a.type = LINE;
-			  a.b.line = a_line;
-			  b.type = LINE;
-			  b.b.line = b_line;
-			  return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
-			}
-		    }
-		}
-	      /* Else if a's bound == circle */
-	      else if (a_b->type == CIRCLE)
-		{
-		  printf("Sorry, no circle collisions yet.\n");
-		  
-		}
-	    }
-
-	  /* If b's boundary is a rectangle: */
-	  else if (b_b->type == RECT)
-	    {
-
-	      /* If a's boundary is a rectangle too: */
-	      if (a_b->type == RECT)
-		{
-		  Rect a_rect, b_rect;
-
-		  /* Map the rectangles into real coordinates for comparison:
-		   */
-		  b_rect.p1.x = b_b->b.rect.p1.x + b_top_left.x;
-		  b_rect.p1.y = b_b->b.rect.p1.y + b_top_left.y;
-		  b_rect.p2.x = b_b->b.rect.p2.x + b_top_left.x;
-		  b_rect.p2.y = b_b->b.rect.p2.y + b_top_left.y;
-
-		  a_rect.p1.x = a_b->b.rect.p1.x + a_top_left.x;
-		  a_rect.p1.y = a_b->b.rect.p1.y + a_top_left.y;
-		  a_rect.p2.x = a_b->b.rect.p2.x + a_top_left.x;
-		  a_rect.p2.y = a_b->b.rect.p2.y + a_top_left.y;
-
-		  /* If the two boundaries are rectangles, return a
-		     collision if they simply overlap.  Collisions are
-		     simpler this way, but two small rectangles are likely to
-		     pass through each other at high speeds, so we just assume
-		     that the rectangles are fairly big: */
-		  if (testRectOverlap(a_rect, b_rect))
-		    {
-		      Bound a, b;
-		      a.type = RECT;
-		      a.b.rect = a_rect;
-		      b.type = RECT;
-		      b.b.rect = b_rect;
-		      return (newCollision(&a, &b, other_obj, tile_pos, 0));
-		    }
-		}
-
-	      /* If a's boundary is a line and its normal is within 90 degrees
-		 of a's velocity: */
-	      else if (a_b->type == LINE &&
-		       (dot(a_v, normal(a_b->b.line)) > 0))
-		{
-
-		  Line b_line;
-
-		  /* Map this object boundary into real coordinates */
-		  Line a_line;
-		  a_line.p1.x = a_b->b.line.p1.x + a_top_left.x;
-		  a_line.p1.y = a_b->b.line.p1.y + a_top_left.y;
-		  a_line.p2.x = a_b->b.line.p2.x + a_top_left.x;
-		  a_line.p2.y = a_b->b.line.p2.y + a_top_left.y;
-
-		  /* Check for collisions as if the b's rectangle is made of
-		     of 4 lines: */
-
-		  /* Check top and bottom before sides, because I think that
-		     there will be collisions with the tiles' tops more
-		     frequently than the sides because of gravity: */
-
-		  /* If a has vertical velocity, check b's top
-		     or bottom: */
-		  if (a_v.y != 0) {
-		  /* If a is moving down, check b's top: */
-		    if (a_v.y > 0)
-		      {
-			b_line.p1.x = b_b->b.rect.p1.x + b_top_left.x;
-			b_line.p1.y = b_b->b.rect.p1.y + b_top_left.y;
-			b_line.p2.x = b_b->b.rect.p2.x + b_top_left.x;
-			b_line.p2.y = b_line.p1.y;
-			
-		      }
-		    /* If a is moving up, check b's bottom: */
-		    else if (a_v.y < 0)
-		      {
-			b_line.p1.x = b_b->b.rect.p2.x + b_top_left.x;
-			b_line.p1.y = b_b->b.rect.p2.y + b_top_left.y;
-			b_line.p2.x = b_b->b.rect.p1.x + b_top_left.x;
-			b_line.p2.y = b_line.p1.y;
-		      }
-
-		    /* Check for collision: */
-		    point_collided = getLineCollision(a_line, b_line, a_v, dt);
-		    if (point_collided != -1)
-		      {
-			Bound a, b;
-			a.type = LINE;
-			a.b.line = a_line;
-			b.type = LINE;
-			b.b.line = b_line;
-			return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
-		      }
-		    
-		  }
-
-		  /* If a has horizontal velocity, check the sides: */
-		  if (a_v.x != 0) {
-		    /* If a is moving right, check b's left: */
-		    if (a_v.x > 0)
-		      {
-			b_line.p1.x = b_b->b.rect.p1.x + b_top_left.x;
-			b_line.p1.y = b_b->b.rect.p2.y + b_top_left.y;
-			b_line.p2.x = b_line.p1.x;
-			b_line.p2.y = b_b->b.rect.p1.y + b_top_left.y;
-		      }
-		    /* If a is moving left, check b's right: */
-		    else if (a_v.x < 0)
-		      {
-			b_line.p1.x = b_b->b.rect.p2.x + b_top_left.x;
-			b_line.p1.y = b_b->b.rect.p1.y + b_top_left.y;
-			b_line.p2.x = b_line.p1.x;
-			b_line.p2.y = b_b->b.rect.p2.y + b_top_left.y;
-		      }
-		    /* Check for collision: */
-		    point_collided = getLineCollision(a_line, b_line, a_v, dt);
-		    if (point_collided != -1)
-		      {
-			Bound a, b;
-			a.type = LINE;
-			a.b.line = a_line;
-			b.type = LINE;
-			b.b.line = b_line;
-			return (newCollision(&a, &b, other_obj, tile_pos, point_collided));
-		      }
-		  }
-
-		}
+	  Collision *c = getBoundCollision(a_b, a_top_left, b_b, b_top_left, a_v, dt, other_obj, tile_pos);
+	  if (c != NULL) return c;
 
-	      /* else if a's bound == circle */
-	      else if (a_b->type == CIRCLE)
-		{
-		  printf("Sorry, no circle collisions yet.\n");
-
-		}
-	    }
 	  /* No collisions yet, see if b has any more boundaries: */
 	  b_b = b_b->next;
 	}
@@ -694,6 +1129,29 @@ col_getCollision(Object *obj, Object *other_obj, Point *tile_pos, Time dt)
   return NULL;
 }
 
+/* getSegmentCollision
+   Checks if an object is colliding with a segment of a chunk's static
+   geometry, in the same way as col_getCollision does with a tile.
+*/
+Collision *
+getSegmentCollision(Object *obj, Segment *seg, Time dt)
+{
+  Bound *a_b, b;
+  Point origin = {0, 0};
+
+  /* The segment is already in real coordinates */
+  b.type = LINE;
+  b.b.line = seg->line;
+  b.next = NULL;
+
+  for (a_b = obj_getObjBounds(obj); a_b != NULL; a_b = a_b->next)
+    {
+      Collision *c = getBoundCollision(a_b, obj_getObjTopLeft(obj), &b, origin, obj_getObjVel(obj), dt, NULL, &seg->tile_pos);
+      if (c != NULL) return c;
+    }
+  return NULL;
+}
+
 /* col_listObjCollisions
    Return a list of all collisions with objects for an object.
 */
@@ -732,8 +1190,9 @@ col_listObjCollisions(Object *obj, Time dt)
 	  while (this_object != NULL)
 	    {
 
-	      /* Make sure we're not detecting collisions between 1 object: */
-	      if (this_object != obj) { 
+	      /* Make sure we're not detecting collisions between 1 object,
+		 or between objects that don't care about each other: */
+	      if (this_object != obj && obj_interacts(obj, this_object)) { 
 		Collision *this_obj_collision = col_getCollision(obj, this_object, NULL, dt);
 		
 		/* If we found a collision with this object, add it to our
@@ -787,39 +1246,50 @@ col_listTileCollisions(Object *obj, Time dt)
 
   /* A linked list of collisions with tiles: */
   Collision *tile_collisions = NULL;
+
+  /* Segments of the static geometry can pass through several of the tile
+     positions we search, so they are stamped the first time we test them: */
+  seg_stamp++;
   
   
   /* Create a list of all tiles the object is colliding with*/
   
-  /* For each tile which the object's bounding box overlaps: */
+  /* For each tile which the object's bounding box overlaps, skipping the
+     ones where there's nothing to collide with: */
   for (map_pos.y = (map_realToMapY(obj_top_left.y) >= 0) ? map_realToMapY(obj_top_left.y) : 0;
        map_pos.y <= map_realToMapY(obj_bot_right.y) &&
 	 map_pos.y < map_getLayerHeight(l);
        map_pos.y++)
     {
-      for (map_pos.x = (map_realToMapX(obj_top_left.x) >= 0) ? map_realToMapX(obj_top_left.x) : 0;
-	   map_pos.x <= map_realToMapX(obj_bot_right.x) &&
-	     map_pos.x < map_getLayerWidth(l);
-	   map_pos.x++)
+      int x_end = map_realToMapX(obj_bot_right.x);
+      for (map_pos.x = map_nextCollidable(l, map_pos.y, map_realToMapX(obj_top_left.x), x_end);
+	   map_pos.x <= x_end;
+	   map_pos.x = map_nextCollidable(l, map_pos.y, map_pos.x + 1, x_end))
 	{
+	  int i, n_segs;
+	  int *segs = map_getCellSegments(l, map_pos.x, map_pos.y, &n_segs);
+
+	  /* Tiles which were merged into the static geometry are found
+	     through its segments */
+	  Collision *this_tile_collision = map_tileIsMerged(l, map_pos.x, map_pos.y) ?
+	    NULL : col_getCollision(obj, NULL, &map_pos, dt);
 
-	  Collision *this_tile_collision = col_getCollision(obj, NULL, &map_pos, dt);
-	  
 	  /* If we found a collision with this tile, add it to our
 	     list: */
 	  if (this_tile_collision != NULL)
 	    {
-	      
-	      /* If this is the first collision we've found,
-		 add this collision as the first node in the list
-	      */
-	      if (tile_collisions == NULL)
-		{
-		  tile_collisions = this_tile_collision;
-		}
-	      /* Otherwise, add this collision to the top of the
-		 list: */
-	      else
+	      this_tile_collision->next = tile_collisions;
+	      tile_collisions = this_tile_collision;
+	    }
+
+	  /* Check the segments passing through here we haven't yet */
+	  for (i = 0; i < n_segs; i++)
+	    {
+	      Segment *seg = map_getSegment(l, map_pos.x, map_pos.y, segs[i]);
+	      if (seg->stamp == seg_stamp) continue;
+	      seg->stamp = seg_stamp;
+
+	      if ((this_tile_collision = getSegmentCollision(obj, seg, dt)) != NULL)
 		{
 		  this_tile_collision->next = tile_collisions;
 		  tile_collisions = this_tile_collision;
@@ -832,6 +1302,249 @@ col_listTileCollisions(Object *obj, Time dt)
 
 }
 
+/* cross
+   Returns the z component of the cross product of two vectors.
+*/
+float
+cross(float ax, float ay, float bx, float by)
+{
+  return ax * by - ay * bx;
+}
+
+/* castLine
+   Finds where a path first crosses a line, as a fraction t of the way
+   along the path.  Lines are only solid from the side their normal faces.
+   Returns 1 if it crosses before *t, and updates *t.
+*/
+int
+castLine(Line path, Line l, float *t)
+{
+  float dx = path.p2.x - path.p1.x, dy = path.p2.y - path.p1.y;
+  float ex = l.p2.x - l.p1.x, ey = l.p2.y - l.p1.y;
+  float qx = l.p1.x - path.p1.x, qy = l.p1.y - path.p1.y;
+  float denom = cross(dx, dy, ex, ey);
+  float s, u;
+  Vector d;
+
+  d.x = dx;
+  d.y = dy;
+  if (denom == 0 || dot(d, normal(l)) >= 0) return 0;
+
+  s = cross(qx, qy, ex, ey) / denom;
+  u = cross(qx, qy, dx, dy) / denom;
+
+  if (s < 0 || s > 1 || u < 0 || u > 1 || s >= *t) return 0;
+  *t = s;
+  return 1;
+}
+
+/* castRect
+   Finds where a path first enters a rectangle, clipping it against the
+   rectangle's x and y slabs.  A path starting inside hits at t = 0.
+   Returns 1 if it enters before *t, and updates *t.
+*/
+int
+castRect(Line path, Rect r, float *t)
+{
+  float d[2], p[2], lo[2], hi[2];
+  float t_in = 0, t_out = 1;
+  int i;
+
+  d[0] = path.p2.x - path.p1.x; d[1] = path.p2.y - path.p1.y;
+  p[0] = path.p1.x; p[1] = path.p1.y;
+  lo[0] = r.p1.x; lo[1] = r.p1.y;
+  hi[0] = r.p2.x; hi[1] = r.p2.y;
+
+  for (i = 0; i < 2; i++)
+    {
+      if (d[i] == 0)
+	{
+	  if (p[i] < lo[i] || p[i] > hi[i]) return 0;
+	}
+      else
+	{
+	  float t1 = (lo[i] - p[i]) / d[i];
+	  float t2 = (hi[i] - p[i]) / d[i];
+	  if (t1 > t2) { float tmp = t1; t1 = t2; t2 = tmp; }
+	  if (t1 > t_in) t_in = t1;
+	  if (t2 < t_out) t_out = t2;
+	  if (t_in > t_out) return 0;
+	}
+    }
+
+  if (t_in >= *t) return 0;
+  *t = t_in;
+  return 1;
+}
+
+/* castCircle
+   Finds where a path first enters a circle.  A path starting inside hits
+   at t = 0.  Returns 1 if it enters before *t, and updates *t.
+*/
+int
+castCircle(Line path, Circle c, float *t)
+{
+  float dx = path.p2.x - path.p1.x, dy = path.p2.y - path.p1.y;
+  float fx = path.p1.x - c.p.x, fy = path.p1.y - c.p.y;
+  float a = dx * dx + dy * dy;
+  float b = 2 * (fx * dx + fy * dy);
+  float k = fx * fx + fy * fy - c.r * c.r;
+  float disc, s;
+
+  if (k <= 0) s = 0;
+  else
+    {
+      disc = b * b - 4 * a * k;
+      if (a == 0 || disc < 0) return 0;
+      s = (-b - sqrt(disc)) / (2 * a);
+      if (s < 0 || s > 1) return 0;
+    }
+
+  if (s >= *t) return 0;
+  *t = s;
+  return 1;
+}
+
+/* castBounds
+   Casts a path against a list of boundaries at some position.  Returns 1 if
+   any of them is hit before *t, and updates *t.
+*/
+int
+castBounds(Line path, Bound *b, Point top_left, float *t)
+{
+  int hit = 0;
+
+  for (; b != NULL; b = b->next)
+    {
+      if (b->type == LINE)
+	{
+	  Line l = b->b.line;
+	  l.p1.x += top_left.x; l.p1.y += top_left.y;
+	  l.p2.x += top_left.x; l.p2.y += top_left.y;
+	  hit |= castLine(path, l, t);
+	}
+      else if (b->type == RECT)
+	{
+	  Rect r = b->b.rect;
+	  r.p1.x += top_left.x; r.p1.y += top_left.y;
+	  r.p2.x += top_left.x; r.p2.y += top_left.y;
+	  hit |= castRect(path, r, t);
+	}
+      else if (b->type == CIRCLE)
+	{
+	  Circle c = b->b.circle;
+	  c.p.x += top_left.x; c.p.y += top_left.y;
+	  hit |= castCircle(path, c, t);
+	}
+    }
+  return hit;
+}
+
+/* col_castSegment
+
+   Finds the first thing a point moving along a path in a layer runs into.
+   This is for things like projectiles, which are too small and too fast
+   to be worth the full collision detection.  Objects are only considered
+   if their category is in the mask, and dead ones never are.
+
+   Returns OBJ_TYPE or TILE_TYPE, filling in *obj or *tile_pos and the
+   fraction *t of the way along the path where it hit.  Returns -1 if the
+   path is clear.
+*/
+int
+col_castSegment(int l, Line path, int mask, Point *tile_pos, Object **obj, float *t)
+{
+  Point map_pos, sector;
+  Point top_left, bot_right;
+  int type = -1;
+
+  *t = 1;
+
+  /* The box around the path */
+  top_left.x = (path.p1.x < path.p2.x) ? path.p1.x : path.p2.x;
+  top_left.y = (path.p1.y < path.p2.y) ? path.p1.y : path.p2.y;
+  bot_right.x = (path.p1.x > path.p2.x) ? path.p1.x : path.p2.x;
+  bot_right.y = (path.p1.y > path.p2.y) ? path.p1.y : path.p2.y;
+
+  seg_stamp++;
+
+  /* The tiles under the box, skipping the empty ones: */
+  for (map_pos.y = (map_realToMapY(top_left.y) >= 0) ? map_realToMapY(top_left.y) : 0;
+       map_pos.y <= map_realToMapY(bot_right.y) && map_pos.y < map_getLayerHeight(l);
+       map_pos.y++)
+    {
+      int x_end = map_realToMapX(bot_right.x);
+      for (map_pos.x = map_nextCollidable(l, map_pos.y, map_realToMapX(top_left.x), x_end);
+	   map_pos.x <= x_end;
+	   map_pos.x = map_nextCollidable(l, map_pos.y, map_pos.x + 1, x_end))
+	{
+	  int i, n_segs;
+	  int *segs = map_getCellSegments(l, map_pos.x, map_pos.y, &n_segs);
+
+	  if (!map_tileIsMerged(l, map_pos.x, map_pos.y))
+	    {
+	      Point tile_top_left;
+	      tile_top_left.x = map_mapToRealX(map_pos.x);
+	      tile_top_left.y = map_mapToRealY(map_pos.y);
+
+	      if (castBounds(path, map_getTileBounds(l, map_pos.x, map_pos.y), tile_top_left, t))
+		{
+		  type = TILE_TYPE;
+		  *tile_pos = map_pos;
+		}
+	    }
+
+	  for (i = 0; i < n_segs; i++)
+	    {
+	      Segment *seg = map_getSegment(l, map_pos.x, map_pos.y, segs[i]);
+	      if (seg->stamp == seg_stamp) continue;
+	      seg->stamp = seg_stamp;
+
+	      if (castLine(path, seg->line, t))
+		{
+		  type = TILE_TYPE;
+		  *tile_pos = seg->tile_pos;
+		}
+	    }
+	}
+    }
+
+  /* The objects in the sectors around the box: */
+  for (sector.y = (obj_realToSectorY(top_left.y) - 1 >= 0) ? obj_realToSectorY(top_left.y) - 1 : 0;
+       sector.y <= obj_realToSectorY(bot_right.y) + 1 && sector.y < obj_getLayerHeight(l);
+       sector.y++)
+    {
+      for (sector.x = (obj_realToSectorX(top_left.x) - 1 >= 0) ? obj_realToSectorX(top_left.x) - 1 : 0;
+	   sector.x <= obj_realToSectorX(bot_right.x) + 1 && sector.x < obj_getLayerWidth(l);
+	   sector.x++)
+	{
+	  Object *this_object;
+	  for (this_object = obj_getObjList(l, sector.x, sector.y);
+	       this_object != NULL;
+	       this_object = obj_getNextObj(this_object))
+	    {
+	      Point obj_top_left = obj_getObjTopLeft(this_object);
+	      Point obj_bot_right = obj_getObjBotRight(this_object);
+
+	      if (!(this_object->category & mask) || this_object->dead) continue;
+
+	      /* Skip it if it's nowhere near the path */
+	      if (obj_bot_right.x < top_left.x || obj_top_left.x > bot_right.x ||
+		  obj_bot_right.y < top_left.y || obj_top_left.y > bot_right.y)
+		continue;
+
+	      if (castBounds(path, obj_getObjBounds(this_object), obj_top_left, t))
+		{
+		  type = OBJ_TYPE;
+		  *obj = this_object;
+		}
+	    }
+	}
+    }
+
+  return type;
+}
+
 /* col_listCollisions
    Gets lists of obj collisions and tile collisions and concatenates them.
 */
@@ -865,7 +1578,6 @@ void
 col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
 {
 
-  Signal sig_a, sig_b;
   Vector impulse_a, impulse_b;
   Velocity v_a, v_b, rel_v_a;
   Point pos_a, new_pos_a, pos_b, new_pos_b;
@@ -873,6 +1585,10 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
 
   float k_a, k_b, k;    /* Coefficients of elasticity */
 
+  /* The normal of the surface a was pushed out of, to remember the
+     contact by: */
+  Vector contact_n = {0, 0};
+
   /* Get object a's position, velocity, mass, and elasticity: */
   v_a = obj_getObjVel(obj);
   new_pos_a = pos_a = obj_getObjPos(obj);
@@ -903,8 +1619,56 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
   rel_v_a.y = v_a.y - v_b.y;
 
 
+  /* If either boundary is a circle, the normal and depth of the collision
+     were already found when it was detected: */
+  if (coll_info->a.type == CIRCLE || coll_info->b.type == CIRCLE)
+    {
+      Vector n = coll_info->n;
+      contact_n = n;
+
+      /* If both things are objects, use the same momentum physics as
+	 collisions between lines: */
+      if (coll_info->type == OBJ_TYPE)
+	{
+	  float a_a, a_b, optimizedP;
+
+	  a_a = dot(v_a, n);
+	  a_b = dot(v_b, n);
+
+	  optimizedP = ((1 + k) * (a_a - a_b)) / (mass_a + mass_b);
+
+	  impulse_a.x = -optimizedP * mass_b * n.x;
+	  impulse_a.y = -optimizedP * mass_b * n.y;
+
+	  impulse_b.x = optimizedP * mass_a * n.x;
+	  impulse_b.y = optimizedP * mass_a * n.y;
+
+	  /* Move both of the objects out of collision: */
+	  new_pos_a.x = pos_a.x + rint(n.x * (coll_info->depth / 2 + 1));
+	  new_pos_a.y = pos_a.y + rint(n.y * (coll_info->depth / 2 + 1));
+	  new_pos_b.x = pos_b.x - rint(n.x * (coll_info->depth / 2 + 1));
+	  new_pos_b.y = pos_b.y - rint(n.y * (coll_info->depth / 2 + 1));
+	}
+
+      /* The tile is not movable, so move a out along the normal and take
+	 away the part of its velocity going into the tile: */
+      else
+	{
+	  float v_dot_n = dot(v_a, n);
+
+	  new_pos_a.x = pos_a.x + rint(n.x * (coll_info->depth + 1));
+	  new_pos_a.y = pos_a.y + rint(n.y * (coll_info->depth + 1));
+
+	  if (v_dot_n > 0) v_dot_n = 0;
+	  v_dot_n *= 1 + k;
+
+	  impulse_a.x = -v_dot_n * n.x;
+	  impulse_a.y = -v_dot_n * n.y;
+	}
+    }
+
   /* If a's boundary is a rectangle: */
-  if (coll_info->a.type == RECT)
+  else if (coll_info->a.type == RECT)
     {
 
       /* If both boundaries are rectangles, all we know about the collision 
@@ -974,6 +1738,7 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
 	  /* Right, now we know which side the collision occurred on, and
 	     we know how deeply the rectangles overlap, so we can set the
 	     position and velocity of the object accordingly: */
+	  contact_n = n;
 
 
 	  /* If both things are objects: */
@@ -1094,7 +1859,7 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
 	    }
 
 	  /* Get the normal of the b's line boundary: */
-	  n = normal(coll_info->b.b.line);
+	  contact_n = n = normal(coll_info->b.b.line);
 
 	  /* If the collision is between two objects, 
 	     do some fancy pants
@@ -1156,11 +1921,6 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
 	}
 
     }
-  /* If a's boundary is a circle: */
-  else if (coll_info->a.type == CIRCLE)
-    {
-      printf("Sorry, no circle collisions yet.\n");
-    }
 
 
   /* Update the position and velocity: */
@@ -1169,17 +1929,6 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
   obj_setObjVel(obj, v_a);
   obj_setObjPos(obj, new_pos_a);
 
-  /* Send an impulse signal */
-  sig_a.type = IMPULSE_SIG;
-  sig_a.sig.imp.vec = impulse_a;
-  sig_a.sig.imp.hit.type = coll_info->type;
-  if (coll_info->type == OBJ_TYPE)
-    sig_a.sig.imp.hit.u.obj_type = obj_getObjType(coll_info->other.obj);
-  else
-    sig_a.sig.imp.hit.u.tile_type = map_getTileType(obj_getObjLayer(obj), coll_info->other.tile_pos.x, coll_info->other.tile_pos.y);
-
-  obj_sendObjSignal(obj, &sig_a);
-
   /* Update the 2nd object (if it's an object) */
   if (coll_info->type == OBJ_TYPE)
     {
@@ -1187,26 +1936,14 @@ col_collisionResponse(Object *obj, Collision *coll_info, Time dt)
       v_b.y += impulse_b.y;
       obj_setObjVel(coll_info->other.obj, v_b);
       obj_setObjPos(coll_info->other.obj, new_pos_b);
-
-      /* Send an impulse signal */
-      sig_b.type = IMPULSE_SIG;
-      sig_b.sig.imp.vec = impulse_b;
-      sig_b.sig.imp.hit.type = OBJ_TYPE;
-      sig_b.sig.imp.hit.u.obj_type = obj_getObjType(obj);
-
-      obj_sendObjSignal(coll_info->other.obj, &sig_b);
     }
-  /* If it's a tile, create an impulse to send it: */
-  else
-    {
-      sig_b.type = IMPULSE_SIG;
-      sig_b.sig.imp.vec.x = -impulse_a.x;
-      sig_b.sig.imp.vec.y = -impulse_a.y;
-      sig_b.sig.imp.hit.type = OBJ_TYPE;
-      sig_b.sig.imp.hit.u.obj_type = obj_getObjType(obj);
 
-      map_sendTileSignal(obj_getObjLayer(obj), coll_info->other.tile_pos.x, coll_info->other.tile_pos.y, &sig_b);
-    }
+  /* Send impulse signals to both things */
+  sendImpulses(obj, coll_info->type, (coll_info->type == OBJ_TYPE) ? coll_info->other.obj : NULL, &coll_info->other.tile_pos, impulse_a, impulse_b);
+
+  /* Remember the contact for the next frame */
+  if (contact_n.x != 0 || contact_n.y != 0)
+    rememberContact(obj, coll_info, contact_n);
 }
 
 /* findSolidCollision
@@ -1222,7 +1959,7 @@ Collision *findSolidCollision(Object *obj, Collision *c)
     {
       if (temp->type == OBJ_TYPE)
 	{
-	  if (obj_isSolid(temp->other.obj)) return temp;
+	  if (obj_isSolid(temp->other.obj) && obj_collides(obj, temp->other.obj)) return temp;
 	}
       else
 	if (map_tileIsSolid(obj_getObjLayer(obj), temp->other.tile_pos.x, temp->other.tile_pos.y)) return temp;
@@ -1363,3 +2100,276 @@ void col_doCollisions(Object *obj, Time dt)
   col_doObjCollisions(obj, dt);
 
 }
+
+/* sendImpulses
+   Sends impulse signals to an object and the object or tile it was pushed
+   by.  A tile gets the opposite of the object's impulse.
+*/
+void
+sendImpulses(Object *obj, int type, Object *other_obj, Point *tile_pos, Vector impulse_a, Vector impulse_b)
+{
+  Signal sig_a, sig_b;
+
+  sig_a.type = IMPULSE_SIG;
+  sig_a.sig.imp.vec = impulse_a;
+  sig_a.sig.imp.hit.type = type;
+  if (type == OBJ_TYPE)
+    sig_a.sig.imp.hit.u.obj_type = obj_getObjType(other_obj);
+  else
+    sig_a.sig.imp.hit.u.tile_type = map_getTileType(obj_getObjLayer(obj), tile_pos->x, tile_pos->y);
+
+  obj_sendObjSignal(obj, &sig_a);
+
+  sig_b.type = IMPULSE_SIG;
+  sig_b.sig.imp.hit.type = OBJ_TYPE;
+  sig_b.sig.imp.hit.u.obj_type = obj_getObjType(obj);
+  if (type == OBJ_TYPE)
+    {
+      sig_b.sig.imp.vec = impulse_b;
+      obj_sendObjSignal(other_obj, &sig_b);
+    }
+  else
+    {
+      sig_b.sig.imp.vec.x = -impulse_a.x;
+      sig_b.sig.imp.vec.y = -impulse_a.y;
+      map_sendTileSignal(obj_getObjLayer(obj), tile_pos->x, tile_pos->y, &sig_b);
+    }
+}
+
+/* findContact
+   Finds the remembered contact between an object and another object or a
+   tile, or returns NULL if there isn't one.
+*/
+Contact *
+findContact(Object *obj, int type, Object *other_obj, Point *tile_pos)
+{
+  Contact *c;
+
+  for (c = contacts[CONTACT_HASH(obj)]; c != NULL; c = c->next)
+    {
+      if (c->obj != obj || c->type != type) continue;
+      if (type == OBJ_TYPE && c->other.obj == other_obj) return c;
+      if (type == TILE_TYPE && c->other.tile_pos.x == tile_pos->x &&
+	  c->other.tile_pos.y == tile_pos->y) return c;
+    }
+  return NULL;
+}
+
+/* rememberContact
+   Remembers (or refreshes) the contact from a collision that was just
+   responded to.  n is the normal a was pushed out along.
+*/
+void
+rememberContact(Object *obj, Collision *coll, Vector n)
+{
+  Object *other_obj = (coll->type == OBJ_TYPE) ? coll->other.obj : NULL;
+  Contact *c = findContact(obj, coll->type, other_obj, &coll->other.tile_pos);
+
+  if (c == NULL)
+    {
+      int hash = CONTACT_HASH(obj);
+      MALLOC(c, sizeof(Contact));
+      c->obj = obj;
+      c->type = coll->type;
+      if (c->type == OBJ_TYPE)
+	c->other.obj = other_obj;
+      else
+	c->other.tile_pos = coll->other.tile_pos;
+      c->resting = 0;
+      c->next = contacts[hash];
+      contacts[hash] = c;
+    }
+
+  /* Keep the other object's bound relative to it, since it can move */
+  c->b = coll->b;
+  if (coll->type == OBJ_TYPE)
+    {
+      Point top_left = obj_getObjTopLeft(other_obj);
+      switch (c->b.type)
+	{
+	case LINE:
+	  c->b.b.line.p1.x -= top_left.x; c->b.b.line.p1.y -= top_left.y;
+	  c->b.b.line.p2.x -= top_left.x; c->b.b.line.p2.y -= top_left.y;
+	  break;
+	case RECT:
+	  c->b.b.rect.p1.x -= top_left.x; c->b.b.rect.p1.y -= top_left.y;
+	  c->b.b.rect.p2.x -= top_left.x; c->b.b.rect.p2.y -= top_left.y;
+	  break;
+	case CIRCLE:
+	  c->b.b.circle.p.x -= top_left.x; c->b.b.circle.p.y -= top_left.y;
+	  break;
+	}
+    }
+  c->b.next = NULL;
+
+  c->n = normalize(n);
+  c->frame = contact_frame;
+}
+
+/* freeContact
+   Takes a contact out of its list and frees it.
+*/
+void
+freeContact(Contact *c)
+{
+  Contact **prev = &contacts[CONTACT_HASH(c->obj)];
+
+  while (*prev != c)
+    prev = &(*prev)->next;
+  *prev = c->next;
+  free(c);
+}
+
+/* contactIsThere
+   Checks if a contact is still there by pretending the object moved a
+   little way into it and seeing if that ran into the bound it was
+   touching.  This is a lot cheaper than finding it again.
+*/
+int
+contactIsThere(Contact *c, Time dt)
+{
+  Bound *a_b;
+  Point a_top_left = obj_getObjTopLeft(c->obj), b_top_left = {0, 0};
+  Velocity probe;
+
+  if (c->type == OBJ_TYPE)
+    b_top_left = obj_getObjTopLeft(c->other.obj);
+
+  /* Collisions are found after things move, so put the object where the
+     probe would have taken it: */
+  probe.x = -c->n.x * CONTACT_PROBE / dt;
+  probe.y = -c->n.y * CONTACT_PROBE / dt;
+  a_top_left.x += rint(probe.x * dt);
+  a_top_left.y += rint(probe.y * dt);
+
+  for (a_b = obj_getObjBounds(c->obj); a_b != NULL; a_b = a_b->next)
+    {
+      Collision *coll = getBoundCollision(a_b, a_top_left, &c->b, b_top_left, probe, dt,
+					  (c->type == OBJ_TYPE) ? c->other.obj : NULL, &c->other.tile_pos);
+      if (coll != NULL)
+	{
+	  free(coll);
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* col_beginFrame
+   Starts a new frame of collisions.  Contacts which were there last frame
+   and still are are kept, and the rest are forgotten.  If the object is
+   only moving into a contact slowly, it is resting there, and whatever part
+   of its velocity is going into the contact is taken away before it moves,
+   the same as if it had run into it and been pushed back out (with no
+   bounce).  The same impulse signals are sent, so things can still tell
+   that they're resting on something.
+*/
+void
+col_beginFrame(Time dt)
+{
+  int i;
+
+  contact_frame++;
+
+  if (dt <= 0) return;
+
+  for (i = 0; i < CONTACT_BUCKETS; i++)
+    {
+      Contact *c = contacts[i];
+
+      while (c != NULL)
+	{
+	  Contact *next = c->next;
+
+	  if (c->frame != contact_frame - 1 || !contactIsThere(c, dt))
+	    freeContact(c);
+	  else
+	    {
+	      Velocity v_a = obj_getObjVel(c->obj), v_b = {0, 0};
+	      Vector impulse_a = {0, 0}, impulse_b = {0, 0};
+	      float a_a, a_b;
+
+	      if (c->type == OBJ_TYPE)
+		v_b = obj_getObjVel(c->other.obj);
+
+	      a_a = dot(v_a, c->n);
+	      a_b = dot(v_b, c->n);
+
+	      /* Only if the object is moving into the contact slowly: */
+	      c->resting = (a_a - a_b > -CONTACT_REST_VEL);
+	      if (c->resting && a_a - a_b < 0)
+		{
+		  if (c->type == OBJ_TYPE)
+		    {
+		      int mass_a = obj_getObjMass(c->obj);
+		      int mass_b = obj_getObjMass(c->other.obj);
+		      float p = (a_a - a_b) / (mass_a + mass_b);
+
+		      impulse_a.x = -p * mass_b * c->n.x;
+		      impulse_a.y = -p * mass_b * c->n.y;
+		      impulse_b.x = p * mass_a * c->n.x;
+		      impulse_b.y = p * mass_a * c->n.y;
+
+		      v_b.x += impulse_b.x;
+		      v_b.y += impulse_b.y;
+		      obj_setObjVel(c->other.obj, v_b);
+		    }
+		  else
+		    {
+		      impulse_a.x = -a_a * c->n.x;
+		      impulse_a.y = -a_a * c->n.y;
+		    }
+
+		  v_a.x += impulse_a.x;
+		  v_a.y += impulse_a.y;
+		  obj_setObjVel(c->obj, v_a);
+
+		  sendImpulses(c->obj, c->type, (c->type == OBJ_TYPE) ? c->other.obj : NULL, &c->other.tile_pos, impulse_a, impulse_b);
+		}
+
+	      c->frame = contact_frame;
+	    }
+	  c = next;
+	}
+    }
+}
+
+/* col_getSupport
+   Returns a contact an object is resting on top of this frame, or NULL if
+   it isn't standing on anything.
+*/
+Contact *
+col_getSupport(Object *obj)
+{
+  Contact *c;
+
+  for (c = contacts[CONTACT_HASH(obj)]; c != NULL; c = c->next)
+    {
+      /* The normal has to point mostly up */
+      if (c->obj == obj && c->frame == contact_frame && c->n.y < -0.5)
+	return c;
+    }
+  return NULL;
+}
+
+/* col_forgetObj
+   Forgets all of the contacts an object is part of.  This has to be done
+   before the object is freed.
+*/
+void
+col_forgetObj(Object *obj)
+{
+  int i;
+
+  for (i = 0; i < CONTACT_BUCKETS; i++)
+    {
+      Contact *c = contacts[i];
+      while (c != NULL)
+	{
+	  Contact *next = c->next;
+	  if (c->obj == obj || (c->type == OBJ_TYPE && c->other.obj == obj))
+	    freeContact(c);
+	  c = next;
+	}
+    }
+}
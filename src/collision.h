@@ -46,11 +46,56 @@ typedef struct collision_struct
      collided. */
   int point_collided;
 
+  /* Collisions with circles find the normal of the surface that was hit
+     (pointing back towards a) and how far a has to move along it to get out
+     of the collision, so they're remembered here. */
+  Vector n;
+  float depth;
+
   /* We will collect these in a list: */
   struct collision_struct *next;
 
 } Collision;
 
+/* Solid contacts are remembered from one frame to the next, so that things
+   resting against each other don't have to run into each other again every
+   frame to stay that way (see col_beginFrame). */
+typedef struct contact_struct
+{
+  Object *obj;      /* The object that was pushed out of the contact */
+
+  /* What it was touching, like in a Collision */
+  int type;
+  union
+  {
+    Object *obj;
+    Point tile_pos;
+  } other;
+
+  /* The bound it was touching.  In real coordinates for a tile, and
+     relative to the other object's top left corner for an object. */
+  Bound b;
+
+  Vector n;         /* The normal of the contact, pointing towards obj */
+  int resting;      /* If obj was barely moving into the contact at the
+		       start of the frame */
+  int frame;        /* The last frame the contact was known to be there */
+
+  struct contact_struct *next;
+} Contact;
+
+/* The number of lists contacts are hashed into by object */
+#define CONTACT_BUCKETS 64
+
+/* Contacts moving together slower than this are resting: */
+#define CONTACT_REST_VEL 60
+
+/* How far to look for a resting contact from one frame to the next: */
+#define CONTACT_PROBE 2
+
+extern void col_beginFrame(Time dt);
+extern Contact *col_getSupport(Object *obj);
+extern void col_forgetObj(Object *obj);
 extern void col_doObjCollisions(Object *obj, Time dt);
 extern void col_doTileCollisions(Object *obj, Time dt);
 extern void col_doCollisions(Object *obj, Time dt);
@@ -59,6 +104,7 @@ extern Collision *col_listCollisions(Object *obj, Time dt);
 extern Collision *col_listTileCollisions(Object *obj, Time dt);
 extern Collision *col_listObjCollisions(Object *obj, Time dt);
 extern void col_collisionResponse(Object *obj, Collision *coll_info, Time dt);
+extern int col_castSegment(int l, Line path, int mask, Point *tile_pos, Object **obj, float *t);
 extern Vector normal(Line l);
 
 
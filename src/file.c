@@ -1,13 +1,75 @@
 #include "file.h"
-
-/* A linked list of the open files: */
-static OpenFile *open_files = NULL;
+#include "pack.h"
+#include "types/tiletypes.h"
+#include "types/objtypes.h"
+#include <sys/stat.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* The registry of dat files that have been read in, and where each one
+   is in it by name: */
+static DatFile **dat_files = NULL;
+static int n_dats = 0, max_dats = 0;
+static NameMap dat_names;
+
+/* And one of the open areas: */
+static Area *open_areas = NULL;
+
+/* Kinds of tiles are found while an area compiles by hashing them into
+   this many buckets: */
+#define KIND_BUCKETS 1024
+
+/* An area being compiled from text.  Each part grows as it's read. */
+typedef struct area_builder_struct
+{
+  AreaHeader head;
+  AreaLayer *layers;
+  AreaTile *tiles;
+  int max_tiles;
+  AreaKind *kinds;
+  int max_kinds;
+  int *kind_next;       /* The next kind in the same bucket */
+  int max_kind_next;
+  int *kind_buckets;    /* The first kind in each bucket, or -1 */
+  Uint32 *chunks;
+  AreaBound *bounds;
+  int max_bounds;
+  AreaObject *objects;
+  int max_objects;
+  char *strings;
+  int max_strings;
+  int n_names, max_names;
+  Uint32 *names;        /* Where each different string starts */
+} AreaBuilder;
 
 /* Private function prototypes */
 char *addDataPrefix(char *f);
 char *trimString(char *s);
-OpenFile *findOpenFile(char *file);
 char *getSpriteFilename(char *dir);
+static void *growArray(void *array, int n, int *max, int size);
+static Uint32 addString(AreaBuilder *ab, char *str);
+static Uint32 addKind(AreaBuilder *ab, AreaKind *k);
+static void sortTiles(AreaBuilder *ab);
+static Area *openArea(char *areafile, int careful);
+static AreaHeader *compileText(char *areafile, int careful);
+static void freeBuilder(AreaBuilder *ab);
+static void compileLayer(Tokenizer *t, AreaBuilder *ab, AreaLayer *l);
+static void compileTile(Tokenizer *t, AreaBuilder *ab, AreaLayer *l);
+static void compileBound(Tokenizer *t, AreaBuilder *ab);
+static void compileObject(Tokenizer *t, AreaBuilder *ab);
+static AreaHeader *mapCompiled(char *areafile, int *held);
+static int checkCompiled(AreaHeader *head, Uint32 size);
+static int fitsIn(Uint32 offset, Uint32 n, Uint32 each, Uint32 size);
+static void writeBenchArea(char *areafile, int n_tiles);
+static void openText(Tokenizer *t, char *filename);
+static int tryOpenText(Tokenizer *t, char *filename);
+static int readAnim(char *name, char *dir, AnimData *anim, int careful);
+static int datExists(char *file);
+static int fileExists(char *filename);
 
 /* trimString
    Given a character buffer with a string in it, create a new string
@@ -49,76 +111,20 @@ getSpriteFilename(char *dir)
 }
 
 
-/* findOpenFile
-   Given the name of an open file, get the OpenFile from the list.
-*/
-OpenFile *
-findOpenFile(char *file)
-{
-  extern OpenFile *open_files;
-  OpenFile *this_file = open_files;
-
-  /* Find the open file */
-  while (strcmp(this_file->name, file) != 0 && this_file != NULL)
-    this_file = this_file->next;
-
-  /* In case the file specified hasn't been opened yet : */
-  if (this_file == NULL)
-    {
-      fprintf(stderr, "Error: Cannot find unopened file: %s\n", file);
-      exit(0);
-    }
-
-  return this_file;
-}
-
-
 /* file_getAreaTilesetFile
    Gets the filename of the dat file for the tileset for an area.
 */
 char *
 file_getAreaTilesetFile(char *areafile)
 {
+  Area *a = file_openArea(areafile);
 
-  FILE *inf;
-
-  char buffer[128], tilebuffer[64];
-  char *tileset_name = NULL;
-  char *areafilename = addDataPrefix(areafile);
-
-  FOPEN(areafilename, inf, READ_MODE);
-  free(areafilename);
-
-  /* Search the area file line by line for the tileset name */
-  /* The line should look like this:
-     tileset "tilesetname"
+  /* Look in tilesets.dat for the filename of the dat file for the
+     specified tileset.  Return the filename (without the full path)
   */
-  while (fgets(buffer, 128, inf) != NULL && tileset_name == NULL)
-    {
-      if (sscanf(buffer, "tileset %*[\"]%[^\"]%*[\"]", tilebuffer) == 1)
-	{
-	  tileset_name = (trimString(tilebuffer));
-	}
-    }
-
-  fclose(inf);
-
-  /* Couldn't find it! */
-  if (tileset_name == NULL)
-    {
-      fprintf(stderr, "Error: Could not find tileset specification in %s\n", areafile);
-      exit(0);
-    }
-  else
-    {
-      /* Look in tilesets.dat for the filename of the dat file for the
-	 specified tileset.  Return the filename (without the full path)
-      */
-      char *tileset_file;
-      tileset_file = file_getDatValue(TILESET_DATFILE, tileset_name);
-      free (tileset_name);
-      return tileset_file;
-    }
+  char *tileset_file = file_getDatValue(TILESET_DATFILE, file_areaString(a, a->head->tileset));
+  file_closeArea(a);
+  return tileset_file;
 }
 
 
@@ -129,466 +135,1001 @@ file_getAreaTilesetFile(char *areafile)
 char *
 file_getAreaMusicFile(char *areafile)
 {
+  Area *a = file_openArea(areafile);
+
+  /* Look in music.dat for the music filename, return it and the
+     full path */
+  char *music_name = file_getDatValue(MUSIC_DATFILE, file_areaString(a, a->head->music));
+  char *musicfile = addDataPrefix(music_name);
+  free(music_name);
+  file_closeArea(a);
+  return musicfile;
+}
 
-  FILE *inf;
-
-  char buffer[128], musbuffer[64];
-  char *musicname = NULL;
-  char *areafilename = addDataPrefix(areafile);
+/* file_openArea
+   Opens an area: its compiled file if there's one that's up to date, and
+   otherwise the text file, compiled in memory.  If it's already open, it's
+   shared.
+*/
+Area *
+file_openArea(char *areafile)
+{
+  return openArea(areafile, 0);
+}
 
+/* file_reopenArea
+   Opens an area like file_openArea(), for reading it again while the game
+   runs.  It's read again even if it's open, and the new copy is the one
+   that's shared from then on.  If there's a mistake in its text, it's
+   reported with its line and column, and NULL is returned instead of
+   quitting.
+*/
+Area *
+file_reopenArea(char *areafile)
+{
+  return openArea(areafile, 1);
+}
 
-  FOPEN(areafilename, inf, READ_MODE);
-  free(areafilename);
+/* openArea
+   Opens an area, quitting on a mistake in its text unless it's careful,
+   in which case NULL is returned, and it's read again even if it's
+   already open.
+*/
+Area *
+openArea(char *areafile, int careful)
+{
+  extern Area *open_areas;
+  Area *a;
 
-  /* Search the area file line by line for the music name */
-  /* The line should look like this:
-     music "musicname"
-  */
-  while (fgets(buffer, 128, inf) != NULL && musicname == NULL)
+  for (a = careful ? NULL : open_areas; a != NULL; a = a->next)
     {
-      if (sscanf(buffer, "music %*[\"]%[^\"]%*[\"]", musbuffer) == 1)
+      if (strcmp(a->name, areafile) == 0)
 	{
-	  musicname = (trimString(musbuffer));
+	  a->refs++;
+	  return a;
 	}
     }
 
-  fclose(inf);
-
-  /* Couldn't find it! */
-  if (musicname == NULL)
+  MALLOC(a, sizeof(Area));
+  a->name = trimString(areafile);
+  a->refs = 1;
+  if ((a->head = mapCompiled(areafile, &a->held)) == NULL)
     {
-      fprintf(stderr, "Error: Could not find music specification in %s\n", areafile);
-      exit(0);
+      a->held = AREA_COMPILED;
+      if ((a->head = compileText(areafile, careful)) == NULL)
+	{
+	  free(a->name);
+	  free(a);
+	  return NULL;
+	}
     }
-  else
-    {
 
-      /* Look in music.dat for the music filename, return it and the
-	 full path */
-      char *musicfile;
-      musicfile = addDataPrefix(file_getDatValue(MUSIC_DATFILE, musicname));
-      free (musicname);
-      return musicfile;
-    }
+  a->next = open_areas;
+  open_areas = a;
+  return a;
 }
 
-/* file_openFile
-   Opens a file.
+/* file_closeArea
+   Closes an area once everyone who opened it has closed it.
 */
 void
-file_openFile(char *file, char mode)
+file_closeArea(Area *a)
 {
-  extern OpenFile *open_files;
-  OpenFile *new_open_file;
-  char *filename = addDataPrefix(file);
-
-  /* Create a new node */
-  MALLOC(new_open_file, sizeof(OpenFile));
-
-  /* Open the file for reading or writing */
-  if (mode == 'w') FOPEN(filename, new_open_file->fp, WRITE_MODE);
-  else FOPEN(filename, new_open_file->fp, READ_MODE);
-  free(filename);
-
-  /* Store the name of the file */
-  MALLOC(new_open_file->name, (strlen(file) + 1) * sizeof(char));
-  strcpy(new_open_file->name, file);
-
-  /* Insert the node in the beginning of the list */
-  new_open_file->next = open_files;
-  open_files = new_open_file;
-
+  extern Area *open_areas;
+  Area **prev;
+
+  if (--a->refs > 0) return;
+
+  for (prev = &open_areas; *prev != a; prev = &(*prev)->next);
+  *prev = a->next;
+
+  if (a->held == AREA_COMPILED) free(a->head);
+  else if (a->held == AREA_MAPPED)
+#ifndef _WIN32
+    munmap(a->head, a->head->size);
+#else
+    free(a->head);
+#endif
+  free(a->name);
+  free(a);
 }
 
-/* file_openSpriteFile
-   Opens a sprite file, given the sprite's directory.
+/* file_getAreaBound
+   Gets one of an open area's bounds.
 */
 void
-file_openSpriteFile(char *dir, char mode)
+file_getAreaBound(Area *a, int i, Bound *b)
 {
+  AreaBound *ab = file_areaBound(a, i);
 
-  char *sprite_file = getSpriteFilename(dir);
-  file_openFile(sprite_file, mode);
-  free(sprite_file);
+  b->type = ab->type;
+  switch (b->type)
+    {
+    case RECT:
+      b->b.rect.p1.x = ab->v[0];
+      b->b.rect.p1.y = ab->v[1];
+      b->b.rect.p2.x = ab->v[2];
+      b->b.rect.p2.y = ab->v[3];
+      break;
+    case LINE:
+      b->b.line.p1.x = ab->v[0];
+      b->b.line.p1.y = ab->v[1];
+      b->b.line.p2.x = ab->v[2];
+      b->b.line.p2.y = ab->v[3];
+      break;
+    case CIRCLE:
+      b->b.circle.p.x = ab->v[0];
+      b->b.circle.p.y = ab->v[1];
+      b->b.circle.r = ab->v[2];
+      break;
+    }
+  b->next = NULL;
 }
 
-/* file_closeSpriteFile
-   Closes a sprite file, given the sprite's directory.
+/* file_compileArea
+   Compiles a text area file, and writes it next to the text one with
+   AREA_SUFFIX on the end of its name.
 */
 void
-file_closeSpriteFile(char *dir)
+file_compileArea(char *areafile)
 {
-  char *sprite_file = getSpriteFilename(dir);
-  file_closeFile(sprite_file);
-  free(sprite_file);
+  FILE *outf;
+  AreaHeader *head = compileText(areafile, 0);
+  char *textfile = addDataPrefix(areafile);
+  char *binfile;
+
+  MALLOC(binfile, (strlen(textfile) + strlen(AREA_SUFFIX) + 1) * sizeof(char));
+  strcpy(binfile, textfile);
+  strcat(binfile, AREA_SUFFIX);
+  free(textfile);
+
+  FOPEN(binfile, outf, "wb");
+  if (fwrite(head, 1, head->size, outf) != head->size)
+    {
+      fprintf(stderr, "Error: Unable to write compiled area file %s\n", binfile);
+      exit(0);
+    }
+  fclose(outf);
+
+  printf("Compiled %s: %d layers, %d tiles of %d kinds, %d bounds, %d objects, %d bytes\n",
+	 binfile, head->n_layers, head->n_tiles, head->n_kinds, head->n_bounds,
+	 head->n_objects, head->size);
+  free(binfile);
+  free(head);
 }
 
-/* file_closeFile
-   Closes an open file.
+/* mapCompiled
+   Maps an area's compiled file into memory, or finds it in the pack, and
+   sets how it's held.  Returns NULL if there isn't one, or it's older than
+   the text file, or it isn't right.
 */
-void
-file_closeFile(char *file)
+AreaHeader *
+mapCompiled(char *areafile, int *held)
 {
-  extern OpenFile *open_files;
-  OpenFile *last_file;
-  OpenFile *this_file = open_files;
-
-  /* Loop through the linked list of open files to find the file */
-  while (strcmp(this_file->name, file) != 0)
+  char *textfile = addDataPrefix(areafile);
+  char *binfile;
+  struct stat text_st, bin_st;
+  AreaHeader *head = NULL;
+  void *packed;
+  int size;
+
+  MALLOC(binfile, (strlen(textfile) + strlen(AREA_SUFFIX) + 1) * sizeof(char));
+  strcpy(binfile, textfile);
+  strcat(binfile, AREA_SUFFIX);
+
+  /* A compiled area in the pack is copied out of it, since the map reads
+     its chunks out of it long after the pack is flushed.  Packs don't have
+     compiled areas that are out of date in them. */
+  if ((packed = pak_copy(binfile, &size)) != NULL)
     {
-      last_file = this_file;
-      this_file = this_file->next;
+      if (size >= sizeof(AreaHeader) && checkCompiled(packed, size))
+	{
+	  head = (AreaHeader *) packed;
+	  *held = AREA_COMPILED;
+	}
+      else
+	{
+	  fprintf(stderr, "Warning: %s in the pack isn't a compiled area this version can read, loading the text instead.\n", binfile);
+	  free(packed);
+	}
     }
-
-  /* In case the file specified hasn't been opened yet : */
-  if (this_file == NULL)
+  /* If the pack just has the text, that's what's loaded */
+  else if (pak_find(textfile, &size) == NULL &&
+	   stat(binfile, &bin_st) == 0 && bin_st.st_size >= sizeof(AreaHeader))
     {
-      fprintf(stderr, "Error: Cannot close unopened file: %s\n", file);
-      exit(0);
+      if (stat(textfile, &text_st) == 0 && text_st.st_mtime > bin_st.st_mtime)
+	fprintf(stderr, "Warning: %s is older than the area, loading the text instead.\n", binfile);
+      else
+	{
+#ifndef _WIN32
+	  int fd = open(binfile, O_RDONLY);
+	  if (fd >= 0)
+	    {
+	      void *p = mmap(NULL, bin_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	      close(fd);
+	      if (p != MAP_FAILED) head = (AreaHeader *) p;
+	    }
+#else
+	  FILE *inf;
+	  FOPEN(binfile, inf, "rb");
+	  MALLOC(head, bin_st.st_size);
+	  if (fread(head, 1, bin_st.st_size, inf) != bin_st.st_size)
+	    {
+	      free(head);
+	      head = NULL;
+	    }
+	  fclose(inf);
+#endif
+	  if (head != NULL && !checkCompiled(head, bin_st.st_size))
+	    {
+	      fprintf(stderr, "Warning: %s isn't a compiled area this version can read, loading the text instead.\n", binfile);
+#ifndef _WIN32
+	      munmap(head, bin_st.st_size);
+#else
+	      free(head);
+#endif
+	      head = NULL;
+	    }
+	  *held = AREA_MAPPED;
+	}
     }
 
+  free(textfile);
+  free(binfile);
+  return head;
+}
 
-  /* If this file is the head, assign the head to the next file: */
-  if (this_file == open_files) open_files = this_file->next;
-  /* Otherwise set the last file's next file to this file's next file */
-  else last_file->next = this_file->next;
-
-  /* Close the file and free it */
-  free(this_file->name);
-  fclose(this_file->fp);
-  free(this_file);
+/* checkCompiled
+   Makes sure a compiled area is one that can be read, that none of it is
+   outside the file, and that every layer, tile, kind, bound and object
+   passes the same checks the text would have when it was compiled.  Its
+   chunks have to be the size the map's are, and each one's tiles have to
+   be in it.
+*/
+int
+checkCompiled(AreaHeader *head, Uint32 size)
+{
+  Uint32 i, j, c;
+
+  if (memcmp(head->magic, AREA_MAGIC, 4) != 0 || head->version != AREA_VERSION ||
+      head->size != size || head->chunk_w != CHUNK_W || head->chunk_h != CHUNK_H)
+    return 0;
+
+  if (!fitsIn(head->layers, head->n_layers, sizeof(AreaLayer), size) ||
+      !fitsIn(head->tiles, head->n_tiles, sizeof(AreaTile), size) ||
+      !fitsIn(head->kinds, head->n_kinds, sizeof(AreaKind), size) ||
+      !fitsIn(head->bounds, head->n_bounds, sizeof(AreaBound), size) ||
+      !fitsIn(head->chunks, head->n_chunks, sizeof(Uint32), size) ||
+      !fitsIn(head->objects, head->n_objects, sizeof(AreaObject), size) ||
+      !fitsIn(head->strings, head->strings_size, 1, size) ||
+      head->strings_size == 0 || ((char *) head + head->strings)[head->strings_size - 1] != '\0' ||
+      head->tileset >= head->strings_size || head->music >= head->strings_size)
+    return 0;
+
+  if (head->n_layers == 0) return 0;
+  for (i = 0; i < head->n_layers; i++)
+    {
+      AreaLayer *l = &((AreaLayer *) ((char *) head + head->layers))[i];
+      Uint32 *starts = (Uint32 *) ((char *) head + head->chunks) + l->first_chunk;
+      Uint32 cw, n_chunks;
+
+      if (l->w <= 0 || l->h <= 0 ||
+	  l->first_tile > head->n_tiles || l->n_tiles > head->n_tiles - l->first_tile)
+	return 0;
+
+      /* It has to have a start for each chunk, and one for the end */
+      cw = ((Uint32) l->w + CHUNK_W - 1) / CHUNK_W;
+      n_chunks = ((Uint32) l->h + CHUNK_H - 1) / CHUNK_H;
+      if (l->first_chunk >= head->n_chunks ||
+	  (Uint64) cw * n_chunks >= head->n_chunks - l->first_chunk)
+	return 0;
+      n_chunks *= cw;
+      if (starts[0] != l->first_tile || starts[n_chunks] != l->first_tile + l->n_tiles)
+	return 0;
+
+      /* Each of the layer's tiles has to be inside it, in its chunk */
+      for (c = 0; c < n_chunks; c++)
+	{
+	  if (starts[c + 1] < starts[c]) return 0;
+	  for (j = starts[c]; j < starts[c + 1]; j++)
+	    {
+	      AreaTile *t = &((AreaTile *) ((char *) head + head->tiles))[j];
+	      if (t->x < 0 || t->x >= l->w || t->y < 0 || t->y >= l->h ||
+		  t->x / CHUNK_W != c % cw || t->y / CHUNK_H != c / cw ||
+		  t->kind >= head->n_kinds)
+		return 0;
+	    }
+	}
+    }
+  for (i = 0; i < head->n_kinds; i++)
+    {
+      AreaKind *k = &((AreaKind *) ((char *) head + head->kinds))[i];
+      if (k->type < 0 || k->type >= N_TILE_TYPES ||
+	  k->anim >= head->strings_size || k->first_bound > head->n_bounds ||
+	  k->n_bounds > head->n_bounds - k->first_bound)
+	return 0;
+    }
+  for (i = 0; i < head->n_bounds; i++)
+    {
+      AreaBound *b = &((AreaBound *) ((char *) head + head->bounds))[i];
+      if (b->type != RECT && b->type != LINE && b->type != CIRCLE) return 0;
+    }
+  for (i = 0; i < head->n_objects; i++)
+    {
+      AreaObject *o = &((AreaObject *) ((char *) head + head->objects))[i];
+      if (o->z < 0 || o->z >= head->n_layers || o->type < 0 || o->type >= N_OBJ_TYPES)
+	return 0;
+    }
+  return 1;
 }
 
-/* file_getAreaNLayers
-   Gets the number of layers from an open area file.
+/* fitsIn
+   Returns true if an array of n things of a size, at an offset, fits in a
+   file of a size.
 */
 int
-file_getAreaNLayers(char *file)
+fitsIn(Uint32 offset, Uint32 n, Uint32 each, Uint32 size)
 {
+  return (offset <= size && n <= (size - offset) / each);
+}
 
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
-  int n_layers;
+/* growArray
+   Makes room for one more thing at the end of an array that's growing,
+   doubling it when it's full.
+*/
+void *
+growArray(void *array, int n, int *max, int size)
+{
+  if (n < *max) return array;
 
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  *max = (*max == 0) ? 64 : *max * 2;
+  if ((array = realloc(array, *max * size)) == NULL)
     {
-      if (sscanf(buffer, "layers %d", &n_layers) == 1) return n_layers;
+      fprintf(stderr, "Unable to allocate memory.\n");
+      exit(0);
     }
+  return array;
+}
 
-  fprintf(stderr, "Error: Couldn't find number of layers in area file %s\n", file);
-  exit(0);
+/* addString
+   Adds a string to the string table of an area that's being compiled,
+   unless it's already there.  Returns where it is.
+*/
+Uint32
+addString(AreaBuilder *ab, char *str)
+{
+  int i, len = strlen(str) + 1;
+  Uint32 at;
+
+  for (i = 0; i < ab->n_names; i++)
+    if (strcmp(ab->strings + ab->names[i], str) == 0) return ab->names[i];
+
+  while (ab->head.strings_size + len > ab->max_strings)
+    ab->strings = growArray(ab->strings, ab->max_strings, &ab->max_strings, 1);
+
+  at = ab->head.strings_size;
+  memcpy(ab->strings + at, str, len);
+  ab->head.strings_size += len;
+
+  ab->names = growArray(ab->names, ab->n_names, &ab->max_names, sizeof(Uint32));
+  ab->names[ab->n_names++] = at;
+  return at;
 }
 
-/* file_getAreaBackgroundColor
-   Gets the background color of an area from an open file.
+/* addKind
+   Adds what a tile is to the kinds of an area that's being compiled,
+   unless there's one exactly like it already, in which case the bounds
+   that were just added for it are dropped.  Returns which kind it is.
 */
-Color
-file_getAreaBackgroundColor(char *file)
+Uint32
+addKind(AreaBuilder *ab, AreaKind *k)
 {
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
-  Color c;
+  unsigned int h = k->type * 31 + k->anim;
+  Uint32 i;
+  int j;
 
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  for (i = k->first_bound; i < k->first_bound + k->n_bounds; i++)
     {
-      if (sscanf(buffer, "bg_color %d %d %d", &c.r, &c.g, &c.b) == 3) return c;
+      h = h * 31 + ab->bounds[i].type;
+      for (j = 0; j < 4; j++) h = h * 31 + ab->bounds[i].v[j];
     }
+  h %= KIND_BUCKETS;
 
-  fprintf(stderr, "Error: Couldn't find background color in area file %s\n", file);
-  exit(0);
+  for (j = ab->kind_buckets[h]; j != -1; j = ab->kind_next[j])
+    {
+      AreaKind *o = &ab->kinds[j];
+      if (o->type == k->type && o->anim == k->anim && o->n_bounds == k->n_bounds &&
+	  (k->n_bounds == 0 ||
+	   memcmp(&ab->bounds[o->first_bound], &ab->bounds[k->first_bound],
+		  k->n_bounds * sizeof(AreaBound)) == 0))
+	{
+	  ab->head.n_bounds = k->first_bound;
+	  return j;
+	}
+    }
+
+  ab->kinds = growArray(ab->kinds, ab->head.n_kinds, &ab->max_kinds, sizeof(AreaKind));
+  ab->kind_next = growArray(ab->kind_next, ab->head.n_kinds, &ab->max_kind_next, sizeof(int));
+  ab->kinds[ab->head.n_kinds] = *k;
+  ab->kind_next[ab->head.n_kinds] = ab->kind_buckets[h];
+  ab->kind_buckets[h] = ab->head.n_kinds;
+  return ab->head.n_kinds++;
 }
 
-/* file_nextLayer
-   Scan to the next layer in the open area file.
+/* sortTiles
+   Sorts each layer's tiles in an area that's been compiled by the chunk
+   they're in, row by row, keeping the ones in each chunk in the order
+   they were read, and fills in where each chunk's tiles start.
 */
 void
-file_nextLayer(char *file)
+sortTiles(AreaBuilder *ab)
 {
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
+  AreaTile *sorted;
+  Uint32 i, c, k, n_chunks = 0;
+  Uint32 *fill;
 
-  /* A new layer is indicated by "layerstart" on a line by itself */
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  for (i = 0; i < ab->head.n_layers; i++)
     {
-      if (strstr(buffer, "layerstart") != NULL) return;
+      AreaLayer *l = &ab->layers[i];
+      l->first_chunk = n_chunks;
+      n_chunks += ((l->w + CHUNK_W - 1) / CHUNK_W) * ((l->h + CHUNK_H - 1) / CHUNK_H) + 1;
     }
+  ab->head.n_chunks = n_chunks;
+  ab->chunks = (Uint32 *) dyn_1dArrayAlloc(n_chunks, sizeof(Uint32));
+  sorted = (AreaTile *) dyn_1dArrayAlloc(ab->head.n_tiles > 0 ? ab->head.n_tiles : 1, sizeof(AreaTile));
 
-  /* No layer found, error */
-  fprintf(stderr, "Error: No more layers found in area file %s\n", file);
-  exit(0);
+  for (i = 0; i < ab->head.n_layers; i++)
+    {
+      AreaLayer *l = &ab->layers[i];
+      Uint32 *starts = ab->chunks + l->first_chunk;
+      int cw = (l->w + CHUNK_W - 1) / CHUNK_W;
+      Uint32 n = cw * ((l->h + CHUNK_H - 1) / CHUNK_H);
+
+      /* Count the tiles in each chunk, then work out where each one's
+	 start, and put them there */
+      for (k = l->first_tile; k < l->first_tile + l->n_tiles; k++)
+	starts[(ab->tiles[k].y / CHUNK_H) * cw + ab->tiles[k].x / CHUNK_W + 1]++;
+      starts[0] = l->first_tile;
+      for (c = 0; c < n; c++) starts[c + 1] += starts[c];
+
+      fill = (Uint32 *) dyn_1dArrayAlloc(n, sizeof(Uint32));
+      memcpy(fill, starts, n * sizeof(Uint32));
+      for (k = l->first_tile; k < l->first_tile + l->n_tiles; k++)
+	sorted[fill[(ab->tiles[k].y / CHUNK_H) * cw + ab->tiles[k].x / CHUNK_W]++] = ab->tiles[k];
+      dyn_1dArrayFree(fill);
+    }
+
+  free(ab->tiles);
+  ab->tiles = sorted;
 }
 
-/* file_nextTile
-   Scan to the next tile, return 0 if there are more tiles in the layer.
+/* openText
+   Reads a text file in, ready to be tokenized, from the pack if it's in
+   there.
 */
-int
-file_nextTile(char *file)
+void
+openText(Tokenizer *t, char *filename)
 {
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
+  if (!tryOpenText(t, filename)) exit(0);
+}
 
-  /* A new tile is indicated by "tilestart" on a line by itself */
-  while (fgets(buffer, 128, area_file->fp) != NULL)
-    {
-      if (strstr(buffer, "tilestart") != NULL) return 1;
+/* tryOpenText
+   Reads a text file in like openText(), and returns true, or false if it
+   can't be read.
+*/
+int
+tryOpenText(Tokenizer *t, char *filename)
+{
+  int size;
+  void *data = pak_find(filename, &size);
 
-      /* If the line is "layerend", there are no more tiles in the layer */
-      if (strstr(buffer, "layerend") != NULL) return 0;
-    }
-  return 0;
+  if (data == NULL) return tok_tryOpen(t, filename);
+  tok_openMem(t, filename, data, size);
+  return 1;
 }
 
-/* file_nextObject
-   Scan to the next object, return 0 if there are no more tiles.
+/* compileText
+   Reads a text area file and compiles it in memory, in one pass.  Returns
+   the compiled area, all in one block of memory.  A mistake in it quits,
+   unless it's careful, in which case NULL is returned once it's reported.
 */
-int
-file_nextObject(char *file)
+AreaHeader *
+compileText(char *areafile, int careful)
 {
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
+  AreaBuilder ab;
+  AreaHeader *head;
+  Tokenizer t;
+  jmp_buf trap;
+  char *filename = addDataPrefix(areafile);
+  int tileset = 0, music = 0, bg_color = 0;
+  Uint32 n_layers = 0, offset;
+  int i;
+
+  memset(&ab, 0, sizeof(AreaBuilder));
+  memcpy(ab.head.magic, AREA_MAGIC, 4);
+  ab.head.version = AREA_VERSION;
+  ab.head.chunk_w = CHUNK_W;
+  ab.head.chunk_h = CHUNK_H;
+  ab.kind_buckets = (int *) dyn_1dArrayAlloc(KIND_BUCKETS, sizeof(int));
+  for (i = 0; i < KIND_BUCKETS; i++) ab.kind_buckets[i] = -1;
+
+  if (!tryOpenText(&t, filename))
+    {
+      free(filename);
+      if (careful) return NULL;
+      exit(0);
+    }
+  free(filename);
 
-  /* A new object is indicated by "objectstart" on a line by itself */
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  /* Everything read so far is in the builder, which is thrown away on a
+     mistake */
+  if (careful)
     {
-      if (strstr(buffer, "objectstart") != NULL) return 1;
+      t.trap = &trap;
+      if (setjmp(trap))
+	{
+	  tok_close(&t);
+	  freeBuilder(&ab);
+	  return NULL;
+	}
+    }
 
-      /* If the line is "objectsend", there are no more objects */
-      if (strstr(buffer, "objectsend") != NULL) return 0;
+  /* The settings come first, then the layers and the objects.  They look
+     like this:
+       tileset "grass"
+       music "m2wily"
+       bg_color 91 213 255
+       layers 4
+       layerstart ... layerend
+       objectsstart ... objectsend
+  */
+  while (tok_next(&t) != TOK_END)
+    {
+      if (tok_is(&t, "tileset"))
+	{
+	  ab.head.tileset = addString(&ab, tok_string(&t));
+	  tileset = 1;
+	}
+      else if (tok_is(&t, "music"))
+	{
+	  ab.head.music = addString(&ab, tok_string(&t));
+	  music = 1;
+	}
+      else if (tok_is(&t, "bg_color"))
+	{
+	  ab.head.bg_color[0] = tok_int(&t);
+	  ab.head.bg_color[1] = tok_int(&t);
+	  ab.head.bg_color[2] = tok_int(&t);
+	  bg_color = 1;
+	}
+      else if (tok_is(&t, "layers") && ab.layers == NULL)
+	{
+	  int n = tok_int(&t);
+	  if (n <= 0) tok_error(&t, "at least one layer");
+	  ab.head.n_layers = n;
+	  ab.layers = (AreaLayer *) dyn_1dArrayAlloc(n, sizeof(AreaLayer));
+	}
+      else if (tok_is(&t, "layerstart") && n_layers < ab.head.n_layers)
+	compileLayer(&t, &ab, &ab.layers[n_layers++]);
+      else if (tok_is(&t, "objectsstart"))
+	{
+	  while (tok_next(&t) != TOK_END && tok_is(&t, "objectstart"))
+	    compileObject(&t, &ab);
+	  if (!tok_is(&t, "objectsend")) tok_error(&t, "objectstart or objectsend");
+	}
+      else if (ab.layers == NULL)
+	tok_error(&t, "tileset, music, bg_color or layers");
+      else
+	tok_error(&t, "layerstart or objectsstart");
     }
-  return 0;
-}
 
-/* file_nextTileBound
-   Scan to the next boundary of the tile, return 0 if there are no more bounds.
-*/
-int
-file_nextTileBound(char *file)
-{
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
+  tok_close(&t);
 
-  /* A new bound is created by "boundstart" on a line by itslef */
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  if (!tileset || !music || !bg_color || ab.layers == NULL || n_layers < ab.head.n_layers)
     {
-      if (strstr(buffer, "boundstart") != NULL) return 1;
+      if (!tileset)
+	fprintf(stderr, "Error: Could not find tileset specification in %s\n", areafile);
+      else if (!music)
+	fprintf(stderr, "Error: Could not find music specification in %s\n", areafile);
+      else if (!bg_color)
+	fprintf(stderr, "Error: Couldn't find background color in area file %s\n", areafile);
+      else
+	fprintf(stderr, "Error: Area file %s has fewer layers than it says\n", areafile);
+      freeBuilder(&ab);
+      if (careful) return NULL;
+      exit(0);
+    }
 
-      /* If the line is "tileend", there are no more boundaries */
-      if (strstr(buffer, "tileend") != NULL) return 0;
+  sortTiles(&ab);
+
+  /* Lay it all out in one block, with the strings at the end */
+  offset = sizeof(AreaHeader);
+  ab.head.layers = offset;
+  offset += ab.head.n_layers * sizeof(AreaLayer);
+  ab.head.tiles = offset;
+  offset += ab.head.n_tiles * sizeof(AreaTile);
+  ab.head.kinds = offset;
+  offset += ab.head.n_kinds * sizeof(AreaKind);
+  ab.head.bounds = offset;
+  offset += ab.head.n_bounds * sizeof(AreaBound);
+  ab.head.chunks = offset;
+  offset += ab.head.n_chunks * sizeof(Uint32);
+  ab.head.objects = offset;
+  offset += ab.head.n_objects * sizeof(AreaObject);
+  ab.head.strings = offset;
+  offset += ab.head.strings_size;
+  ab.head.size = (offset + 3) & ~3;
+
+  head = (AreaHeader *) calloc(1, ab.head.size);
+  if (head == NULL)
+    {
+      fprintf(stderr, "Unable to allocate memory.\n");
+      exit(0);
     }
-  return 0;
+  *head = ab.head;
+  memcpy((char *) head + head->layers, ab.layers, head->n_layers * sizeof(AreaLayer));
+  if (head->n_tiles > 0) memcpy((char *) head + head->tiles, ab.tiles, head->n_tiles * sizeof(AreaTile));
+  if (head->n_kinds > 0) memcpy((char *) head + head->kinds, ab.kinds, head->n_kinds * sizeof(AreaKind));
+  if (head->n_bounds > 0) memcpy((char *) head + head->bounds, ab.bounds, head->n_bounds * sizeof(AreaBound));
+  memcpy((char *) head + head->chunks, ab.chunks, head->n_chunks * sizeof(Uint32));
+  if (head->n_objects > 0) memcpy((char *) head + head->objects, ab.objects, head->n_objects * sizeof(AreaObject));
+  memcpy((char *) head + head->strings, ab.strings, head->strings_size);
+
+  freeBuilder(&ab);
+  return head;
 }
 
-/* file_getTileBound
-   Read the current boundary.
+/* freeBuilder
+   Frees everything an area being compiled has read.
 */
 void
-file_getTileBound(char *file, Bound *b)
+freeBuilder(AreaBuilder *ab)
 {
+  dyn_1dArrayFree(ab->layers);
+  free(ab->tiles);
+  free(ab->kinds);
+  free(ab->kind_next);
+  dyn_1dArrayFree(ab->kind_buckets);
+  dyn_1dArrayFree(ab->chunks);
+  free(ab->bounds);
+  free(ab->objects);
+  free(ab->strings);
+  free(ab->names);
+}
 
-  char buffer[128];
-  char type_buffer[64];
-  OpenFile *area_file = findOpenFile(file);
+/* compileLayer
+   Compiles one layer of a text area, up to its layerend.  It looks like
+   this:
+     dimensions 20 10
+     tilestart ... tileend
+     ...
+*/
+void
+compileLayer(Tokenizer *t, AreaBuilder *ab, AreaLayer *l)
+{
+  tok_expect(t, "dimensions");
+  l->w = tok_int(t);
+  l->h = tok_int(t);
+  if (l->w <= 0 || l->h <= 0) tok_error(t, "dimensions bigger than 0");
+
+  l->first_tile = ab->head.n_tiles;
+  while (tok_next(t) != TOK_END && tok_is(t, "tilestart"))
+    compileTile(t, ab, l);
+  if (!tok_is(t, "layerend")) tok_error(t, "tilestart or layerend");
+  l->n_tiles = ab->head.n_tiles - l->first_tile;
+}
 
-  /* Find the type */
-  while (fgets(buffer, 128, area_file->fp) != NULL) 
-    {
-      if (sscanf(buffer, "type %s", type_buffer) == 1) break;
-    }
-  
-  if (strstr(type_buffer, "rect") != NULL) b->type = RECT;
-  else if (strstr(type_buffer, "line") != NULL) b->type = LINE;
-  else if (strstr(type_buffer, "circle") != NULL) b->type = CIRCLE;
+/* compileTile
+   Compiles one tile of a text area, up to its tileend.  It looks like this:
+     pos 7 4
+     type 0
+     anim "cloud-0x0"
+     boundstart ... boundend
+     ...
+*/
+void
+compileTile(Tokenizer *t, AreaBuilder *ab, AreaLayer *l)
+{
+  AreaTile *at;
+  AreaKind k;
+  int seen = 0;        /* Which of pos, type and anim have been read */
+
+  ab->tiles = growArray(ab->tiles, ab->head.n_tiles, &ab->max_tiles, sizeof(AreaTile));
+  at = &ab->tiles[ab->head.n_tiles++];
+  k.first_bound = ab->head.n_bounds;
+  k.n_bounds = 0;
 
-  /* Get the boundary definition */
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  while (tok_next(t) != TOK_END && !tok_is(t, "tileend"))
     {
-      switch (b->type)
+      if (tok_is(t, "pos"))
+	{
+	  at->x = tok_int(t);
+	  at->y = tok_int(t);
+	  if (at->x < 0 || at->x >= l->w || at->y < 0 || at->y >= l->h)
+	    tok_error(t, "a position inside the layer");
+	  seen |= 1;
+	}
+      else if (tok_is(t, "type"))
+	{
+	  k.type = tok_int(t);
+	  if (k.type < 0 || k.type >= N_TILE_TYPES) tok_error(t, "a tile type");
+	  seen |= 2;
+	}
+      else if (tok_is(t, "anim"))
 	{
-	case RECT:
-	  if (sscanf(buffer, "%d %d %d %d", &b->b.rect.p1.x, &b->b.rect.p1.y, &b->b.rect.p2.x, &b->b.rect.p2.y) == 4) return;
-	  break;
-	case LINE:
-	  if (sscanf(buffer, "%d %d %d %d", &b->b.line.p1.x, &b->b.line.p1.y, &b->b.line.p2.x, &b->b.line.p2.y) != 4) return;
-	  break;
-	case CIRCLE:
-	  if (sscanf(buffer, "%d %d %d", &b->b.circle.p.x, &b->b.circle.p.y, &b->b.circle.r) != 3) return;
-	  break;
+	  k.anim = addString(ab, tok_string(t));
+	  seen |= 4;
 	}
+      else if (tok_is(t, "boundstart"))
+	{
+	  compileBound(t, ab);
+	  k.n_bounds++;
+	}
+      else tok_error(t, "pos, type, anim, boundstart or tileend");
     }
 
-  /* Still haven't found the proper boundary defs?  Error! */
-  printf("Error: Could not find %s boundary definition in file %s.\n", type_buffer, file);
-  exit(0);
+  if (t->type == TOK_END) tok_error(t, "tileend");
+  if (seen != 7) tok_error(t, "a pos, type and anim before tileend");
 
+  /* Tiles that are exactly alike share a kind */
+  at->kind = addKind(ab, &k);
 }
 
-/* file_getObjectAtts
-   Read in the attributes of the current object.
+/* compileBound
+   Compiles one of a tile's boundaries, up to its boundend.  It looks like
+   this:
+     type rect
+     0 0 31 31
+   with x1 y1 x2 y2 for rects and lines, and x y r for circles.
 */
 void
-file_getObjectAtts(char *file, int *z, Point *pos, Velocity *vel, int *type)
+compileBound(Tokenizer *t, AreaBuilder *ab)
 {
-  char buffer[128];
-  int atts_found = 0;
-  OpenFile *area_file = findOpenFile(file);
+  AreaBound *out;
+  int i, n;
 
-  while (atts_found < 3 && fgets(buffer, 128, area_file->fp) != NULL)
-    {
-      if (sscanf(buffer, "pos %d %d %d", z, &pos->x, &pos->y) == 3) atts_found++;
-      else if (sscanf(buffer, "vel %f %f", &vel->x, &vel->y) == 2) atts_found++;
-      else if (sscanf(buffer, "type %d", type) == 1) atts_found++;
-    }
+  ab->bounds = growArray(ab->bounds, ab->head.n_bounds, &ab->max_bounds, sizeof(AreaBound));
+  out = &ab->bounds[ab->head.n_bounds++];
+  memset(out, 0, sizeof(AreaBound));
 
-  if (atts_found == 3) return;
+  tok_expect(t, "type");
+  tok_next(t);
+  if (tok_is(t, "rect")) out->type = RECT;
+  else if (tok_is(t, "line")) out->type = LINE;
+  else if (tok_is(t, "circle")) out->type = CIRCLE;
+  else tok_error(t, "rect, line or circle");
 
-  /* Haven't found all the attributes? Error! */
-  fprintf(stderr, "Error: Could not find enough object attributes in file %s\n", file);
-  exit(0);
+  n = (out->type == CIRCLE) ? 3 : 4;
+  for (i = 0; i < n; i++) out->v[i] = tok_int(t);
+
+  tok_expect(t, "boundend");
 }
 
-/* file_getTileAtts
-   Read the attributes of the current tile, not including boundaries.
+/* compileObject
+   Compiles one object of a text area, up to its objectend.  It looks like
+   this:
+     pos 2 700 250
+     vel 20.000000 0.000000
+     type 1
+   where the first number of the pos is the object's layer.
 */
 void
-file_getTileAtts(char *file, int *x, int *y, int *type, char **anim_name)
+compileObject(Tokenizer *t, AreaBuilder *ab)
 {
+  AreaObject *o;
+  int seen = 0;        /* Which of pos, vel and type have been read */
 
-  char buffer[128];
-  char anim_name_buffer[64];
-  int atts_found = 0;
-  OpenFile *area_file = findOpenFile(file);
+  ab->objects = growArray(ab->objects, ab->head.n_objects, &ab->max_objects, sizeof(AreaObject));
+  o = &ab->objects[ab->head.n_objects++];
 
-  while (atts_found < 3 && fgets(buffer, 128, area_file->fp) != NULL)
+  while (tok_next(t) != TOK_END && !tok_is(t, "objectend"))
     {
-      if (sscanf(buffer, "pos %d %d", x, y) == 2) atts_found++;
-      else if (sscanf(buffer, "type %d", type) == 1) atts_found++;
-      else if (sscanf(buffer, "anim %*[\"]%[^\"]%*[\"]", anim_name_buffer) == 1)
+      if (tok_is(t, "pos"))
+	{
+	  o->z = tok_int(t);
+	  if (o->z < 0 || o->z >= (int) ab->head.n_layers) tok_error(t, "a layer in the area");
+	  o->x = tok_int(t);
+	  o->y = tok_int(t);
+	  seen |= 1;
+	}
+      else if (tok_is(t, "vel"))
 	{
-	  atts_found++;
-	  *anim_name = trimString(anim_name_buffer);
+	  o->vx = tok_float(t);
+	  o->vy = tok_float(t);
+	  seen |= 2;
 	}
+      else if (tok_is(t, "type"))
+	{
+	  o->type = tok_int(t);
+	  if (o->type < 0 || o->type >= N_OBJ_TYPES) tok_error(t, "an object type");
+	  seen |= 4;
+	}
+      else tok_error(t, "pos, vel, type or objectend");
     }
 
-  if (atts_found == 3) return;
-
-  /* Haven't found all the attributes? Error! */
-  fprintf(stderr, "Error: Could not find enough tile attributes in file %s\n", file);
-  exit(0);
-
+  if (t->type == TOK_END) tok_error(t, "objectend");
+  if (seen != 7) tok_error(t, "a pos, vel and type before objectend");
 }
 
-/* file_getLayerDims
-   Gets the dimensions for the current layer.
+/* file_openDat
+   Reads a dat file in, in one go, the first time it's asked for.  Returns
+   it, with all of its name and value pairs.
 */
-void
-file_getLayerDims(char *file, int *w, int *h)
+DatFile *
+file_openDat(char *file)
 {
-  char buffer[128];
-  OpenFile *area_file = findOpenFile(file);
-  while (fgets(buffer, 128, area_file->fp) != NULL)
+  extern DatFile **dat_files;
+  extern int n_dats, max_dats;
+  extern NameMap dat_names;
+  DatFile *d;
+  char *filename;
+  int max_pairs = 0, i;
+
+  if ((i = nam_lookup(&dat_names, file)) >= 0) return dat_files[i];
+
+  MALLOC(d, sizeof(DatFile));
+  d->name = trimString(file);
+  d->n_pairs = 0;
+  d->pairs = NULL;
+  nam_initMap(&d->index);
+
+  filename = addDataPrefix(file);
+  openText(&d->tok, filename);
+  free(filename);
+
+  /* Lines are in this format:
+     "name" "value"
+     The strings are left where they are in the tokenizer's copy of the
+     file.
+  */
+  while (tok_next(&d->tok) != TOK_END)
     {
-      if (sscanf(buffer, "dimensions %d %d", w, h) == 2) return;
+      if (d->tok.type != TOK_STRING) tok_error(&d->tok, "a name in quotes");
+      d->pairs = growArray(d->pairs, d->n_pairs, &max_pairs, sizeof(DatPair));
+      d->pairs[d->n_pairs].name = d->tok.token;
+      d->pairs[d->n_pairs].value = tok_string(&d->tok);
+
+      /* If a name's in there twice, the first one counts */
+      nam_set(&d->index, nam_intern(d->pairs[d->n_pairs].name), d->n_pairs);
+      d->n_pairs++;
     }
 
-  /* No dimensions found, error */
-  fprintf(stderr, "Error: No dimensions found in area file %s\n", file);
-  exit(0);
+  dat_files = growArray(dat_files, n_dats, &max_dats, sizeof(DatFile *));
+  dat_files[n_dats] = d;
+  nam_set(&dat_names, nam_intern(file), n_dats++);
+  return d;
 }
 
-/* file_getNextDatPair
-   Gets the next data pair out of an open dat file.  Returns 0 when a pair
-   cannot be found.
+/* file_loadDats
+   Reads in a dat file, and every dat file it names, and every one they
+   name, so they're all in the registry before anything needs them.
 */
-int
-file_getNextDatPair(char *file, char **name, char **value)
+void
+file_loadDats(char *file)
 {
-  OpenFile *dat_file;
+  extern NameMap dat_names;
+  DatFile *d;
+  int i;
 
-  /* Temporary strings for name and value pairs */
-  char n[64], v[64];
+  if (nam_lookup(&dat_names, file) >= 0) return;
 
-  dat_file = findOpenFile(file);
-
-  /* Get the next line: */
-  while (fscanf(dat_file->fp, "%*[\"]%[^\"]%*[\"] %*[\"]%[^\"]%*[\"]\n", n, v) == 2)
+  d = file_openDat(file);
+  for (i = 0; i < d->n_pairs; i++)
     {
-      *name = trimString(n);
-      *value = trimString(v);
-      return 1;
-    }
+      char *v = d->pairs[i].value;
+      int len = strlen(v);
 
-  /* None found, return 0 */
-  return 0;
+      if (len > 4 && strcmp(v + len - 4, ".dat") == 0 && datExists(v))
+	file_loadDats(v);
+    }
 }
 
-/* file_getNextSound
-   Gets the next sound name and file out of a datfile.
+/* datExists
+   Tells whether a dat file named in another one is really there, in the
+   pack or on disk.  Some are listed without being shipped.
 */
 int
-file_getNextSound(char *file, char **name, char **sound_file)
+datExists(char *file)
 {
-  char *short_filename;
+  char *filename = addDataPrefix(file);
+  int found = fileExists(filename);
 
-  if (!file_getNextDatPair(file, name, &short_filename)) return 0;
-  *sound_file = addDataPrefix(short_filename);
-  free (short_filename);
-  return 1;
+  free(filename);
+  return found;
 }
 
-/* file_getNextSpriteAnim
-   Gets the next animation name and directory out of an open sprite file.
+/* fileExists
+   Tells whether a file, with its full path, is in the pack or on disk.
 */
 int
-file_getNextSpriteAnim(char *dir, char **anim_name, char **anim_dir)
+fileExists(char *filename)
 {
-  char n[64], v[64];
-  char *sprite_filename = getSpriteFilename(dir);
-  OpenFile *sprite_file = findOpenFile(sprite_filename);
+  FILE *fp;
+  int size;
+
+  if (pak_find(filename, &size) != NULL) return 1;
+  if ((fp = fopen(filename, "rb")) == NULL) return 0;
+  fclose(fp);
+  return 1;
+}
 
-  while (fscanf(sprite_file->fp, "%*[\"]%[^\"]%*[\"] %*[\"]%[^\"]%*[\"]\n", n, v) == 2)
+/* file_preloadArea
+   Gets everything an area uses from its tileset and music ready at once:
+   the tileset's dat file is read in, and the animations the area's tiles
+   use and the music are unpacked from the pack together, before they're
+   loaded one by one.
+*/
+void
+file_preloadArea(char *areafile)
+{
+  Area *a = file_openArea(areafile);
+  DatFile *tileset;
+  NameMap used;
+  char **paths;
+  int i, j, n = 0;
+
+  tileset = file_openDat(file_getDatPairValue(TILESET_DATFILE, file_areaString(a, a->head->tileset)));
+  MALLOC(paths, (tileset->n_pairs + 1) * sizeof(char *));
+
+  /* Each animation once, however many tiles use it */
+  nam_initMap(&used);
+  for (i = 0; i < a->head->n_kinds; i++)
     {
+      Name anim = nam_intern(file_areaString(a, file_areaKind(a, i)->anim));
 
-      *anim_name = trimString(n);
-      MALLOC(*anim_dir, (strlen(v) + strlen(dir) + 1) * sizeof(char));
-      strcpy(*anim_dir, dir);
-      strcat(*anim_dir, v);
-      return 1;
+      if ((j = nam_get(&tileset->index, anim)) >= 0 && nam_set(&used, anim, j))
+	paths[n++] = tileset->pairs[j].value;
     }
+  nam_freeMap(&used);
+  paths[n++] = file_getDatPairValue(MUSIC_DATFILE, file_areaString(a, a->head->music));
 
-  /* None found, return 0 */
-  return 0;
+  pak_prefetch(paths, n);
+  free(paths);
+  file_closeArea(a);
 }
 
-/* file_countDatPairs
-   Counts the number of name value pairs in a datfile.
+/* file_openSpriteDat
+   Reads in a sprite file, given the sprite's directory.
 */
-int
-file_countDatPairs(char *file)
+DatFile *
+file_openSpriteDat(char *dir)
 {
-  FILE *inf;
-  char *filename = addDataPrefix(file);
-  int n = 0;
-  FOPEN(filename, inf, READ_MODE);
-  free(filename);
+  char *sprite_file = getSpriteFilename(dir);
+  DatFile *d = file_openDat(sprite_file);
+  free(sprite_file);
+  return d;
+}
 
-  while (fscanf(inf, "%*[\"]%*[^\"]%*[\"] %*[\"]%*[^\"]%*[\"]\n") != EOF)
-    n++;
+/* file_getDatPair
+   Gets a copy of one of a dat file's name and value pairs.
+*/
+void
+file_getDatPair(DatFile *d, int i, char **name, char **value)
+{
+  *name = trimString(d->pairs[i].name);
+  *value = trimString(d->pairs[i].value);
+}
 
-  fclose(inf);
-  return n;
+/* file_getSound
+   Gets a sound's name and its file, with the full path, out of a dat file.
+*/
+void
+file_getSound(DatFile *d, int i, char **name, char **sound_file)
+{
+  *name = trimString(d->pairs[i].name);
+  *sound_file = addDataPrefix(d->pairs[i].value);
 }
 
-/* file_countSpriteAnims
-   Counts the number of animations in a sprite file given the sprites directory
+/* file_getSpriteAnim
+   Gets an animation's name and directory out of a sprite file.
 */
-int
-file_countSpriteAnims(char *dir)
+void
+file_getSpriteAnim(DatFile *d, char *dir, int i, char **anim_name, char **anim_dir)
 {
-  int n;
-  char *sprite_file = getSpriteFilename(dir);
-  n = file_countDatPairs(sprite_file);
-  free(sprite_file);
-  return n;
+  *anim_name = trimString(d->pairs[i].name);
+  MALLOC(*anim_dir, (strlen(d->pairs[i].value) + strlen(dir) + 1) * sizeof(char));
+  strcpy(*anim_dir, dir);
+  strcat(*anim_dir, d->pairs[i].value);
 }
 
 /* file_getDatValue
@@ -597,34 +1138,51 @@ file_countSpriteAnims(char *dir)
 char *
 file_getDatValue(char *file, char *name)
 {
+  return (trimString(file_getDatPairValue(file, name)));
+}
 
-  FILE *inf;
-  /* Temporary strings for name and value pairs */
-  char n[64], v[64];
-  char *filename = addDataPrefix(file);
+/* file_getDatPairValue
+   Finds the value for a name in a dat file, without copying it.  It stays
+   where it is until file_free().
+*/
+char *
+file_getDatPairValue(char *file, char *name)
+{
+  DatFile *d = file_openDat(file);
+  int i = nam_lookup(&d->index, name);
 
-  FOPEN(filename, inf, READ_MODE);
-  free(filename);
+  if (i >= 0) return d->pairs[i].value;
 
-  /* Search line by line: */
-  /* Lines are in this format:
-     "name" "value"
-  */
-  while (fscanf(inf, "%*[\"]%[^\"]%*[\"] %*[\"]%[^\"]%*[\"]\n", n, v) == 2)
-    {
-      /* Return the value if the name matched */
-      if (strcmp(name, n) == 0)
-	{
-	  fclose(inf);
-	  return (trimString(v));
-	}
-    }
   /* Not found, error and quit */
-  fclose(inf);
   fprintf(stderr, "Error: value for name \"%s\" in file \"%s\" not found.\n", name, file);
   exit(0);
 }
 
+/* file_free
+   Frees all of the dat files that have been read in.
+*/
+void
+file_free(void)
+{
+  extern DatFile **dat_files;
+  extern int n_dats, max_dats;
+  extern NameMap dat_names;
+  int i;
+
+  for (i = 0; i < n_dats; i++)
+    {
+      tok_close(&dat_files[i]->tok);
+      free(dat_files[i]->pairs);
+      free(dat_files[i]->name);
+      nam_freeMap(&dat_files[i]->index);
+      free(dat_files[i]);
+    }
+  free(dat_files);
+  dat_files = NULL;
+  n_dats = max_dats = 0;
+  nam_freeMap(&dat_names);
+}
+
 /* file_loadAnim
    Given an animation's directory, the animations name, 
    and the address where the
@@ -633,88 +1191,210 @@ file_getDatValue(char *file, char *name)
 void
 file_loadAnim(char *name, char *dir, AnimData *anim)
 {
-  FILE *inf;
+  readAnim(name, dir, anim, 0);
+}
+
+/* file_reloadAnim
+   Reads an animation again while the game runs.  If there's a mistake in
+   its file, or one of its images isn't there, it's reported with its line
+   and column, nothing is left allocated, and false is returned instead of
+   quitting.
+*/
+int
+file_reloadAnim(char *name, char *dir, AnimData *anim)
+{
+  return readAnim(name, dir, anim, 1);
+}
 
+/* readAnim
+   Reads an animation, quitting on a mistake unless it's careful, in which
+   case it checks its images are there too, and returns false on a
+   mistake.
+*/
+int
+readAnim(char *name, char *dir, AnimData *anim, int careful)
+{
+  Tokenizer t;
+  jmp_buf trap;
   char *anim_dir = addDataPrefix(dir);
   char *anim_file;
-  char buffer[128], img_buff[64];
-  int x, y, play_mode, i = 0;
+  int play_mode, max_frames = 0, max_files = 0, i;
 
   /* Get the full path and filename of the animation file */
   MALLOC(anim_file, (strlen(anim_dir) + strlen(ANIM_FILENAME) + 1) * sizeof(char));
   strcpy(anim_file, anim_dir);
   strcat(anim_file, ANIM_FILENAME);
 
-  /* Open the file */
-  FOPEN(anim_file, inf, READ_MODE);
+  /* Read it in */
+  if (!tryOpenText(&t, anim_file))
+    {
+      free(anim_file);
+      free(anim_dir);
+      if (careful) return 0;
+      exit(0);
+    }
   free(anim_file);
 
-  /* Set the animation's name: */
+  /* Everything it's read is kept in the animation as it goes, so it can
+     all be freed after a mistake */
+  anim->name = anim->dir = NULL;
+  anim->frames = NULL;
+  anim->files = NULL;
+  anim->n_frames = 0;
+  if (careful)
+    {
+      t.trap = &trap;
+      if (setjmp(trap))
+	{
+	  anim_freeAnim(anim);
+	  free(anim_dir);
+	  tok_close(&t);
+	  return 0;
+	}
+    }
+
+  /* Set the animation's name, and remember where it came from: */
   MALLOC(anim->name, (strlen(name) + 1) * sizeof(char));
   strcpy(anim->name, name);
+  MALLOC(anim->dir, (strlen(dir) + 1) * sizeof(char));
+  strcpy(anim->dir, dir);
 
-  /* Get the playback mode from the first line of the file */
+  /* Get the playback mode and the default delay from the start of the
+     file */
   /* Format:
      play 0
-  */
-  if (fscanf(inf, "play %d ", &play_mode) != 1)
-    {
-      fprintf(stderr, "Error: Could not find the play mode in animation: %s\n", dir);
-      exit(0);
-    }
-  /* Get the default delay from the 2nd line */
-  /* Format:
      delay .25
   */
-  if (fscanf(inf, "delay %f ", &anim->def_delay) != 1)
-    {
-      fprintf(stderr, "Error: Could not find the default delay in animation: %s\n", dir);
-      exit(0);
-    }
-
+  tok_expect(&t, "play");
+  play_mode = tok_int(&t);
+  tok_expect(&t, "delay");
+  anim->def_delay = tok_float(&t);
 
   anim->play_mode = (play_mode == 0) ? SINE : REPEAT;
 
-  /* Count the number of frames */
-  while (fscanf(inf, "%*[\"]%*[^\"]%*[\"] %*d %*d\n") != EOF)
-    i++;
-  
-  anim->n_frames = i;
-
-  /* Go back to the beginning of the file */
-  rewind(inf);
-
-  /* Allocate the array for the frames */
-  anim->frames = (Frame *) dyn_1dArrayAlloc(anim->n_frames, sizeof(Frame));
-
-  i = 0;
-  /* Populate the frame array */
+  /* Populate the frame array, growing it as the frames are read */
   /* Format of frame data:
      "gfx_file.png" 0 0
      where the two numbers are the x,y offset
   */
-  while (fgets(buffer, 128, inf) != NULL)
+  while (tok_next(&t) != TOK_END)
     {
-      if (sscanf(buffer, "%*[\"]%[^\"]%*[\"] %d %d", img_buff, &x, &y) == 3)
-	{
-	  char *gfx_file;
-	  MALLOC(gfx_file, (strlen(img_buff) + strlen(anim_dir) + 1) * sizeof(char));
-	  strcpy(gfx_file, anim_dir);
-	  strcat(gfx_file, img_buff);
-
-	  anim->frames[i].image = gfx_loadImage(gfx_file);
-	  anim->frames[i].offset.x = x;
-	  anim->frames[i].offset.y = y;
+      char *gfx_file;
+      Frame *f;
+
+      if (t.type != TOK_STRING) tok_error(&t, "a frame's image file in quotes");
+      anim->frames = growArray(anim->frames, anim->n_frames, &max_frames, sizeof(Frame));
+      f = &anim->frames[anim->n_frames++];
+
+      MALLOC(gfx_file, (strlen(t.token) + strlen(anim_dir) + 1) * sizeof(char));
+      strcpy(gfx_file, anim_dir);
+      strcat(gfx_file, t.token);
+      anim->files = growArray(anim->files, anim->n_frames - 1, &max_files, sizeof(char *));
+      anim->files[anim->n_frames - 1] = gfx_file;
+      if (careful && !fileExists(gfx_file)) tok_error(&t, "an image file that's there");
+
+      f->offset.x = tok_int(&t);
+      f->offset.y = tok_int(&t);
+    }
+  if (anim->n_frames == 0) tok_error(&t, "at least one frame");
 
-	  free(gfx_file);
-	  i++;
-	}
+  /* The images aren't loaded yet.  Whatever the animation is in loads
+     them, all together with the rest it needs, or in the background if
+     it's drawn before then. */
+  for (i = 0; i < anim->n_frames; i++)
+    {
+      anim->frames[i].page = NULL;
+      memset(&anim->frames[i].src, 0, sizeof(SDL_Rect));
     }
+  anim->gfx = GFX_OUT;
+  anim->pages = NULL;
+  anim->own = NULL;
 
   free(anim_dir);
-  fclose(inf);
+  tok_close(&t);
 
+  /* Start the animation's shared clock */
+  anim_initClock(&anim->clock, anim);
+  return 1;
+}
+
+/* file_benchArea
+   Makes up a big area with a number of tiles in it, and times loading it,
+   from the text and then compiled.  The files are deleted afterwards.
+*/
+void
+file_benchArea(int n_tiles)
+{
+  char *textfile, *binfile;
+  AreaHeader *head;
+  Area *a;
+  clock_t start;
+  double text_ms, map_ms;
+  struct stat st;
+  Uint32 i, sum = 0;
+
+  writeBenchArea(BENCH_AREA, n_tiles);
+  textfile = addDataPrefix(BENCH_AREA);
+  stat(textfile, &st);
+
+  /* Parse the text */
+  start = clock();
+  head = compileText(BENCH_AREA, 0);
+  text_ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+  printf("Text: %d tiles, %d bounds, %ld bytes parsed in %.1f ms (%.1f MB/s)\n",
+	 head->n_tiles, head->n_bounds, (long) st.st_size, text_ms,
+	 text_ms > 0 ? st.st_size / (text_ms * 1000.0) : 0.0);
+  free(head);
+
+  /* Compile it, then map it in and look at every tile, since the pages
+     aren't read until they're touched */
+  file_compileArea(BENCH_AREA);
+  start = clock();
+  a = file_openArea(BENCH_AREA);
+  for (i = 0; i < a->head->n_tiles; i++) sum += file_areaKind(a, file_areaTile(a, i)->kind)->type;
+  map_ms = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+  printf("Compiled: %d tiles mapped in %.1f ms\n", a->head->n_tiles, map_ms);
+  file_closeArea(a);
+
+  MALLOC(binfile, (strlen(textfile) + strlen(AREA_SUFFIX) + 1) * sizeof(char));
+  strcpy(binfile, textfile);
+  strcat(binfile, AREA_SUFFIX);
+  remove(binfile);
+  remove(textfile);
+  free(binfile);
+  free(textfile);
 }
 
+/* writeBenchArea
+   Writes a made-up text area, with one square layer holding a number of
+   tiles, a bound on most of them, and a few objects.
+*/
+void
+writeBenchArea(char *areafile, int n_tiles)
+{
+  FILE *outf;
+  char *filename = addDataPrefix(areafile);
+  int i, side = 1;
 
+  while (side * side < n_tiles) side++;
 
+  FOPEN(filename, outf, WRITE_MODE);
+  free(filename);
+
+  fprintf(outf, "tileset \"grass\"\nmusic \"m2wily\"\nbg_color 91 213 255\nlayers 1\n\n");
+  fprintf(outf, "layerstart\ndimensions %d %d\n\n", side, side);
+  for (i = 0; i < n_tiles; i++)
+    {
+      fprintf(outf, "tilestart\npos %d %d\ntype %d\nanim \"tile-%d\"\n",
+	      i % side, i / side, i % N_TILE_TYPES, i % 16);
+      if (i % 4 != 3) fprintf(outf, "boundstart\ntype rect\n0 0 31 31\nboundend\n");
+      if (i % 8 == 0) fprintf(outf, "boundstart\ntype line\n0 31 31 0\nboundend\n");
+      fprintf(outf, "tileend\n");
+    }
+  fprintf(outf, "layerend\n\nobjectsstart\n");
+  for (i = 0; i < 16; i++)
+    fprintf(outf, "objectstart\npos 0 %d %d\nvel 20.000000 0.000000\ntype %d\nobjectend\n",
+	    i * 100, i * 50, i == 0 ? 0 : 1);
+  fprintf(outf, "objectsend\n");
+  fclose(outf);
+}
@@ -5,6 +5,8 @@
 #include "defs.h"
 #include "graphics.h"
 #include "animation.h"
+#include "token.h"
+#include "names.h"
 
 /* File types that file.c works with:
 
@@ -17,19 +19,37 @@
 
    anim files.  These contain information about animations.
 
+   compiled area files.  An .area file can be compiled (giraffe -c) into a
+   binary file next to it, with AREA_SUFFIX on the end of its name, which
+   is mapped straight into memory instead of being parsed.  A text area
+   is compiled into the same format in memory when it's opened, so the
+   rest of the game only ever sees the compiled format.
+
+   All of the text files are read in one go and parsed in one pass by the
+   token module, so a mistake in one is reported with its line and column.
+
    For now, because I'm lazy, all path names are relative to the root data
    directory path.
 
 */
 
-/* Open files are kept in a linked list.  Each node has the name of the file
-   and the pointer to the file. */
-typedef struct openfile_struct
+/* A name and value pair from a .dat file */
+typedef struct datpair_struct
 {
   char *name;
-  FILE *fp;
-  struct openfile_struct *next;
-} OpenFile;
+  char *value;
+} DatPair;
+
+/* A .dat file that's been read in.  They're kept in a registry, by name,
+   so each file is only read once, and stay there until file_free(). */
+typedef struct datfile_struct
+{
+  char *name;
+  Tokenizer tok;       /* The file itself, which the pairs point into */
+  int n_pairs;
+  DatPair *pairs;
+  NameMap index;       /* Which pair each name is in */
+} DatFile;
 
 /* String for opening files in read mode: */
 #define READ_MODE "r"
@@ -45,34 +65,127 @@ if (((pointer) = fopen((name), (mode))) == NULL) \
 } \
 } while(0)
 
+/* The compiled area format.  All of it is 4 byte numbers, in the byte
+   order of the machine that compiled it, and everything after the header
+   is found by its offset from the start of the file.
+
+   Each layer's tiles are sorted by the map chunk they're in, so the map
+   can read a chunk straight out of the area when it's needed, and what a
+   tile is (its type, animation and bounds) is kept once for every tile
+   that's exactly the same, as a kind. */
+#define AREA_MAGIC "GARA"
+#define AREA_VERSION 2
+#define AREA_SUFFIX ".bin"
+
+typedef struct area_header_struct
+{
+  char magic[4];       /* AREA_MAGIC */
+  Uint32 version;      /* AREA_VERSION, which also shows the byte order */
+  Uint32 size;         /* The size of the whole file */
+  Sint32 bg_color[3];
+  Uint32 tileset;      /* The tileset's name, in the string table */
+  Uint32 music;        /* The music's name, in the string table */
+  Uint32 chunk_w, chunk_h;    /* The size of the chunks the tiles are
+				 sorted into */
+  Uint32 n_layers, layers;    /* Each array's size and offset */
+  Uint32 n_tiles, tiles;
+  Uint32 n_kinds, kinds;
+  Uint32 n_bounds, bounds;
+  Uint32 n_chunks, chunks;
+  Uint32 n_objects, objects;
+  Uint32 strings_size, strings;
+} AreaHeader;
+
+typedef struct area_layer_struct
+{
+  Sint32 w, h;
+  Uint32 first_tile, n_tiles;    /* The layer's tiles in the tile array */
+  Uint32 first_chunk;  /* Where each of its chunks' tiles start in the tile
+			  array, row by row, is in the chunk array from
+			  here, with one more after them for where the last
+			  one ends */
+} AreaLayer;
+
+typedef struct area_tile_struct
+{
+  Sint32 x, y;
+  Uint32 kind;         /* What the tile is, in the kind array */
+} AreaTile;
+
+typedef struct area_kind_struct
+{
+  Sint32 type;
+  Uint32 anim;         /* The animation's name, in the string table */
+  Uint32 first_bound, n_bounds;  /* The bounds in the bound array */
+} AreaKind;
+
+typedef struct area_bound_struct
+{
+  Sint32 type;
+  Sint32 v[4];         /* x1 y1 x2 y2 for lines and rects, x y r for
+			  circles */
+} AreaBound;
+
+typedef struct area_object_struct
+{
+  Sint32 z, x, y, type;
+  float vx, vy;
+} AreaObject;
+
+/* Where an open area's compiled copy is: in memory, compiled from the
+   text or copied out of the resource pack, or a compiled file mapped into
+   memory */
+enum area_held {AREA_COMPILED, AREA_MAPPED};
+
+/* An open area.  Areas are kept open in a list, like files, so every
+   module loading something from the same area shares one copy. */
+typedef struct area_struct
+{
+  char *name;
+  int refs;            /* How many times it's been opened and not closed */
+  int held;            /* Where the compiled area is: see area_held */
+  AreaHeader *head;    /* The start of the compiled area */
+  struct area_struct *next;
+} Area;
+
+/* Get the parts of an open area */
+#define AREA_ARRAY(a, type, off) ((type *) ((char *) (a)->head + (off)))
+#define file_areaLayer(a, i) (&AREA_ARRAY(a, AreaLayer, (a)->head->layers)[i])
+#define file_areaTile(a, i) (&AREA_ARRAY(a, AreaTile, (a)->head->tiles)[i])
+#define file_areaKind(a, i) (&AREA_ARRAY(a, AreaKind, (a)->head->kinds)[i])
+#define file_areaChunk(a, i) (AREA_ARRAY(a, Uint32, (a)->head->chunks)[i])
+#define file_areaBound(a, i) (&AREA_ARRAY(a, AreaBound, (a)->head->bounds)[i])
+#define file_areaObject(a, i) (&AREA_ARRAY(a, AreaObject, (a)->head->objects)[i])
+#define file_areaString(a, off) (AREA_ARRAY(a, char, (a)->head->strings) + (off))
+
 #define DATA_PREFIX "data/"
 #define MUSIC_DATFILE "music/music.dat"
 #define TILESET_DATFILE "tilesets/tilesets.dat"
 #define ANIM_FILENAME "anim"
 #define SPRITE_FILENAME "sprite"
 
+/* Where giraffe -b writes the area it times loading */
+#define BENCH_AREA "levels/bench.area"
+
 extern char *file_getDatValue(char *file, char *name);
+extern char *file_getDatPairValue(char *file, char *name);
 extern char *file_getAreaMusicFile(char *areafile);
 extern char *file_getAreaTilesetFile(char *areafile);
-extern void file_openFile(char *file, char mode);
-extern void file_closeFile(char *file);
-extern void file_openSpriteFile(char *dir, char mode);
-extern void file_closeSpriteFile(char *dir);
-extern int file_getNextDatPair(char *file, char **name, char **value);
-extern int file_getNextSound(char *file, char **name, char **sound_file);
-extern int file_countDatPairs(char *file);
+extern DatFile *file_openDat(char *file);
+extern DatFile *file_openSpriteDat(char *dir);
+extern void file_loadDats(char *file);
+extern void file_preloadArea(char *areafile);
+extern void file_getDatPair(DatFile *d, int i, char **name, char **value);
+extern void file_getSound(DatFile *d, int i, char **name, char **sound_file);
+extern void file_getSpriteAnim(DatFile *d, char *dir, int i, char **anim_name, char **anim_dir);
+extern void file_free(void);
 extern void file_loadAnim(char *name, char *dir, AnimData *anim);
-extern int file_getAreaNLayers(char *file);
-extern Color file_getAreaBackgroundColor(char *file);
-extern void file_nextLayer(char *file);
-extern void file_getLayerDims(char *file, int *w, int *h);
-extern int file_nextTile(char *file);
-extern void file_getTileAtts(char *file, int *x, int *y, int *type, char **anim_name);
-extern int file_nextTileBound(char *file);
-extern void file_getTileBound(char *file, Bound *b);
-extern int file_countSpriteAnims(char *dir);
-extern int file_getNextSpriteAnim(char *dir, char **anim_name, char **anim_dir);
-extern int file_nextObject(char *file);
-extern void file_getObjectAtts(char *file, int *z, Point *pos, Velocity *vel, int *type);
+extern int file_reloadAnim(char *name, char *dir, AnimData *anim);
+extern Area *file_openArea(char *areafile);
+extern Area *file_reopenArea(char *areafile);
+extern void file_closeArea(Area *a);
+extern void file_compileArea(char *areafile);
+extern void file_getAreaBound(Area *a, int i, Bound *b);
+extern void file_benchArea(int n_tiles);
 
 #endif /* __DEFINED_FILE_H */
@@ -1,4 +1,9 @@
 #include "graphics.h"
+#include "pack.h"
+#include "pool.h"
+#include "atlas.h"
+#include <stdlib.h>
+#include <string.h>
 
 #include "SDL_image.h"
 #include "SDL_gfxPrimitives.h"
@@ -6,22 +11,80 @@
 // Maintain the screen information in this module
 static SDL_Surface *screen;
 
+/* An image waiting to be loaded by gfx_loadQueued() */
+typedef struct queued_image_struct
+{
+  char *filename;
+  SDL_Surface **page;    /* Where the page it's put on goes */
+  SDL_Rect *src;         /* And where on the page it is */
+  void *data;            /* Where it is in the pack, if it's in there */
+  int size;
+  SDL_Surface *decoded;  /* The image as it was in the file */
+  int on_page;           /* The page it's been packed onto */
+  SDL_Rect rect;         /* Where on that page */
+} QueuedImage;
+
+/* Images taken off the queue to be decoded in the background */
+struct image_batch_struct
+{
+  int n;
+  QueuedImage *images;
+};
+
+/* The images waiting to be loaded, and when the first one was queued */
+static QueuedImage *queue = NULL;
+static int n_queued = 0, max_queued = 0;
+static Uint32 queue_start;
+
+/* The images being sorted by packImages() */
+static QueuedImage *sorting;
+
+/* SDL_image sets itself up the first time it loads something, which can't
+   happen on two threads at once, so that's always done on this one */
+static int decoded_any = 0;
+
+/* Private function prototypes */
+static void decodeImage(void *thing);
+static SDL_Surface *convertImage(SDL_Surface *temp_img);
+static int compareHeights(const void *a, const void *b);
+static Atlas *packImages(QueuedImage *images, int n);
+static void fillPlaceholders(SDL_Rect *dest_rects, int n);
+static Atlas *loadQueued(int careful);
+static void dropQueue(void);
+
 
 /* gfx_loadImage
  * loads an image from a file
  */
 SDL_Surface *gfx_loadImage(char *filename) {
 
-  extern SDL_Surface *screen;
-
-  SDL_Surface *src_img = NULL, *temp_img;
+  SDL_Surface *temp_img;
+  SDL_RWops *rw;
 
-  /* Load the image from the file */
-  if (!(temp_img = IMG_Load(filename))) {
+  /* Load the image straight out of the pack if it's in there, otherwise
+     from the file */
+  if ((rw = pak_openRW(filename)) != NULL) temp_img = IMG_Load_RW(rw, 1);
+  else temp_img = IMG_Load(filename);
+  if (!temp_img) {
     printf("Error loading image: %s\n", IMG_GetError());
     exit(0);
   }
 
+  return (convertImage(temp_img));
+
+}
+
+/* convertImage
+   Converts a loaded image to the screen's format, with the transparent
+   color set, and frees the one it was loaded as.  SDL only lets this be
+   done on the main thread.
+*/
+SDL_Surface *
+convertImage(SDL_Surface *temp_img)
+{
+  extern SDL_Surface *screen;
+  SDL_Surface *src_img;
+
   /* Format the image to that of the framebuffer, scrap the temp image.
    * (Important step!  It doesn't do the transparency right if I don't
    * do SDL_DisplayFormat)
@@ -34,28 +97,391 @@ SDL_Surface *gfx_loadImage(char *filename) {
   SDL_SetColorKey(src_img, SDL_SRCCOLORKEY|SDL_RLEACCEL, SDL_MapRGB(screen->format, TRANSPARENT_RGB));
 
   return (src_img);
+}
+
+/* gfx_queueImage
+   Puts an image on the list to be loaded by gfx_loadQueued(), which will
+   put it on an atlas page, and set *page to the page and *src to where it
+   is.  Until then *page is NULL.
+*/
+void
+gfx_queueImage(char *filename, SDL_Surface **page, SDL_Rect *src)
+{
+  extern QueuedImage *queue;
+  extern int n_queued, max_queued;
+  extern Uint32 queue_start;
+
+  if (n_queued == 0) queue_start = SDL_GetTicks();
+  if (n_queued == max_queued)
+    {
+      max_queued = (max_queued == 0) ? 64 : max_queued * 2;
+      if ((queue = realloc(queue, max_queued * sizeof(QueuedImage))) == NULL)
+	{
+	  fprintf(stderr, "Unable to allocate memory.\n");
+	  exit(0);
+	}
+    }
+
+  MALLOC(queue[n_queued].filename, (strlen(filename) + 1) * sizeof(char));
+  strcpy(queue[n_queued].filename, filename);
+  queue[n_queued].page = page;
+  queue[n_queued].src = src;
+  *page = NULL;
+  n_queued++;
+}
+
+/* gfx_loadQueued
+   Loads all of the queued images onto as few atlas pages as they'll fit
+   on, and returns the atlas, which is freed with gfx_freeAtlas().  The
+   files are decoded on all of the loading threads at once, then packed
+   and converted to the screen's format here.  Prints how long gathering
+   them, decoding them and converting them took.
+*/
+Atlas *
+gfx_loadQueued(void)
+{
+  return loadQueued(0);
+}
+
+/* gfx_tryLoadQueued
+   Loads the queued images like gfx_loadQueued(), but if one of them can't
+   be loaded, it says which, throws the queue away and returns NULL
+   instead of quitting.
+*/
+Atlas *
+gfx_tryLoadQueued(void)
+{
+  return loadQueued(1);
+}
+
+/* loadQueued
+   Loads the queued images onto an atlas, quitting if one can't be loaded
+   unless it's careful.
+*/
+Atlas *
+loadQueued(int careful)
+{
+  extern QueuedImage *queue;
+  extern int n_queued, max_queued;
+  extern Uint32 queue_start;
+  Uint32 decode_start, convert_start;
+  Atlas *atlas;
+  char **paths;
+  int i;
+
+  if (n_queued == 0) return NULL;
+  decode_start = SDL_GetTicks();
+
+  /* Anything compressed in the pack is unpacked first, all together,
+     since the pack can't be touched from the loading threads */
+  MALLOC(paths, n_queued * sizeof(char *));
+  for (i = 0; i < n_queued; i++) paths[i] = queue[i].filename;
+  pak_prefetch(paths, n_queued);
+  free(paths);
+  for (i = 0; i < n_queued; i++)
+    queue[i].data = pak_find(queue[i].filename, &queue[i].size);
+
+  /* The first one is done here, in case SDL_image isn't set up yet */
+  decodeImage(&queue[0]);
+  decoded_any = 1;
+  pool_run(decodeImage, &queue[1], n_queued - 1, sizeof(QueuedImage));
+
+  convert_start = SDL_GetTicks();
+  for (i = 0; i < n_queued; i++)
+    {
+      if (queue[i].decoded == NULL)
+	{
+	  printf("Error loading image: %s\n", queue[i].filename);
+	  if (!careful) exit(0);
+	  dropQueue();
+	  return NULL;
+	}
+    }
+  atlas = packImages(queue, n_queued);
+
+  printf("Loaded %d images onto %d pages: gathered in %d ms, decoded in %d ms on %d threads, converted in %d ms\n",
+	 n_queued, atlas->n_pages, decode_start - queue_start,
+	 convert_start - decode_start, pool_nWorkers(),
+	 SDL_GetTicks() - convert_start);
+
+  dropQueue();
+  return atlas;
+}
+
+/* dropQueue
+   Empties the queue, freeing any images that were decoded but not put on
+   a page.
+*/
+void
+dropQueue(void)
+{
+  extern QueuedImage *queue;
+  extern int n_queued, max_queued;
+  int i;
+
+  for (i = 0; i < n_queued; i++)
+    {
+      if (queue[i].decoded != NULL) SDL_FreeSurface(queue[i].decoded);
+      free(queue[i].filename);
+    }
+  free(queue);
+  queue = NULL;
+  n_queued = max_queued = 0;
+}
+
+/* compareHeights
+   For sorting images tallest first, which is the order the skyline packs
+   best in.
+*/
+int
+compareHeights(const void *a, const void *b)
+{
+  extern QueuedImage *sorting;
+  SDL_Surface *sa = sorting[*(int *) a].decoded, *sb = sorting[*(int *) b].decoded;
+
+  if (sa->h != sb->h) return sb->h - sa->h;
+  if (sa->w != sb->w) return sb->w - sa->w;
+  return *(int *) a - *(int *) b;
+}
+
+/* packImages
+   Packs decoded images onto atlas pages, in the screen's format, and
+   tells each one's frame where it went.
+*/
+Atlas *
+packImages(QueuedImage *images, int n)
+{
+  extern SDL_Surface *screen;
+  extern QueuedImage *sorting;
+  Skyline *skylines = NULL;
+  Atlas *atlas;
+  int *order;
+  int i, p, n_skylines = 0;
+
+  MALLOC(order, n * sizeof(int));
+  for (i = 0; i < n; i++) order[i] = i;
+  sorting = images;
+  qsort(order, n, sizeof(int), compareHeights);
+
+  /* Work out where everything goes first, so each page can be made only
+     as big as it needs to be */
+  MALLOC(skylines, n * sizeof(Skyline));
+  for (i = 0; i < n; i++)
+    {
+      QueuedImage *q = &images[order[i]];
+      int w = q->decoded->w, h = q->decoded->h, x, y;
+
+      for (p = 0; p < n_skylines; p++)
+	if (atl_place(&skylines[p], w, h, &x, &y)) break;
+      if (p == n_skylines)
+	{
+	  atl_init(&skylines[p], (w > ATLAS_SIZE) ? w : ATLAS_SIZE, (h > ATLAS_SIZE) ? h : ATLAS_SIZE);
+	  atl_place(&skylines[p], w, h, &x, &y);
+	  n_skylines++;
+	}
+      q->on_page = p;
+      q->rect.x = x;
+      q->rect.y = y;
+      q->rect.w = w;
+      q->rect.h = h;
+    }
+
+  MALLOC(atlas, sizeof(Atlas));
+  atlas->n_pages = n_skylines;
+  MALLOC(atlas->pages, n_skylines * sizeof(SDL_Surface *));
+  for (p = 0; p < n_skylines; p++)
+    {
+      SDL_Surface *temp_img = SDL_CreateRGBSurface(SDL_SWSURFACE, skylines[p].used_w, skylines[p].used_h,
+						   32, 0, 0, 0, 0);
+      if (temp_img == NULL || (atlas->pages[p] = SDL_DisplayFormat(temp_img)) == NULL)
+	{
+	  fprintf(stderr, "Unable to make an atlas page: %s\n", SDL_GetError());
+	  exit(0);
+	}
+      SDL_FreeSurface(temp_img);
+      SDL_FillRect(atlas->pages[p], NULL, SDL_MapRGB(screen->format, TRANSPARENT_RGB));
+      atl_free(&skylines[p]);
+    }
+  free(skylines);
+
+  /* Copy each image onto its page as it is, the same as converting it
+     would, without blending it or leaving out its own transparent
+     color */
+  for (i = 0; i < n; i++)
+    {
+      QueuedImage *q = &images[i];
+      SDL_Rect dest_rect = q->rect;
+
+      SDL_SetAlpha(q->decoded, 0, SDL_ALPHA_OPAQUE);
+      SDL_SetColorKey(q->decoded, 0, 0);
+      SDL_BlitSurface(q->decoded, NULL, atlas->pages[q->on_page], &dest_rect);
+      SDL_FreeSurface(q->decoded);
+      q->decoded = NULL;
+
+      *q->page = atlas->pages[q->on_page];
+      *q->src = q->rect;
+    }
+
+  /* The transparent color is set on the whole page once it's filled, so
+     it's only run-length encoded once */
+  for (p = 0; p < atlas->n_pages; p++)
+    SDL_SetColorKey(atlas->pages[p], SDL_SRCCOLORKEY|SDL_RLEACCEL, SDL_MapRGB(screen->format, TRANSPARENT_RGB));
+
+  free(order);
+  return atlas;
+}
+
+/* gfx_freeAtlas
+   Frees an atlas' pages.
+*/
+void
+gfx_freeAtlas(Atlas *atlas)
+{
+  int i;
 
+  if (atlas == NULL) return;
+  for (i = 0; i < atlas->n_pages; i++) SDL_FreeSurface(atlas->pages[i]);
+  free(atlas->pages);
+  free(atlas);
+}
+
+/* gfx_takeQueued
+   Takes the queued images off the queue, to be decoded in the background
+   with gfx_decodeBatch() and put on atlas pages with gfx_packBatch().
+   Whatever's in the pack is copied out, since the pack might be flushed
+   before they're decoded.  Returns NULL if nothing's queued.
+*/
+ImageBatch *
+gfx_takeQueued(void)
+{
+  extern QueuedImage *queue;
+  extern int n_queued, max_queued;
+  ImageBatch *batch;
+  int i;
+
+  if (n_queued == 0) return NULL;
+
+  MALLOC(batch, sizeof(ImageBatch));
+  batch->n = n_queued;
+  batch->images = queue;
+  for (i = 0; i < n_queued; i++)
+    {
+      queue[i].data = pak_copy(queue[i].filename, &queue[i].size);
+      queue[i].decoded = NULL;
+    }
+  queue = NULL;
+  n_queued = max_queued = 0;
+
+  if (!decoded_any)
+    {
+      decodeImage(&batch->images[0]);
+      decoded_any = 1;
+    }
+  return batch;
+}
+
+/* gfx_decodeBatch
+   Decodes a batch of images, for a background job.
+*/
+void
+gfx_decodeBatch(void *thing)
+{
+  ImageBatch *batch = (ImageBatch *) thing;
+  int i;
+
+  for (i = 0; i < batch->n; i++)
+    {
+      QueuedImage *q = &batch->images[i];
+
+      if (q->decoded == NULL) decodeImage(q);
+      free(q->data);
+      q->data = NULL;
+    }
+}
+
+/* gfx_packBatch
+   Puts a decoded batch of images on atlas pages, and frees the batch.
+   This has to be done on the main thread.
+*/
+Atlas *
+gfx_packBatch(ImageBatch *batch)
+{
+  Atlas *atlas;
+  int i;
+
+  for (i = 0; i < batch->n; i++)
+    {
+      if (batch->images[i].decoded == NULL)
+	{
+	  printf("Error loading image: %s\n", batch->images[i].filename);
+	  exit(0);
+	}
+    }
+  atlas = packImages(batch->images, batch->n);
+
+  for (i = 0; i < batch->n; i++) free(batch->images[i].filename);
+  free(batch->images);
+  free(batch);
+  return atlas;
+}
+
+/* gfx_atlasBytes
+   Returns how much memory an atlas' pages take up.
+*/
+long
+gfx_atlasBytes(Atlas *atlas)
+{
+  long bytes = 0;
+  int i;
+
+  if (atlas == NULL) return 0;
+  for (i = 0; i < atlas->n_pages; i++)
+    bytes += (long) atlas->pages[i]->pitch * atlas->pages[i]->h;
+  return bytes;
+}
+
+/* decodeImage
+   Decodes a queued image, out of the pack or from its file, for the
+   loading threads.  It's left NULL if it can't be.
+*/
+void
+decodeImage(void *thing)
+{
+  QueuedImage *q = (QueuedImage *) thing;
+
+  if (q->data != NULL)
+    q->decoded = IMG_Load_RW(SDL_RWFromConstMem(q->data, q->size), 1);
+  else
+    q->decoded = IMG_Load(q->filename);
 }
 
 
 /* gfx_blitImage
- * blits an SDL_Surface onto another surface at a specified location
+ * blits an SDL_Surface, or the part of it in src_rect if that isn't NULL
+ * (like a frame on an atlas page), onto the screen at a specified location
  * returns 0 on failure
  */
 
-int gfx_blitImage(SDL_Surface *src_surf, int x, int y) {
+int gfx_blitImage(SDL_Surface *src_surf, SDL_Rect *src_rect, int x, int y) {
 
   extern SDL_Surface *screen;
   SDL_Rect dest_rect;
 
   dest_rect.x = x;
   dest_rect.y = y;
-  dest_rect.w = src_surf->w;
-  dest_rect.h = src_surf->h;
+
+  /* An image that isn't loaded yet shows as a placeholder */
+  if (src_surf == NULL) {
+    fillPlaceholders(&dest_rect, 1);
+    return (1);
+  }
+
+  dest_rect.w = (src_rect != NULL) ? src_rect->w : src_surf->w;
+  dest_rect.h = (src_rect != NULL) ? src_rect->h : src_surf->h;
 
 
   /* Do the blit! */
-  if ((SDL_BlitSurface(src_surf, NULL, screen, &dest_rect)) < 0) {
+  if ((SDL_BlitSurface(src_surf, src_rect, screen, &dest_rect)) < 0) {
     printf("Error blitting image: %s\n", IMG_GetError());
     return (0);
   }
@@ -63,6 +489,41 @@ int gfx_blitImage(SDL_Surface *src_surf, int x, int y) {
   return (1);
 }
 
+/* fillPlaceholders
+   Draws placeholders where images that aren't loaded yet go.  Only the x
+   and y of the rects are looked at.
+*/
+void
+fillPlaceholders(SDL_Rect *dest_rects, int n)
+{
+  extern SDL_Surface *screen;
+  Uint32 color = SDL_MapRGB(screen->format, PLACEHOLDER_RGB);
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      dest_rects[i].w = dest_rects[i].h = PLACEHOLDER_SIZE;
+      SDL_FillRect(screen, &dest_rects[i], color);
+    }
+}
+
+/* gfx_blitImages
+   Blits a batch of parts of one surface, like neighboring tiles off the
+   same atlas page, onto the screen.  Only the x and y of the destination
+   rects are looked at, and they may be clipped in place.
+*/
+void
+gfx_blitImages(SDL_Surface *src_surf, SDL_Rect *src_rects, SDL_Rect *dest_rects, int n)
+{
+  extern SDL_Surface *screen;
+  int i;
+
+  if (src_surf == NULL) fillPlaceholders(dest_rects, n);
+  else
+    for (i = 0; i < n; i++)
+      SDL_BlitSurface(src_surf, &src_rects[i], screen, &dest_rects[i]);
+}
+
 /* gfx_setClipRect
 
    sets a clipping rect on the screen
@@ -91,6 +552,30 @@ void gfx_clearScreen(Color *c) {
 
 }
 
+/* gfx_mapColor
+   Returns the screen's pixel value for a color.
+*/
+Uint32
+gfx_mapColor(int r, int g, int b)
+{
+  extern SDL_Surface *screen;
+  return SDL_MapRGB(screen->format, r, g, b);
+}
+
+/* gfx_fillRects
+   Fills a batch of rectangles on the screen with one color.  The
+   rectangles may be clipped in place.
+*/
+void
+gfx_fillRects(SDL_Rect *rects, int n, Uint32 color)
+{
+  extern SDL_Surface *screen;
+  int i;
+
+  for (i = 0; i < n; i++)
+    SDL_FillRect(screen, &rects[i], color);
+}
+
 /* gfx_initScreen
  * creates the screen surface with specified resolution
  */
@@ -10,11 +10,37 @@
  */
 #define TRANSPARENT_RGB 255, 0, 255
 
+/* An image that hasn't been loaded yet is drawn as a box this size and
+   color until it is */
+#define PLACEHOLDER_SIZE 16
+#define PLACEHOLDER_RGB 128, 128, 128
+
 #define gfx_freeImage(x) SDL_FreeSurface(x)
 
+/* The pages a batch of images were packed onto by gfx_loadQueued() */
+typedef struct atlas_struct
+{
+  int n_pages;
+  SDL_Surface **pages;
+} Atlas;
+
+/* Images taken off the queue to be loaded in the background */
+typedef struct image_batch_struct ImageBatch;
+
 extern SDL_Surface *gfx_loadImage(char *filename);
-extern int gfx_blitImage(SDL_Surface *src_surf, int x, int y);
+extern void gfx_queueImage(char *filename, SDL_Surface **page, SDL_Rect *src);
+extern Atlas *gfx_loadQueued(void);
+extern Atlas *gfx_tryLoadQueued(void);
+extern ImageBatch *gfx_takeQueued(void);
+extern void gfx_decodeBatch(void *thing);
+extern Atlas *gfx_packBatch(ImageBatch *batch);
+extern void gfx_freeAtlas(Atlas *atlas);
+extern long gfx_atlasBytes(Atlas *atlas);
+extern int gfx_blitImage(SDL_Surface *src_surf, SDL_Rect *src_rect, int x, int y);
+extern void gfx_blitImages(SDL_Surface *src_surf, SDL_Rect *src_rects, SDL_Rect *dest_rects, int n);
 extern void gfx_clearScreen(Color *c);
+extern Uint32 gfx_mapColor(int r, int g, int b);
+extern void gfx_fillRects(SDL_Rect *rects, int n, Uint32 color);
 extern void gfx_initScreen(int xres, int yres, int fullscreen);
 extern int gfx_getScreenWidth(void);
 extern int gfx_getScreenHeight(void);
@@ -0,0 +1,241 @@
+#include "hotload.h"
+
+#ifdef HOT_RELOAD
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "file.h"
+#include "map.h"
+#include "object.h"
+#include "pack.h"
+#include "animation.h"
+
+/* An animation being watched, by the directory it was read from */
+typedef struct watch_struct
+{
+  int wd;            /* The inotify watch on its directory */
+  AnimData *anim;
+  int dirty;         /* Something in its directory was written this
+			cycle */
+} Watch;
+
+static int watch_fd = -1;
+static Watch *watches = NULL;
+static int n_watches = 0, max_watches = 0;
+
+/* The area being watched, and the watch on its directory */
+static char *area_file = NULL;
+static char *area_base = NULL;   /* Its file name, without the directory */
+static int area_wd = -1;
+
+/* Private function prototypes */
+static char *dataPath(char *f);
+static int watchDir(char *dir);
+static void watchAnims(AnimData *anims, int n);
+static void reloadAnims(void);
+
+/* hot_init
+   Starts watching an area, and the animations loaded for it, for changes.
+   The map and objects have to be loaded, and the chunks started.
+*/
+void
+hot_init(char *areafile)
+{
+  extern int watch_fd, area_wd, n_watches;
+  extern char *area_file, *area_base;
+  char *path, *slash;
+  AnimData *anims;
+  int i, n;
+
+  if (pak_isOpen())
+    {
+      printf("Not watching for changes, since everything's in the pack.\n");
+      return;
+    }
+  if ((watch_fd = inotify_init1(IN_NONBLOCK)) < 0)
+    {
+      fprintf(stderr, "Unable to watch for changes.\n");
+      return;
+    }
+
+  /* Watch the area file's directory for the area file */
+  MALLOC(area_file, strlen(areafile) + 1);
+  strcpy(area_file, areafile);
+  path = dataPath(areafile);
+  if ((slash = strrchr(path, '/')) != NULL)
+    {
+      *slash = '\0';
+      area_wd = watchDir(path);
+      *slash = '/';
+    }
+  else area_wd = watchDir(".");
+  MALLOC(area_base, strlen(path) + 1);
+  strcpy(area_base, (slash != NULL) ? slash + 1 : path);
+  free(path);
+
+  /* And every animation's */
+  anims = map_getTileAnims(&n);
+  watchAnims(anims, n);
+  for (i = 0; i < obj_getNSprites(); i++)
+    {
+      anims = obj_getSpriteAnims(i, &n);
+      watchAnims(anims, n);
+    }
+
+  printf("Watching %s and %d animations for changes\n", area_file, n_watches);
+}
+
+/* dataPath
+   Returns the path to a file in the data directory, to be freed.
+*/
+char *
+dataPath(char *f)
+{
+  char *path;
+
+  MALLOC(path, strlen(DATA_PREFIX) + strlen(f) + 1);
+  strcpy(path, DATA_PREFIX);
+  strcat(path, f);
+  return path;
+}
+
+/* watchDir
+   Starts watching a directory for files being written in it, or moved
+   into it.  Watching the same directory twice gives the same watch.
+*/
+int
+watchDir(char *dir)
+{
+  extern int watch_fd;
+  int wd;
+
+  if ((wd = inotify_add_watch(watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO)) < 0)
+    fprintf(stderr, "Unable to watch %s for changes.\n", dir);
+  return wd;
+}
+
+/* watchAnims
+   Starts watching an array of animations' directories.
+*/
+void
+watchAnims(AnimData *anims, int n)
+{
+  extern Watch *watches;
+  extern int n_watches, max_watches;
+  char *path;
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      if (n_watches == max_watches)
+	{
+	  max_watches = max_watches ? max_watches * 2 : 64;
+	  if ((watches = realloc(watches, max_watches * sizeof(Watch))) == NULL)
+	    {
+	      fprintf(stderr, "Unable to allocate memory.\n");
+	      exit(0);
+	    }
+	}
+      path = dataPath(anims[i].dir);
+      watches[n_watches].wd = watchDir(path);
+      watches[n_watches].anim = &anims[i];
+      watches[n_watches].dirty = 0;
+      n_watches++;
+      free(path);
+    }
+}
+
+/* hot_update
+   Called between cycles.  Reads what's changed since the last time, and
+   puts the animations and tiles that changed into the game.  However many
+   times a file was written, it's only read once.
+*/
+void
+hot_update(void)
+{
+  extern int watch_fd, area_wd, n_watches;
+  extern Watch *watches;
+  extern char *area_file, *area_base;
+  char buf[HOT_BUFFER] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  int len, i, area_dirty = 0;
+  Uint32 start;
+
+  if (watch_fd < 0) return;
+
+  while ((len = read(watch_fd, buf, sizeof(buf))) > 0)
+    {
+      char *p;
+
+      for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len)
+	{
+	  struct inotify_event *ev = (struct inotify_event *) p;
+
+	  if (ev->wd == area_wd && ev->len > 0 && strcmp(ev->name, area_base) == 0)
+	    area_dirty = 1;
+	  for (i = 0; i < n_watches; i++)
+	    if (watches[i].wd == ev->wd) watches[i].dirty = 1;
+	}
+    }
+
+  start = SDL_GetTicks();
+  reloadAnims();
+
+  if (area_dirty)
+    {
+      int n = map_reloadArea(area_file);
+
+      if (n < 0)
+	printf("Left the map as it was.\n");
+      else
+	printf("Reloaded %s, %d tiles changed, in %d ms\n", area_file, n, SDL_GetTicks() - start);
+    }
+}
+
+/* reloadAnims
+   Reads the animations in directories that were written to again.  One
+   with a mistake in it is left as it was.
+*/
+void
+reloadAnims(void)
+{
+  extern Watch *watches;
+  extern int n_watches;
+  AnimData fresh;
+  int i;
+
+  for (i = 0; i < n_watches; i++)
+    {
+      if (!watches[i].dirty) continue;
+      watches[i].dirty = 0;
+
+      if (file_reloadAnim(watches[i].anim->name, watches[i].anim->dir, &fresh) &&
+	  anim_replace(watches[i].anim, &fresh))
+	printf("Reloaded animation %s\n", watches[i].anim->name);
+      else
+	printf("Left animation %s as it was.\n", watches[i].anim->name);
+    }
+}
+
+/* hot_free
+   Stops watching.  It has to be done before the tileset and sprites are
+   given back.
+*/
+void
+hot_free(void)
+{
+  extern int watch_fd, area_wd, n_watches, max_watches;
+  extern Watch *watches;
+  extern char *area_file, *area_base;
+
+  if (watch_fd >= 0) close(watch_fd);
+  watch_fd = area_wd = -1;
+  free(watches);
+  watches = NULL;
+  n_watches = max_watches = 0;
+  free(area_file);
+  free(area_base);
+  area_file = area_base = NULL;
+}
+
+#endif /* HOT_RELOAD */
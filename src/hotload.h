@@ -0,0 +1,45 @@
+#ifndef __DEFINED_HOTLOAD_H
+#define __DEFINED_HOTLOAD_H
+
+#include "SDL.h"
+#include "defs.h"
+#include <stdio.h>
+
+/* Uncomment this, or build with -DHOT_RELOAD, to have the game watch the
+   area and animations it's loaded for changes while it runs, and put them
+   in between cycles.  It needs inotify, so it only works on Linux, and
+   only when loading from the data directory. */
+//#define HOT_RELOAD
+
+#if defined(HOT_RELOAD) && !defined(__linux__)
+#undef HOT_RELOAD
+#endif
+
+/* The hot module watches the directories of the area file and of every
+   animation in the tileset and sprites.  When an animation's anim file or
+   one of its images is written, that animation is read again in place
+   (anim_replace()), so everything showing it by id shows the new one.
+   When the area file is written, the map is compared with it chunk by
+   chunk, and only the chunks with tiles that changed are replaced
+   (map_reloadArea()).  A file with a mistake in it, or an image that
+   isn't there or can't be loaded, is reported and the old animation or
+   map is kept, so the game keeps running. */
+
+#ifdef HOT_RELOAD
+
+/* How many bytes of events are read at a time */
+#define HOT_BUFFER 4096
+
+extern void hot_init(char *areafile);
+extern void hot_update(void);
+extern void hot_free(void);
+
+#else
+
+#define hot_init(areafile)
+#define hot_update()
+#define hot_free()
+
+#endif /* HOT_RELOAD */
+
+#endif /* __DEFINED_HOTLOAD_H */
@@ -0,0 +1,244 @@
+#include "loader.h"
+#include "file.h"
+#include "map.h"
+#include "object.h"
+#include "audio.h"
+#include "graphics.h"
+#include "pool.h"
+
+/* A phase of loading an area.  It's done on the main thread once the
+   phases it comes after are done. */
+typedef struct load_phase_struct
+{
+  char *name;
+  int after;               /* The phases it needs, as bits */
+  void (*start)(void);
+} LoadPhase;
+
+#define AFTER(p) (1 << (p))
+
+/* Private function prototypes */
+static void unpack(void);
+static void startMusic(void);
+static void loadSounds(void);
+static void loadTileset(void);
+static void loadSprites(void);
+static void buildMap(void);
+static void buildObjects(void);
+static int canStart(int i);
+
+/* The map and objects are built on the main thread too, since they give
+   out Names and open the area, which the workers can't do.  Building them
+   is quick, since the map's chunks are only read once the game's
+   running, so it doesn't hold up drawing the progress for long. */
+static LoadPhase phases[N_LOAD_PHASES] =
+  {
+    {"files", 0, unpack},
+    {"music", AFTER(LOAD_UNPACK), startMusic},
+    {"sounds", 0, loadSounds},
+    {"tile animations", AFTER(LOAD_UNPACK), loadTileset},
+    {"sprite animations", AFTER(LOAD_SOUNDS), loadSprites},
+    {"map", AFTER(LOAD_TILESET), buildMap},
+    {"objects", AFTER(LOAD_MAP) | AFTER(LOAD_SPRITES), buildObjects}
+  };
+
+/* The area being loaded, kept open so it's only read once */
+static char *area_file = NULL;
+static Area *area = NULL;
+
+/* Where each phase is, and how long it took */
+static int states[N_LOAD_PHASES];
+static Uint32 began[N_LOAD_PHASES], took[N_LOAD_PHASES];
+
+/* When loading started, and how long it took once it's done */
+static Uint32 load_start = 0, load_time = 0;
+
+/* ldr_start
+   Starts loading an area.  Nothing's loaded until ldr_update() is called,
+   and the file name has to be kept until it says it's done.
+*/
+void
+ldr_start(char *areafile)
+{
+  extern char *area_file;
+  extern Area *area;
+  extern int states[];
+  extern Uint32 load_start, load_time;
+  int i;
+
+  area_file = areafile;
+  area = file_openArea(areafile);
+  for (i = 0; i < N_LOAD_PHASES; i++) states[i] = PHASE_WAITING;
+  load_start = SDL_GetTicks();
+  load_time = 0;
+}
+
+/* ldr_update
+   Puts in whatever was loaded in the background, does the next phase
+   that's ready to go, and returns true once everything's loaded.  At most
+   one phase is done each time, so the progress can be drawn in between.
+*/
+int
+ldr_update(void)
+{
+  extern LoadPhase phases[];
+  extern Area *area;
+  extern int states[];
+  extern Uint32 began[], took[], load_start, load_time;
+  int i, started = 0, done = 0;
+
+  pool_finish(0);
+
+  for (i = 0; i < N_LOAD_PHASES; i++)
+    {
+      if (states[i] == PHASE_DONE) done++;
+      if (states[i] != PHASE_WAITING || started || !canStart(i)) continue;
+
+      printf("Loading %s...\n", phases[i].name);
+      began[i] = SDL_GetTicks();
+      phases[i].start();
+      took[i] = SDL_GetTicks() - began[i];
+      states[i] = PHASE_DONE;
+      started = 1;
+      done++;
+    }
+
+  /* Done once every phase is, and the images and sounds they asked for
+     are in */
+  if (done < N_LOAD_PHASES || pool_pending() > 0)
+    {
+      if (!started) SDL_Delay(LOAD_DELAY);
+      return 0;
+    }
+
+  if (area != NULL)
+    {
+      file_closeArea(area);
+      area = NULL;
+      load_time = SDL_GetTicks() - load_start;
+      printf("Loaded in %d ms:", load_time);
+      for (i = 0; i < N_LOAD_PHASES; i++) printf(" %s %d ms%s", phases[i].name, took[i], (i < N_LOAD_PHASES - 1) ? "," : "\n");
+    }
+  return 1;
+}
+
+/* canStart
+   Returns true if every phase a phase comes after is done.
+*/
+int
+canStart(int i)
+{
+  extern LoadPhase phases[];
+  extern int states[];
+  int j;
+
+  for (j = 0; j < N_LOAD_PHASES; j++)
+    if ((phases[i].after & AFTER(j)) && states[j] != PHASE_DONE) return 0;
+  return 1;
+}
+
+/* ldr_draw
+   Draws how loading is going: a box for each phase, lit up once it's
+   done.
+*/
+void
+ldr_draw(void)
+{
+  extern int states[];
+  Color bg = {LOAD_BG_RGB};
+  Uint32 colors[2];
+  SDL_Rect box;
+  int i, w = N_LOAD_PHASES * (LOAD_BOX_W + LOAD_BOX_GAP) - LOAD_BOX_GAP;
+
+  colors[PHASE_WAITING] = gfx_mapColor(LOAD_WAITING_RGB);
+  colors[PHASE_DONE] = gfx_mapColor(LOAD_DONE_RGB);
+
+  gfx_clearScreen(&bg);
+  for (i = 0; i < N_LOAD_PHASES; i++)
+    {
+      box.x = (gfx_getScreenWidth() - w) / 2 + i * (LOAD_BOX_W + LOAD_BOX_GAP);
+      box.y = (gfx_getScreenHeight() - LOAD_BOX_H) / 2;
+      box.w = LOAD_BOX_W;
+      box.h = LOAD_BOX_H;
+      gfx_fillRects(&box, 1, colors[states[i]]);
+    }
+  gfx_renderScreen();
+}
+
+/* ldr_getTime
+   Returns how long the last area took to load, in milliseconds, or 0 if
+   it isn't done.
+*/
+Uint32
+ldr_getTime(void)
+{
+  extern Uint32 load_time;
+  return load_time;
+}
+
+/* unpack
+   Gets what the area uses from its tileset and music out of the pack
+   together.
+*/
+void
+unpack(void)
+{
+  file_preloadArea(area_file);
+}
+
+/* startMusic
+   Loads the area's music, and starts playing it right away.
+*/
+void
+startMusic(void)
+{
+  aud_loadMusic(area_file);
+  aud_playMusic(-1);
+}
+
+/* loadSounds
+   Reads what the sounds are.
+*/
+void
+loadSounds(void)
+{
+  aud_loadSounds(SOUND_DAT);
+}
+
+/* loadTileset
+   Gets the area's tileset, and starts its tiles' images decoding.
+*/
+void
+loadTileset(void)
+{
+  map_loadTileset(area_file, 0);
+}
+
+/* loadSprites
+   Gets the sprites, and starts the images and sounds the area's objects
+   use loading.
+*/
+void
+loadSprites(void)
+{
+  obj_loadSprites(SPRITES_DAT);
+  obj_loadAreaAssets(area_file, 0);
+}
+
+/* buildMap
+   Builds the map.
+*/
+void
+buildMap(void)
+{
+  map_loadMap(area_file);
+}
+
+/* buildObjects
+   Creates the objects.
+*/
+void
+buildObjects(void)
+{
+  obj_loadObjects(area_file);
+}
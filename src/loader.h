@@ -0,0 +1,53 @@
+#ifndef __DEFINED_LOADER_H
+#define __DEFINED_LOADER_H
+
+#include "SDL.h"
+#include "defs.h"
+#include <stdio.h>
+
+/* The loader loads an area while the game keeps drawing.  Loading is cut
+   into phases (the music, the sounds, the tileset, the sprites, the map
+   and the objects), and each one starts as soon as the phases it needs
+   are done.  They're all done on the main thread, because they use the
+   resource cache or SDL_mixer or give out Names, one a cycle by
+   ldr_update(), while the images and sounds they start decode on pool.c's
+   workers.  In between, main.c pumps events and draws the progress with
+   ldr_draw().  The music starts playing as soon as it's loaded. */
+
+#define SPRITES_DAT "sprites/sprites.dat"
+#define SOUND_DAT "sounds/sounds.dat"
+
+/* How long to wait for the background work each cycle when there's
+   nothing to start, in milliseconds */
+#define LOAD_DELAY 10
+
+/* The progress bar: a box for each phase, this big, and their colors
+   when they're waiting and done */
+#define LOAD_BOX_W 32
+#define LOAD_BOX_H 12
+#define LOAD_BOX_GAP 4
+#define LOAD_BG_RGB 0, 0, 0
+#define LOAD_WAITING_RGB 48, 48, 48
+#define LOAD_DONE_RGB 255, 255, 255
+
+enum load_phases
+  {
+    LOAD_UNPACK,
+    LOAD_MUSIC,
+    LOAD_SOUNDS,
+    LOAD_TILESET,
+    LOAD_SPRITES,
+    LOAD_MAP,
+    LOAD_OBJECTS,
+    N_LOAD_PHASES
+  };
+
+/* A phase is waiting for the ones it needs, or done */
+enum phase_states {PHASE_WAITING, PHASE_DONE};
+
+extern void ldr_start(char *areafile);
+extern int ldr_update(void);
+extern void ldr_draw(void);
+extern Uint32 ldr_getTime(void);
+
+#endif /* __DEFINED_LOADER_H */
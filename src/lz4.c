@@ -0,0 +1,161 @@
+#include "lz4.h"
+#include <string.h>
+
+/* A block is a list of sequences.  Each one is a token byte, with how many
+   literal bytes there are in its top 4 bits and how long the match is
+   (less 4) in its bottom 4, then the literals, then how far back the match
+   is, in 2 bytes.  A length of 15 in the token goes on in the bytes after
+   it, adding each one until one isn't 255.  The last sequence is only
+   literals: the last 5 bytes are always literals, and no match starts in
+   the last 12. */
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+#define MAX_OFFSET 65535
+
+/* Private function prototypes */
+static Uint32 read32(Uint8 *p);
+static Uint8 *putLength(Uint8 *op, int len);
+
+/* read32
+   Reads 4 bytes, however they're aligned.
+*/
+Uint32
+read32(Uint8 *p)
+{
+  Uint32 n;
+  memcpy(&n, p, 4);
+  return n;
+}
+
+/* putLength
+   Writes the rest of a length that didn't fit in its token.
+*/
+Uint8 *
+putLength(Uint8 *op, int len)
+{
+  for (; len >= 255; len -= 255) *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* lz4_compress
+   Compresses n bytes into dst, which has room for max.  Returns the
+   compressed size, or -1 if it won't fit.
+*/
+int
+lz4_compress(Uint8 *src, int n, Uint8 *dst, int max)
+{
+  int table[1 << LZ4_HASH_BITS];
+  Uint8 *op = dst, *oend = dst + max;
+  int i = 0, anchor = 0, lit;
+
+  /* Where each hash was last seen, plus 1, so 0 is nowhere */
+  memset(table, 0, sizeof(table));
+
+  while (i + MATCH_LIMIT < n)
+    {
+      Uint32 seq = read32(src + i);
+      int h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+      int ref = table[h] - 1;
+      int len = MIN_MATCH;
+
+      table[h] = i + 1;
+      if (ref < 0 || i - ref > MAX_OFFSET || read32(src + ref) != seq)
+	{
+	  i++;
+	  continue;
+	}
+
+      while (i + len < n - LAST_LITERALS && src[ref + len] == src[i + len]) len++;
+
+      /* The literals since the last match, then the match */
+      lit = i - anchor;
+      if (oend - op < 1 + lit / 255 + 1 + lit + 2 + (len - MIN_MATCH) / 255 + 1)
+	return -1;
+      *op = ((lit < 15 ? lit : 15) << 4) | (len - MIN_MATCH < 15 ? len - MIN_MATCH : 15);
+      op++;
+      if (lit >= 15) op = putLength(op, lit - 15);
+      memcpy(op, src + anchor, lit);
+      op += lit;
+      *op++ = (i - ref) & 0xff;
+      *op++ = (i - ref) >> 8;
+      if (len - MIN_MATCH >= 15) op = putLength(op, len - MIN_MATCH - 15);
+
+      i += len;
+      anchor = i;
+    }
+
+  /* The rest is literals */
+  lit = n - anchor;
+  if (oend - op < 1 + lit / 255 + 1 + lit) return -1;
+  *op++ = (lit < 15 ? lit : 15) << 4;
+  if (lit >= 15) op = putLength(op, lit - 15);
+  memcpy(op, src + anchor, lit);
+  op += lit;
+
+  return op - dst;
+}
+
+/* lz4_decompress
+   Decompresses n bytes of a block into dst, which has room for size.
+   Returns how many bytes came out, or -1 if the block is broken.  Nothing
+   is read or written outside of src and dst, however broken it is.
+*/
+int
+lz4_decompress(Uint8 *src, int n, Uint8 *dst, int size)
+{
+  Uint8 *ip = src, *iend = src + n;
+  Uint8 *op = dst, *oend = dst + size;
+
+  for (;;)
+    {
+      int token, len, offset;
+      Uint8 *match;
+
+      if (ip >= iend) return -1;
+      token = *ip++;
+
+      /* The literals */
+      len = token >> 4;
+      if (len == 15)
+	{
+	  int b;
+	  do
+	    {
+	      if (ip >= iend) return -1;
+	      b = *ip++;
+	      len += b;
+	    } while (b == 255);
+	}
+      if (len > iend - ip || len > oend - op) return -1;
+      memcpy(op, ip, len);
+      op += len;
+      ip += len;
+
+      /* The last sequence doesn't have a match */
+      if (ip == iend) break;
+
+      /* The match, which can overlap what it's copying */
+      if (iend - ip < 2) return -1;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op - dst) return -1;
+      len = token & 15;
+      if (len == 15)
+	{
+	  int b;
+	  do
+	    {
+	      if (ip >= iend) return -1;
+	      b = *ip++;
+	      len += b;
+	    } while (b == 255);
+	}
+      len += MIN_MATCH;
+      if (len > oend - op) return -1;
+      for (match = op - offset; len > 0; len--) *op++ = *match++;
+    }
+
+  return op - dst;
+}
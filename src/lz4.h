@@ -0,0 +1,21 @@
+#ifndef __DEFINED_LZ4_H
+#define __DEFINED_LZ4_H
+
+#include "defs.h"
+#include "SDL.h"
+
+/* Compression in the LZ4 block format, for the resource pack.  It's simple
+   enough to have here instead of needing the library, and it unpacks about
+   as fast as memory can be copied.  There's no frame format: whoever stores
+   a block has to remember how big it was before it was compressed. */
+
+/* How much room compressing n bytes can take, at worst */
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* The number of bits in the compressor's hash table */
+#define LZ4_HASH_BITS 12
+
+extern int lz4_compress(Uint8 *src, int n, Uint8 *dst, int max);
+extern int lz4_decompress(Uint8 *src, int n, Uint8 *dst, int size);
+
+#endif /* __DEFINED_LZ4_H */
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "SDL.h"
 #include "map.h"
 #include "object.h"
@@ -9,6 +10,14 @@
 #include "camera.h"
 #include "input.h"
 #include "signal.h"
+#include "projectile.h"
+#include "particle.h"
+#include "chunk.h"
+#include "pack.h"
+#include "pool.h"
+#include "res.h"
+#include "loader.h"
+#include "hotload.h"
 
 /* If more than this number of seconds passes during a cycle, the game will
    run slowly : */
@@ -16,8 +25,10 @@
 
 
 #define LEVELS_DAT "levels/levels.dat"
-#define SPRITES_DAT "sprites/sprites.dat"
-#define SOUND_DAT "sounds/sounds.dat"
+
+/* The packs made to time loading from */
+#define BENCH_PACK "bench.pak"
+#define BENCH_PACKZ "benchz.pak"
 
 
 /* Here's our code for running the world. */
@@ -42,6 +53,9 @@ runTheWorld(Time dt)
   Object *this_object = NULL;
   
   
+  /* Check on the contacts things were resting on last frame */
+  col_beginFrame(dt);
+
   // Set god's position to the same position as the camera:
   god_sector.x = obj_realToSectorX(cam_getCameraPos().x);
   god_sector.y = obj_realToSectorY(cam_getCameraPos().y);
@@ -109,10 +123,16 @@ runTheWorld(Time dt)
     }  /* End of for loops */
 
 
-  /* Have visible tiles do their go() function and animate: */
+  /* Move the projectiles, they send signals to whatever they hit: */
+  proj_run(dt);
+
+  /* Move the particles: */
+  part_run(dt);
+
+  /* Have visible tiles do their go() function: */
   map_runTiles();
 
-  /* Have each object do its go() function and animate: */
+  /* Have each object do its go() function: */
   for (curr_sector.y = (god_sector.y - SECTOR_Y_RANGE > 0) ? god_sector.y - SECTOR_Y_RANGE : 0;
        curr_sector.y <= god_sector.y + SECTOR_Y_RANGE && curr_sector.y < obj_getLayerHeight(l);
        curr_sector.y++
@@ -135,9 +155,6 @@ runTheWorld(Time dt)
 	      // Have the object do its think code or whatever it does:
 	      this_object->go(this_object, dt);
 
-	      /* Animate */
-	      obj_animateObj(this_object);
-
 	      // get the next object
 	      this_object = obj_getNextObj(this_object);
 	    }
@@ -152,6 +169,79 @@ runTheWorld(Time dt)
 }
 
 
+/* benchStartup
+   Times loading the tileset, sprites and sounds for an area from the data
+   directory, from a pack, and from a compressed pack, each one cold (with
+   the files dropped from the system's cache first) and then warm, and
+   then out of the resource cache.
+*/
+void
+benchStartup(char *areafile)
+{
+  char *names[3] = {"data directory", "pack", "compressed pack"};
+  char *packs[3] = {NULL, BENCH_PACK, BENCH_PACKZ};
+  Uint32 start;
+  int i, warm;
+
+  pak_build(DATA_PREFIX, BENCH_PACK, 0);
+  pak_build(DATA_PREFIX, BENCH_PACKZ, 1);
+  printf("Unpacking with %d threads\n", pool_nWorkers());
+
+  for (i = 0; i < 3; i++)
+    {
+      for (warm = 0; warm < 2; warm++)
+	{
+	  if (!warm)
+	    {
+	      pak_evict(DATA_PREFIX);
+	      if (packs[i] != NULL) pak_evict(packs[i]);
+	    }
+
+	  start = SDL_GetTicks();
+	  if (packs[i] != NULL) pak_open(packs[i], DATA_PREFIX);
+	  map_loadTileset(areafile, 1);
+	  obj_loadSprites(SPRITES_DAT);
+	  aud_loadSounds(SOUND_DAT);
+	  obj_loadAreaAssets(areafile, 1);
+	  pak_flush();
+	  printf("%s, %s: %d ms\n", names[i], warm ? "warm" : "cold",
+		 SDL_GetTicks() - start);
+
+	  map_freeTileset();
+	  obj_freeSprites();
+	  aud_freeSounds();
+	  res_free();
+	  file_free();
+	  pak_close();
+	}
+    }
+
+  /* Once they've been loaded and given back, they're in the cache */
+  map_loadTileset(areafile, 1);
+  obj_loadSprites(SPRITES_DAT);
+  aud_loadSounds(SOUND_DAT);
+  obj_loadAreaAssets(areafile, 1);
+  map_freeTileset();
+  obj_freeSprites();
+  aud_freeSounds();
+
+  start = SDL_GetTicks();
+  map_loadTileset(areafile, 1);
+  obj_loadSprites(SPRITES_DAT);
+  aud_loadSounds(SOUND_DAT);
+  obj_loadAreaAssets(areafile, 1);
+  printf("cache: %d ms\n", SDL_GetTicks() - start);
+  res_printStats();
+
+  map_freeTileset();
+  obj_freeSprites();
+  aud_freeSounds();
+  res_free();
+
+  remove(BENCH_PACK);
+  remove(BENCH_PACKZ);
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -160,9 +250,33 @@ int main(int argc, char *argv[])
   int quit = 0;
   Timer main_timer;
   char *levelfile, *areafile;
+  int i, first_frame = 1;
 
   Object *player_ptr; // A pointer to the player object
 
+  /* giraffe -c <areafile>... compiles areas to the binary format and quits */
+  if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+    for (i = 2; i < argc; i++) file_compileArea(argv[i]);
+    return 0;
+  }
+
+  /* giraffe -b [tiles] times loading a big made-up area and quits */
+  if (argc >= 2 && strcmp(argv[1], "-b") == 0) {
+    file_benchArea(argc >= 3 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 100000);
+    return 0;
+  }
+
+  /* giraffe -p builds the resource pack out of the data directory and
+     quits, and giraffe -pz builds a compressed one */
+  if (argc >= 2 && strcmp(argv[1], "-p") == 0) {
+    pak_build(DATA_PREFIX, PACK_FILE, 0);
+    return 0;
+  }
+  if (argc >= 2 && strcmp(argv[1], "-pz") == 0) {
+    pak_build(DATA_PREFIX, PACK_FILE, 1);
+    return 0;
+  }
+
   // Get resolution from command line options -- default to 640x480
   if (argc >= 3) {
     if (!(xres = atoi(argv[1]))) xres = 640;
@@ -179,6 +293,10 @@ int main(int argc, char *argv[])
   else {
     fullscreen = 0;
   }
+  // Memory budget for loaded map chunks, in kilobytes
+  if (argc >= 5 && atoi(argv[4]) > 0) {
+    chk_setBudget(atoi(argv[4]) * 1024);
+  }
 
   /* Init SDL */
   if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO) < 0) {
@@ -196,6 +314,17 @@ int main(int argc, char *argv[])
   /* Init audio */
   aud_init();
 
+  /* Load everything out of the resource pack, if there is one */
+  if (pak_open(PACK_FILE, DATA_PREFIX))
+    printf("Loading from %s\n", PACK_FILE);
+
+  /* Read in all of the dat files at once, and keep them */
+  file_loadDats(LEVELS_DAT);
+  file_loadDats(TILESET_DATFILE);
+  file_loadDats(MUSIC_DATFILE);
+  file_loadDats(SPRITES_DAT);
+  file_loadDats(SOUND_DAT);
+
   /* Start off on level 1, area 1 */
 
   /* Find the area filename */
@@ -203,33 +332,43 @@ int main(int argc, char *argv[])
   areafile = file_getDatValue(levelfile, "demo_area");
   free(levelfile);
 
-  /* Load the music for this area: */
-  printf("Loading music...\n");
-  aud_loadMusic(areafile);
-
-  /* Load sounds */
-  printf("Loading sounds...\n");
-  aud_loadSounds(SOUND_DAT);
-
-  /* Load the tileset for this area: */
-  printf("Loading tile animations...\n");
-  map_loadTileset(areafile);
-
-  printf("Loading map...\n");
-  /* Load the map for this area: */
-  map_loadMap(areafile);
-
-  printf("Loading sprite animations...\n");
-  /* Load the sprites */
-  obj_loadSprites(SPRITES_DAT);
+  /* giraffe -s times loading from the data directory and from packs, and
+     quits */
+  if (argc >= 2 && strcmp(argv[1], "-s") == 0) {
+    pak_close();
+    benchStartup(areafile);
+    free(areafile);
+    file_free();
+    nam_free();
+    pool_free();
+    return 0;
+  }
 
-  printf("Loading objects...\n");
-  /* Load the objects for this area: */
-  obj_loadObjects(areafile);
+  /* Load the area's music, sounds, tileset, sprites, map and objects,
+     drawing how it's going.  The music starts as soon as it's in.  If
+     the game's quit while it's loading, it still has to finish, since
+     some of it is being done in the background. */
+  ldr_start(areafile);
+  while (!ldr_update())
+    {
+      ldr_draw();
+      while (SDL_PollEvent(&event))
+	{
+	  if (event.type == SDL_QUIT)
+	    quit = 1;
+	  else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)
+	    quit = 1;
+	  else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F4)
+	    gfx_toggleFullscreen();
+	}
+    }
 
+  /* Anything that was unpacked out of the pack has been loaded now */
+  pak_flush();
 
-  /* Play the music */
-  aud_playMusic(-1);
+  /* Make room for projectiles and particles */
+  proj_init();
+  part_init();
 
 
   /* Get a pointer to the player */
@@ -244,6 +383,14 @@ int main(int argc, char *argv[])
   /* Make the camera the size of the screen */
   cam_setCameraSize(xres, yres);
 
+  /* Start loading the map chunks around the camera, and wait for the ones
+     it can see */
+  chk_start();
+  chk_update();
+
+  /* In a build with HOT_RELOAD, watch the data for changes */
+  hot_init(areafile);
+
 
   /* Initialize the main timer: */
   time_init(&main_timer, MAX_ELAPSED_TIME);
@@ -253,14 +400,35 @@ int main(int argc, char *argv[])
     {
 
 
+      /* Everything animates by the time this cycle started */
+      anim_setTime(SDL_GetTicks());
+
       runTheWorld(time_dt(&main_timer));
       time_update(&main_timer);
 
 
       /* Set the camera's position to center on the player */
       cam_setCameraPos(obj_getObjPos(player_ptr).x, obj_getObjPos(player_ptr).y);
+
+      /* Put in any of the area or animations that were edited */
+      hot_update();
+
+      /* Stream in the chunks near the camera and throw out far ones */
+      chk_update();
+
+      /* Put in any images and sounds that were loaded in the background */
+      pool_finish(0);
+
       cam_render();
 
+      /* How long it took to get the game up, from starting SDL */
+      if (first_frame)
+	{
+	  printf("First frame after %d ms, %d ms of it loading\n",
+		 SDL_GetTicks(), ldr_getTime());
+	  first_frame = 0;
+	}
+
       while (SDL_PollEvent(&event))
 	{
 	  switch (event.type)
@@ -331,6 +499,19 @@ int main(int argc, char *argv[])
 	}
     }
 
+  /* Let anything still loading in the background finish */
+  pool_finish(1);
+
+  hot_free();
+  chk_free();
+  printf("Chunks freed.\n");
+
+  proj_free();
+  printf("Projectiles freed.\n");
+
+  part_free();
+  printf("Particles freed.\n");
+
   obj_freeObjects();
   printf("Objects freed.\n");
 
@@ -345,7 +526,18 @@ int main(int argc, char *argv[])
 
   aud_freeMusic();
   aud_freeSounds();
+
+  /* Everything's been given back to the cache, so it can all go */
+  res_printStats();
+  res_free();
   aud_close();
   printf("Audio freed.\n");
 
+  file_free();
+  nam_free();
+  printf("Files freed.\n");
+
+  pak_close();
+  pool_free();
+
 }
@@ -1,5 +1,7 @@
 #include "map.h"
 #include "camera.h"
+#include "chunk.h"
+#include "pool.h"
 
 /* The tile specific data is in this file: */
 #include "types/tiletypes.h"
@@ -10,12 +12,66 @@ extern struct tile_att_define *tile_defs[];
 /* The map for 1 area.  (Only 1 for now.) */
 static Map map;
 
-/* The tile animation data: */
-static Tileset tileset;
+/* The tile animation data, out of the cache: */
+static Tileset *tileset = NULL;
+static ResHandle tileset_res = RES_NONE;
+
+/* A tile edge used while building the static geometry of a chunk.  An
+   edge's direction is reduced to its smallest whole vector u, off says
+   which of the lines in that direction it lies on, and t1 and t2 are how
+   far along that line it starts and ends.
+
+   Horizontal and vertical edges are faces, which can be pressed up against
+   a neighboring tile's.  For those, c is the row or column of pixels the
+   face is on, facing is 1 if it faces right or down and -1 if it faces
+   left or up, and lo and hi are where it starts and ends along c. */
+typedef struct edge_struct
+{
+  Line line;
+  Point tile_pos;
+  int type;
+  int ux, uy, off, t1, t2;
+  int face, vert, c, facing, lo, hi;
+} Edge;
+
+typedef struct edgelist_struct
+{
+  int n, max;
+  Edge *edges;
+} EdgeList;
+
+/* Prototypes are found while the map loads by hashing them into this many
+   buckets: */
+#define PROTO_BUCKETS 256
+
+/* The buckets, kept so that tiles can be added to a running map */
+static int proto_buckets[PROTO_BUCKETS];
+static int max_protos;
 
 /* Private function prototypes */
 static int animNameToID(char *name);
-static void freeTile(int l, int x, int y);
+static int boundsAreEqual(Bound *a, Bound *b);
+static unsigned int hashProto(TileProto *t);
+static int internProto(TileProto *t);
+static void readKind(Area *area, AreaKind *ak, TileProto *t);
+static Uint16 *readKinds(Area *area);
+static void readTiles(Area *area, Uint16 *kind_protos, int l, int x1, int y1, int w, int h, Uint16 *grid);
+static void freeBounds(Bound *b);
+static TileProto *protoAt(int z, int x, int y);
+static Animation *getTileAnim(int z, int x, int y);
+static Chunk *newChunk(Uint16 *tiles);
+static int nextInChunks(int z, int y, int x, int x_end, int collide);
+static int tileIsMergeable(TileProto *t);
+static void addEdge(EdgeList *el, Point p1, Point p2, Point tile_pos, int type);
+static int gcd(int a, int b);
+static int compareFaces(const void *a, const void *b);
+static int compareEdges(const void *a, const void *b);
+static int compareInts(const void *a, const void *b);
+static int findFaces(EdgeList *el, int vert, int c, int facing);
+static void cutFaces(EdgeList *in, EdgeList *out);
+static void buildGeometry(Chunk *c, int l, int cx, int cy, Uint16 *ring);
+static int checkArea(Area *area);
+static int reloadLayer(Area *area, Uint16 *kind_protos, int l);
 
 /* animNameToID
    Searches the loaded tileset array for an animation with the given name,
@@ -24,14 +80,12 @@ static void freeTile(int l, int x, int y);
 int
 animNameToID(char *name)
 {
-  extern Tileset tileset;
-  int i = 0;
-  do
-    {
-      if (strcmp(name, tileset.data[i].name) == 0) return i;
-    } while (i++ < tileset.n_animations);
+  extern Tileset *tileset;
+  int id = nam_lookup(&tileset->names, name);
+
+  if (id >= 0) return id;
 
-  /* Still haven't found the animation of this name? Error! */
+  /* Haven't found the animation of this name? Error! */
   fprintf(stderr, "Error: Animation of name %s not loaded.\n", name);
   exit(0);
 }
@@ -44,6 +98,18 @@ map_getNLayers(void)
   return map.n_layers;
 }
 
+/* map_getTileAnims
+   Returns the tileset's animations, and sets how many there are.
+*/
+AnimData *
+map_getTileAnims(int *n)
+{
+  extern Tileset *tileset;
+
+  *n = tileset->n_animations;
+  return tileset->data;
+}
+
 /* map_getBackgroundColor
    Return the background color.
 */
@@ -70,17 +136,46 @@ map_getLayerHeight(int z)
   return map.layers[z].h;
 }
 
+/* getTileAnim
+   Returns the animation a tile is showing: its own if it's active, and its
+   prototype's if it isn't.
+*/
+Animation *
+getTileAnim(int z, int x, int y)
+{
+  TileProto *t = protoAt(z, x, y);
+
+  return t->active ? &map_getTileState(z, x, y)->anim : &t->anim;
+}
+
+/* protoAt
+   Returns the prototype of the tile at a position, or NULL if there's no
+   tile there or its chunk isn't loaded.
+*/
+TileProto *
+protoAt(int z, int x, int y)
+{
+  extern Map map;
+  Chunk *c = CHUNK_AT(z, x, y);
+
+  if (c == NULL || !bit_test(&c->occupied, x % CHUNK_W, y % CHUNK_H)) return NULL;
+  return PROTO_AT(z, x, y);
+}
+
 /* map_getTileGfx
-   Returns a pointer to an SDL_Surface of the currently displayed graphic of
-   a tile, or NULL if there is no tile.
+   Returns a pointer to the currently displayed frame of a tile, or NULL if
+   there is no tile.
 */
-SDL_Surface *
+Frame *
 map_getTileGfx(int z, int x, int y)
 {
-  extern Tileset tileset;
-  extern Map map;
+  extern Tileset *tileset;
+  Animation *a;
 
-  return (TILE_AT(z, x, y) == NULL) ? NULL : tileset.data[TILE_AT(z, x, y)->anim.anim_id].frames[TILE_AT(z, x, y)->anim.curr_frame].image;
+  if (protoAt(z, x, y) == NULL) return NULL;
+  a = getTileAnim(z, x, y);
+  anim_needGfx(&tileset->data[a->anim_id]);
+  return &tileset->data[a->anim_id].frames[anim_getFrame(a, &tileset->data[a->anim_id])];
 }
 
 /* map_getTileGfxOffset
@@ -90,12 +185,13 @@ map_getTileGfx(int z, int x, int y)
 Point
 map_getTileGfxOffset(int z, int x, int y)
 {
-  extern Map map;
-  extern Tileset tileset;
+  extern Tileset *tileset;
+  Animation *a = getTileAnim(z, x, y);
+  Frame *f = &tileset->data[a->anim_id].frames[anim_getFrame(a, &tileset->data[a->anim_id])];
   Point p;
 
-  p.x = TILE_AT(z, x, y)->anim.offset.x + tileset.data[TILE_AT(z, x, y)->anim.anim_id].frames[TILE_AT(z, x, y)->anim.curr_frame].offset.x;
-  p.y = TILE_AT(z, x, y)->anim.offset.y + tileset.data[TILE_AT(z, x, y)->anim.anim_id].frames[TILE_AT(z, x, y)->anim.curr_frame].offset.y;
+  p.x = a->offset.x + f->offset.x;
+  p.y = a->offset.y + f->offset.y;
 
   return p;
 }
@@ -107,204 +203,958 @@ map_getTileGfxOffset(int z, int x, int y)
 Bound *
 map_getTileBounds(int z, int x, int y)
 {
-  extern Map map;
-  return (TILE_AT(z, x, y) == NULL) ? NULL : TILE_AT(z, x, y)->bounds;
+  TileProto *t = protoAt(z, x, y);
+  return (t == NULL) ? NULL : t->bounds;
 }
 
 /* map_getTileType
-   Returns a tile's type.
+   Returns a tile's type, or NONE_T if there's no tile there or its chunk
+   isn't loaded.
 */
 int map_getTileType(int z, int x, int y)
 {
-  extern Map map;
-  return (TILE_AT(z, x, y)->type);
+  TileProto *t = protoAt(z, x, y);
+  return (t == NULL) ? NONE_T : t->type;
+}
+
+/* map_loadTileset
+   Gets the tileset for an area out of the cache, reading its description
+   only if it isn't cached already, and loads the images of the animations
+   the area's tiles use, waiting for them if wait is true.  The rest are
+   loaded in the background if they're ever shown.
+*/
+void
+map_loadTileset(char *areafile, int wait)
+{
+  extern Tileset *tileset;
+  extern ResHandle tileset_res;
+  char *tileset_datfile, *seen;
+  AnimData **used;
+  Area *a;
+  int i, id, n = 0;
+
+  tileset_datfile = file_getAreaTilesetFile(areafile);
+  tileset_res = res_acquire(RES_TILESET, tileset_datfile);
+  tileset = (Tileset *) res_get(tileset_res);
+  free(tileset_datfile);
+
+  /* Find the animations the area uses, once each */
+  a = file_openArea(areafile);
+  MALLOC(used, (tileset->n_animations + 1) * sizeof(AnimData *));
+  MALLOC(seen, tileset->n_animations + 1);
+  memset(seen, 0, tileset->n_animations + 1);
+  for (i = 0; i < a->head->n_kinds; i++)
+    {
+      id = nam_lookup(&tileset->names, file_areaString(a, file_areaKind(a, i)->anim));
+      if (id >= 0 && !seen[id])
+	{
+	  seen[id] = 1;
+	  used[n++] = &tileset->data[id];
+	}
+    }
+  free(seen);
+  file_closeArea(a);
+
+  /* Load all of their frames' images at once, onto atlas pages */
+  anim_loadGfx(used, n, wait);
+  free(used);
 }
-/* Load the tileset for an area */
+
+/* map_freeTileset
+   Gives the area's tileset back to the cache, which keeps it for a while
+   in case the next area uses it too.
+*/
 void
-map_loadTileset(char *areafile)
+map_freeTileset(void)
 {
+  extern Tileset *tileset;
+  extern ResHandle tileset_res;
+
+  res_release(tileset_res);
+  tileset_res = RES_NONE;
+  tileset = NULL;
+}
 
-  extern Tileset tileset;
-  char *tileset_datfile;
+/* map_makeTileset
+   Reads the descriptions of a tileset's animations from its .dat file, for
+   the cache.  None of their images are loaded yet.
+*/
+void *
+map_makeTileset(char *tileset_datfile)
+{
+  Tileset *t;
   char *anim_name, *anim_dir;
-  int i = 0;
+  DatFile *dat;
+  int i;
 
-  tileset_datfile = file_getAreaTilesetFile(areafile);
+  MALLOC(t, sizeof(Tileset));
 
-  /* Count the number of animations in this tileset and allocate the tileset
-     array */
-  tileset.n_animations = file_countDatPairs(tileset_datfile);
-  tileset.data = (AnimData *) dyn_1dArrayAlloc(tileset.n_animations, sizeof(AnimData));
-  
+  /* Read the datfile in */
+  dat = file_openDat(tileset_datfile);
 
-  /* Open the datfile for reading */
-  file_openFile(tileset_datfile, 'r');
+  /* Allocate the tileset array for the animations in this tileset */
+  t->n_animations = dat->n_pairs;
+  t->data = (AnimData *) dyn_1dArrayAlloc(t->n_animations, sizeof(AnimData));
+  nam_initMap(&t->names);
+  t->pages.n_atlases = 0;
+  t->pages.atlases = NULL;
 
-  while (file_getNextDatPair(tileset_datfile, &anim_name, &anim_dir))
+  for (i = 0; i < dat->n_pairs; i++)
     {
-      /* Load the animation */
-      file_loadAnim(anim_name, anim_dir, &tileset.data[i]);
+      /* Read the animation */
+      file_getDatPair(dat, i, &anim_name, &anim_dir);
+      file_loadAnim(anim_name, anim_dir, &t->data[i]);
+      t->data[i].pages = &t->pages;
+      nam_set(&t->names, nam_intern(anim_name), i);
       free(anim_name); free(anim_dir);
-      i++;
     }
 
-  /* Close the datfile */
-  file_closeFile(tileset_datfile);
+  return t;
+}
 
-  free(tileset_datfile);
+/* map_destroyTileset
+   Frees a tileset the cache is done with.
+*/
+void
+map_destroyTileset(void *data)
+{
+  Tileset *t = (Tileset *) data;
+  int i;
 
+  /* Nothing can still be loading onto its pages */
+  pool_finish(1);
+
+  for (i = 0; i < t->n_animations; i++)
+    {
+      anim_freeAnim(&t->data[i]);
+    }
+  dyn_1dArrayFree(t->data);
+  nam_freeMap(&t->names);
+  anim_freePages(&t->pages);
+  free(t);
 }
 
-/* map_freeTileset
-   Frees the loaded tileset.
+/* map_tilesetBytes
+   Returns about how much memory a tileset takes up, for the cache.
 */
-void
-map_freeTileset(void)
+long
+map_tilesetBytes(void *data)
 {
-  extern Tileset tileset;
+  Tileset *t = (Tileset *) data;
+
+  return sizeof(Tileset) + t->n_animations * sizeof(AnimData) + anim_pagesBytes(&t->pages);
+}
+
+/* boundsAreEqual
+   Returns true if two lists of boundaries are exactly the same.
+*/
+int
+boundsAreEqual(Bound *a, Bound *b)
+{
+  for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+      if (a->type != b->type) return 0;
+      switch (a->type)
+	{
+	case LINE:
+	  if (a->b.line.p1.x != b->b.line.p1.x || a->b.line.p1.y != b->b.line.p1.y ||
+	      a->b.line.p2.x != b->b.line.p2.x || a->b.line.p2.y != b->b.line.p2.y)
+	    return 0;
+	  break;
+	case RECT:
+	  if (a->b.rect.p1.x != b->b.rect.p1.x || a->b.rect.p1.y != b->b.rect.p1.y ||
+	      a->b.rect.p2.x != b->b.rect.p2.x || a->b.rect.p2.y != b->b.rect.p2.y)
+	    return 0;
+	  break;
+	case CIRCLE:
+	  if (a->b.circle.p.x != b->b.circle.p.x || a->b.circle.p.y != b->b.circle.p.y ||
+	      a->b.circle.r != b->b.circle.r)
+	    return 0;
+	  break;
+	}
+    }
+  return (a == NULL && b == NULL);
+}
+
+/* hashProto
+   Hashes the things which make a tile prototype different from another.
+*/
+unsigned int
+hashProto(TileProto *t)
+{
+  unsigned int h = t->type * 31 + t->anim.anim_id;
+  Bound *b;
+
+  for (b = t->bounds; b != NULL; b = b->next)
+    {
+      h = h * 31 + b->type;
+      switch (b->type)
+	{
+	case LINE:
+	  h = h * 31 + b->b.line.p1.x;
+	  h = h * 31 + b->b.line.p1.y;
+	  h = h * 31 + b->b.line.p2.x;
+	  h = h * 31 + b->b.line.p2.y;
+	  break;
+	case RECT:
+	  h = h * 31 + b->b.rect.p1.x;
+	  h = h * 31 + b->b.rect.p1.y;
+	  h = h * 31 + b->b.rect.p2.x;
+	  h = h * 31 + b->b.rect.p2.y;
+	  break;
+	case CIRCLE:
+	  h = h * 31 + b->b.circle.p.x;
+	  h = h * 31 + b->b.circle.p.y;
+	  h = h * 31 + b->b.circle.r;
+	  break;
+	}
+    }
+  return h % PROTO_BUCKETS;
+}
+
+/* internProto
+   Returns the number of the prototype which is the same as t, adding t as
+   a new one if there isn't any.  If there already was one, t's bounds are
+   freed.
+*/
+int
+internProto(TileProto *t)
+{
+  extern Map map;
+  extern int proto_buckets[], max_protos;
+  unsigned int h = hashProto(t);
   int i;
 
-  for (i = 0; i < tileset.n_animations; i++)
+  for (i = proto_buckets[h]; i != -1; i = map.protos[i].hash_next)
+    {
+      if (map.protos[i].type == t->type &&
+	  map.protos[i].anim.anim_id == t->anim.anim_id &&
+	  boundsAreEqual(map.protos[i].bounds, t->bounds))
+	{
+	  freeBounds(t->bounds);
+	  return i;
+	}
+    }
+
+  if (map.n_protos == MAX_PROTOS)
     {
-      anim_freeAnim(&tileset.data[i]);
+      fprintf(stderr, "Error: More than %d different tiles in the map.\n", MAX_PROTOS);
+      exit(0);
     }
-  dyn_1dArrayFree(tileset.data);
+  if (map.n_protos == max_protos)
+    {
+      max_protos *= 2;
+      if ((map.protos = (TileProto *) realloc(map.protos, max_protos * sizeof(TileProto))) == NULL)
+	{
+	  fprintf(stderr, "Unable to allocate memory.\n");
+	  exit(0);
+	}
+    }
+
+  t->merged = tileIsMergeable(t);
+  t->hash_next = proto_buckets[h];
+  proto_buckets[h] = map.n_protos;
+  map.protos[map.n_protos] = *t;
+  return map.n_protos++;
 }
 
-/* map_loadMap
-   Loads the map for an area.
+/* readKind
+   Reads a kind of tile out of an area into a prototype.
 */
 void
-map_loadMap(char *areafile)
+readKind(Area *area, AreaKind *ak, TileProto *t)
 {
-  extern Map map;
-  extern Tileset tileset;
+  extern Tileset *tileset;
   extern struct tile_att_define *tile_defs[];
-  int i;
+  Bound *b;
+  int j, id, type = ak->type;
+
+  /* Set the tile's type: */
+  t->type = type;
+
+  /* Get tile-specific attributes from the definitions included in
+     tiledata.c */
+  t->elasticity = tile_defs[type]->elasticity;
+  t->solid = tile_defs[type]->solid;
+  t->friction = tile_defs[type]->friction;
+  t->go = NULL;
+  t->free_atts = NULL;
+  if (t->active = tile_defs[type]->active)
+    {
+      /* Only assign the tile functions if it is active */
+      t->go = tile_defs[type]->go;
+      t->free_atts = tile_defs[type]->free_atts;
+    }
 
-  /* Open the area file */
-  file_openFile(areafile, 'r');
+  /* Set the tile's animation.  It plays in step with every other tile
+     showing the same animation. */
+  id = animNameToID(file_areaString(area, ak->anim));
+  anim_init(&t->anim, id, &tileset->data[id]);
 
-  /* Get the background color */
-  map.bg_color = file_getAreaBackgroundColor(areafile);
+  /* Get all of the boundaries for this tile */
+  t->bounds = NULL;
+  for (j = 0; j < ak->n_bounds; j++)
+    {
+      /* If this is the head of the list: */
+      if (t->bounds == NULL)
+	{
+	  MALLOC(t->bounds, sizeof(Bound));
+	  b = t->bounds;
+	}
+      else
+	{
+	  MALLOC(b->next, sizeof(Bound));
+	  b = b->next;
+	}
+      /* Read the boundary in */
+      file_getAreaBound(area, ak->first_bound + j, b);
+    }
+}
 
-  /* Get the number of layers */
-  map.n_layers = file_getAreaNLayers(areafile);
+/* readKinds
+   Reads every kind of tile in an area, and returns the prototype each one
+   is.  The array is the caller's to free.
+*/
+Uint16 *
+readKinds(Area *area)
+{
+  Uint16 *kind_protos = (Uint16 *) dyn_1dArrayAlloc(area->head->n_kinds > 0 ? area->head->n_kinds : 1,
+						     sizeof(Uint16));
+  Uint32 k;
 
-  /* Allocate the array of layers */
-  map.layers = (Layer *) dyn_1dArrayAlloc(map.n_layers, sizeof(Layer));
+  for (k = 0; k < area->head->n_kinds; k++)
+    {
+      TileProto t;
 
-  /* Create the layers */
-  for (i = 0; i < map.n_layers; i++)
+      readKind(area, file_areaKind(area, k), &t);
+
+      /* Use the prototype this kind is the same as, or make it a new
+	 one */
+      kind_protos[k] = internProto(&t);
+    }
+  return kind_protos;
+}
+
+/* readTiles
+   Reads the tiles in a box of one of an area's layers, w by h tiles from
+   x1, y1, into a grid of prototype numbers plus 1, row by row, with
+   NO_TILE where there's no tile.  The box can go past the edges of the
+   layer.  Only the chunks the box covers are looked at.
+*/
+void
+readTiles(Area *area, Uint16 *kind_protos, int l, int x1, int y1, int w, int h, Uint16 *grid)
+{
+  extern Map map;
+  Layer *layer = &map.layers[l];
+  AreaLayer *al = file_areaLayer(area, l);
+  int cx, cy;
+  int cx1 = (x1 > 0) ? x1 / CHUNK_W : 0, cy1 = (y1 > 0) ? y1 / CHUNK_H : 0;
+  int cx2 = (x1 + w - 1) / CHUNK_W, cy2 = (y1 + h - 1) / CHUNK_H;
+  Uint32 k;
+
+  memset(grid, 0, w * h * sizeof(Uint16));
+  if (cx2 >= layer->cw) cx2 = layer->cw - 1;
+  if (cy2 >= layer->ch) cy2 = layer->ch - 1;
+
+  for (cy = cy1; cy <= cy2; cy++)
     {
-      int w, h;
-      /* Find the next layer in the area file */
-      file_nextLayer(areafile);
-      /* Get the layer's dimensions. */
-      file_getLayerDims(areafile, &w, &h);
-      map.layers[i].w = w;
-      map.layers[i].h = h;
+      for (cx = cx1; cx <= cx2; cx++)
+	{
+	  int c = al->first_chunk + cy * layer->cw + cx;
 
-      /* Allocate the layer data array */
-      map.layers[i].data = (Tile ***) dyn_arrayAlloc(map.layers[i].w, map.layers[i].h, sizeof(Tile *));
+	  for (k = file_areaChunk(area, c); k < file_areaChunk(area, c + 1); k++)
+	    {
+	      AreaTile *at = file_areaTile(area, k);
+	      int x = at->x - x1, y = at->y - y1;
 
+	      if (x >= 0 && x < w && y >= 0 && y < h)
+		grid[y * w + x] = kind_protos[at->kind] + 1;
+	    }
+	}
+    }
+}
 
-      /* Get all the tiles in the layer */
-      while (file_nextTile(areafile))
+/* freeBounds
+   Frees a list of boundaries.
+*/
+void
+freeBounds(Bound *b)
+{
+  while (b != NULL)
+    {
+      Bound *next_bound = b->next;
+      free(b);
+      b = next_bound;
+    }
+}
+
+/* tileIsMergeable
+   Returns true if a tile's bounds can be merged into the static geometry:
+   it has to be solid, it can't do anything on its own, and it can only be
+   made of lines and rectangles.
+*/
+int
+tileIsMergeable(TileProto *t)
+{
+  Bound *b;
+
+  if (!t->solid || t->active || t->bounds == NULL) return 0;
+
+  for (b = t->bounds; b != NULL; b = b->next)
+    {
+      if (b->type != LINE && b->type != RECT) return 0;
+    }
+  return 1;
+}
+
+/* gcd
+   Greatest common divisor of the absolute values of two numbers.
+*/
+int
+gcd(int a, int b)
+{
+  if (a < 0) a = -a;
+  if (b < 0) b = -b;
+  while (b != 0)
+    {
+      int r = a % b;
+      a = b;
+      b = r;
+    }
+  return a;
+}
+
+/* addEdge
+   Adds an edge going from p1 to p2 to a list of edges.  Edges with no
+   length are ignored.
+*/
+void
+addEdge(EdgeList *el, Point p1, Point p2, Point tile_pos, int type)
+{
+  Edge *e;
+  int g;
+
+  if (p1.x == p2.x && p1.y == p2.y) return;
+
+  if (el->n == el->max)
+    {
+      el->max = (el->max == 0) ? 64 : el->max * 2;
+      if ((el->edges = (Edge *) realloc(el->edges, el->max * sizeof(Edge))) == NULL)
 	{
-	  Bound *b;
-	  int x, y, type;
-	  char *anim_name;
-
-	  /* Get the tile's attributes */
-	  file_getTileAtts(areafile, &x, &y, &type, &anim_name);
-
-	  /* Allocate the tile in the proper place in the array */
-	  MALLOC(TILE_AT(i, x, y), sizeof(Tile));
-	  
-	  /* Initialize the signal queue */
-	  sig_initQ(&TILE_AT(i, x, y)->signals);
-
-	  /* Set the tile's type: */
-	  TILE_AT(i, x, y)->type = type;
-
-	  /* Get tile-specific attributes from the definitions included in
-	     tiledata.c */
-	  TILE_AT(i, x, y)->elasticity = tile_defs[type]->elasticity;
-	  TILE_AT(i, x, y)->solid = tile_defs[type]->solid;
-	  TILE_AT(i, x, y)->friction = tile_defs[type]->friction;
-	  if (TILE_AT(i, x, y)->active = tile_defs[type]->active)
+	  fprintf(stderr, "Unable to allocate memory.\n");
+	  exit(0);
+	}
+    }
+
+  e = &el->edges[el->n++];
+  e->line.p1 = p1;
+  e->line.p2 = p2;
+  e->tile_pos = tile_pos;
+  e->type = type;
+
+  g = gcd(p2.x - p1.x, p2.y - p1.y);
+  e->ux = (p2.x - p1.x) / g;
+  e->uy = (p2.y - p1.y) / g;
+  e->off = p1.x * e->uy - p1.y * e->ux;
+  e->t1 = p1.x * e->ux + p1.y * e->uy;
+  e->t2 = p2.x * e->ux + p2.y * e->uy;
+
+  /* The normal of a line is (dy, -dx), so a line going down faces right
+     and a line going right faces up: */
+  e->face = (e->ux == 0 || e->uy == 0);
+  e->vert = (e->ux == 0);
+  e->c = e->vert ? p1.x : p1.y;
+  e->facing = e->vert ? e->uy : -e->ux;
+  e->lo = e->vert ? (p1.y < p2.y ? p1.y : p2.y) : (p1.x < p2.x ? p1.x : p2.x);
+  e->hi = e->vert ? (p1.y > p2.y ? p1.y : p2.y) : (p1.x > p2.x ? p1.x : p2.x);
+}
+
+/* compareFaces
+   Sorts faces so that ones on the same row or column of pixels which face
+   the same way end up together, in order.  Edges which aren't faces go at
+   the end.
+*/
+int
+compareFaces(const void *a, const void *b)
+{
+  const Edge *ea = (const Edge *) a, *eb = (const Edge *) b;
+
+  if (ea->face != eb->face) return eb->face - ea->face;
+  if (ea->vert != eb->vert) return ea->vert - eb->vert;
+  if (ea->c != eb->c) return ea->c - eb->c;
+  if (ea->facing != eb->facing) return ea->facing - eb->facing;
+  return ea->lo - eb->lo;
+}
+
+/* compareEdges
+   Sorts edges so that ones which could be merged end up next to each
+   other, in order along the line they lie on.
+*/
+int
+compareEdges(const void *a, const void *b)
+{
+  const Edge *ea = (const Edge *) a, *eb = (const Edge *) b;
+
+  if (ea->type != eb->type) return ea->type - eb->type;
+  if (ea->ux != eb->ux) return ea->ux - eb->ux;
+  if (ea->uy != eb->uy) return ea->uy - eb->uy;
+  if (ea->off != eb->off) return ea->off - eb->off;
+  return ea->t1 - eb->t1;
+}
+
+/* compareInts
+   For sorting with qsort by the first int.
+*/
+int
+compareInts(const void *a, const void *b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+/* findFaces
+   Finds the first face on a row or column of pixels facing a certain way
+   in a list sorted by compareFaces, or returns -1 if there are none.
+*/
+int
+findFaces(EdgeList *el, int vert, int c, int facing)
+{
+  int lo = 0, hi = el->n;
+
+  /* Find the first edge which doesn't come before the ones we want */
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      Edge *e = &el->edges[mid];
+      if (e->face &&
+	  (e->vert < vert || (e->vert == vert &&
+	   (e->c < c || (e->c == c && e->facing < facing)))))
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  if (lo < el->n && el->edges[lo].face && el->edges[lo].vert == vert &&
+      el->edges[lo].c == c && el->edges[lo].facing == facing)
+    return lo;
+  return -1;
+}
+
+/* cutFaces
+   Copies the edges in one list to another, leaving out the parts of faces
+   which are pressed up against a face pointing the other way.  Tile bounds
+   include their last pixel, so the right side of one tile (x = 31) and the
+   left side of the next (x = 32) count as pressed together.
+*/
+void
+cutFaces(EdgeList *in, EdgeList *out)
+{
+  int i, k, n_covers, max_covers = 16;
+  int *covers = (int *) dyn_1dArrayAlloc(max_covers * 2, sizeof(int));
+
+  if (in->n > 0) qsort(in->edges, in->n, sizeof(Edge), compareFaces);
+
+  for (i = 0; i < in->n; i++)
+    {
+      Edge *e = &in->edges[i];
+      int pos, c;
+
+      if (!e->face)
+	{
+	  addEdge(out, e->line.p1, e->line.p2, e->tile_pos, e->type);
+	  continue;
+	}
+
+      /* Gather the parts of the opposite faces on the same row or column
+	 of pixels, or the next one over in the direction this one faces,
+	 which overlap this face: */
+      n_covers = 0;
+      for (c = e->c; c != e->c + 2 * e->facing; c += e->facing)
+	{
+	  if ((k = findFaces(in, e->vert, c, -e->facing)) < 0) continue;
+	  for (; k < in->n && in->edges[k].face && in->edges[k].vert == e->vert &&
+		 in->edges[k].c == c && in->edges[k].facing == -e->facing; k++)
+	    {
+	      if (in->edges[k].hi < e->lo || in->edges[k].lo > e->hi) continue;
+	      if (n_covers == max_covers)
+		{
+		  max_covers *= 2;
+		  if ((covers = (int *) realloc(covers, max_covers * 2 * sizeof(int))) == NULL)
+		    {
+		      fprintf(stderr, "Unable to allocate memory.\n");
+		      exit(0);
+		    }
+		}
+	      covers[n_covers * 2] = in->edges[k].lo;
+	      covers[n_covers * 2 + 1] = in->edges[k].hi;
+	      n_covers++;
+	    }
+	}
+      qsort(covers, n_covers, 2 * sizeof(int), compareInts);
+
+      /* Keep the pieces of the face in between the covered parts */
+      pos = e->lo;
+      for (k = 0; k <= n_covers && pos < e->hi; k++)
+	{
+	  int end = (k < n_covers) ? covers[k * 2] - 1 : e->hi;
+
+	  if (end > pos)
 	    {
-	      /* Only assign the tile functions if it is active */
-	      TILE_AT(i, x, y)->atts = tile_defs[type]->init_atts();
-	      TILE_AT(i, x, y)->go = tile_defs[type]->go;
-	      TILE_AT(i, x, y)->free_atts = tile_defs[type]->free_atts;
+	      Point p1, p2;
+	      int forward = (e->vert ? e->uy : e->ux) > 0;
+	      if (e->vert)
+		{
+		  p1.x = p2.x = e->c;
+		  p1.y = forward ? pos : end;
+		  p2.y = forward ? end : pos;
+		}
+	      else
+		{
+		  p1.y = p2.y = e->c;
+		  p1.x = forward ? pos : end;
+		  p2.x = forward ? end : pos;
+		}
+	      addEdge(out, p1, p2, e->tile_pos, e->type);
 	    }
+	  if (k < n_covers && covers[k * 2 + 1] + 1 > pos)
+	    pos = covers[k * 2 + 1] + 1;
+	}
+    }
+
+  dyn_1dArrayFree(covers);
+}
+
+/* buildGeometry
+   Merges the bounds of the mergeable tiles in a chunk into long segments
+   and indexes them by where they are in the chunk.  The chunk's tiles are
+   given as a grid, row by row, with a ring of the tiles around it, whose
+   faces cut the chunk's own.
+*/
+void
+buildGeometry(Chunk *chunk, int l, int cx, int cy, Uint16 *ring)
+{
+  extern Map map;
+  Layer *layer = &map.layers[l];
+  Geometry *g = &chunk->geom;
+  EdgeList edges = {0, 0, NULL}, cut = {0, 0, NULL};
+  int x, y, i, k, end = 0, n_cells = CHUNK_W * CHUNK_H;
+  int x1 = cx * CHUNK_W, y1 = cy * CHUNK_H;
+  int x2 = x1 + CHUNK_W - 1, y2 = y1 + CHUNK_H - 1;
+  int *fill;
+
+  /* Break every mergeable tile's bounds up into edges in real coordinates.
+     The sides of a rectangle go clockwise so that their normals face
+     out. */
+  for (x = x1 - 1; x <= x2 + 1; x++)
+    {
+      for (y = y1 - 1; y <= y2 + 1; y++)
+	{
+	  TileProto *t;
+	  Point tile_pos, o, c[4];
+	  Bound *b;
+
+	  Uint16 id = ring[(y - y1 + 1) * (CHUNK_W + 2) + x - x1 + 1];
 
-	  /* Set the tile's animation: */
-	  TILE_AT(i, x, y)->anim.anim_id = animNameToID(anim_name);
-	  free(anim_name);
-	  TILE_AT(i, x, y)->anim.curr_frame = 0;
-	  TILE_AT(i, x, y)->anim.play_dir = 0;
-	  TILE_AT(i, x, y)->anim.offset.x = 0;
-	  TILE_AT(i, x, y)->anim.offset.y = 0;
-	  /* Get the animation speed from the animation's default: */
-	  time_init(&TILE_AT(i, x, y)->anim.timer, tileset.data[TILE_AT(i, x, y)->anim.anim_id].def_delay);
-
-	  /* Get all of the boundaries for this tile */
-	  TILE_AT(i, x, y)->bounds = NULL;
-	  while (file_nextTileBound(areafile))
+	  if (id == NO_TILE || !(t = &map.protos[id - 1])->merged) continue;
+
+	  tile_pos.x = x;
+	  tile_pos.y = y;
+	  o.x = map_mapToRealX(x);
+	  o.y = map_mapToRealY(y);
+
+	  for (b = t->bounds; b != NULL; b = b->next)
 	    {
-	      /* If this is the head of the list: */
-	      if (TILE_AT(i, x, y)->bounds == NULL)
+	      if (b->type == LINE)
 		{
-		  MALLOC(TILE_AT(i, x, y)->bounds, sizeof(Bound));
-		  b = TILE_AT(i, x, y)->bounds;
+		  c[0].x = b->b.line.p1.x + o.x; c[0].y = b->b.line.p1.y + o.y;
+		  c[1].x = b->b.line.p2.x + o.x; c[1].y = b->b.line.p2.y + o.y;
+		  addEdge(&edges, c[0], c[1], tile_pos, t->type);
 		}
 	      else
 		{
-		  MALLOC(b->next, sizeof(Bound));
-		  b = b->next;
+		  c[0].x = b->b.rect.p1.x + o.x; c[0].y = b->b.rect.p1.y + o.y;
+		  c[1].x = b->b.rect.p2.x + o.x; c[1].y = b->b.rect.p1.y + o.y;
+		  c[2].x = b->b.rect.p2.x + o.x; c[2].y = b->b.rect.p2.y + o.y;
+		  c[3].x = b->b.rect.p1.x + o.x; c[3].y = b->b.rect.p2.y + o.y;
+		  addEdge(&edges, c[0], c[1], tile_pos, t->type);
+		  addEdge(&edges, c[1], c[2], tile_pos, t->type);
+		  addEdge(&edges, c[2], c[3], tile_pos, t->type);
+		  addEdge(&edges, c[3], c[0], tile_pos, t->type);
 		}
-	      /* Read the boundary in */
-	      file_getTileBound(areafile, b);
-	      b->next = NULL;
 	    }
+	}
+    }
 
-	}  /* Found all the tiles in the layer */
+  /* Drop the faces two tiles share, then the edges of the tiles around
+     the chunk, which were only needed for that */
+  cutFaces(&edges, &cut);
+  free(edges.edges);
+  for (i = 0, k = 0; i < cut.n; i++)
+    {
+      Point *p = &cut.edges[i].tile_pos;
+      if (p->x >= x1 && p->x <= x2 && p->y >= y1 && p->y <= y2)
+	cut.edges[k++] = cut.edges[i];
+    }
+  cut.n = k;
 
-    }  /* Found all the layers */
+  g->n_segments = 0;
+  g->segments = NULL;
+  g->cell_start = NULL;
+  g->cell_segs = NULL;
+  if (cut.n == 0)
+    {
+      free(cut.edges);
+      return;
+    }
+
+  /* Join edges of the same type of tile which lie on the same line and
+     touch or overlap.  Like in cutFaces, edges which end a pixel apart
+     touch, and a pixel along u is u.u along the line. */
+  qsort(cut.edges, cut.n, sizeof(Edge), compareEdges);
+  g->segments = (Segment *) dyn_1dArrayAlloc(cut.n, sizeof(Segment));
+  for (i = 0; i < cut.n; i++)
+    {
+      Edge *e = &cut.edges[i];
+      Edge *prev = NULL;
+
+      if (i > 0) prev = &cut.edges[i - 1];
+      if (prev != NULL && prev->type == e->type && prev->ux == e->ux &&
+	  prev->uy == e->uy && prev->off == e->off &&
+	  e->t1 <= end + e->ux * e->ux + e->uy * e->uy)
+	{
+	  if (e->t2 > end)
+	    {
+	      g->segments[g->n_segments - 1].line.p2 = e->line.p2;
+	      end = e->t2;
+	    }
+	}
+      else
+	{
+	  g->segments[g->n_segments].line = e->line;
+	  g->segments[g->n_segments].tile_pos = e->tile_pos;
+	  g->segments[g->n_segments].type = e->type;
+	  g->n_segments++;
+	  end = e->t2;
+	}
+    }
+  free(cut.edges);
+
+  /* Index the segments by every tile position in the chunk their bounding
+     box covers.  First count how many go in each position's list, then
+     fill the lists in. */
+  g->cell_start = (int *) dyn_1dArrayAlloc(n_cells + 1, sizeof(int));
+  fill = (int *) dyn_1dArrayAlloc(n_cells, sizeof(int));
+  for (i = 0; i < 2; i++)
+    {
+      int s;
 
-  file_closeFile(areafile);
+      for (s = 0; s < g->n_segments; s++)
+	{
+	  Line *ln = &g->segments[s].line;
+	  int sx1 = map_realToMapX(ln->p1.x < ln->p2.x ? ln->p1.x : ln->p2.x);
+	  int sx2 = map_realToMapX(ln->p1.x > ln->p2.x ? ln->p1.x : ln->p2.x);
+	  int sy1 = map_realToMapY(ln->p1.y < ln->p2.y ? ln->p1.y : ln->p2.y);
+	  int sy2 = map_realToMapY(ln->p1.y > ln->p2.y ? ln->p1.y : ln->p2.y);
+
+	  if (sx1 < x1) sx1 = x1;
+	  if (sy1 < y1) sy1 = y1;
+	  for (x = sx1; x <= sx2 && x <= x2 && x < layer->w; x++)
+	    {
+	      for (y = sy1; y <= sy2 && y <= y2 && y < layer->h; y++)
+		{
+		  int cell = (y - y1) * CHUNK_W + x - x1;
+		  if (i == 0)
+		    g->cell_start[cell + 1]++;
+		  else
+		    g->cell_segs[g->cell_start[cell] + fill[cell]++] = s;
+		}
+	    }
+	}
 
+      if (i == 0)
+	{
+	  for (s = 0; s < n_cells; s++)
+	    g->cell_start[s + 1] += g->cell_start[s];
+	  g->cell_segs = (int *) dyn_1dArrayAlloc(g->cell_start[n_cells] > 0 ? g->cell_start[n_cells] : 1, sizeof(int));
+	}
+    }
+  dyn_1dArrayFree(fill);
 }
 
-/* freeTile
-   Frees a tile.
+/* map_loadMap
+   Loads the map for an area.  Only the kinds of tiles are read now.  The
+   area is kept open, and each chunk is read out of it when it's needed.
 */
 void
-freeTile(int l, int x, int y)
+map_loadMap(char *areafile)
 {
+  extern Map map;
+  extern int proto_buckets[], max_protos;
+  int i;
 
-  Tile *t = TILE_AT(l, x, y);
-  /* Free its boundaries */
-  Bound *b = t->bounds;
-  while (b != NULL)
+  max_protos = 64;
+  for (i = 0; i < PROTO_BUCKETS; i++) proto_buckets[i] = -1;
+
+  /* Open the area */
+  map.area = file_openArea(areafile);
+
+  /* Get the background color */
+  map.bg_color.r = map.area->head->bg_color[0];
+  map.bg_color.g = map.area->head->bg_color[1];
+  map.bg_color.b = map.area->head->bg_color[2];
+
+  /* Get the number of layers */
+  map.n_layers = map.area->head->n_layers;
+
+  /* Allocate the array of layers */
+  map.layers = (Layer *) dyn_1dArrayAlloc(map.n_layers, sizeof(Layer));
+
+  /* And the prototypes, which all of the layers share */
+  map.n_protos = 0;
+  map.protos = (TileProto *) dyn_1dArrayAlloc(max_protos, sizeof(TileProto));
+  map.kind_protos = readKinds(map.area);
+
+  /* Get ready to load the layers' chunks */
+  chk_init(map.n_layers);
+
+  /* Create the layers.  None of their chunks are loaded to begin with. */
+  for (i = 0; i < map.n_layers; i++)
     {
-      Bound *next_bound = b->next;
-      free(b);
-      b = next_bound;
+      Layer *layer = &map.layers[i];
+      AreaLayer *al = file_areaLayer(map.area, i);
+
+      layer->w = al->w;
+      layer->h = al->h;
+      layer->cw = (layer->w + CHUNK_W - 1) / CHUNK_W;
+      layer->ch = (layer->h + CHUNK_H - 1) / CHUNK_H;
+      layer->chunks = (Chunk **) dyn_1dArrayAlloc(layer->cw * layer->ch, sizeof(Chunk *));
+      chk_initLayer(i, layer->cw, layer->ch);
     }
+}
 
-  /* Flush the signal queue */
-  sig_flush(&t->signals);
+/* map_reloadArea
+   Reads an area's file again and changes the running map to match it,
+   for when it's been edited.  Only the chunks with tiles that changed, and
+   the ones around them whose static geometry they could cut, are thrown
+   out, to be read again from the new area when they're needed.  New tiles
+   are looked up in the tileset, and the rest keep their prototypes.  The
+   objects and the layers' sizes aren't changed.  Returns how many tiles
+   changed, or -1, having said why, if there's a mistake in the file or
+   the map can't be changed to match without loading it again.
+*/
+int
+map_reloadArea(char *areafile)
+{
+  extern Map map;
+  Area *area = file_reopenArea(areafile);
+  Uint16 *kind_protos;
+  int l, n = 0;
+
+  if (area == NULL) return -1;
+  if (!checkArea(area))
+    {
+      file_closeArea(area);
+      return -1;
+    }
 
-  /* If the object is active, it may have allocated its own type-specific
-     attributes which it will free itself: */
-  if (t->active) t->free_atts(l, x, y);
+  /* The loading thread reads the prototypes and the area, so it has to be
+     idle while they change */
+  chk_settle();
+  kind_protos = readKinds(area);
 
-  free(t);
-  TILE_AT(l, x, y) = NULL;
+  map.bg_color.r = area->head->bg_color[0];
+  map.bg_color.g = area->head->bg_color[1];
+  map.bg_color.b = area->head->bg_color[2];
+
+  for (l = 0; l < map.n_layers; l++) n += reloadLayer(area, kind_protos, l);
+
+  file_closeArea(map.area);
+  dyn_1dArrayFree(map.kind_protos);
+  map.area = area;
+  map.kind_protos = kind_protos;
+  return n;
+}
+
+/* checkArea
+   Makes sure an area that's been edited can be put into the running map:
+   it has the same layers, the same size, and its tiles only use
+   animations that are in the tileset.
+*/
+int
+checkArea(Area *area)
+{
+  extern Map map;
+  extern Tileset *tileset;
+  int i;
+
+  if (area->head->n_layers != map.n_layers)
+    {
+      fprintf(stderr, "The area has a different number of layers now.\n");
+      return 0;
+    }
+  for (i = 0; i < map.n_layers; i++)
+    {
+      if (file_areaLayer(area, i)->w != map.layers[i].w || file_areaLayer(area, i)->h != map.layers[i].h)
+	{
+	  fprintf(stderr, "Layer %d of the area is a different size now.\n", i);
+	  return 0;
+	}
+    }
+  for (i = 0; i < area->head->n_kinds; i++)
+    {
+      char *anim = file_areaString(area, file_areaKind(area, i)->anim);
+
+      if (nam_lookup(&tileset->names, anim) < 0)
+	{
+	  fprintf(stderr, "Animation %s isn't in the tileset.\n", anim);
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+/* reloadLayer
+   Compares a layer of an edited area with the running one, chunk by
+   chunk, and throws out the chunks that are different, and the ones
+   around them.  Returns how many tiles changed.
+*/
+int
+reloadLayer(Area *area, Uint16 *kind_protos, int l)
+{
+  extern Map map;
+  Layer *layer = &map.layers[l];
+  Uint16 old[CHUNK_W * CHUNK_H], tiles[CHUNK_W * CHUNK_H];
+  char *changed = (char *) dyn_1dArrayAlloc(layer->cw * layer->ch, sizeof(char));
+  int cx, cy, x, y, i, n = 0;
+
+  for (cy = 0; cy < layer->ch; cy++)
+    {
+      for (cx = 0; cx < layer->cw; cx++)
+	{
+	  readTiles(map.area, map.kind_protos, l, cx * CHUNK_W, cy * CHUNK_H, CHUNK_W, CHUNK_H, old);
+	  readTiles(area, kind_protos, l, cx * CHUNK_W, cy * CHUNK_H, CHUNK_W, CHUNK_H, tiles);
+	  for (i = 0; i < CHUNK_W * CHUNK_H; i++)
+	    {
+	      if (old[i] == tiles[i]) continue;
+	      changed[cy * layer->cw + cx] = 1;
+	      n++;
+	    }
+	}
+    }
+
+  for (cy = 0; cy < layer->ch; cy++)
+    for (cx = 0; cx < layer->cw; cx++)
+      {
+	int drop = 0;
+
+	for (y = cy - 1; y <= cy + 1; y++)
+	  for (x = cx - 1; x <= cx + 1; x++)
+	    if (x >= 0 && x < layer->cw && y >= 0 && y < layer->ch && changed[y * layer->cw + x])
+	      drop = 1;
+	if (drop) chk_dropChunk(l, cx, cy);
+      }
+
+  dyn_1dArrayFree(changed);
+  return n;
 }
 
 /* map_freeMap
@@ -319,25 +1169,247 @@ map_freeMap(void)
   /* Free it layer by layer */
   for (i = 0; i < map.n_layers; i++)
     {
-      int x, y;
+      Layer *layer = &map.layers[i];
+      int cx, cy;
+
+      /* Free the chunks that are loaded */
+      for (cy = 0; cy < layer->ch; cy++)
+	for (cx = 0; cx < layer->cw; cx++)
+	  map_evictChunk(i, cx, cy);
+
+      /* Free the array */
+      dyn_1dArrayFree(layer->chunks);
+    }
+  /* Free the array of layers */
+  dyn_1dArrayFree(map.layers);
+
+  /* Free the prototypes */
+  for (i = 0; i < map.n_protos; i++)
+    freeBounds(map.protos[i].bounds);
+  dyn_1dArrayFree(map.protos);
+
+  dyn_1dArrayFree(map.kind_protos);
+  file_closeArea(map.area);
+  map.area = NULL;
+}
 
-      /* Free all of the tiles in the layer */
-      for (x = 0; x < map.layers[i].w; x++)
+/* map_chunkTiles
+   Returns how many tiles a chunk has in the area, whether it's loaded or
+   not.
+*/
+int
+map_chunkTiles(int z, int cx, int cy)
+{
+  extern Map map;
+  int c = file_areaLayer(map.area, z)->first_chunk + cy * map.layers[z].cw + cx;
+
+  return file_areaChunk(map.area, c + 1) - file_areaChunk(map.area, c);
+}
+
+/* map_readChunk
+   Reads a chunk out of the area, with its static geometry and where its
+   tiles are, ready to be put into its layer.  Returns NULL if it has no
+   tiles.  This is done on chunk.c's loading thread, so it only reads the
+   map, which nothing changes while it's loading.
+*/
+Chunk *
+map_readChunk(int z, int cx, int cy)
+{
+  extern Map map;
+  Uint16 ring[(CHUNK_W + 2) * (CHUNK_H + 2)], tiles[CHUNK_W * CHUNK_H];
+  Chunk *c;
+  int x, y;
+
+  /* The chunk's tiles and the ring of tiles around it */
+  readTiles(map.area, map.kind_protos, z, cx * CHUNK_W - 1, cy * CHUNK_H - 1,
+	    CHUNK_W + 2, CHUNK_H + 2, ring);
+  for (y = 0; y < CHUNK_H; y++)
+    memcpy(&tiles[y * CHUNK_W], &ring[(y + 1) * (CHUNK_W + 2) + 1], CHUNK_W * sizeof(Uint16));
+
+  if ((c = newChunk(tiles)) == NULL) return NULL;
+
+  buildGeometry(c, z, cx, cy, ring);
+
+  /* Where the tiles are, and where collisions have to be checked */
+  bit_alloc(&c->occupied, CHUNK_W, CHUNK_H);
+  bit_alloc(&c->collide, CHUNK_W, CHUNK_H);
+  for (y = 0; y < CHUNK_H; y++)
+    for (x = 0; x < CHUNK_W; x++)
+      {
+	Uint16 id = tiles[y * CHUNK_W + x];
+	TileProto *t = (id == NO_TILE) ? NULL : &map.protos[id - 1];
+	int cell = y * CHUNK_W + x;
+
+	bit_set(&c->occupied, x, y, t != NULL);
+	bit_set(&c->collide, x, y,
+		(t != NULL && !t->merged && t->bounds != NULL) ||
+		(c->geom.cell_start != NULL && c->geom.cell_start[cell + 1] > c->geom.cell_start[cell]));
+      }
+
+  return c;
+}
+
+/* newChunk
+   Makes a chunk out of a full array of tiles, row by row, keeping only the
+   tiles it has if there are few enough of them.  Returns NULL if there
+   aren't any.  The chunk and its tiles are one block of memory.
+*/
+Chunk *
+newChunk(Uint16 *tiles)
+{
+  Chunk *c;
+  int i, n = 0;
+
+  for (i = 0; i < CHUNK_W * CHUNK_H; i++)
+    if (tiles[i] != NO_TILE) n++;
+
+  if (n == 0) return NULL;
+
+  if (n < SPARSE_TILES)
+    {
+      MALLOC(c, sizeof(Chunk) + 2 * n * sizeof(Uint16));
+      c->n_tiles = n;
+      c->where = (Uint16 *) (c + 1);
+      c->tiles = c->where + n;
+      for (i = 0, n = 0; i < CHUNK_W * CHUNK_H; i++)
 	{
-	  for (y = 0; y < map.layers[i].h; y++)
+	  if (tiles[i] == NO_TILE) continue;
+	  c->where[n] = i;
+	  c->tiles[n++] = tiles[i];
+	}
+    }
+  else
+    {
+      MALLOC(c, sizeof(Chunk) + CHUNK_W * CHUNK_H * sizeof(Uint16));
+      c->n_tiles = CHUNK_W * CHUNK_H;
+      c->where = NULL;
+      c->tiles = (Uint16 *) (c + 1);
+      memcpy(c->tiles, tiles, CHUNK_W * CHUNK_H * sizeof(Uint16));
+    }
+
+  c->n_states = 0;
+  c->states = NULL;
+  return c;
+}
+
+/* map_sparseTile
+   Finds the tile at a position in a sparse chunk.
+*/
+Uint16
+map_sparseTile(Chunk *c, int i)
+{
+  int lo = 0, hi = c->n_tiles;
+
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (c->where[mid] < i) lo = mid + 1;
+      else hi = mid;
+    }
+  return (lo < c->n_tiles && c->where[lo] == i) ? c->tiles[lo] : NO_TILE;
+}
+
+/* map_installChunk
+   Puts a chunk of tiles into a layer, giving its active tiles their own
+   state.  Returns how many bytes it takes up, with its geometry and the
+   active tiles' attributes.
+*/
+int
+map_installChunk(int z, int cx, int cy, Chunk *c)
+{
+  extern Map map;
+  extern struct tile_att_define *tile_defs[];
+  Layer *layer = &map.layers[z];
+  Geometry *g = &c->geom;
+  int i, bytes, max_states = 0;
+  int x1 = cx * CHUNK_W, y1 = cy * CHUNK_H;
+
+  layer->chunks[cy * layer->cw + cx] = c;
+  bytes = sizeof(Chunk) + ((c->where == NULL) ? 1 : 2) * c->n_tiles * sizeof(Uint16) +
+    2 * c->occupied.words * CHUNK_H * sizeof(Uint32);
+  if (g->cell_start != NULL)
+    bytes += g->n_segments * sizeof(Segment) +
+      (CHUNK_W * CHUNK_H + 1 + g->cell_start[CHUNK_W * CHUNK_H]) * sizeof(int);
+
+  /* Going through the tiles in order keeps the states sorted by
+     position */
+  for (i = 0; i < c->n_tiles; i++)
+    {
+      int at = (c->where == NULL) ? i : c->where[i];
+      TileProto *t;
+      TileState *ts;
+
+      if (c->tiles[i] == NO_TILE || !(t = &map.protos[c->tiles[i] - 1])->active) continue;
+
+      if (c->n_states == max_states)
+	{
+	  max_states = (max_states == 0) ? 16 : max_states * 2;
+	  if ((c->states = (TileState *) realloc(c->states, max_states * sizeof(TileState))) == NULL)
 	    {
-	      /* Is there a tile here? */
-	      if (TILE_AT(i, x, y) != NULL)
-		{
-		  freeTile(i, x, y);
-		}
+	      fprintf(stderr, "Unable to allocate memory.\n");
+	      exit(0);
 	    }
 	}
-      /* Free the array */
-      dyn_arrayFree((void **) map.layers[i].data, map.layers[i].w);
+      ts = &c->states[c->n_states++];
+      ts->pos = (y1 + at / CHUNK_W) * layer->w + x1 + at % CHUNK_W;
+      ts->anim = t->anim;
+      sig_initQ(&ts->signals);
+      ts->atts = tile_defs[t->type]->init_atts();
+      bytes += sizeof(TileState) + tile_defs[t->type]->atts_size;
     }
-  /* Free the array of layers */
-  dyn_1dArrayFree(map.layers);
+
+  return bytes;
+}
+
+/* map_evictChunk
+   Takes a chunk of tiles out of a layer and frees it, if it's loaded.
+*/
+void
+map_evictChunk(int z, int cx, int cy)
+{
+  extern Map map;
+  Layer *layer = &map.layers[z];
+  Chunk *c = layer->chunks[cy * layer->cw + cx];
+  int k, x, y;
+
+  if (c == NULL) return;
+
+  /* Free the active tiles' states */
+  for (k = 0; k < c->n_states; k++)
+    {
+      TileState *ts = &c->states[k];
+      x = ts->pos % layer->w;
+      y = ts->pos / layer->w;
+
+      /* Flush the signal queue */
+      sig_flush(&ts->signals);
+
+      /* The tile may have allocated its own type-specific attributes
+	 which it will free itself: */
+      PROTO_AT(z, x, y)->free_atts(z, x, y);
+    }
+  free(c->states);
+  c->states = NULL;
+  layer->chunks[cy * layer->cw + cx] = NULL;
+  map_freeChunk(c);
+}
+
+/* map_freeChunk
+   Frees a chunk that isn't in its layer, or has been taken out of it.
+*/
+void
+map_freeChunk(Chunk *c)
+{
+  free(c->states);
+  bit_free(&c->occupied);
+  bit_free(&c->collide);
+  if (c->geom.cell_start != NULL)
+    {
+      dyn_1dArrayFree(c->geom.segments);
+      dyn_1dArrayFree(c->geom.cell_start);
+      dyn_1dArrayFree(c->geom.cell_segs);
+    }
+  free(c);
 }
 
 /* map_sendTileSignal
@@ -348,62 +1420,189 @@ map_sendTileSignal(int z, int x, int y, Signal *s)
 {
   extern Map map;
 
-  if (TILE_AT(z, x, y)->active)
-    sig_push(&TILE_AT(z, x, y)->signals, s);
+  TileState *ts = map_getTileState(z, x, y);
+
+  if (ts != NULL)
+    sig_push(&ts->signals, s);
+}
+
+/* map_getTileState
+   Returns the state of an active tile, or NULL if there isn't an active
+   tile there or its chunk isn't loaded.
+*/
+TileState *
+map_getTileState(int z, int x, int y)
+{
+  extern Map map;
+  Chunk *c = CHUNK_AT(z, x, y);
+  int pos = y * map.layers[z].w + x;
+  int lo = 0, hi;
+
+  if (c == NULL) return NULL;
+  hi = c->n_states;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (c->states[mid].pos < pos) lo = mid + 1;
+      else hi = mid;
+    }
+  return (lo < c->n_states && c->states[lo].pos == pos) ? &c->states[lo] : NULL;
 }
 
 /* map_tileIsSolid
-   Returns true if a tile is solid
+   Returns true if there's a solid tile somewhere whose chunk is loaded.
 */
 int map_tileIsSolid(int z, int x, int y)
+{
+  TileProto *t = protoAt(z, x, y);
+  return (t != NULL && t->solid);
+}
+
+/* map_tileIsMerged
+   Returns true if a tile's bounds are part of its chunk's static geometry,
+   in which case collisions with it are found through map_getCellSegments
+   instead.
+*/
+int
+map_tileIsMerged(int z, int x, int y)
+{
+  TileProto *t = protoAt(z, x, y);
+  return (t != NULL && t->merged);
+}
+
+/* map_nextTile
+   Returns the first x from x to x_end in row y of a layer where there is a
+   tile, or x_end + 1 if there are none.
+*/
+int
+map_nextTile(int z, int y, int x, int x_end)
+{
+  return nextInChunks(z, y, x, x_end, 0);
+}
+
+/* map_nextCollidable
+   Returns the first x from x to x_end in row y of a layer where collisions
+   have to be checked, or x_end + 1 if there are none.
+*/
+int
+map_nextCollidable(int z, int y, int x, int x_end)
+{
+  return nextInChunks(z, y, x, x_end, 1);
+}
+
+/* nextInChunks
+   Searches a row of a layer for the next position that's on in its
+   chunks' occupied bitmaps, or their collide bitmaps if collide is true,
+   like bit_next().  Chunks that aren't loaded are skipped whole.
+*/
+int
+nextInChunks(int z, int y, int x, int x_end, int collide)
+{
+  extern Map map;
+  Layer *layer = &map.layers[z];
+  int last = (x_end < layer->w) ? x_end : layer->w - 1;
+
+  if (y < 0 || y >= layer->h) return x_end + 1;
+  if (x < 0) x = 0;
+
+  while (x <= last)
+    {
+      Chunk *c = CHUNK_AT(z, x, y);
+      int x1 = x - x % CHUNK_W;
+      int end = (x1 + CHUNK_W - 1 < last) ? x1 + CHUNK_W - 1 : last;
+
+      if (c != NULL)
+	{
+	  int found = bit_next(collide ? &c->collide : &c->occupied, y % CHUNK_H, x - x1, end - x1);
+	  if (found <= end - x1) return x1 + found;
+	}
+      x = x1 + CHUNK_W;
+    }
+  return x_end + 1;
+}
+
+/* map_getCellSegments
+   Returns the numbers of the static geometry segments which pass near a
+   tile position, and puts how many there are in n.  They're numbers in
+   the geometry of the chunk the position is in, for map_getSegment().
+*/
+int *
+map_getCellSegments(int z, int x, int y, int *n)
 {
   extern Map map;
-  return (TILE_AT(z, x, y)->solid);
+  Chunk *c = CHUNK_AT(z, x, y);
+  Geometry *g;
+  int cell = (y % CHUNK_H) * CHUNK_W + x % CHUNK_W;
+
+  if (c == NULL || (g = &c->geom)->cell_start == NULL)
+    {
+      *n = 0;
+      return NULL;
+    }
+  *n = g->cell_start[cell + 1] - g->cell_start[cell];
+  return &g->cell_segs[g->cell_start[cell]];
 }
 
+/* map_getSegment
+   Returns a segment of the static geometry of the chunk a tile position
+   is in, by a number map_getCellSegments() gave for it.
+*/
+Segment *
+map_getSegment(int z, int x, int y, int i)
+{
+  extern Map map;
+  return &CHUNK_AT(z, x, y)->geom.segments[i];
+}
 
 /* map_runTiles
-   Has tiles which are within our specified range run and animate
+   Has tiles which are within our specified range run.  Tiles don't have
+   to be animated, their frames are worked out when they're drawn.
 */
 void
 map_runTiles(void)
 {
   extern Map map;
-  extern Tileset tileset;
-  int l, x, y;
+  extern Tileset *tileset;
+  int l, i;
 
   for (l = 0; l < map.n_layers; l++)
     {
       /* Get the range of real coordinates on this layer the camera can see */
       Rect cam_range = cam_getViewRange(l);
-
-      /* Loop through all of the onscreen tiles, plus a certain range beyond
-	 that */
-      for (x = (map_realToMapX(cam_range.p1.x) - TILE_X_RANGE) >= 0 ?
-	     (map_realToMapX(cam_range.p1.x) - TILE_X_RANGE) : 0;
-	   (x <= map_realToMapX(cam_range.p2.x) + TILE_X_RANGE)
-	     && (x < map_getLayerWidth(l));
-	   x++)
+      Layer *layer = &map.layers[l];
+      int cx, cy, x, y;
+
+      /* Run the onscreen tiles, plus a certain range beyond that.  The
+	 active tiles are only ever found through the chunks they're in. */
+      int x1 = map_realToMapX(cam_range.p1.x) - TILE_X_RANGE;
+      int y1 = map_realToMapY(cam_range.p1.y) - TILE_Y_RANGE;
+      int x2 = map_realToMapX(cam_range.p2.x) + TILE_X_RANGE;
+      int y2 = map_realToMapY(cam_range.p2.y) + TILE_Y_RANGE;
+
+      if (x1 < 0) x1 = 0;
+      if (y1 < 0) y1 = 0;
+      if (x2 >= layer->w) x2 = layer->w - 1;
+      if (y2 >= layer->h) y2 = layer->h - 1;
+
+      for (cy = y1 / CHUNK_H; cy <= y2 / CHUNK_H; cy++)
 	{
-	  for (y = (map_realToMapY(cam_range.p1.y) - TILE_Y_RANGE) >= 0 ?
-		 (map_realToMapY(cam_range.p1.y) - TILE_Y_RANGE) : 0;
-	       (y <= map_realToMapY(cam_range.p2.y) + TILE_Y_RANGE)
-		 && (y < map_getLayerHeight(l));
-	       y++)
+	  for (cx = x1 / CHUNK_W; cx <= x2 / CHUNK_W; cx++)
 	    {
+	      Chunk *c = layer->chunks[cy * layer->cw + cx];
+
+	      if (c == NULL) continue;
 
-	      /* If there is a tile here */
-	      if (TILE_AT(l, x, y) != NULL)
+	      /* Have the active tiles do their go actions */
+	      for (i = 0; i < c->n_states; i++)
 		{
-		  /* Have the tile do its go action if it's active */
-		  if (TILE_AT(l, x, y)->active)
-		    TILE_AT(l, x, y)->go(l, x, y);
+		  TileState *ts = &c->states[i];
+		  x = ts->pos % layer->w;
+		  y = ts->pos / layer->w;
+		  if (x < x1 || x > x2 || y < y1 || y > y2) continue;
 
-		  /* Animate */
-		  anim_animate(&TILE_AT(l, x, y)->anim, &tileset.data[TILE_AT(l, x, y)->anim.anim_id]);
+		  PROTO_AT(l, x, y)->go(l, x, y);
 		}
 	    }
 	}
     }
 }
-
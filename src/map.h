@@ -2,10 +2,13 @@
 #define __DEFINED_MAP_H
 
 #include "animation.h"
+#include "bitmap.h"
 #include "defs.h"
 #include "dynarray.h"
 #include "file.h"
 #include "signal.h"
+#include "names.h"
+#include "res.h"
 
 /* The map module:
    - Loads animations for tiles
@@ -14,11 +17,15 @@
 */
 
 
-/* The Tile is the map equivalent of an Object */
-typedef struct tile_struct
+/* Most tiles in a map are exactly alike, so the things about a tile which
+   never change are kept once in a tile prototype, and the map itself is
+   just prototype numbers.  The prototype is the map equivalent of an
+   Object's definition. */
+typedef struct tile_proto_struct
 {
 
-  Animation anim;    /* The tile's animation */
+  Animation anim;    /* The animation all the inactive tiles made from this
+			prototype show */
   Bound *bounds;     /* The linked list of boundaries */
 
   int solid;         /* Whether or not objects can pass through the bounds */
@@ -38,16 +45,90 @@ typedef struct tile_struct
      If so, this frees whatever it allocated. */
   void (*free_atts)(int l, int x, int y);
 
-  SigQ signals;      /* The tile accumulates signals in this queue */
+  int merged;        /* If the tile's bounds were merged into its chunk's
+			static geometry, collisions are found with that
+			instead of with the tile's own bounds */
+
+  int hash_next;     /* The next prototype in the same bucket while the map
+			is loading */
+
+} TileProto;
 
+/* Active tiles each have a little state of their own besides their
+   prototype, which is kept in a table on the side. */
+typedef struct tile_state_struct
+{
+  int pos;           /* Where the tile is, y * w + x, which is also what the
+			table is sorted by */
+  Animation anim;    /* Its own animation, which can play out of step */
+  SigQ signals;      /* The tile accumulates signals in this queue */
   void *atts;
+} TileState;
+
+/* When a chunk is loaded, the bounds of its solid tiles which don't do
+   anything are merged with their neighbors' into long segments, and edges
+   that two solid tiles share are dropped, because nothing can ever reach
+   them.  Tiles in the chunks around it are looked at for that, but only
+   the chunk's own tiles' edges are kept, so a segment never goes past the
+   edge of its chunk. */
+typedef struct segment_struct
+{
+  Line line;         /* The segment in real coordinates */
+  Point tile_pos;    /* The tile the segment came from, for signals */
+  int type;          /* The type of the tiles it came from */
+  int stamp;         /* The collision code marks segments it has tested */
+} Segment;
 
-} Tile;
+typedef struct geometry_struct
+{
+  int n_segments;
+  Segment *segments;   /* A 1d array of the merged segments */
+  int *cell_start;     /* For each tile position in the chunk, row by row,
+			  where its list of segment numbers starts in
+			  cell_segs.  The list ends where the next
+			  position's starts.  NULL if there are no
+			  segments. */
+  int *cell_segs;
+} Geometry;
+
+/* Tiles are kept in chunks of this many tiles across and down: */
+#define CHUNK_W 32
+#define CHUNK_H 32
+
+/* A chunk with fewer tiles than this is kept sparse */
+#define SPARSE_TILES (CHUNK_W * CHUNK_H / 8)
+
+/* The part of a layer which is loaded and unloaded all together.  It's
+   read straight out of the area when it's needed, and nothing is kept of
+   it once it's thrown out.  Its tiles are prototype numbers plus 1, or
+   NO_TILE.  Most chunks keep a tile for every position, row by row, but
+   mostly empty ones (the sky, say) only keep the tiles they have, sorted
+   by position.  Chunks with no tiles at all are never loaded. */
+typedef struct chunk_struct
+{
+  int n_tiles;     /* How many tiles there are in tiles */
+  Uint16 *where;   /* If the chunk is sparse, each tile's position in the
+		      chunk, otherwise NULL */
+  Uint16 *tiles;
+  int n_states;
+  TileState *states;  /* The state of each active tile, sorted by position */
+  Geometry geom;      /* The merged static geometry of the chunk */
+
+  /* Which positions in the chunk have a tile, so that they can be found
+     without looking at the tiles themselves.  The active tiles are found
+     through the states instead. */
+  Bitmap occupied;
+  /* Which positions collisions have to be checked at: tiles with bounds
+     that weren't merged, and positions static geometry passes through */
+  Bitmap collide;
+} Chunk;
 
 typedef struct layer_struct
 {
   int w, h;     /* The layer's dimensions */
-  Tile ***data;    /* The data is a 2d array of pointers to tiles. */
+  int cw, ch;   /* The layer's dimensions in chunks */
+  Chunk **chunks;  /* The chunks, row by row, or NULL where a chunk isn't
+		      loaded */
 } Layer;
 
 typedef struct map_struct
@@ -55,16 +136,34 @@ typedef struct map_struct
   int n_layers;     /* The number of layers */
   Color bg_color;   /* The RGB color of the background */
   Layer *layers;         /* A 1d array of the layers */
+  int n_protos;
+  TileProto *protos;     /* A 1d array of the tile prototypes */
+  Area *area;            /* The area, kept open to read chunks out of */
+  Uint16 *kind_protos;   /* The prototype each of the area's kinds of tile
+			    is */
 } Map;
 
 typedef struct tileset_struct
 {
   int n_animations;   /* The number of animations in a tileset */
   AnimData *data;        /* A 1d array of animations */
+  NameMap names;         /* Where each animation is, by name */
+  AnimPages pages;       /* The pages the animations' images are on */
 } Tileset;
 
-/* A handy macro to get tile pointers in layer z, coordinate x, y */
-#define TILE_AT(z, x, y) (map.layers[(z)].data[(x)][(y)])
+/* The map says there's no tile somewhere with this number */
+#define NO_TILE 0
+
+/* The most tile prototypes there can be */
+#define MAX_PROTOS 65535
+
+/* Handy macros to get the chunk holding the tile in layer z, coordinate
+   x, y, the prototype number plus 1 of the tile, and a pointer to the
+   prototype itself.  The last two only work if the chunk is loaded. */
+#define CHUNK_AT(z, x, y) (map.layers[(z)].chunks[((y) / CHUNK_H) * map.layers[(z)].cw + (x) / CHUNK_W])
+#define CHUNK_TILE(c, i) ((c)->where == NULL ? (c)->tiles[(i)] : map_sparseTile((c), (i)))
+#define TILE_AT(z, x, y) CHUNK_TILE(CHUNK_AT(z, x, y), ((y) % CHUNK_H) * CHUNK_W + (x) % CHUNK_W)
+#define PROTO_AT(z, x, y) (&map.protos[TILE_AT(z, x, y) - 1])
 
 /* Dimensions of tiles in real coordinates */
 #define TILE_W 32
@@ -84,19 +183,36 @@ typedef struct tileset_struct
 #define map_xInTile(x) ((x) % TILE_W)
 #define map_yInTile(y) ((y) % TILE_W)
 
-extern void map_loadTileset(char *areafile);
+extern void map_loadTileset(char *areafile, int wait);
 extern void map_freeTileset(void);
+extern void *map_makeTileset(char *tileset_datfile);
+extern void map_destroyTileset(void *data);
+extern long map_tilesetBytes(void *data);
 extern void map_loadMap(char *areafile);
+extern AnimData *map_getTileAnims(int *n);
+extern int map_reloadArea(char *areafile);
 extern void map_freeMap(void);
 extern int map_getNLayers(void);
 extern int map_getLayerHeight(int z);
 extern int map_getLayerWidth(int z);
-extern SDL_Surface *map_getTileGfx(int z, int x, int y);
+extern Frame *map_getTileGfx(int z, int x, int y);
 extern Point map_getTileGfxOffset(int z, int x, int y);
 extern Bound *map_getTileBounds(int z, int x, int y);
 extern int map_getTileType(int z, int x, int y);
 extern int map_tileIsSolid(int z, int x, int y);
+extern int map_tileIsMerged(int z, int x, int y);
+extern int map_nextTile(int z, int y, int x, int x_end);
+extern int map_nextCollidable(int z, int y, int x, int x_end);
+extern int *map_getCellSegments(int z, int x, int y, int *n);
+extern Segment *map_getSegment(int z, int x, int y, int i);
 extern void map_sendTileSignal(int z, int x, int y, Signal *s);
+extern TileState *map_getTileState(int z, int x, int y);
+extern int map_chunkTiles(int z, int cx, int cy);
+extern Chunk *map_readChunk(int z, int cx, int cy);
+extern Uint16 map_sparseTile(Chunk *c, int i);
+extern int map_installChunk(int z, int cx, int cy, Chunk *c);
+extern void map_evictChunk(int z, int cx, int cy);
+extern void map_freeChunk(Chunk *c);
 extern void map_runTiles(void);
 extern Color *map_getBackgroundColor(void);
 
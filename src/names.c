@@ -0,0 +1,236 @@
+#include "names.h"
+#include <string.h>
+
+/* The interned strings, by Name, and the hash table for finding them */
+static char **strings = NULL;
+static int n_strings = 0, max_strings = 0;
+static Name *table = NULL;
+static int table_size = 0;
+
+/* Private function prototypes */
+static Uint32 hashString(char *s);
+static Uint32 hashName(Name name);
+static void growTable(void);
+static void growMap(NameMap *m);
+
+/* hashString
+   The FNV-1a hash of a string.
+*/
+Uint32
+hashString(char *s)
+{
+  Uint32 h = 2166136261u;
+
+  while (*s)
+    {
+      h ^= (Uint8) *s++;
+      h *= 16777619u;
+    }
+  return h;
+}
+
+/* hashName
+   Spreads out Names, which are small numbers one after another, over a
+   map.
+*/
+Uint32
+hashName(Name name)
+{
+  return (Uint32) name * 2654435761u;
+}
+
+/* growTable
+   Doubles the size of the string hash table, and puts everything back
+   in.
+*/
+void
+growTable(void)
+{
+  extern Name *table;
+  extern int table_size;
+  extern char **strings;
+  extern int n_strings;
+  int i;
+
+  table_size = (table_size == 0) ? 256 : table_size * 2;
+  free(table);
+  MALLOC(table, table_size * sizeof(Name));
+  for (i = 0; i < table_size; i++) table[i] = NAME_NONE;
+
+  for (i = 0; i < n_strings; i++)
+    {
+      Uint32 h = hashString(strings[i]) & (table_size - 1);
+      while (table[h] != NAME_NONE) h = (h + 1) & (table_size - 1);
+      table[h] = i;
+    }
+}
+
+/* nam_find
+   Returns a string's Name, or NAME_NONE if it's never been interned.
+*/
+Name
+nam_find(char *s)
+{
+  extern Name *table;
+  extern int table_size;
+  extern char **strings;
+  Uint32 h;
+
+  if (table_size == 0) return NAME_NONE;
+  for (h = hashString(s) & (table_size - 1); table[h] != NAME_NONE; h = (h + 1) & (table_size - 1))
+    if (strcmp(strings[table[h]], s) == 0) return table[h];
+  return NAME_NONE;
+}
+
+/* nam_intern
+   Returns a string's Name, giving it one if it doesn't have one yet.  The
+   string is copied.
+*/
+Name
+nam_intern(char *s)
+{
+  extern Name *table;
+  extern int table_size;
+  extern char **strings;
+  extern int n_strings, max_strings;
+  Name name = nam_find(s);
+  Uint32 h;
+
+  if (name != NAME_NONE) return name;
+
+  if ((n_strings + 1) * 2 > table_size) growTable();
+  if (n_strings == max_strings)
+    {
+      max_strings = (max_strings == 0) ? 64 : max_strings * 2;
+      if ((strings = realloc(strings, max_strings * sizeof(char *))) == NULL)
+	{
+	  fprintf(stderr, "Unable to allocate memory.\n");
+	  exit(0);
+	}
+    }
+
+  name = n_strings++;
+  MALLOC(strings[name], (strlen(s) + 1) * sizeof(char));
+  strcpy(strings[name], s);
+
+  for (h = hashString(s) & (table_size - 1); table[h] != NAME_NONE; h = (h + 1) & (table_size - 1));
+  table[h] = name;
+  return name;
+}
+
+/* nam_string
+   Returns the string a Name is for.
+*/
+char *
+nam_string(Name name)
+{
+  extern char **strings;
+  extern int n_strings;
+
+  if (name < 0 || name >= n_strings) return "(none)";
+  return strings[name];
+}
+
+/* nam_free
+   Forgets every Name.  Nothing that kept one can use it after this.
+*/
+void
+nam_free(void)
+{
+  extern Name *table;
+  extern int table_size;
+  extern char **strings;
+  extern int n_strings, max_strings;
+  int i;
+
+  for (i = 0; i < n_strings; i++) free(strings[i]);
+  free(strings);
+  free(table);
+  strings = NULL;
+  table = NULL;
+  n_strings = max_strings = table_size = 0;
+}
+
+/* nam_initMap
+   Starts an empty map.
+*/
+void
+nam_initMap(NameMap *m)
+{
+  m->size = m->n = 0;
+  m->keys = NULL;
+  m->values = NULL;
+}
+
+/* nam_freeMap
+   Frees a map.
+*/
+void
+nam_freeMap(NameMap *m)
+{
+  free(m->keys);
+  free(m->values);
+  nam_initMap(m);
+}
+
+/* growMap
+   Doubles the size of a map, and puts everything back in.
+*/
+void
+growMap(NameMap *m)
+{
+  Name *old_keys = m->keys;
+  int *old_values = m->values;
+  int old_size = m->size, i;
+
+  m->size = (m->size == 0) ? 16 : m->size * 2;
+  MALLOC(m->keys, m->size * sizeof(Name));
+  MALLOC(m->values, m->size * sizeof(int));
+  for (i = 0; i < m->size; i++) m->keys[i] = NAME_NONE;
+
+  for (i = 0; i < old_size; i++)
+    {
+      if (old_keys[i] != NAME_NONE)
+	{
+	  Uint32 h = hashName(old_keys[i]) & (m->size - 1);
+	  while (m->keys[h] != NAME_NONE) h = (h + 1) & (m->size - 1);
+	  m->keys[h] = old_keys[i];
+	  m->values[h] = old_values[i];
+	}
+    }
+  free(old_keys);
+  free(old_values);
+}
+
+/* nam_set
+   Puts a Name in a map.  Returns false, and leaves it alone, if the Name
+   is already in it.
+*/
+int
+nam_set(NameMap *m, Name name, int value)
+{
+  Uint32 h;
+
+  if (nam_get(m, name) >= 0) return 0;
+  if ((m->n + 1) * 2 > m->size) growMap(m);
+
+  for (h = hashName(name) & (m->size - 1); m->keys[h] != NAME_NONE; h = (h + 1) & (m->size - 1));
+  m->keys[h] = name;
+  m->values[h] = value;
+  m->n++;
+  return 1;
+}
+
+/* nam_get
+   Returns what a Name is mapped to, or -1 if it isn't in the map.
+*/
+int
+nam_get(NameMap *m, Name name)
+{
+  Uint32 h;
+
+  if (m->size == 0 || name == NAME_NONE) return -1;
+  for (h = hashName(name) & (m->size - 1); m->keys[h] != NAME_NONE; h = (h + 1) & (m->size - 1))
+    if (m->keys[h] == name) return m->values[h];
+  return -1;
+}
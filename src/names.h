@@ -0,0 +1,42 @@
+#ifndef __DEFINED_NAMES_H
+#define __DEFINED_NAMES_H
+
+#include "SDL.h"
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/* The names module interns strings: every different string it's given
+   gets a number, a Name, which is the same every time that string is
+   given, so names can be compared and hashed as numbers.  Things that are
+   looked up by name (sprites, animations, sounds) keep a NameMap from the
+   Name to wherever they are, so looking one up is a hash and a compare,
+   and the things that look them up every cycle can do it once when
+   they're loaded and keep a handle instead. */
+
+typedef int Name;
+
+/* The Name of nothing, for a string that's never been interned */
+#define NAME_NONE (-1)
+
+/* A hash map from Names to numbers, like where something is in an array.
+   It's open addressed, and kept at most half full. */
+typedef struct name_map_struct
+{
+  int size;            /* A power of 2 */
+  int n;
+  Name *keys;          /* NAME_NONE in empty slots */
+  int *values;
+} NameMap;
+
+extern Name nam_intern(char *s);
+extern Name nam_find(char *s);
+extern char *nam_string(Name name);
+extern void nam_free(void);
+extern void nam_initMap(NameMap *m);
+extern void nam_freeMap(NameMap *m);
+extern int nam_set(NameMap *m, Name name, int value);
+extern int nam_get(NameMap *m, Name name);
+#define nam_lookup(m, s) nam_get(m, nam_find(s))
+
+#endif /* __DEFINED_NAMES_H */
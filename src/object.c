@@ -1,13 +1,17 @@
 #include "object.h"
 
 #include "camera.h"
+#include "collision.h"
+#include "chunk.h"
+#include "pool.h"
 
 /* The definitions for object types are in this header: */
 #include "types/objtypes.h"
 extern struct obj_att_define *obj_defs[];
 
-/* The sprites are loaded in a SpriteSet */
-static SpriteSet sprite_set;
+/* The sprites are loaded in a SpriteSet, out of the cache */
+static SpriteSet *sprite_set = NULL;
+static ResHandle sprite_res = RES_NONE;
 
 /* The objects are loaded into this structure */
 static ObjContainer the_objects;
@@ -19,6 +23,11 @@ static SigQ signals;
 /* A pointer we maintain that knows where the player object is: */
 static Object *player_pointer;
 
+/* Each object type's sprite and the animation it starts with, looked up
+   once the sprites are loaded */
+static int type_sprites[N_OBJ_TYPES];
+static AnimHandle type_anims[N_OBJ_TYPES];
+
 /* Private function prototypes */
 static void insertObj(Object *obj);
 static void removeObj(Object *obj);
@@ -27,94 +36,233 @@ static int animNameToID(int spr_id, char *name);
 static void setPlayerPtr(Object *ptr);
 static Object *newObject(int layer, Point pos, Velocity vel, int type);
 static void freeObject(Object *obj);
+static void resolveTypes(void);
+static void needType(int type, int *needed);
 
 /* obj_loadSprites
-   Loads sprite animations.
+   Gets the sprite animations out of the cache, which reads what they are
+   the first time.  Their images are loaded by obj_loadAreaAssets().
 */
 void
 obj_loadSprites(char *sprite_datfile)
 {
-  extern SpriteSet sprite_set;
+  extern SpriteSet *sprite_set;
+  extern ResHandle sprite_res;
+
+  sprite_res = res_acquire(RES_SPRITES, sprite_datfile);
+  sprite_set = (SpriteSet *) res_get(sprite_res);
+}
+
+/* obj_freeSprites
+   Gives the sprite animations back to the cache.
+*/
+void
+obj_freeSprites(void)
+{
+  extern SpriteSet *sprite_set;
+  extern ResHandle sprite_res;
+
+  res_release(sprite_res);
+  sprite_res = RES_NONE;
+  sprite_set = NULL;
+}
+
+/* obj_makeSprites
+   Reads the descriptions of the sprites' animations from their .dat
+   files, for the cache.  None of their images are loaded yet.
+*/
+void *
+obj_makeSprites(char *sprite_datfile)
+{
+  SpriteSet *set;
   char *spr_name, *spr_dir;
-  int i = 0;
+  DatFile *dat;
+  int i;
 
-  /* Count the number of sprites and allocate the spriteset array */
-  sprite_set.n_sprites = file_countDatPairs(sprite_datfile);
-  sprite_set.data = (SprData *) dyn_1dArrayAlloc(sprite_set.n_sprites, sizeof(SprData));
+  MALLOC(set, sizeof(SpriteSet));
 
-  /* Open the sprite datfile for reading */
-  file_openFile(sprite_datfile, 'r');
+  /* Read the sprite datfile in, and allocate the spriteset array */
+  dat = file_openDat(sprite_datfile);
+  set->n_sprites = dat->n_pairs;
+  set->data = (SprData *) dyn_1dArrayAlloc(set->n_sprites, sizeof(SprData));
+  nam_initMap(&set->names);
+  set->pages.n_atlases = 0;
+  set->pages.atlases = NULL;
 
   /* Get all of the sprite names and directories */
-  while (file_getNextDatPair(sprite_datfile, &spr_name, &spr_dir))
+  for (i = 0; i < dat->n_pairs; i++)
     {
       char *anim_name, *anim_dir;
-      int j = 0;
+      DatFile *spr_dat;
+      int j;
+
+      file_getDatPair(dat, i, &spr_name, &spr_dir);
 
       /* Assign the name to the sprite */
-      sprite_set.data[i].name = spr_name;
-      /* Count the number of animations in the sprite */
-      sprite_set.data[i].n_animations = file_countSpriteAnims(spr_dir);
-      /* Allocate the array of animations */
-      sprite_set.data[i].data = (AnimData *) dyn_1dArrayAlloc(sprite_set.data[i].n_animations, sizeof(AnimData));
+      set->data[i].name = spr_name;
+      nam_set(&set->names, nam_intern(spr_name), i);
 
+      /* Read the sprite file to get out the animations */
+      spr_dat = file_openSpriteDat(spr_dir);
 
-      /* Open the sprite file to read out the animations */
-      file_openSpriteFile(spr_dir, 'r');
+      /* Allocate the array of animations */
+      set->data[i].n_animations = spr_dat->n_pairs;
+      set->data[i].data = (AnimData *) dyn_1dArrayAlloc(set->data[i].n_animations, sizeof(AnimData));
+      nam_initMap(&set->data[i].anims);
 
-      while (file_getNextSpriteAnim(spr_dir, &anim_name, &anim_dir))
+      for (j = 0; j < spr_dat->n_pairs; j++)
 	{
-	  file_loadAnim(anim_name, anim_dir, &sprite_set.data[i].data[j]);
+	  file_getSpriteAnim(spr_dat, spr_dir, j, &anim_name, &anim_dir);
+	  file_loadAnim(anim_name, anim_dir, &set->data[i].data[j]);
+	  set->data[i].data[j].pages = &set->pages;
+	  nam_set(&set->data[i].anims, nam_intern(anim_name), j);
 	  free(anim_name); free(anim_dir);
-	  j++;
 	}
-      /* Close the sprite file */
-      file_closeSpriteFile(spr_dir);
 
       free(spr_dir);
       /* Don't free spr_name because we saved that string in the sprite */
-      i++;
     }
 
-  file_closeFile(sprite_datfile);
+  return set;
 }
 
-/* obj_freeSprites
-   free the loaded sprite animations
+/* obj_destroySprites
+   Frees sprite animations the cache is done with.
 */
 void
-obj_freeSprites(void)
+obj_destroySprites(void *data)
 {
-  extern SpriteSet sprite_set;
+  SpriteSet *set = (SpriteSet *) data;
   int i, j;
 
+  /* Nothing can still be loading onto its pages */
+  pool_finish(1);
+
   /* Loop through all of the sprites in the sprite set */
-  for (i = 0; i < sprite_set.n_sprites; i++)
+  for (i = 0; i < set->n_sprites; i++)
     {
       /* Loop through all of the animations in the sprite */
-      for (j = 0; j < sprite_set.data[i].n_animations; j++)
+      for (j = 0; j < set->data[i].n_animations; j++)
 	{
-	  anim_freeAnim(&sprite_set.data[i].data[j]);
+	  anim_freeAnim(&set->data[i].data[j]);
 	}
       /* Free the animation array */
-      dyn_1dArrayFree(sprite_set.data[i].data);
+      dyn_1dArrayFree(set->data[i].data);
+      nam_freeMap(&set->data[i].anims);
 
       /* Free the sprite's name */
-      free(sprite_set.data[i].name);
+      free(set->data[i].name);
     }
   /* Free the sprite array */
-  dyn_1dArrayFree(sprite_set.data);
+  dyn_1dArrayFree(set->data);
+  nam_freeMap(&set->names);
+  anim_freePages(&set->pages);
+  free(set);
+}
+
+/* obj_spritesBytes
+   Returns about how much memory the sprites take up, for the cache.
+*/
+long
+obj_spritesBytes(void *data)
+{
+  SpriteSet *set = (SpriteSet *) data;
+
+  return sizeof(SpriteSet) + set->n_sprites * sizeof(SprData) + anim_pagesBytes(&set->pages);
+}
+
+/* needType
+   Marks an object type as needed, and every type it makes.
+*/
+void
+needType(int type, int *needed)
+{
+  int i;
+
+  if (type < 0 || type >= N_OBJ_TYPES || needed[type]) return;
+  needed[type] = 1;
+  if (obj_defs[type]->makes != NULL)
+    for (i = 0; obj_defs[type]->makes[i] >= 0; i++) needType(obj_defs[type]->makes[i], needed);
+}
+
+/* obj_loadAreaAssets
+   Loads the images of the sprites used by the types of object in an area,
+   and by the types they make, all at once, and the sounds they make,
+   waiting for them if wait is true.  Anything else is loaded in the
+   background if it's ever needed.
+*/
+void
+obj_loadAreaAssets(char *areafile, int wait)
+{
+  extern SpriteSet *sprite_set;
+  int needed[N_OBJ_TYPES], spr_used[N_OBJ_TYPES];
+  AnimData **anims = NULL;
+  char **sounds = NULL;
+  int type, i, j, n_anims = 0, n_sounds = 0, n_used = 0;
+  Area *area;
+
+  memset(needed, 0, sizeof(needed));
+  area = file_openArea(areafile);
+  for (i = 0; i < area->head->n_objects; i++)
+    needType(file_areaObject(area, i)->type, needed);
+  file_closeArea(area);
+
+  for (type = 0; type < N_OBJ_TYPES; type++)
+    {
+      int spr_id;
+
+      if (!needed[type]) continue;
+
+      /* Each sprite's animations once, even if types share it */
+      spr_id = spriteNameToID(obj_defs[type]->sprite);
+      for (i = 0; i < n_used && spr_used[i] != spr_id; i++);
+      if (i == n_used)
+	{
+	  SprData *spr = &sprite_set->data[spr_id];
+
+	  spr_used[n_used++] = spr_id;
+	  if ((anims = realloc(anims, (n_anims + spr->n_animations) * sizeof(AnimData *))) == NULL)
+	    {
+	      fprintf(stderr, "Unable to allocate memory.\n");
+	      exit(0);
+	    }
+	  for (j = 0; j < spr->n_animations; j++) anims[n_anims++] = &spr->data[j];
+	}
+
+      if (obj_defs[type]->sounds != NULL)
+	for (j = 0; obj_defs[type]->sounds[j] != NULL; j++)
+	  {
+	    if ((sounds = realloc(sounds, (n_sounds + 1) * sizeof(char *))) == NULL)
+	      {
+		fprintf(stderr, "Unable to allocate memory.\n");
+		exit(0);
+	      }
+	    sounds[n_sounds++] = obj_defs[type]->sounds[j];
+	  }
+    }
+
+  /* Load all of the frames' images at once, onto atlas pages */
+  anim_loadGfx(anims, n_anims, wait);
+  aud_loadNeeded(sounds, n_sounds, wait);
+  free(anims);
+  free(sounds);
 }
 
 /* obj_loadObjects
    Load objects for an area.
-   (The map must be loaded first before this can be done.)
+   (The map must be loaded first before this can be done, since the
+   objects are handed to the chunks they start in.  Their sprites' images
+   and their sounds are loaded by obj_loadAreaAssets().)
 */
 void
 obj_loadObjects(char *areafile)
 {
   extern ObjContainer the_objects;
-  int l;
+  int l, i;
+  Area *area;
+
+  /* Look up what the types need, now the sprites and sounds are in */
+  resolveTypes();
 
   /* Allocate the same number of layers as the map has: */
   the_objects.n_layers = map_getNLayers();
@@ -131,25 +279,33 @@ obj_loadObjects(char *areafile)
       the_objects.layers[l].obj_array = (Object ***) dyn_arrayAlloc(the_objects.layers[l].w, the_objects.layers[l].h, sizeof(Object *));
     }
 
-  /* Load the objects from the area file */
-  file_openFile(areafile, 'r');
+  /* Load the objects from the area */
+  area = file_openArea(areafile);
 
-  /* Loop through all of the objects in the file */
-  while (file_nextObject(areafile))
+  /* Loop through all of the objects in the area */
+  for (i = 0; i < area->head->n_objects; i++)
     {
+      AreaObject *o = file_areaObject(area, i);
       Velocity vel;
       Point pos;
-      int z, type;
+      int z = o->z, type = o->type;
 
       /* Get the attributes for this object */
-      file_getObjectAtts(areafile, &z, &pos, &vel, &type);
-
-      /* Create the object and put it into the container */
-      insertObj(newObject(z, pos, vel, type));
+      pos.x = o->x;
+      pos.y = o->y;
+      vel.x = o->vx;
+      vel.y = o->vy;
+
+      /* The player is created right away and put into the container.
+	 Everything else sleeps in its chunk until the chunk is loaded. */
+      if (type == PLAYER_TYPE)
+	insertObj(newObject(z, pos, vel, type));
+      else
+	chk_addDormant(z, pos, vel, type);
     }
 
-  /* Close the file */
-  file_closeFile(areafile);
+  /* Close the area */
+  file_closeArea(area);
 }
 
 /* obj_freeObjects
@@ -176,7 +332,9 @@ obj_freeObjects(void)
 	      //free all of the objects in this sector
 	      while (OBJ_AT(l, x, y) != NULL)
 		{
-		  freeObject(OBJ_AT(l, x, y));
+		  Object *obj = OBJ_AT(l, x, y);
+		  removeObj(obj);
+		  freeObject(obj);
 		}
 	    }
 	}
@@ -208,6 +366,7 @@ void obj_handleSignals(void)
 	      insertObj((Object *) sig.sig.sk.obj);
 	      break;
 	    case KILL_OBJECT:
+	      removeObj((Object *) sig.sig.sk.obj);
 	      freeObject((Object *) sig.sig.sk.obj);
 	      break;
 	    }
@@ -261,6 +420,41 @@ void obj_killObj(Object *obj)
     }
 }
 
+/* obj_sleepObj
+   Takes an object out of the object container without freeing it, when
+   the chunk it's in is thrown out.  It keeps its attributes, and
+   obj_wakeObj() puts it back just as it was.  It forgets what it was
+   touching, since nothing can touch it while it's asleep.
+*/
+void obj_sleepObj(Object *obj)
+{
+  removeObj(obj);
+  col_forgetObj(obj);
+}
+
+/* obj_wakeObj
+   Puts an object that was put to sleep back in the object container, with
+   a spawn signal like a new object.
+*/
+void obj_wakeObj(Object *obj)
+{
+  extern SigQ signals;
+  Signal sig;
+
+  sig.type = SPAWN_KILL_SIG;
+  sig.sig.sk.todo = SPAWN_OBJECT;
+  sig.sig.sk.obj = (void *) obj;
+  sig_push(&signals, &sig);
+}
+
+/* obj_freeSleepingObj
+   Frees an object that's asleep, which isn't in the object container.
+*/
+void obj_freeSleepingObj(Object *obj)
+{
+  freeObject(obj);
+}
+
 /* newObject
    Given the object's layer, position, starting velocity and type, create it
    , but do not put it in the object container.  Returns
@@ -272,7 +466,7 @@ Object *
 newObject(int layer, Point pos, Velocity vel, int type)
 {
 
-  extern SpriteSet sprite_set;
+  extern SpriteSet *sprite_set;
   extern struct obj_att_define *obj_defs[];
 
   Object *obj;
@@ -309,10 +503,13 @@ newObject(int layer, Point pos, Velocity vel, int type)
   obj->elasticity = obj_defs[type]->elasticity;
   obj->friction = obj_defs[type]->friction;
   obj->solid = obj_defs[type]->solid;
+  obj->category = obj_defs[type]->category;
+  obj->collides = obj_defs[type]->collides;
+  obj->senses = obj_defs[type]->senses;
   obj->w = obj_defs[type]->w;
   obj->h = obj_defs[type]->h;
-  obj_setSprite(obj_defs[type]->sprite, obj);
-  obj_setAnim(obj_defs[type]->animation, obj);
+  obj->spr.spr_id = type_sprites[type];
+  obj_setAnimByHandle(type_anims[type], obj);
   obj->bounds = obj_defs[type]->bounds();
   obj->atts = obj_defs[type]->init_atts();
   obj->go = obj_defs[type]->go;
@@ -326,7 +523,8 @@ newObject(int layer, Point pos, Velocity vel, int type)
 }
 
 /* freeObject
-   Frees an object, removing it from the object container.
+   Frees an object which has been taken out of the object container, or
+   was never in it.
 */
 void
 freeObject(Object *obj)
@@ -346,11 +544,13 @@ freeObject(Object *obj)
   /* Flush the signal queue */
   sig_flush(&obj->signals);
 
+  /* Forget anything the object was touching */
+  col_forgetObj(obj);
+
   /* The object has its own function for freeing attributes because within
      the atts structure, it may have allocated additional memory: */
   obj->free_atts(obj);
 
-  removeObj(obj);
   free(obj);
 
   obj = NULL;
@@ -427,14 +627,12 @@ removeObj(Object *obj)
 int
 spriteNameToID(char *name)
 {
-  extern SpriteSet sprite_set;
-  int i = 0;
-  do
-    {
-      if (strcmp(name, sprite_set.data[i].name) == 0) return i;
-    } while (i++ < sprite_set.n_sprites);
+  extern SpriteSet *sprite_set;
+  int id = nam_lookup(&sprite_set->names, name);
+
+  if (id >= 0) return id;
 
-  /* Still haven't found the sprite of this name? Error! */
+  /* Haven't found the sprite of this name? Error! */
   fprintf(stderr, "Error: Sprite of name %s not loaded.\n", name);
   exit(0);
 }
@@ -446,16 +644,13 @@ spriteNameToID(char *name)
 int
 animNameToID(int spr_id, char *name)
 {
-  extern SpriteSet sprite_set;
+  extern SpriteSet *sprite_set;
+  int id = nam_lookup(&sprite_set->data[spr_id].anims, name);
 
-  int i = 0;
-  do
-    {
-      if (strcmp(name, sprite_set.data[spr_id].data[i].name) == 0) return i;
-    } while (i++ < sprite_set.data[spr_id].n_animations);
+  if (id >= 0) return id;
 
-  /* Still haven't found the animation of this name? Error! */
-  fprintf(stderr, "Error: Animation of name %s not loaded in sprite %s.\n", name, sprite_set.data[spr_id].name);
+  /* Haven't found the animation of this name? Error! */
+  fprintf(stderr, "Error: Animation of name %s not loaded in sprite %s.\n", name, sprite_set->data[spr_id].name);
   exit(0);
 }
 
@@ -477,38 +672,114 @@ obj_setSprite(char *name, Object *obj)
 void
 obj_setAnim(char *name, Object *obj)
 {
-  extern SpriteSet sprite_set;
-
   /* Find the animation id in the sprite set */
-  obj->spr.anim.anim_id = animNameToID(obj->spr.spr_id, name);
-  obj->spr.anim.curr_frame = 0;
-  obj->spr.anim.play_dir = FORWARD;
-  obj->spr.anim.offset.x = 0;
-  obj->spr.anim.offset.y = 0;
+  obj_setAnimByHandle(animNameToID(obj->spr.spr_id, name), obj);
+}
+
+/* obj_setAnimByHandle
+   Sets the object's animation to one that's already been looked up.  The
+   object plays it in step with every other object showing it, at the
+   default speed.
+*/
+void
+obj_setAnimByHandle(AnimHandle anim, Object *obj)
+{
+  extern SpriteSet *sprite_set;
+  anim_init(&obj->spr.anim, anim, &sprite_set->data[obj->spr.spr_id].data[anim]);
+}
+
+/* obj_getAnimHandle
+   Looks up one of the animations of an object type's sprite, for the
+   type's resolve function to keep.
+*/
+AnimHandle
+obj_getAnimHandle(int type, char *name)
+{
+  extern int type_sprites[];
+  return animNameToID(type_sprites[type], name);
+}
+
+/* obj_getTypeAnimData
+   Returns the data of the animation an object type starts with.  For
+   things that show a type's sprite without being objects.
+*/
+AnimData *
+obj_getTypeAnimData(int type)
+{
+  extern SpriteSet *sprite_set;
+  extern int type_sprites[];
+  extern AnimHandle type_anims[];
+  return &sprite_set->data[type_sprites[type]].data[type_anims[type]];
+}
+
+/* resolveTypes
+   Looks up every object type's sprite and first animation, and has each
+   type look up the other animations and sounds it uses.
+*/
+void
+resolveTypes(void)
+{
+  extern int type_sprites[];
+  extern AnimHandle type_anims[];
+  int type;
+
+  for (type = 0; type < N_OBJ_TYPES; type++)
+    {
+      type_sprites[type] = spriteNameToID(obj_defs[type]->sprite);
+      type_anims[type] = animNameToID(type_sprites[type], obj_defs[type]->animation);
+      if (obj_defs[type]->resolve != NULL) obj_defs[type]->resolve(type);
+    }
+}
 
-  /* Set the default animation speed: */
-  time_init(&obj->spr.anim.timer, sprite_set.data[obj->spr.spr_id].data[obj->spr.anim.anim_id].def_delay);
+/* obj_getAnimData
+   Given the names of a sprite and one of its animations, return a pointer
+   to the animation's data.  For things that show a sprite without being
+   objects.
+*/
+AnimData *
+obj_getAnimData(char *sprite, char *anim)
+{
+  extern SpriteSet *sprite_set;
+  int spr_id = spriteNameToID(sprite);
+
+  return &sprite_set->data[spr_id].data[animNameToID(spr_id, anim)];
+}
+
+/* obj_getNSprites
+   Returns how many sprites there are.
+*/
+int
+obj_getNSprites(void)
+{
+  extern SpriteSet *sprite_set;
+  return sprite_set->n_sprites;
+}
+
+/* obj_getSpriteAnims
+   Returns a sprite's animations, and sets how many there are.
+*/
+AnimData *
+obj_getSpriteAnims(int spr_id, int *n)
+{
+  extern SpriteSet *sprite_set;
+
+  *n = sprite_set->data[spr_id].n_animations;
+  return sprite_set->data[spr_id].data;
 }
 
 /* obj_setAnimSpeed
    Set the animation speed of the current object's animation.
    Delay = 1/speed
+   The object's animation gets its own clock, so it plays out of step
+   with the other objects showing it until its animation is set again.
 */
 void
 obj_setAnimSpeed(Object *obj, int speed)
 {
+  extern SpriteSet *sprite_set;
   Time delay;
   delay = (speed == 0) ? 0 : 1 / (float) speed;
-  time_setMax(&obj->spr.anim.timer, delay);
-}
-
-/* obj_animateObj
-   Animate an object.
-*/
-void obj_animateObj(Object *obj)
-{
-  extern SpriteSet sprite_set;
-  anim_animate(&obj->spr.anim, &sprite_set.data[obj->spr.spr_id].data[obj->spr.anim.anim_id]);
+  anim_setDelay(&obj->spr.anim, &sprite_set->data[obj->spr.spr_id].data[obj->spr.anim.anim_id], delay);
 }
 
 /* obj_getLayerWidth
@@ -561,16 +832,17 @@ Point
 obj_getGfxPos(Object *obj)
 {
 
-  extern SpriteSet sprite_set;
+  extern SpriteSet *sprite_set;
   Point gfx_pos;
 
+  AnimData *data = &sprite_set->data[obj->spr.spr_id].data[obj->spr.anim.anim_id];
+  Frame *f = &data->frames[anim_getFrame(&obj->spr.anim, data)];
+
   gfx_pos.x = obj_getObjTopLeft(obj).x + 
-    obj->spr.anim.offset.x +
-    sprite_set.data[obj->spr.spr_id].data[obj->spr.anim.anim_id].frames[obj->spr.anim.curr_frame].offset.x;
+    obj->spr.anim.offset.x + f->offset.x;
 
   gfx_pos.y = obj_getObjTopLeft(obj).y + 
-    obj->spr.anim.offset.y +
-    sprite_set.data[obj->spr.spr_id].data[obj->spr.anim.anim_id].frames[obj->spr.anim.curr_frame].offset.y;
+    obj->spr.anim.offset.y + f->offset.y;
   
   return gfx_pos;
 }
@@ -589,13 +861,16 @@ obj_getObjTopLeft(Object *obj)
 }
 
 /* obj_getObjGfx
-   Return the object's currently displayed graphic.
+   Return the object's currently displayed frame.
 */
-SDL_Surface *
+Frame *
 obj_getObjGfx(Object *obj)
 {
-  extern SpriteSet sprite_set;
-  return sprite_set.data[obj->spr.spr_id].data[obj->spr.anim.anim_id].frames[obj->spr.anim.curr_frame].image;
+  extern SpriteSet *sprite_set;
+  AnimData *data = &sprite_set->data[obj->spr.spr_id].data[obj->spr.anim.anim_id];
+
+  anim_needGfx(data);
+  return &data->frames[anim_getFrame(&obj->spr.anim, data)];
 
 }
 
@@ -694,6 +969,24 @@ int obj_isSolid(Object *obj)
   return obj->solid;
 }
 
+/* obj_interacts
+   True if two objects should be tested for collisions at all: one of them
+   collides with or senses the other's category.
+*/
+int obj_interacts(Object *a, Object *b)
+{
+  return ((a->collides | a->senses) & b->category) ||
+    ((b->collides | b->senses) & a->category);
+}
+
+/* obj_collides
+   True if two objects push each other apart when they collide.
+*/
+int obj_collides(Object *a, Object *b)
+{
+  return (a->collides & b->category) && (b->collides & a->category);
+}
+
 /* obj_sendObjSignal
    Add a signal onto the object's signal queue
 */
@@ -815,6 +1108,15 @@ obj_getPlayerPtr(void)
 */
 int
 obj_makeSound(Object *obj, char *sound, int loops)
+{
+  return obj_makeSoundByHandle(obj, aud_getSoundHandle(sound), loops);
+}
+
+/* obj_makeSoundByHandle
+   The same as obj_makeSound(), for a sound that's already been looked up.
+*/
+int
+obj_makeSoundByHandle(Object *obj, SoundHandle sound, int loops)
 {
   int pan;
   Rect cam_range = cam_getViewRange(obj->layer);
@@ -830,5 +1132,5 @@ obj_makeSound(Object *obj, char *sound, int loops)
     {
       pan = (int) (PANNING_MAX * (float) (obj->pos.x - cam_range.p1.x) / (float) (cam_range.p2.x - cam_range.p1.x));
     }
-  return (aud_playSound(sound, pan, SOUND_DEFAULT_VOL, loops));
+  return (aud_playSoundByHandle(sound, pan, SOUND_DEFAULT_VOL, loops));
 }
@@ -9,6 +9,7 @@
 #include "timer.h"
 #include "signal.h"
 #include "audio.h"
+#include "names.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -38,17 +39,26 @@
    have sprites, which refer to preloaded sprite data, which is no more than
    groups of animation data.
 */
+/* One of the animations of an object type's sprite.  Gameplay code looks
+   up the handles of the animations it uses once, when the type is
+   resolved (see the resolve function in types/objtypes.h), instead of
+   finding them by name every time. */
+typedef int AnimHandle;
+
 typedef struct sprdata_struct
 {
   char *name;         /* The name of the sprite */
   int n_animations;   /* The number of animations in the sprite */
   AnimData *data;     /* A 1d array of AnimData */
+  NameMap anims;      /* Where each animation is, by name */
 } SprData;
 
 typedef struct spriteset_struct
 {
   int n_sprites;    /* The number of sprites */
   SprData *data;     /* A 1d array of SprData */
+  NameMap names;     /* Where each sprite is, by name */
+  AnimPages pages;   /* The pages the sprites' images are on */
 } SpriteSet;
 
 typedef struct sprite_struct
@@ -80,6 +90,10 @@ typedef struct object_struct
 
   int solid;       /* Whether or not the object can pass through things. */
 
+  int category;    /* The object's collision category, and the categories */
+  int collides;    /* it collides with and only senses (see */
+  int senses;      /* types/objtypes.h) */
+
   float elasticity;/* How elastic the object's collisions are. Values: 0 - 1 */
   float friction;  /* Not used yet... */
 
@@ -127,23 +141,38 @@ typedef struct obj_container_struct
 
 extern void obj_loadSprites(char *sprite_datfile);
 extern void obj_freeSprites(void);
+extern void *obj_makeSprites(char *sprite_datfile);
+extern void obj_destroySprites(void *data);
+extern long obj_spritesBytes(void *data);
+extern void obj_loadAreaAssets(char *areafile, int wait);
 extern void obj_loadObjects(char *areafile);
 extern void obj_freeObjects(void);
 extern void obj_spawnObj(int layer, Point pos, Velocity vel, int type);
 extern void obj_killObj(Object *obj);
+extern void obj_sleepObj(Object *obj);
+extern void obj_wakeObj(Object *obj);
+extern void obj_freeSleepingObj(Object *obj);
 extern void obj_handleSignals(void);
 extern void obj_setSprite(char *name, Object *obj);
 extern void obj_setAnim(char *name, Object *obj);
+extern AnimHandle obj_getAnimHandle(int type, char *name);
+extern void obj_setAnimByHandle(AnimHandle anim, Object *obj);
+extern AnimData *obj_getTypeAnimData(int type);
+extern AnimData *obj_getAnimData(char *sprite, char *anim);
+extern int obj_getNSprites(void);
+extern AnimData *obj_getSpriteAnims(int spr_id, int *n);
 extern int obj_getLayerWidth(int l);
 extern int obj_getLayerHeight(int l);
 extern Object *obj_getObjList(int l, int x, int y);
 extern Object *obj_getNextObj(Object *this_object);
-extern SDL_Surface *obj_getObjGfx(Object *obj);
+extern Frame *obj_getObjGfx(Object *obj);
 extern Point obj_getObjTopLeft(Object *obj);
 extern Point obj_getGfxPos(Object *obj);
 extern Bound *obj_getObjBounds(Object *object_ptr);
 extern Point obj_getObjPos(Object *obj);
 extern int obj_isSolid(Object *obj);
+extern int obj_interacts(Object *a, Object *b);
+extern int obj_collides(Object *a, Object *b);
 extern int obj_getObjType(Object *obj);
 extern int obj_getObjLayer(Object *obj);
 extern Point obj_getObjBotRight(Object *obj);
@@ -154,10 +183,10 @@ extern void obj_setObjPos(Object *object_ptr, Point new_pos);
 extern void obj_moveObj(Object *obj, Time dt);
 extern void obj_setObjVel(Object *object_ptr, Velocity vel);
 extern Object *obj_getPlayerPtr(void);
-extern void obj_animateObj(Object *obj);
 extern void obj_setAnimSpeed(Object *obj, int speed);
 extern void obj_sendObjSignal(Object *obj, Signal *s);
 extern int obj_makeSound(Object *obj, char *sound, int loops);
+extern int obj_makeSoundByHandle(Object *obj, SoundHandle sound, int loops);
 #define obj_stopSound(x) aud_haltSound(x)
 
 #define obj_getSectorW() SECTOR_W
@@ -0,0 +1,767 @@
+#include "pack.h"
+#include "lz4.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* The open pack, if there is one */
+static PackHeader *pack = NULL;
+static int pack_mapped;
+
+/* What's taken off the front of a file's name to get its path in the
+   pack */
+static char *pack_prefix = NULL;
+
+/* The compressed files that have been unpacked, by entry, until the pack
+   is flushed */
+static Uint8 **unpacked = NULL;
+
+/* A block of a compressed file to unpack, for the loading threads */
+typedef struct block_job_struct
+{
+  PackEntry *e;
+  int block;
+  Uint8 *out;          /* Where the whole file goes */
+  int broken;          /* Set if the block couldn't be unpacked */
+} BlockJob;
+
+/* The files found for a pack that's being built */
+typedef struct pack_list_struct
+{
+  int n, max;
+  char **paths;        /* From the data directory */
+} PackList;
+
+/* Private function prototypes */
+static Uint32 hashPath(char *path);
+static int checkPack(PackHeader *head, Uint32 size);
+static int fitsIn(Uint32 offset, Uint32 n, Uint32 each, Uint32 size);
+static void findFiles(PackList *list, char *dir, char *path);
+static int isStale(char *dir, char *path);
+static int comparePaths(const void *a, const void *b);
+static Uint32 align(Uint32 n);
+static PackEntry *findEntry(char *file);
+static void unpackEntries(PackEntry **list, int n);
+static void unpackBlock(void *thing);
+static void evictFile(char *filename);
+
+/* hashPath
+   The FNV-1a hash of a path.
+*/
+Uint32
+hashPath(char *path)
+{
+  Uint32 h = 2166136261u;
+
+  while (*path != '\0')
+    {
+      h ^= (unsigned char) *path++;
+      h *= 16777619u;
+    }
+  return h;
+}
+
+/* align
+   Rounds a size up to the next multiple of PACK_ALIGN.
+*/
+Uint32
+align(Uint32 n)
+{
+  return (n + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+}
+
+/* pak_open
+   Maps a pack into memory, if there is one.  Files whose names start with
+   prefix are looked for in it.  Returns true if the pack is open.
+*/
+int
+pak_open(char *packfile, char *prefix)
+{
+  extern PackHeader *pack;
+  extern int pack_mapped;
+  extern char *pack_prefix;
+  struct stat st;
+  PackHeader *head = NULL;
+
+  if (stat(packfile, &st) != 0 || st.st_size < sizeof(PackHeader)) return 0;
+
+#ifndef _WIN32
+  {
+    int fd = open(packfile, O_RDONLY);
+    if (fd >= 0)
+      {
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p != MAP_FAILED) head = (PackHeader *) p;
+      }
+    pack_mapped = 1;
+  }
+#else
+  {
+    FILE *inf;
+    if ((inf = fopen(packfile, "rb")) != NULL)
+      {
+	MALLOC(head, st.st_size);
+	if (fread(head, 1, st.st_size, inf) != st.st_size)
+	  {
+	    free(head);
+	    head = NULL;
+	  }
+	fclose(inf);
+      }
+    pack_mapped = 0;
+  }
+#endif
+
+  if (head == NULL) return 0;
+  if (!checkPack(head, st.st_size))
+    {
+      fprintf(stderr, "Warning: %s isn't a pack this version can read, loading from the data directory instead.\n", packfile);
+#ifndef _WIN32
+      munmap(head, st.st_size);
+#else
+      free(head);
+#endif
+      return 0;
+    }
+
+  pack = head;
+  MALLOC(pack_prefix, (strlen(prefix) + 1) * sizeof(char));
+  strcpy(pack_prefix, prefix);
+  if ((unpacked = (Uint8 **) calloc(pack->n_entries + 1, sizeof(Uint8 *))) == NULL)
+    {
+      fprintf(stderr, "Unable to allocate memory.\n");
+      exit(0);
+    }
+  return 1;
+}
+
+/* pak_close
+   Unmaps the pack.  Nothing found in it can be used after this.
+*/
+void
+pak_close(void)
+{
+  extern PackHeader *pack;
+  extern int pack_mapped;
+  extern char *pack_prefix;
+
+  if (pack == NULL) return;
+
+  pak_flush();
+  free(unpacked);
+  unpacked = NULL;
+
+#ifndef _WIN32
+  if (pack_mapped) munmap(pack, pack->size);
+  else
+#endif
+    free(pack);
+  free(pack_prefix);
+  pack = NULL;
+  pack_prefix = NULL;
+}
+
+/* pak_isOpen
+   Returns true if everything's being loaded out of a pack.
+*/
+int
+pak_isOpen(void)
+{
+  extern PackHeader *pack;
+  return pack != NULL;
+}
+
+/* checkPack
+   Makes sure a pack is one that can be read, and that none of it is
+   outside the file.
+*/
+int
+checkPack(PackHeader *head, Uint32 size)
+{
+  PackEntry *entries = (PackEntry *) ((char *) head + head->entries);
+  Uint32 *buckets = (Uint32 *) ((char *) head + head->buckets);
+  char *paths = (char *) head + head->paths;
+  Uint32 i;
+
+  if (memcmp(head->magic, PACK_MAGIC, 4) != 0 || head->version != PACK_VERSION ||
+      head->size != size)
+    return 0;
+
+  if (head->n_buckets == 0 || (head->n_buckets & (head->n_buckets - 1)) != 0 ||
+      !fitsIn(head->buckets, head->n_buckets, sizeof(Uint32), size) ||
+      !fitsIn(head->entries, head->n_entries, sizeof(PackEntry), size) ||
+      !fitsIn(head->paths, head->paths_size, 1, size) ||
+      head->paths_size == 0 || paths[head->paths_size - 1] != '\0')
+    return 0;
+
+  for (i = 0; i < head->n_buckets; i++)
+    if (buckets[i] != PACK_NONE && buckets[i] >= head->n_entries) return 0;
+  for (i = 0; i < head->n_entries; i++)
+    {
+      PackEntry *e = &entries[i];
+      if (e->path >= head->paths_size || !fitsIn(e->offset, e->packed, 1, size) ||
+	  (e->next != PACK_NONE && e->next >= head->n_entries))
+	return 0;
+      /* A compressed file has to at least have room for its block table */
+      if (e->packed != e->size &&
+	  e->packed < (e->size + PACK_BLOCK - 1) / PACK_BLOCK * sizeof(Uint32))
+	return 0;
+    }
+  return 1;
+}
+
+/* fitsIn
+   Returns true if an array of n things of a size, at an offset, fits in a
+   file of a size.
+*/
+int
+fitsIn(Uint32 offset, Uint32 n, Uint32 each, Uint32 size)
+{
+  return (offset <= size && n <= (size - offset) / each);
+}
+
+/* findEntry
+   Finds a file's entry in the pack, or returns NULL if there's no pack or
+   it isn't in it.
+*/
+PackEntry *
+findEntry(char *file)
+{
+  extern PackHeader *pack;
+  extern char *pack_prefix;
+  PackEntry *entries;
+  Uint32 h, i, hops = 0;
+
+  if (pack == NULL) return NULL;
+
+  /* The paths in the pack are from the data directory */
+  if (strncmp(file, pack_prefix, strlen(pack_prefix)) == 0)
+    file += strlen(pack_prefix);
+
+  entries = (PackEntry *) ((char *) pack + pack->entries);
+  h = hashPath(file);
+  i = ((Uint32 *) ((char *) pack + pack->buckets))[h & (pack->n_buckets - 1)];
+
+  /* Count the hops too, so a bad chain can't go round forever */
+  while (i != PACK_NONE && hops++ < pack->n_entries)
+    {
+      if (entries[i].hash == h &&
+	  strcmp((char *) pack + pack->paths + entries[i].path, file) == 0)
+	return &entries[i];
+      i = entries[i].next;
+    }
+  return NULL;
+}
+
+/* pak_find
+   Finds a file in the pack.  Returns where it is, and sets its size, or
+   returns NULL if there's no pack or it isn't in it.  A compressed file is
+   unpacked, and stays unpacked until the pack is flushed.
+*/
+void *
+pak_find(char *file, int *size)
+{
+  extern PackHeader *pack;
+  extern Uint8 **unpacked;
+  PackEntry *e = findEntry(file);
+  int i;
+
+  if (e == NULL) return NULL;
+  *size = e->size;
+  if (e->packed == e->size) return (char *) pack + e->offset;
+
+  i = e - (PackEntry *) ((char *) pack + pack->entries);
+  if (unpacked[i] == NULL) unpackEntries(&e, 1);
+  return unpacked[i];
+}
+
+/* pak_openRW
+   Opens a file in the pack for SDL to read, without copying it.  Returns
+   NULL if it isn't in the pack.  It can't be read after the pack is
+   flushed.
+*/
+SDL_RWops *
+pak_openRW(char *file)
+{
+  int size;
+  void *data = pak_find(file, &size);
+
+  if (data == NULL) return NULL;
+  return SDL_RWFromConstMem(data, size);
+}
+
+/* pak_copy
+   Copies a file out of the pack, for something that needs it after the
+   pack is flushed.  The copy is the caller's to free.  Returns NULL if it
+   isn't in the pack.
+*/
+void *
+pak_copy(char *file, int *size)
+{
+  void *data = pak_find(file, size), *copy;
+
+  if (data == NULL) return NULL;
+  MALLOC(copy, *size + 1);
+  memcpy(copy, data, *size);
+  return copy;
+}
+
+/* pak_prefetch
+   Unpacks every compressed file in the pack whose path starts with one of
+   a list of paths, all at once, spread over the loading threads.  Loading
+   something that's been prefetched doesn't have to wait for it to unpack.
+*/
+void
+pak_prefetch(char **paths, int n)
+{
+  extern PackHeader *pack;
+  extern char *pack_prefix;
+  extern Uint8 **unpacked;
+  PackEntry *entries, **list;
+  Uint32 i;
+  int j, n_list = 0;
+
+  if (pack == NULL || n <= 0) return;
+
+  entries = (PackEntry *) ((char *) pack + pack->entries);
+  MALLOC(list, (pack->n_entries + 1) * sizeof(PackEntry *));
+  for (i = 0; i < pack->n_entries; i++)
+    {
+      char *path = (char *) pack + pack->paths + entries[i].path;
+
+      if (entries[i].packed == entries[i].size || unpacked[i] != NULL) continue;
+      for (j = 0; j < n; j++)
+	{
+	  char *p = paths[j];
+	  if (strncmp(p, pack_prefix, strlen(pack_prefix)) == 0) p += strlen(pack_prefix);
+	  if (strncmp(path, p, strlen(p)) == 0)
+	    {
+	      list[n_list++] = &entries[i];
+	      break;
+	    }
+	}
+    }
+
+  unpackEntries(list, n_list);
+  free(list);
+}
+
+/* pak_flush
+   Frees all of the unpacked copies of compressed files.  Whatever was
+   found in them can't be used after this.
+*/
+void
+pak_flush(void)
+{
+  extern PackHeader *pack;
+  extern Uint8 **unpacked;
+  Uint32 i;
+
+  if (pack == NULL) return;
+  for (i = 0; i < pack->n_entries; i++)
+    {
+      free(unpacked[i]);
+      unpacked[i] = NULL;
+    }
+}
+
+/* unpackEntries
+   Unpacks a list of compressed files, a block to a job.
+*/
+void
+unpackEntries(PackEntry **list, int n)
+{
+  extern PackHeader *pack;
+  extern Uint8 **unpacked;
+  PackEntry *entries = (PackEntry *) ((char *) pack + pack->entries);
+  BlockJob *jobs;
+  int i, b, n_jobs = 0;
+
+  for (i = 0; i < n; i++) n_jobs += (list[i]->size + PACK_BLOCK - 1) / PACK_BLOCK;
+  MALLOC(jobs, (n_jobs + 1) * sizeof(BlockJob));
+
+  n_jobs = 0;
+  for (i = 0; i < n; i++)
+    {
+      Uint8 *out;
+
+      MALLOC(out, list[i]->size);
+      unpacked[list[i] - entries] = out;
+      for (b = 0; b * PACK_BLOCK < list[i]->size; b++)
+	{
+	  jobs[n_jobs].e = list[i];
+	  jobs[n_jobs].block = b;
+	  jobs[n_jobs].out = out;
+	  jobs[n_jobs].broken = 0;
+	  n_jobs++;
+	}
+    }
+
+  pool_run(unpackBlock, jobs, n_jobs, sizeof(BlockJob));
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      if (jobs[i].broken)
+	{
+	  fprintf(stderr, "Error: %s in the pack is broken.\n",
+		  (char *) pack + pack->paths + jobs[i].e->path);
+	  exit(0);
+	}
+    }
+  free(jobs);
+}
+
+/* unpackBlock
+   Unpacks one block of a compressed file.  Blocks that didn't get smaller
+   were kept as they were.
+*/
+void
+unpackBlock(void *thing)
+{
+  extern PackHeader *pack;
+  BlockJob *job = (BlockJob *) thing;
+  PackEntry *e = job->e;
+  int n_blocks = (e->size + PACK_BLOCK - 1) / PACK_BLOCK;
+  Uint32 *ends = (Uint32 *) ((char *) pack + e->offset);
+  Uint8 *data = (Uint8 *) (ends + n_blocks);
+  Uint32 start = (job->block == 0) ? 0 : ends[job->block - 1];
+  Uint32 end = ends[job->block];
+  int len = (job->block == n_blocks - 1) ? e->size - job->block * PACK_BLOCK : PACK_BLOCK;
+  Uint8 *out = job->out + job->block * PACK_BLOCK;
+
+  if (start > end || end > e->packed - n_blocks * sizeof(Uint32))
+    job->broken = 1;
+  else if (end - start == len)
+    memcpy(out, data + start, len);
+  else if (lz4_decompress(data + start, end - start, out, len) != len)
+    job->broken = 1;
+}
+
+/* pak_evict
+   Asks the system to forget what it has cached of a file, or of every file
+   in a directory, so the next read of it comes from the disk.  It's for
+   timing cold starts.
+*/
+void
+pak_evict(char *path)
+{
+  struct stat st;
+  PackList list;
+  int i;
+
+  if (stat(path, &st) != 0) return;
+  if (!S_ISDIR(st.st_mode))
+    {
+      evictFile(path);
+      return;
+    }
+
+  list.n = list.max = 0;
+  list.paths = NULL;
+  findFiles(&list, path, "");
+  for (i = 0; i < list.n; i++)
+    {
+      char *filename;
+      MALLOC(filename, (strlen(path) + strlen(list.paths[i]) + 1) * sizeof(char));
+      strcpy(filename, path);
+      strcat(filename, list.paths[i]);
+      evictFile(filename);
+      free(filename);
+      free(list.paths[i]);
+    }
+  free(list.paths);
+}
+
+/* evictFile
+   Drops one file from the system's cache, where that can be done.
+*/
+void
+evictFile(char *filename)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#endif
+}
+
+/* pak_build
+   Builds a pack out of everything in a directory.  If compress is true,
+   files that get smaller by at least PACK_SAVING are compressed.
+*/
+void
+pak_build(char *dir, char *packfile, int compress)
+{
+  PackList list;
+  PackHeader head;
+  PackEntry *entries;
+  Uint32 *buckets;
+  Uint32 i, offset, raw = 0;
+  FILE *outf;
+  Uint8 *buffer = NULL, *packed = NULL;
+  int buffer_size = 0, packed_size = 0, n_compressed = 0;
+  static char zeros[PACK_ALIGN];
+
+  list.n = list.max = 0;
+  list.paths = NULL;
+  findFiles(&list, dir, "");
+  qsort(list.paths, list.n, sizeof(char *), comparePaths);
+
+  /* Lay out the tables */
+  memset(&head, 0, sizeof(PackHeader));
+  memcpy(head.magic, PACK_MAGIC, 4);
+  head.version = PACK_VERSION;
+  head.n_entries = list.n;
+  for (head.n_buckets = 1; head.n_buckets < list.n; head.n_buckets *= 2);
+  head.buckets = sizeof(PackHeader);
+  head.entries = head.buckets + head.n_buckets * sizeof(Uint32);
+  head.paths = head.entries + head.n_entries * sizeof(PackEntry);
+  head.paths_size = 1;
+  for (i = 0; i < list.n; i++) head.paths_size += strlen(list.paths[i]) + 1;
+
+  MALLOC(buckets, head.n_buckets * sizeof(Uint32));
+  MALLOC(entries, (list.n + 1) * sizeof(PackEntry));
+  for (i = 0; i < head.n_buckets; i++) buckets[i] = PACK_NONE;
+
+  /* The files go after the tables, which are written last, once the
+     files' sizes are known */
+  if ((outf = fopen(packfile, "wb")) == NULL)
+    {
+      fprintf(stderr, "Unable to open file: %s\n", packfile);
+      exit(0);
+    }
+  offset = align(head.paths + head.paths_size);
+  for (i = 0; i < offset; i += PACK_ALIGN) fwrite(zeros, 1, PACK_ALIGN, outf);
+
+  head.paths_size = 1;
+  for (i = 0; i < list.n; i++)
+    {
+      PackEntry *e = &entries[i];
+      Uint32 *bucket;
+      struct stat st;
+      FILE *inf;
+      char *filename;
+
+      MALLOC(filename, (strlen(dir) + strlen(list.paths[i]) + 1) * sizeof(char));
+      strcpy(filename, dir);
+      strcat(filename, list.paths[i]);
+      if (stat(filename, &st) != 0 || (inf = fopen(filename, "rb")) == NULL)
+	{
+	  fprintf(stderr, "Unable to open file: %s\n", filename);
+	  exit(0);
+	}
+      if (st.st_size > buffer_size)
+	{
+	  free(buffer);
+	  buffer_size = st.st_size;
+	  MALLOC(buffer, buffer_size);
+	}
+      if (fread(buffer, 1, st.st_size, inf) != st.st_size)
+	{
+	  fprintf(stderr, "Unable to read file: %s\n", filename);
+	  exit(0);
+	}
+      fclose(inf);
+      free(filename);
+
+      e->hash = hashPath(list.paths[i]);
+      e->path = head.paths_size;
+      head.paths_size += strlen(list.paths[i]) + 1;
+      e->offset = offset;
+      e->size = e->packed = st.st_size;
+      raw += e->size;
+
+      /* Compress it a block at a time, so the blocks can be unpacked at
+	 the same time.  The block table holds where each block ends. */
+      if (compress && e->size > 0)
+	{
+	  int n_blocks = (e->size + PACK_BLOCK - 1) / PACK_BLOCK;
+	  Uint32 *ends, end = 0, b;
+	  int need = n_blocks * sizeof(Uint32) + LZ4_BOUND(e->size) + n_blocks * 16;
+
+	  if (need > packed_size)
+	    {
+	      free(packed);
+	      packed_size = need;
+	      MALLOC(packed, packed_size);
+	    }
+	  ends = (Uint32 *) packed;
+	  for (b = 0; b < n_blocks; b++)
+	    {
+	      Uint8 *src = buffer + b * PACK_BLOCK;
+	      Uint8 *dst = packed + n_blocks * sizeof(Uint32) + end;
+	      int len = (b == n_blocks - 1) ? e->size - b * PACK_BLOCK : PACK_BLOCK;
+	      int c = lz4_compress(src, len, dst, LZ4_BOUND(len));
+
+	      /* A block that doesn't get smaller is kept as it is */
+	      if (c < 0 || c >= len)
+		{
+		  memcpy(dst, src, len);
+		  c = len;
+		}
+	      end += c;
+	      ends[b] = end;
+	    }
+
+	  if (n_blocks * sizeof(Uint32) + end < e->size - e->size / PACK_SAVING)
+	    {
+	      e->packed = n_blocks * sizeof(Uint32) + end;
+	      n_compressed++;
+	    }
+	}
+
+      if (e->packed != e->size) fwrite(packed, 1, e->packed, outf);
+      else fwrite(buffer, 1, e->size, outf);
+      offset = align(offset + e->packed);
+      fwrite(zeros, 1, offset - (e->offset + e->packed), outf);
+
+      /* Chain it onto the end of its bucket, so the order stays sorted */
+      for (bucket = &buckets[e->hash & (head.n_buckets - 1)]; *bucket != PACK_NONE;
+	   bucket = &entries[*bucket].next);
+      *bucket = i;
+      e->next = PACK_NONE;
+    }
+  head.size = offset;
+
+  /* Now the tables */
+  rewind(outf);
+  fwrite(&head, sizeof(PackHeader), 1, outf);
+  fwrite(buckets, sizeof(Uint32), head.n_buckets, outf);
+  fwrite(entries, sizeof(PackEntry), head.n_entries, outf);
+  fputc('\0', outf);
+  for (i = 0; i < list.n; i++) fwrite(list.paths[i], 1, strlen(list.paths[i]) + 1, outf);
+
+  if (ferror(outf))
+    {
+      fprintf(stderr, "Error: Unable to write pack %s\n", packfile);
+      exit(0);
+    }
+  fclose(outf);
+
+  printf("Packed %d files from %s into %s: %d bytes", list.n, dir, packfile, head.size);
+  if (compress) printf(" (%d bytes of files, %d compressed)", raw, n_compressed);
+  printf("\n");
+
+  for (i = 0; i < list.n; i++) free(list.paths[i]);
+  free(list.paths);
+  free(entries);
+  free(buckets);
+  free(buffer);
+  free(packed);
+}
+
+/* findFiles
+   Adds every file in a directory, and the directories in it, to the list,
+   by its path from the data directory.  Hidden files, editor backups
+   ending in ~, and out of date files (see isStale) are left out.
+*/
+void
+findFiles(PackList *list, char *dir, char *path)
+{
+  DIR *d;
+  struct dirent *ent;
+  char *dirname;
+
+  MALLOC(dirname, (strlen(dir) + strlen(path) + 1) * sizeof(char));
+  strcpy(dirname, dir);
+  strcat(dirname, path);
+  if ((d = opendir(dirname)) == NULL)
+    {
+      fprintf(stderr, "Unable to open directory: %s\n", dirname);
+      exit(0);
+    }
+
+  while ((ent = readdir(d)) != NULL)
+    {
+      struct stat st;
+      char *sub, *filename;
+      int len = strlen(ent->d_name);
+
+      if (ent->d_name[0] == '.' || ent->d_name[len - 1] == '~') continue;
+
+      MALLOC(sub, (strlen(path) + len + 2) * sizeof(char));
+      strcpy(sub, path);
+      strcat(sub, ent->d_name);
+      MALLOC(filename, (strlen(dir) + strlen(sub) + 1) * sizeof(char));
+      strcpy(filename, dir);
+      strcat(filename, sub);
+
+      if (stat(filename, &st) != 0)
+	free(sub);
+      else if (S_ISDIR(st.st_mode))
+	{
+	  strcat(sub, "/");
+	  findFiles(list, dir, sub);
+	  free(sub);
+	}
+      else if (S_ISREG(st.st_mode) && !isStale(dir, sub))
+	{
+	  if (list->n == list->max)
+	    {
+	      list->max = (list->max == 0) ? 64 : list->max * 2;
+	      if ((list->paths = realloc(list->paths, list->max * sizeof(char *))) == NULL)
+		{
+		  fprintf(stderr, "Unable to allocate memory.\n");
+		  exit(0);
+		}
+	    }
+	  list->paths[list->n++] = sub;
+	}
+      else free(sub);
+      free(filename);
+    }
+
+  closedir(d);
+  free(dirname);
+}
+
+/* isStale
+   A file made from another one is named after it, with something on the
+   end, like demo.area.bin from demo.area.  If the file it's made from is
+   newer, it's out of date, and this returns true.
+*/
+int
+isStale(char *dir, char *path)
+{
+  struct stat st, source_st;
+  char *filename, *dot;
+  int stale = 0;
+
+  MALLOC(filename, (strlen(dir) + strlen(path) + 1) * sizeof(char));
+  strcpy(filename, dir);
+  strcat(filename, path);
+
+  if ((dot = strrchr(filename, '.')) != NULL && strchr(dot, '/') == NULL &&
+      stat(filename, &st) == 0)
+    {
+      *dot = '\0';
+      if (stat(filename, &source_st) == 0 && S_ISREG(source_st.st_mode) &&
+	  source_st.st_mtime > st.st_mtime)
+	{
+	  fprintf(stderr, "Warning: leaving %s%s out of the pack, it's older than %s\n", dir, path, filename);
+	  stale = 1;
+	}
+    }
+
+  free(filename);
+  return stale;
+}
+
+/* comparePaths
+   For sorting the paths with qsort.
+*/
+int
+comparePaths(const void *a, const void *b)
+{
+  return strcmp(*(char **) a, *(char **) b);
+}
@@ -0,0 +1,84 @@
+#ifndef __DEFINED_PACK_H
+#define __DEFINED_PACK_H
+
+#include <stdio.h>
+#include "SDL.h"
+#include "defs.h"
+
+/* The pack module reads game data out of one resource pack instead of the
+   data directory, when there is one.  The pack is mapped into memory once,
+   and files in it are found through a hash table of their paths, so loading
+   doesn't open, stat and read hundreds of little files.  Images and sounds
+   are loaded straight out of the mapped pack.
+
+   Files in a pack can be compressed, in blocks, so a big file is unpacked
+   by all the loading threads at once.  Compressed files are unpacked into
+   memory the first time they're asked for (or ahead of time, with
+   pak_prefetch()), and kept until the pack is flushed, which is done once
+   everything is loaded.  Files that don't get any smaller, like PNGs, are
+   stored as they are and read in place.
+
+   giraffe -p builds the pack from the data directory, and giraffe -pz
+   builds a compressed one. */
+
+/* Where the pack is, and what it's built from */
+#define PACK_FILE "data.pak"
+
+/* The pack format.  All of it is 4 byte numbers, in the byte order of the
+   machine that built it, and everything after the header is found by its
+   offset from the start of the file:
+
+   the header
+   the hash table, n_buckets entry numbers
+   the entries
+   the paths, each ended with a 0
+   the files themselves, each starting on a multiple of PACK_ALIGN
+
+   A compressed file starts with a table of where each of its PACK_BLOCK
+   byte blocks ends (from the end of the table), and then the blocks, each
+   compressed by itself in the LZ4 block format.  A block that's the same
+   size compressed as it would be unpacked is stored as it is.
+*/
+#define PACK_MAGIC "GPAK"
+#define PACK_VERSION 2
+#define PACK_ALIGN 16
+#define PACK_NONE 0xffffffff
+#define PACK_BLOCK 65536
+
+/* Files are only compressed if it saves at least 1/PACK_SAVING of them */
+#define PACK_SAVING 16
+
+typedef struct pack_header_struct
+{
+  char magic[4];       /* PACK_MAGIC */
+  Uint32 version;      /* PACK_VERSION, which also shows the byte order */
+  Uint32 size;         /* The size of the whole file */
+  Uint32 n_buckets, buckets;  /* A power of 2, and where they are */
+  Uint32 n_entries, entries;
+  Uint32 paths_size, paths;
+} PackHeader;
+
+/* A file in the pack */
+typedef struct pack_entry_struct
+{
+  Uint32 hash;         /* The hash of its path */
+  Uint32 path;         /* Its path from the data directory, in the paths */
+  Uint32 offset;       /* Where it is in the pack */
+  Uint32 size;         /* How big it is */
+  Uint32 packed;       /* How much room it takes up in the pack.  If it's
+			  the same as size, the file isn't compressed. */
+  Uint32 next;         /* The next entry in the same bucket, or PACK_NONE */
+} PackEntry;
+
+extern int pak_open(char *packfile, char *prefix);
+extern void pak_close(void);
+extern int pak_isOpen(void);
+extern void *pak_find(char *file, int *size);
+extern SDL_RWops *pak_openRW(char *file);
+extern void *pak_copy(char *file, int *size);
+extern void pak_prefetch(char **paths, int n);
+extern void pak_flush(void);
+extern void pak_evict(char *path);
+extern void pak_build(char *dir, char *packfile, int compress);
+
+#endif /* __DEFINED_PACK_H */
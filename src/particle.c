@@ -0,0 +1,187 @@
+#include "particle.h"
+#include "map.h"
+#include <math.h>
+
+/* The pool of particles */
+static Particles parts;
+
+/* Private function prototypes */
+static void integrate(float *restrict x, float *restrict y,
+		      float *restrict vx, float *restrict vy,
+		      float *restrict life, int n, float g, Time dt);
+static void killPart(int i);
+
+/* part_init
+   Allocates the particle pool.
+*/
+void
+part_init(void)
+{
+  extern Particles parts;
+
+  parts.n = 0;
+  parts.x = (float *) dyn_1dArrayAlloc(PART_MAX, sizeof(float));
+  parts.y = (float *) dyn_1dArrayAlloc(PART_MAX, sizeof(float));
+  parts.vx = (float *) dyn_1dArrayAlloc(PART_MAX, sizeof(float));
+  parts.vy = (float *) dyn_1dArrayAlloc(PART_MAX, sizeof(float));
+  parts.life = (float *) dyn_1dArrayAlloc(PART_MAX, sizeof(float));
+  parts.layer = (int *) dyn_1dArrayAlloc(PART_MAX, sizeof(int));
+  parts.collide = (int *) dyn_1dArrayAlloc(PART_MAX, sizeof(int));
+  parts.color = (Uint32 *) dyn_1dArrayAlloc(PART_MAX, sizeof(Uint32));
+}
+
+/* part_free
+   Frees the particle pool.
+*/
+void
+part_free(void)
+{
+  extern Particles parts;
+
+  dyn_1dArrayFree(parts.x);
+  dyn_1dArrayFree(parts.y);
+  dyn_1dArrayFree(parts.vx);
+  dyn_1dArrayFree(parts.vy);
+  dyn_1dArrayFree(parts.life);
+  dyn_1dArrayFree(parts.layer);
+  dyn_1dArrayFree(parts.collide);
+  dyn_1dArrayFree(parts.color);
+  parts.n = 0;
+}
+
+/* part_emit
+   Throws out n particles of a color from a point, in all directions at up
+   to the given speed.  If the pool fills up, the rest are dropped.
+*/
+void
+part_emit(int layer, Point pos, int n, float speed, Time life, Color c, int collide)
+{
+  extern Particles parts;
+  Uint32 color = gfx_mapColor(c.r, c.g, c.b);
+
+  for (; n > 0 && parts.n < PART_MAX; n--)
+    {
+      int i = parts.n++;
+      float angle = 2 * M_PI * rand() / (RAND_MAX + 1.0);
+      float v = speed * (.5 + .5 * rand() / (RAND_MAX + 1.0));
+
+      parts.x[i] = pos.x;
+      parts.y[i] = pos.y;
+      parts.vx[i] = v * cos(angle);
+      parts.vy[i] = v * sin(angle);
+      parts.life[i] = life * (.5 + .5 * rand() / (RAND_MAX + 1.0));
+      parts.layer[i] = layer;
+      parts.collide[i] = collide;
+      parts.color[i] = color;
+    }
+}
+
+/* integrate
+   Moves particles along and ages them.  The arrays never overlap, and the
+   loop has no branches, so the compiler is free to vectorize it.
+*/
+void
+integrate(float *restrict x, float *restrict y,
+	  float *restrict vx, float *restrict vy,
+	  float *restrict life, int n, float g, Time dt)
+{
+  int i;
+  for (i = 0; i < n; i++)
+    {
+      vy[i] += g * dt;
+      x[i] += vx[i] * dt;
+      y[i] += vy[i] * dt;
+      life[i] -= dt;
+    }
+}
+
+/* killPart
+   Gets rid of a particle by moving the last one into its place.
+*/
+void
+killPart(int i)
+{
+  extern Particles parts;
+  int last = --parts.n;
+
+  parts.x[i] = parts.x[last];
+  parts.y[i] = parts.y[last];
+  parts.vx[i] = parts.vx[last];
+  parts.vy[i] = parts.vy[last];
+  parts.life[i] = parts.life[last];
+  parts.layer[i] = parts.layer[last];
+  parts.collide[i] = parts.collide[last];
+  parts.color[i] = parts.color[last];
+}
+
+/* part_run
+   Moves all of the particles, bounces the ones that collide off of solid
+   tiles, and gets rid of the ones which have died or left their layer.
+*/
+void
+part_run(Time dt)
+{
+  extern Particles parts;
+  int i = 0;
+
+  integrate(parts.x, parts.y, parts.vx, parts.vy, parts.life, parts.n, PART_GRAVITY, dt);
+
+  while (i < parts.n)
+    {
+      int l = parts.layer[i];
+      int map_x, map_y;
+
+      if (parts.life[i] <= 0 || parts.x[i] < 0 || parts.y[i] < 0 ||
+	  parts.x[i] >= map_mapToRealX(map_getLayerWidth(l)) ||
+	  parts.y[i] >= map_mapToRealY(map_getLayerHeight(l)))
+	{
+	  killPart(i);
+	  continue;
+	}
+
+      map_x = map_realToMapX((int) parts.x[i]);
+      map_y = map_realToMapY((int) parts.y[i]);
+
+      /* Landed in a solid tile?  Step back out of it and bounce off
+	 whichever way we came in: */
+      if (parts.collide[i] && map_tileIsSolid(l, map_x, map_y))
+	{
+	  float old_x = parts.x[i] - parts.vx[i] * dt;
+	  float old_y = parts.y[i] - parts.vy[i] * dt;
+	  int bounced = 0;
+
+	  if (map_realToMapX((int) old_x) != map_x)
+	    {
+	      parts.vx[i] = -parts.vx[i] * PART_BOUNCE;
+	      bounced = 1;
+	    }
+	  if (map_realToMapY((int) old_y) != map_y)
+	    {
+	      parts.vy[i] = -parts.vy[i] * PART_BOUNCE;
+	      bounced = 1;
+	    }
+
+	  /* It was born inside the tile, there's no way out */
+	  if (!bounced)
+	    {
+	      killPart(i);
+	      continue;
+	    }
+
+	  parts.x[i] = old_x;
+	  parts.y[i] = old_y;
+	}
+
+      i++;
+    }
+}
+
+/* part_getParticles
+   Returns the pool of particles, for rendering.
+*/
+Particles *
+part_getParticles(void)
+{
+  extern Particles parts;
+  return &parts;
+}
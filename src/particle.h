@@ -0,0 +1,43 @@
+#ifndef __DEFINED_PARTICLE_H
+#define __DEFINED_PARTICLE_H
+
+#include "defs.h"
+#include "timer.h"
+#include "graphics.h"
+#include "dynarray.h"
+#include "SDL.h"
+
+/* The most particles there can be at once */
+#define PART_MAX 8192
+
+/* Particles are drawn as squares this many pixels across */
+#define PART_SIZE 3
+
+/* How fast particles fall, and how much of their speed they keep when
+   they bounce off a solid tile */
+#define PART_GRAVITY 600
+#define PART_BOUNCE .4
+
+/* Particles are little colored squares for visual effects, like sparks
+   from an explosion.  They don't collide with objects or send signals.
+   They are kept in one pool, as a structure of arrays, with the live ones
+   packed at the front so that they can be moved in tight loops. */
+typedef struct particles_struct
+{
+  int n;              /* The number of live particles */
+
+  float *x, *y;       /* The position, in real coordinates */
+  float *vx, *vy;     /* The velocity */
+  float *life;        /* How much longer it has to live */
+  int *layer;
+  int *collide;       /* Does it bounce off solid tiles? */
+  Uint32 *color;      /* Its color, as a screen pixel value */
+} Particles;
+
+extern void part_init(void);
+extern void part_free(void);
+extern void part_emit(int layer, Point pos, int n, float speed, Time life, Color c, int collide);
+extern void part_run(Time dt);
+extern Particles *part_getParticles(void);
+
+#endif /* __DEFINED_PARTICLE_H */
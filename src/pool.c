@@ -0,0 +1,286 @@
+#include "pool.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+static int n_workers = 0;
+static SDL_Thread *workers[POOL_MAX];
+
+/* The lock and conditions that guard the run that's going */
+static SDL_mutex *lock = NULL;
+static SDL_cond *work_cond, *done_cond;
+static int quitting;
+
+/* The run that's going: the job, and the things it's done to */
+static PoolJob run_job;
+static char *run_things;
+static int run_n = 0, run_size;
+static int run_next = 0;       /* The next thing to hand out */
+static int run_done = 0;       /* How many are finished */
+
+/* A job posted to be done in the background, and what to do with what it
+   did once it's done */
+typedef struct posted_struct
+{
+  PoolJob job, finish;
+  void *thing;
+  struct posted_struct *next;
+} Posted;
+
+/* The posted jobs waiting for a worker, and the ones waiting to be
+   finished, oldest first */
+static Posted *todo_first = NULL, *todo_last = NULL;
+static Posted *done_first = NULL, *done_last = NULL;
+static int n_posted = 0;       /* How many haven't been finished */
+
+/* Private function prototypes */
+static void startWorkers(void);
+static int work(void *data);
+static void doJobs(void);
+static void doPosted(void);
+
+/* startWorkers
+   Starts a worker for each processor after the first, which is the one
+   that runs the game.
+*/
+void
+startWorkers(void)
+{
+  extern SDL_mutex *lock;
+  extern SDL_cond *work_cond, *done_cond;
+  extern int n_workers;
+  int n = POOL_DEFAULT;
+
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+  if (sysconf(_SC_NPROCESSORS_ONLN) > 0) n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+#endif
+  if (n > POOL_MAX) n = POOL_MAX;
+
+  lock = SDL_CreateMutex();
+  work_cond = SDL_CreateCond();
+  done_cond = SDL_CreateCond();
+  quitting = 0;
+
+  for (n_workers = 0; n_workers < n; n_workers++)
+    {
+      if ((workers[n_workers] = SDL_CreateThread(work, NULL)) == NULL)
+	{
+	  fprintf(stderr, "Unable to start a loading thread: %s\n", SDL_GetError());
+	  exit(0);
+	}
+    }
+}
+
+/* work
+   A worker thread.  It waits for a run to start, and helps with it, or
+   does posted jobs while there's no run going.
+*/
+int
+work(void *data)
+{
+  SDL_LockMutex(lock);
+  while (1)
+    {
+      while (run_next >= run_n && todo_first == NULL && !quitting)
+	SDL_CondWait(work_cond, lock);
+      if (quitting) break;
+      if (run_next < run_n) doJobs();
+      else doPosted();
+    }
+  SDL_UnlockMutex(lock);
+  return 0;
+}
+
+/* doJobs
+   Takes things from the run that's going and does them, until there are
+   none left to take.  Called with the lock held.
+*/
+void
+doJobs(void)
+{
+  while (run_next < run_n)
+    {
+      int i = run_next++;
+
+      SDL_UnlockMutex(lock);
+      run_job(run_things + i * run_size);
+      SDL_LockMutex(lock);
+
+      if (++run_done == run_n) SDL_CondBroadcast(done_cond);
+    }
+}
+
+/* doPosted
+   Takes the oldest posted job and does it, and leaves it to be finished.
+   Called with the lock held.
+*/
+void
+doPosted(void)
+{
+  extern Posted *todo_first, *todo_last, *done_first, *done_last;
+  Posted *p = todo_first;
+
+  todo_first = p->next;
+  if (todo_first == NULL) todo_last = NULL;
+
+  SDL_UnlockMutex(lock);
+  p->job(p->thing);
+  SDL_LockMutex(lock);
+
+  p->next = NULL;
+  if (done_last != NULL) done_last->next = p;
+  else done_first = p;
+  done_last = p;
+  SDL_CondBroadcast(done_cond);
+}
+
+/* pool_run
+   Does a job to each of n things in an array, where each is size bytes,
+   spread over the workers.  Returns when they're all done.  Jobs mustn't
+   touch anything another one might, and only one run can go at a time.
+*/
+void
+pool_run(PoolJob job, void *things, int n, int size)
+{
+  extern SDL_mutex *lock;
+
+  if (n <= 0) return;
+  if (lock == NULL) startWorkers();
+
+  SDL_LockMutex(lock);
+  run_job = job;
+  run_things = (char *) things;
+  run_size = size;
+  run_done = 0;
+  run_next = 0;
+  run_n = n;
+  SDL_CondBroadcast(work_cond);
+
+  /* Help out, then wait for the workers to finish what they took */
+  doJobs();
+  while (run_done < run_n) SDL_CondWait(done_cond, lock);
+  run_n = run_next = 0;
+  SDL_UnlockMutex(lock);
+}
+
+/* pool_post
+   Posts a job to be done to a thing in the background, while the game goes
+   on.  Once it's done, pool_finish() calls finish with the thing, on the
+   thread that calls that, so finish can do what only the main thread may.
+*/
+void
+pool_post(PoolJob job, PoolJob finish, void *thing)
+{
+  extern SDL_mutex *lock;
+  extern Posted *todo_first, *todo_last;
+  extern int n_posted;
+  Posted *p;
+
+  if (lock == NULL) startWorkers();
+
+  MALLOC(p, sizeof(Posted));
+  p->job = job;
+  p->finish = finish;
+  p->thing = thing;
+  p->next = NULL;
+
+  SDL_LockMutex(lock);
+  if (todo_last != NULL) todo_last->next = p;
+  else todo_first = p;
+  todo_last = p;
+  n_posted++;
+  SDL_CondSignal(work_cond);
+  SDL_UnlockMutex(lock);
+}
+
+/* pool_finish
+   Finishes the posted jobs that are done.  If wait is true, it does the
+   ones nobody's started and waits for the rest, so nothing's left going.
+   With no workers, posted jobs are only done here.
+*/
+void
+pool_finish(int wait)
+{
+  extern SDL_mutex *lock;
+  extern Posted *todo_first, *done_first, *done_last;
+  extern int n_workers, n_posted;
+  Posted *p;
+
+  if (lock == NULL) return;
+
+  SDL_LockMutex(lock);
+  while (1)
+    {
+      if (todo_first != NULL && (wait || n_workers == 0)) doPosted();
+
+      while ((p = done_first) != NULL)
+	{
+	  done_first = p->next;
+	  if (done_first == NULL) done_last = NULL;
+	  SDL_UnlockMutex(lock);
+	  p->finish(p->thing);
+	  free(p);
+	  SDL_LockMutex(lock);
+	  n_posted--;
+	}
+
+      if (n_posted == 0 || (!wait && (todo_first == NULL || n_workers > 0)))
+	break;
+      if (todo_first == NULL) SDL_CondWait(done_cond, lock);
+    }
+  SDL_UnlockMutex(lock);
+}
+
+/* pool_pending
+   Returns how many posted jobs haven't been finished yet.
+*/
+int
+pool_pending(void)
+{
+  extern SDL_mutex *lock;
+  extern int n_posted;
+  int n;
+
+  if (lock == NULL) return 0;
+  SDL_LockMutex(lock);
+  n = n_posted;
+  SDL_UnlockMutex(lock);
+  return n;
+}
+
+/* pool_nWorkers
+   How many threads pool_run() spreads work over, counting the one that
+   calls it.
+*/
+int
+pool_nWorkers(void)
+{
+  if (lock == NULL) startWorkers();
+  return n_workers + 1;
+}
+
+/* pool_free
+   Stops the workers.
+*/
+void
+pool_free(void)
+{
+  extern SDL_mutex *lock;
+  int i;
+
+  if (lock == NULL) return;
+  pool_finish(1);
+
+  SDL_LockMutex(lock);
+  quitting = 1;
+  SDL_CondBroadcast(work_cond);
+  SDL_UnlockMutex(lock);
+
+  for (i = 0; i < n_workers; i++) SDL_WaitThread(workers[i], NULL);
+  n_workers = 0;
+
+  SDL_DestroyCond(work_cond);
+  SDL_DestroyCond(done_cond);
+  SDL_DestroyMutex(lock);
+  lock = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef __DEFINED_POOL_H
+#define __DEFINED_POOL_H
+
+#include "defs.h"
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
+/* The pool module keeps a few worker threads for loading, to do the same
+   thing to a lot of things at once: pool_run() hands each thing in an array
+   to a job, spread over the workers and the thread that called it, and
+   returns when they're all done.  The workers are started the first time
+   there's something for them to do.  A job can also be posted to be done
+   in the background, and finished on the main thread by pool_finish()
+   once it's done. */
+
+/* The most workers there can be, and how many there are if the number of
+   processors can't be found out */
+#define POOL_MAX 8
+#define POOL_DEFAULT 3
+
+typedef void (*PoolJob)(void *thing);
+
+extern void pool_run(PoolJob job, void *things, int n, int size);
+extern void pool_post(PoolJob job, PoolJob finish, void *thing);
+extern void pool_finish(int wait);
+extern int pool_pending(void);
+extern int pool_nWorkers(void);
+extern void pool_free(void);
+
+#endif /* __DEFINED_POOL_H */
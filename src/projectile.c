@@ -0,0 +1,248 @@
+#include "projectile.h"
+#include "map.h"
+
+/* The definitions for object types are in this header: */
+#include "types/objtypes.h"
+extern struct obj_att_define *obj_defs[];
+
+/* The pool of projectiles */
+static Projectiles projs;
+
+/* The hits found during a frame */
+static ProjHit *hits;
+static int n_hits;
+
+/* Private function prototypes */
+static void killProj(int i);
+static void sendHits(void);
+
+/* proj_init
+   Allocates the projectile pool.  The sprites have to be loaded first.
+*/
+void
+proj_init(void)
+{
+  extern Projectiles projs;
+  extern ProjHit *hits;
+
+  projs.n = 0;
+  projs.x = (float *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(float));
+  projs.y = (float *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(float));
+  projs.vx = (float *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(float));
+  projs.vy = (float *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(float));
+  projs.age = (float *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(float));
+  projs.layer = (int *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(int));
+  projs.type = (int *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(int));
+  projs.w = (int *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(int));
+  projs.h = (int *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(int));
+  projs.mask = (int *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(int));
+  projs.anim = (AnimData **) dyn_1dArrayAlloc(PROJ_MAX, sizeof(AnimData *));
+
+  hits = (ProjHit *) dyn_1dArrayAlloc(PROJ_MAX, sizeof(ProjHit));
+}
+
+/* proj_free
+   Frees the projectile pool.
+*/
+void
+proj_free(void)
+{
+  extern Projectiles projs;
+  extern ProjHit *hits;
+
+  dyn_1dArrayFree(projs.x);
+  dyn_1dArrayFree(projs.y);
+  dyn_1dArrayFree(projs.vx);
+  dyn_1dArrayFree(projs.vy);
+  dyn_1dArrayFree(projs.age);
+  dyn_1dArrayFree(projs.layer);
+  dyn_1dArrayFree(projs.type);
+  dyn_1dArrayFree(projs.w);
+  dyn_1dArrayFree(projs.h);
+  dyn_1dArrayFree(projs.mask);
+  dyn_1dArrayFree(projs.anim);
+  dyn_1dArrayFree(hits);
+  projs.n = 0;
+}
+
+/* proj_fire
+   Fires a projectile acting as an object of the given type from a position
+   (its center) with a velocity.  If the pool is full, nothing happens.
+*/
+void
+proj_fire(int layer, Point pos, Velocity vel, int type)
+{
+  extern Projectiles projs;
+  int i = projs.n;
+
+  if (projs.n == PROJ_MAX) return;
+  projs.n++;
+
+  projs.x[i] = pos.x;
+  projs.y[i] = pos.y;
+  projs.vx[i] = vel.x;
+  projs.vy[i] = vel.y;
+  projs.age[i] = 0;
+  projs.layer[i] = layer;
+  projs.type[i] = type;
+  projs.w[i] = obj_defs[type]->w;
+  projs.h[i] = obj_defs[type]->h;
+  projs.mask[i] = obj_defs[type]->collides;
+  projs.anim[i] = obj_getTypeAnimData(type);
+}
+
+/* killProj
+   Gets rid of a projectile by moving the last one into its place.
+*/
+void
+killProj(int i)
+{
+  extern Projectiles projs;
+  int last = --projs.n;
+
+  projs.x[i] = projs.x[last];
+  projs.y[i] = projs.y[last];
+  projs.vx[i] = projs.vx[last];
+  projs.vy[i] = projs.vy[last];
+  projs.age[i] = projs.age[last];
+  projs.layer[i] = projs.layer[last];
+  projs.type[i] = projs.type[last];
+  projs.w[i] = projs.w[last];
+  projs.h[i] = projs.h[last];
+  projs.mask[i] = projs.mask[last];
+  projs.anim[i] = projs.anim[last];
+}
+
+/* proj_run
+   Moves all of the projectiles.  Each one's path this frame is tested
+   against the tiles and objects around it, and it stops at the first thing
+   it runs into.  Projectiles die when they hit an object or a solid tile,
+   or leave their layer.
+*/
+void
+proj_run(Time dt)
+{
+  extern Projectiles projs;
+  extern ProjHit *hits;
+  extern int n_hits;
+  int i = 0;
+
+  n_hits = 0;
+
+  while (i < projs.n)
+    {
+      Line path;
+      Point tile_pos;
+      Object *obj;
+      float t;
+      int hit;
+
+      path.p1.x = rint(projs.x[i]);
+      path.p1.y = rint(projs.y[i]);
+      path.p2.x = rint(projs.x[i] + projs.vx[i] * dt);
+      path.p2.y = rint(projs.y[i] + projs.vy[i] * dt);
+
+      /* Off the edge of the layer? */
+      if (path.p2.x < 0 || path.p2.y < 0 ||
+	  path.p2.x >= map_mapToRealX(map_getLayerWidth(projs.layer[i])) ||
+	  path.p2.y >= map_mapToRealY(map_getLayerHeight(projs.layer[i])))
+	{
+	  killProj(i);
+	  continue;
+	}
+
+      hit = col_castSegment(projs.layer[i], path, projs.mask[i], &tile_pos, &obj, &t);
+
+      if (hit != -1)
+	{
+	  ProjHit *h = &hits[n_hits++];
+	  h->proj_type = projs.type[i];
+	  h->layer = projs.layer[i];
+	  h->type = hit;
+	  if (hit == OBJ_TYPE)
+	    h->other.obj = obj;
+	  else
+	    h->other.tile_pos = tile_pos;
+
+	  if (hit == OBJ_TYPE || map_tileIsSolid(projs.layer[i], tile_pos.x, tile_pos.y))
+	    {
+	      killProj(i);
+	      continue;
+	    }
+	}
+
+      projs.x[i] += projs.vx[i] * dt;
+      projs.y[i] += projs.vy[i] * dt;
+      projs.age[i] += dt;
+      i++;
+    }
+
+  sendHits();
+}
+
+/* sendHits
+   Sends hit signals for everything the projectiles ran into this frame.
+*/
+void
+sendHits(void)
+{
+  extern ProjHit *hits;
+  extern int n_hits;
+  int i;
+
+  for (i = 0; i < n_hits; i++)
+    {
+      Signal sig;
+      sig.type = HIT_SIG;
+      sig.sig.hit.type = OBJ_TYPE;
+      sig.sig.hit.u.obj_type = hits[i].proj_type;
+
+      if (hits[i].type == OBJ_TYPE)
+	obj_sendObjSignal(hits[i].other.obj, &sig);
+      else
+	map_sendTileSignal(hits[i].layer, hits[i].other.tile_pos.x, hits[i].other.tile_pos.y, &sig);
+    }
+  n_hits = 0;
+}
+
+/* proj_getProjectiles
+   Returns the pool of projectiles, for rendering.
+*/
+Projectiles *
+proj_getProjectiles(void)
+{
+  extern Projectiles projs;
+  return &projs;
+}
+
+/* proj_getGfx
+   Returns the frame a projectile is currently showing.  All projectiles
+   play their animation from the start.
+*/
+Frame *
+proj_getGfx(int i)
+{
+  extern Projectiles projs;
+  AnimData *a = projs.anim[i];
+  int frame = (a->def_delay > 0) ? anim_frameAfter(a, (long) (projs.age[i] / a->def_delay)) : 0;
+
+  anim_needGfx(a);
+  return &a->frames[frame];
+}
+
+/* proj_getGfxPos
+   Returns the top left point of a projectile's graphic, in real
+   coordinates.
+*/
+Point
+proj_getGfxPos(int i)
+{
+  extern Projectiles projs;
+  AnimData *a = projs.anim[i];
+  int frame = (a->def_delay > 0) ? anim_frameAfter(a, (long) (projs.age[i] / a->def_delay)) : 0;
+  Point p;
+
+  p.x = rint(projs.x[i]) - projs.w[i] / 2 + a->frames[frame].offset.x;
+  p.y = rint(projs.y[i]) - projs.h[i] / 2 + a->frames[frame].offset.y;
+  return p;
+}
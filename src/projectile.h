@@ -0,0 +1,54 @@
+#ifndef __DEFINED_PROJECTILE_H
+#define __DEFINED_PROJECTILE_H
+
+#include "defs.h"
+#include "object.h"
+#include "collision.h"
+#include "signal.h"
+#include "timer.h"
+#include "animation.h"
+
+/* The most projectiles there can be at once */
+#define PROJ_MAX 4096
+
+/* Projectiles (bullets and such) are too many and too simple to be objects.
+   They are kept in one pool, as a structure of arrays, with the ones in use
+   packed at the front.  A projectile acts as an object of some type when
+   it hits things, and it looks like that type's sprite. */
+typedef struct projectiles_struct
+{
+  int n;             /* The number of projectiles in use */
+
+  float *x, *y;      /* The position of the center, in real coordinates */
+  float *vx, *vy;    /* The velocity */
+  float *age;        /* How long it's been flying, for animating */
+  int *layer;
+  int *type;         /* The type of object it acts as */
+  int *w, *h;        /* Its dimensions, from the type */
+  int *mask;         /* The categories it hits, from the type */
+  AnimData **anim;   /* The animation it shows, from the type */
+} Projectiles;
+
+/* What a projectile ran into.  They are collected while the projectiles
+   move, and the signals are sent afterwards all together. */
+typedef struct proj_hit_struct
+{
+  int proj_type;
+  int layer;
+  int type;          /* TILE_TYPE or OBJ_TYPE */
+  union
+  {
+    Object *obj;
+    Point tile_pos;
+  } other;
+} ProjHit;
+
+extern void proj_init(void);
+extern void proj_free(void);
+extern void proj_fire(int layer, Point pos, Velocity vel, int type);
+extern void proj_run(Time dt);
+extern Projectiles *proj_getProjectiles(void);
+extern Frame *proj_getGfx(int i);
+extern Point proj_getGfxPos(int i);
+
+#endif /* __DEFINED_PROJECTILE_H */
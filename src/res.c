@@ -0,0 +1,284 @@
+#include "res.h"
+#include "map.h"
+#include "object.h"
+#include "audio.h"
+
+/* Everything that's been asked for, loaded or not.  A thing keeps its
+   place once it's been asked for, so handles stay good, and is loaded
+   again there if it's asked for after it's been freed. */
+typedef struct resource_struct
+{
+  int kind;
+  Name file;          /* What it was loaded from */
+  void *data;         /* NULL if it isn't loaded */
+  int refs;           /* How many are using it */
+  long bytes;         /* About how much memory it took up when it was last
+			 measured, and is counted for in stats.bytes */
+  Uint32 released;    /* When it was last given back, for freeing the
+			 oldest first */
+} Resource;
+
+/* How to load, free and size up each kind */
+typedef struct res_kind_struct
+{
+  char *name;
+  ResLoad load;
+  ResFree free;
+  ResSize size;
+} ResKind;
+
+static ResKind kinds[N_RES_KINDS] =
+  {
+    {"tileset", map_makeTileset, map_destroyTileset, map_tilesetBytes},
+    {"sprites", obj_makeSprites, obj_destroySprites, obj_spritesBytes},
+    {"sounds", aud_makeSounds, aud_destroySounds, aud_soundsBytes},
+    {"music", aud_makeMusic, aud_destroyMusic, aud_musicBytes}
+  };
+
+static Resource *resources = NULL;
+static int n_resources = 0, max_resources = 0;
+/* Where each one is, by file, for each kind */
+static NameMap res_names[N_RES_KINDS];
+/* Counts up each time something's given back */
+static Uint32 res_clock = 0;
+/* stats.bytes is kept as things are loaded, given back and freed, so
+   trim() doesn't have to add everything up again each time it frees one */
+static ResStats stats = {0, 0, 0, 0, 0, 0, RES_BUDGET};
+
+/* Private function prototypes */
+static void unload(Resource *r);
+static void measure(Resource *r);
+static void measureAll(void);
+static void trim(void);
+
+/* res_acquire
+   Gets something of a kind, loaded from a file, loading it if it isn't in
+   the cache.  It's kept until it's given back with res_release().
+*/
+ResHandle
+res_acquire(int kind, char *file)
+{
+  extern Resource *resources;
+  extern int n_resources, max_resources;
+  extern NameMap res_names[];
+  extern ResKind kinds[];
+  extern ResStats stats;
+  Name name = nam_intern(file);
+  Resource *r;
+  int i;
+
+  if ((i = nam_get(&res_names[kind], name)) < 0)
+    {
+      if (n_resources == max_resources)
+	{
+	  max_resources = max_resources ? max_resources * 2 : 16;
+	  if ((resources = realloc(resources, max_resources * sizeof(Resource))) == NULL)
+	    {
+	      fprintf(stderr, "Unable to allocate memory.\n");
+	      exit(0);
+	    }
+	}
+      i = n_resources++;
+      resources[i].kind = kind;
+      resources[i].file = name;
+      resources[i].data = NULL;
+      resources[i].refs = 0;
+      resources[i].bytes = 0;
+      resources[i].released = 0;
+      nam_set(&res_names[kind], name, i);
+    }
+
+  r = &resources[i];
+  if (r->data == NULL)
+    {
+      r->data = kinds[kind].load(file);
+      measure(r);
+      stats.misses++;
+      stats.resident++;
+    }
+  else stats.hits++;
+
+  if (r->refs++ == 0) stats.in_use++;
+  return i;
+}
+
+/* res_get
+   Returns the thing a handle is for.
+*/
+void *
+res_get(ResHandle h)
+{
+  extern Resource *resources;
+
+  return (h == RES_NONE) ? NULL : resources[h].data;
+}
+
+/* res_release
+   Gives back something that was acquired.  When nobody's using it, it's
+   kept in case it's wanted again, unless the cache is over its budget.
+*/
+void
+res_release(ResHandle h)
+{
+  extern Resource *resources;
+  extern Uint32 res_clock;
+  extern ResStats stats;
+  Resource *r;
+
+  if (h == RES_NONE) return;
+  r = &resources[h];
+  if (r->refs == 0) return;
+  if (--r->refs == 0)
+    {
+      r->released = ++res_clock;
+      stats.in_use--;
+
+      /* It may have grown while it was being used */
+      measure(r);
+      trim();
+    }
+}
+
+/* unload
+   Frees a thing, leaving its place in the cache.
+*/
+void
+unload(Resource *r)
+{
+  extern ResKind kinds[];
+  extern ResStats stats;
+
+  kinds[r->kind].free(r->data);
+  r->data = NULL;
+  stats.bytes -= r->bytes;
+  r->bytes = 0;
+  stats.resident--;
+}
+
+/* measure
+   Works out again about how much memory a loaded thing takes up, and
+   changes the total by the difference.  Things can grow after they're
+   loaded, as more of what's in them is.
+*/
+void
+measure(Resource *r)
+{
+  extern ResKind kinds[];
+  extern ResStats stats;
+  long bytes = kinds[r->kind].size(r->data);
+
+  stats.bytes += bytes - r->bytes;
+  r->bytes = bytes;
+}
+
+/* measureAll
+   Measures everything that's loaded, so the total is up to date.
+*/
+void
+measureAll(void)
+{
+  extern Resource *resources;
+  extern int n_resources;
+  int i;
+
+  for (i = 0; i < n_resources; i++)
+    if (resources[i].data != NULL) measure(&resources[i]);
+}
+
+/* trim
+   Frees the things nobody's using, the ones given back longest ago first,
+   until the cache is under its budget.  Things being used are never
+   freed, even if they're over the budget by themselves.
+*/
+void
+trim(void)
+{
+  extern Resource *resources;
+  extern int n_resources;
+  extern ResStats stats;
+  int i, oldest;
+
+  while (stats.bytes > stats.budget)
+    {
+      oldest = -1;
+      for (i = 0; i < n_resources; i++)
+	if (resources[i].data != NULL && resources[i].refs == 0 &&
+	    (oldest < 0 || resources[i].released < resources[oldest].released))
+	  oldest = i;
+      if (oldest < 0) return;
+
+      unload(&resources[oldest]);
+      stats.evictions++;
+    }
+}
+
+/* res_setBudget
+   Sets how much memory the cache can take up before it frees things
+   nobody's using.  A budget of 0 frees them as soon as they're given back.
+*/
+void
+res_setBudget(long bytes)
+{
+  extern ResStats stats;
+
+  stats.budget = bytes;
+  trim();
+}
+
+/* res_getStats
+   Copies out how well the cache is doing and how much it's holding.
+*/
+void
+res_getStats(ResStats *s)
+{
+  extern ResStats stats;
+
+  measureAll();
+  *s = stats;
+}
+
+/* res_printStats
+   Prints the cache's stats, and everything that's loaded.
+*/
+void
+res_printStats(void)
+{
+  extern Resource *resources;
+  extern int n_resources;
+  extern ResKind kinds[];
+  extern ResStats stats;
+  int i;
+
+  measureAll();
+  printf("Cache: %d hits, %d misses, %d evicted, %d loaded (%d in use), %ld of %ld kb\n",
+	 stats.hits, stats.misses, stats.evictions, stats.resident,
+	 stats.in_use, stats.bytes / 1024, stats.budget / 1024);
+  for (i = 0; i < n_resources; i++)
+    if (resources[i].data != NULL)
+      printf("  %s %s: %ld kb, %d refs\n", kinds[resources[i].kind].name,
+	     nam_string(resources[i].file),
+	     resources[i].bytes / 1024,
+	     resources[i].refs);
+}
+
+/* res_free
+   Frees everything in the cache, whether it's being used or not, and
+   forgets it.  Handles can't be used after this.
+*/
+void
+res_free(void)
+{
+  extern Resource *resources;
+  extern int n_resources, max_resources;
+  extern NameMap res_names[];
+  extern ResStats stats;
+  int i;
+
+  for (i = 0; i < n_resources; i++)
+    if (resources[i].data != NULL) unload(&resources[i]);
+  free(resources);
+  resources = NULL;
+  n_resources = max_resources = 0;
+  for (i = 0; i < N_RES_KINDS; i++) nam_freeMap(&res_names[i]);
+  stats.in_use = 0;
+}
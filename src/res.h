@@ -0,0 +1,64 @@
+#ifndef __DEFINED_RES_H
+#define __DEFINED_RES_H
+
+#include "SDL.h"
+#include "defs.h"
+#include "names.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/* The res module keeps the things an area loads (its tileset, the sprites,
+   the sounds and its music) in a cache, by kind and by the file they were
+   loaded from.  A module asks for one with res_acquire() and gets a handle,
+   and gives it back with res_release() when it's done.  Something nobody's
+   using is kept, so the next area that uses the same tileset or music gets
+   it for nothing, until the cache is over its memory budget, when the ones
+   that were given back longest ago are freed first. */
+
+/* The kinds of things that are cached.  res.c knows how to load and free
+   each kind. */
+enum
+  {
+    RES_TILESET,
+    RES_SPRITES,
+    RES_SOUNDS,
+    RES_MUSIC,
+    N_RES_KINDS
+  };
+
+/* Where something is in the cache.  It stays the same while the program
+   runs, even if the thing is freed and loaded again. */
+typedef int ResHandle;
+
+/* The handle of nothing */
+#define RES_NONE (-1)
+
+/* How much memory things nobody's using can take before they're freed */
+#define RES_BUDGET (64 * 1024 * 1024)
+
+/* Loads something of a kind from a file, frees it, and says about how
+   much memory it takes up */
+typedef void *(*ResLoad)(char *file);
+typedef void (*ResFree)(void *data);
+typedef long (*ResSize)(void *data);
+
+typedef struct res_stats_struct
+{
+  int hits;          /* Asked for and already there */
+  int misses;        /* Asked for and loaded */
+  int evictions;     /* Freed to stay under the budget */
+  int resident;      /* How many things are loaded */
+  int in_use;        /* How many of them someone's using */
+  long bytes;        /* About how much memory they take up */
+  long budget;
+} ResStats;
+
+extern ResHandle res_acquire(int kind, char *file);
+extern void *res_get(ResHandle h);
+extern void res_release(ResHandle h);
+extern void res_setBudget(long bytes);
+extern void res_getStats(ResStats *s);
+extern void res_printStats(void);
+extern void res_free(void);
+
+#endif /* __DEFINED_RES_H */
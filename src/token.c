@@ -0,0 +1,254 @@
+#include "token.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+/* Private function prototypes */
+static void skipSpace(Tokenizer *t);
+static void startText(Tokenizer *t, char *file);
+
+/* tok_open
+   Reads a whole file in, ready to be tokenized.
+*/
+void
+tok_open(Tokenizer *t, char *file)
+{
+  if (!tok_tryOpen(t, file)) exit(0);
+}
+
+/* tok_tryOpen
+   Reads a whole file in, ready to be tokenized, and returns true, or says
+   why it couldn't and returns false.
+*/
+int
+tok_tryOpen(Tokenizer *t, char *file)
+{
+  FILE *inf;
+  long size;
+
+  if ((inf = fopen(file, "rb")) == NULL)
+    {
+      fprintf(stderr, "Unable to open file: %s\n", file);
+      return 0;
+    }
+  fseek(inf, 0, SEEK_END);
+  size = ftell(inf);
+  rewind(inf);
+
+  MALLOC(t->text, size + 1);
+  if (fread(t->text, 1, size, inf) != size)
+    {
+      fprintf(stderr, "Unable to read file: %s\n", file);
+      free(t->text);
+      fclose(inf);
+      return 0;
+    }
+  fclose(inf);
+  t->text[size] = '\0';
+  t->size = size;
+
+  startText(t, file);
+  return 1;
+}
+
+/* tok_openMem
+   Gets a file that's already in memory ready to be tokenized.  It's copied,
+   because strings are ended in place as they're read.
+*/
+void
+tok_openMem(Tokenizer *t, char *file, void *data, int size)
+{
+  MALLOC(t->text, size + 1);
+  memcpy(t->text, data, size);
+  t->text[size] = '\0';
+  t->size = size;
+
+  startText(t, file);
+}
+
+/* startText
+   Starts tokenizing from the beginning of a file that's been read in.
+*/
+void
+startText(Tokenizer *t, char *file)
+{
+  MALLOC(t->file, (strlen(file) + 1) * sizeof(char));
+  strcpy(t->file, file);
+
+  t->p = t->line_start = t->text;
+  t->line = 1;
+  t->type = TOK_END;
+  t->token = t->word;
+  t->word[0] = '\0';
+  t->tok_line = t->tok_col = 0;
+  t->trap = NULL;
+}
+
+/* tok_close
+   Frees a file that's been tokenized.  Strings from it are gone after this.
+*/
+void
+tok_close(Tokenizer *t)
+{
+  free(t->text);
+  free(t->file);
+}
+
+/* skipSpace
+   Moves past whitespace, keeping count of the lines.
+*/
+void
+skipSpace(Tokenizer *t)
+{
+  while (*t->p == ' ' || *t->p == '\t' || *t->p == '\r' || *t->p == '\n')
+    {
+      if (*t->p == '\n')
+	{
+	  t->line++;
+	  t->line_start = t->p + 1;
+	}
+      t->p++;
+    }
+}
+
+/* tok_next
+   Reads the next token, and returns what type it is.
+*/
+int
+tok_next(Tokenizer *t)
+{
+  char *start;
+
+  skipSpace(t);
+  t->tok_line = t->line;
+  t->tok_col = t->p - t->line_start + 1;
+  start = t->p;
+
+  /* The end of the file (a 0 in the middle of one counts too) */
+  if (*t->p == '\0')
+    {
+      t->type = TOK_END;
+      t->token = t->word;
+      t->word[0] = '\0';
+      return TOK_END;
+    }
+
+  /* A string, which is ended where its closing quote was */
+  if (*t->p == '"')
+    {
+      t->p++;
+      while (*t->p != '"' && *t->p != '\n' && *t->p != '\0') t->p++;
+      if (*t->p != '"')
+	{
+	  t->type = TOK_END;
+	  t->token = "the end of the line";
+	  tok_error(t, "a closing \"");
+	}
+      *t->p++ = '\0';
+      t->type = TOK_STRING;
+      t->token = start + 1;
+      return TOK_STRING;
+    }
+
+  /* A word.  It's copied out, because what's after it may be the start of
+     the next token. */
+  while (*t->p != '\0' && *t->p != '"' && *t->p != ' ' && *t->p != '\t' &&
+	 *t->p != '\r' && *t->p != '\n')
+    t->p++;
+  if (t->p - start >= TOK_WORD_MAX)
+    {
+      t->type = TOK_END;
+      t->token = "a word that's too long";
+      tok_error(t, "a word");
+    }
+  memcpy(t->word, start, t->p - start);
+  t->word[t->p - start] = '\0';
+  t->type = TOK_WORD;
+  t->token = t->word;
+  return TOK_WORD;
+}
+
+/* tok_is
+   Returns true if the last token read is a particular word.
+*/
+int
+tok_is(Tokenizer *t, char *word)
+{
+  return (t->type == TOK_WORD && strcmp(t->word, word) == 0);
+}
+
+/* tok_expect
+   Reads the next token, which has to be a particular word.
+*/
+void
+tok_expect(Tokenizer *t, char *word)
+{
+  tok_next(t);
+  if (!tok_is(t, word)) tok_error(t, word);
+}
+
+/* tok_int
+   Reads the next token, which has to be a whole number that fits in an int.
+*/
+int
+tok_int(Tokenizer *t)
+{
+  char *end;
+  long n;
+
+  if (tok_next(t) != TOK_WORD) tok_error(t, "a number");
+  errno = 0;
+  n = strtol(t->word, &end, 10);
+  if (*end != '\0') tok_error(t, "a whole number");
+  if (errno == ERANGE || n < INT_MIN || n > INT_MAX) tok_error(t, "a number that fits in an int");
+  return n;
+}
+
+/* tok_float
+   Reads the next token, which has to be a number.
+*/
+float
+tok_float(Tokenizer *t)
+{
+  char *end;
+  double n;
+
+  if (tok_next(t) != TOK_WORD) tok_error(t, "a number");
+  n = strtod(t->word, &end);
+  if (*end != '\0') tok_error(t, "a number");
+  return n;
+}
+
+/* tok_string
+   Reads the next token, which has to be a string.  The string stays in the
+   tokenizer's copy of the file, until it's closed.
+*/
+char *
+tok_string(Tokenizer *t)
+{
+  if (tok_next(t) != TOK_STRING) tok_error(t, "a string in quotes");
+  return t->token;
+}
+
+/* tok_error
+   Quits, saying where in the file the last token was, what it was, and what
+   was expected instead.  If the tokenizer has a trap, it jumps there
+   instead of quitting.
+*/
+void
+tok_error(Tokenizer *t, char *expected)
+{
+  if (t->type == TOK_STRING)
+    fprintf(stderr, "Error: %s, line %d, column %d: expected %s, found \"%s\"\n",
+	    t->file, t->tok_line, t->tok_col, expected, t->token);
+  else if (t->type == TOK_WORD)
+    fprintf(stderr, "Error: %s, line %d, column %d: expected %s, found %s\n",
+	    t->file, t->tok_line, t->tok_col, expected, t->token);
+  else
+    fprintf(stderr, "Error: %s, line %d, column %d: expected %s, found %s\n",
+	    t->file, t->tok_line, t->tok_col, expected,
+	    t->token[0] != '\0' ? t->token : "the end of the file");
+  if (t->trap != NULL) longjmp(*t->trap, 1);
+  exit(0);
+}
@@ -0,0 +1,57 @@
+#ifndef __DEFINED_TOKEN_H
+#define __DEFINED_TOKEN_H
+
+#include <stdio.h>
+#include <setjmp.h>
+#include "defs.h"
+
+/* The token module reads the game's text files.  A whole file is read into
+   memory at once, and then split up into tokens as it's parsed, in one
+   pass.  There are only two kinds of token:
+
+   words, which are anything between whitespace, like layerstart or 25
+   strings, which are anything in double quotes, like "walk_left/"
+
+   Anything wrong in a file is reported with the line and column where it
+   is, and the game quits.  Something reading a file while the game runs
+   can set the tokenizer's trap instead, and it's jumped to after the
+   mistake is reported. */
+
+/* The longest word there can be */
+#define TOK_WORD_MAX 64
+
+enum token_types {TOK_END, TOK_WORD, TOK_STRING};
+
+typedef struct tokenizer_struct
+{
+  char *file;          /* The file's name, for errors */
+  char *text;          /* All of the file, with a 0 on the end */
+  int size;            /* How long it is */
+  char *p;             /* How far it's been read */
+  int line;            /* The line p is on, counting from 1 */
+  char *line_start;    /* Where that line starts */
+
+  /* The last token read */
+  int type;
+  char *token;         /* A string, ended in place in text, or a word, in
+			  word */
+  char word[TOK_WORD_MAX];
+  int tok_line, tok_col;    /* Where it starts */
+
+  jmp_buf *trap;       /* Where to jump to on a mistake instead of quitting,
+			  or NULL */
+} Tokenizer;
+
+extern void tok_open(Tokenizer *t, char *file);
+extern int tok_tryOpen(Tokenizer *t, char *file);
+extern void tok_openMem(Tokenizer *t, char *file, void *data, int size);
+extern void tok_close(Tokenizer *t);
+extern int tok_next(Tokenizer *t);
+extern int tok_is(Tokenizer *t, char *word);
+extern void tok_expect(Tokenizer *t, char *word);
+extern int tok_int(Tokenizer *t);
+extern float tok_float(Tokenizer *t);
+extern char *tok_string(Tokenizer *t);
+extern void tok_error(Tokenizer *t, char *expected);
+
+#endif /* __DEFINED_TOKEN_H */
@@ -1,5 +1,12 @@
 #include "../objtypes.h"
 #include "../tiletypes.h"
+#include "../../particle.h"
+
+/* The color of the sparks that fly when a baddie gets hurt: */
+#define SPARK_RGB 255, 160, 0
+
+/* The sounds baddies make, looked up once */
+static SoundHandle explode, ow, thock;
 
 struct baddie_atts
 {
@@ -64,6 +71,14 @@ static Bound *bounds(void)
       b->b.line.p2.x = 40;
       b->b.line.p2.y = 0;
     }
+  else if (bound_type == CIRCLE)
+    {
+      /* Baddies are round enough to just use a circle: */
+      b->type = CIRCLE;
+      b->b.circle.p.x = 20;
+      b->b.circle.p.y = 20;
+      b->b.circle.r = 20;
+    }
   b->next = NULL;
   return head;
 }
@@ -88,17 +103,32 @@ static void free_atts(Object *me)
   free(atts);
 }
 
+/* Look up the sounds */
+static void resolve(int type)
+{
+  explode = aud_getSoundHandle("explode");
+  ow = aud_getSoundHandle("ow");
+  thock = aud_getSoundHandle("thock");
+}
+
 /* Take damage */
 static void damage(Object *me, int n)
 {
   struct baddie_atts *atts = (struct baddie_atts *) me->atts;
+  Color spark = {SPARK_RGB};
+
   atts->hitpoints -= n;
   if (atts->hitpoints <= 0) 
     {
-      obj_makeSound(me, "explode", 0);
+      obj_makeSoundByHandle(me, explode, 0);
+      part_emit(me->layer, me->pos, 80, 300, .8, spark, 1);
       obj_killObj(me);
     }
-  else obj_makeSound(me, "ow", 0);
+  else
+    {
+      obj_makeSoundByHandle(me, ow, 0);
+      part_emit(me->layer, me->pos, 12, 150, .3, spark, 1);
+    }
 }
 
 static void go(Object *me, Time dt)
@@ -118,7 +148,7 @@ static void go(Object *me, Time dt)
 		{
 		case PLAYER_TYPE:
 		  /* I've hit the player */
-		  obj_makeSound(me, "thock", 0);
+		  obj_makeSoundByHandle(me, thock, 0);
 		  break;
 		case BADDIE_TYPE:
 		  /* I've hit a baddie */
@@ -148,6 +178,9 @@ static void go(Object *me, Time dt)
 
 }
 
+/* The sounds it makes */
+static char *sounds[] = {"explode", "ow", "thock", NULL};
+
 struct obj_att_define baddie_def =
 {
   /*mass = */ 1,
@@ -156,10 +189,16 @@ struct obj_att_define baddie_def =
   /*elasticity = */ 1,
   /*friction = */ 0,
   /*solid = */ 1,
+  /*category = */ BADDIE_CAT,
+  /*collides = */ PLAYER_CAT | BADDIE_CAT | BULLET_CAT,
+  /*senses = */ 0,
   /*sprite = */ "baddie",
   /*animation = */ "idle",
   /*bounds = */ bounds,
   /*init_atts = */ init_atts,
   /*go = */ go,
-  /*free_atts = */ free_atts
+  /*free_atts = */ free_atts,
+  /*resolve = */ resolve,
+  /*sounds = */ sounds,
+  /*makes = */ NULL
 };
@@ -68,11 +68,17 @@ struct obj_att_define bullet_def =
   /*elasticity = */ 0,
   /*friction = */ 0,
   /*solid = */ 1,
+  /*category = */ BULLET_CAT,
+  /*collides = */ PLAYER_CAT | BADDIE_CAT,
+  /*senses = */ 0,
   /*sprite = */ "bullet",
   /*animation = */ "fuh",
   /*bounds = */ bounds,
   /*init_atts = */ init_atts,
   /*go = */ go,
-  /*free_atts = */ free_atts
+  /*free_atts = */ free_atts,
+  /*resolve = */ NULL,
+  /*sounds = */ NULL,
+  /*makes = */ NULL
 };
 
@@ -1,6 +1,9 @@
 #include "../objtypes.h"
 #include "../tiletypes.h"
 #include "../../input.h"
+#include "../../collision.h"
+#include "../../projectile.h"
+#include "../../particle.h"
 
 /* Just some temporary physics values: */
 #define PLAYER_MAX_WALKING_VEL 125
@@ -14,8 +17,15 @@
 
 #define BULLET_VELOCITY 400
 
+/* The color of the muzzle flash: */
+#define FLASH_RGB 255, 255, 160
+
 #define ANIM_SPEED .20
 
+/* The animations and sounds the player uses, looked up once */
+static AnimHandle walk_right, walk_left;
+static SoundHandle piew;
+
 struct player_atts
 {
   int hitpoints;
@@ -118,6 +128,13 @@ static void free_atts(Object *me)
   free(atts);
 }
 
+static void resolve(int type)
+{
+  walk_right = obj_getAnimHandle(type, "walk_right");
+  walk_left = obj_getAnimHandle(type, "walk_left");
+  piew = aud_getSoundHandle("piew");
+}
+
 static void go(Object *me, Time dt)
 {
 
@@ -139,12 +156,8 @@ static void go(Object *me, Time dt)
 	      switch (sig.sig.imp.hit.u.tile_type)
 		{
 		case NONE_T:
-		  /* If the player got an impulse with a vector pointing up
-		     from a solid tile, it's on the ground. */
-		  if (sig.sig.imp.vec.y < 0)
-		    atts->on_ground = 1;
 		  /* If the player was knocked from above, make him fall */
-		  else if (sig.sig.imp.vec.y > 0)
+		  if (sig.sig.imp.vec.y > 0)
 		    {
 		      atts->jump_power = 0;
 		    }
@@ -157,6 +170,10 @@ static void go(Object *me, Time dt)
     }
 
 
+  /* The player is on the ground if he's resting on something.  (He's not
+     once he walks off a ledge.) */
+  atts->on_ground = (col_getSupport(me) != NULL);
+
   /* Jumping! */
   /* If the player has jump power and the jump key is down, change his
      velocity and decrease his jump power */
@@ -182,9 +199,10 @@ static void go(Object *me, Time dt)
   /* Shooting: */
   if (inp_isDown(SHOOT_KEY) && !atts->shooting)
     {
-      /* Spawn a bullet: */
+      /* Fire a bullet: */
       Point p;
       Velocity v;
+      Color flash = {FLASH_RGB};
       atts->shooting = 1;
 
       p.y = me->pos.y;
@@ -192,8 +210,9 @@ static void go(Object *me, Time dt)
 	(me->pos.x - me->w / 2 - 5);
       v.y = 0;
       v.x = (atts->facing == RIGHT) ? (BULLET_VELOCITY) : (-BULLET_VELOCITY);
-      obj_spawnObj(me->layer, p, v, BULLET_TYPE);
-      obj_makeSound(me, "piew", 0);
+      proj_fire(me->layer, p, v, BULLET_TYPE);
+      part_emit(me->layer, p, 8, 100, .1, flash, 0);
+      obj_makeSoundByHandle(me, piew, 0);
     }
   else if (atts->shooting && !inp_isDown(SHOOT_KEY)) atts->shooting = 0;
 
@@ -231,7 +250,7 @@ static void go(Object *me, Time dt)
 	{
 	  if (atts->facing != RIGHT)
 	    {
-	      obj_setAnim("walk_right", me);
+	      obj_setAnimByHandle(walk_right, me);
 	      atts->facing = RIGHT;
 	    }
 	}
@@ -239,7 +258,7 @@ static void go(Object *me, Time dt)
 	{
 	  if (atts->facing != LEFT)
 	    {
-	      obj_setAnim("walk_left", me);
+	      obj_setAnimByHandle(walk_left, me);
 	      atts->facing = LEFT;
 	    }
 	}
@@ -259,6 +278,10 @@ static void go(Object *me, Time dt)
    me->vel.y = LIMIT(me->vel.y, PLAYER_MAX_FALLING_VEL);
 }
 
+/* The sounds it makes, and the types it makes */
+static char *sounds[] = {"piew", NULL};
+static int makes[] = {BULLET_TYPE, -1};
+
 struct obj_att_define player_def =
 {
   /*mass = */ 3,
@@ -267,10 +290,16 @@ struct obj_att_define player_def =
   /*elasticity = */ 0,
   /*friction = */ 0,
   /*solid = */ 1,
+  /*category = */ PLAYER_CAT,
+  /*collides = */ PLAYER_CAT | BADDIE_CAT | BULLET_CAT,
+  /*senses = */ 0,
   /*sprite = */ "player",
   /*animation = */ "walk_left",
   /*bounds = */ bounds,
   /*init_atts = */ init_atts,
   /*go = */ go,
-  /*free_atts = */ free_atts
+  /*free_atts = */ free_atts,
+  /*resolve = */ resolve,
+  /*sounds = */ sounds,
+  /*makes = */ makes
 };
@@ -8,7 +8,20 @@ enum obj_types
 {
   PLAYER_TYPE = 0,
   BADDIE_TYPE,
-  BULLET_TYPE
+  BULLET_TYPE,
+  N_OBJ_TYPES
+};
+
+/* Collision categories.  Each type of object is in one category, and it says
+   which categories it collides with and which it only senses.  Two objects
+   are only tested for collisions if at least one of them collides with or
+   senses the other.  They only push each other apart if each one collides
+   with the other; otherwise they just get hit signals. */
+enum obj_categories
+{
+  PLAYER_CAT = 1 << 0,
+  BADDIE_CAT = 1 << 1,
+  BULLET_CAT = 1 << 2
 };
 
 /* To make an object, create a new .c file in the objects/ directory.
@@ -22,6 +35,9 @@ struct obj_att_define
   float elasticity;            /* Coefficient of elasticity (0 - 1) */
   float friction;              /* Coefficient of friction (not yet done) */
   int solid;                   /* Can the object pass through things? */
+  int category;                /* The collision category it's in */
+  int collides;                /* Categories it collides with */
+  int senses;                  /* Categories it only senses */
   char *sprite;                /* Sprite name */
   char *animation;             /* Initial animation name */
   Bound *(*bounds)(void);      /* Pointer to a function which creates the 
@@ -32,6 +48,16 @@ struct obj_att_define
 				  does once every game cycle */
   void (*free_atts)(Object *); /* Pointer to a function which frees the
 				  type-specific attributes */
+  void (*resolve)(int);        /* Pointer to a function which looks up the
+				  handles of the animations and sounds the
+				  type uses, given its type, once they're
+				  loaded.  May be NULL. */
+  char **sounds;               /* The names of the sounds it makes, ending
+				  with NULL, so they're loaded with an area
+				  it's in.  May be NULL. */
+  int *makes;                  /* The types of the objects it makes, ending
+				  with -1, so their sprites and sounds are
+				  loaded too.  May be NULL. */
 };
 
 extern struct obj_att_define *obj_defs[];
@@ -8,6 +8,7 @@ struct tile_att_define none_def =
   /* elasticity = */ 1,
   /* friction = */ 0,
   /* active = */ 0,
+  /* atts_size = */ 0,
   /* init_atts = */ NULL,
   /* go = */ NULL,
   /* free_atts = */ NULL
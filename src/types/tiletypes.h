@@ -5,7 +5,8 @@
 
 enum tile_types
 {
-  NONE_T = 0     /* The tile does nothing */
+  NONE_T = 0,    /* The tile does nothing */
+  N_TILE_TYPES
 };
 
 struct tile_att_define
@@ -14,6 +15,8 @@ struct tile_att_define
   float elasticity;
   float friction;
   int active;
+  int atts_size;     /* How big what init_atts() makes is, for chunk.c's
+			budget */
   void *(*init_atts)(void);
   void (*go)(int, int, int);
   void (*free_atts)(int, int, int);